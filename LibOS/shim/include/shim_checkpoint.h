@@ -96,6 +96,12 @@ struct shim_mem_entry {
     void ** paddr;
     int prot;
     void * data;
+    bool streamed;      /* sent over the parallel streams */
+    bool anonymous;     /* private anonymous, untouched pages are zero */
+    /* runs of pages, alternately with data and all zero, starting with
+       data; only the data is sent if there is a map */
+    unsigned int * pagemap;
+    int nruns;
 };
 
 struct shim_gipc_entry {
@@ -105,6 +111,13 @@ struct shim_gipc_entry {
 #endif
 };
 
+/* ranges of memory sent after the checkpoint */
+struct shim_postcopy_entry {
+    void * addr;
+    size_t size;
+    int prot;
+};
+
 struct shim_palhdl_entry {
     struct shim_palhdl_entry * prev;
     PAL_HANDLE handle;
@@ -112,6 +125,14 @@ struct shim_palhdl_entry {
     PAL_HANDLE * phandle;
 };
 
+#define POSTCOPY_MIN_SIZE   (1024 * 1024)
+#define POSTCOPY_MAX_HINTS  2
+
+#define CP_MAX_STREAMS      4
+#define CP_COMPRESS_LZ      1   /* the memory on the streams is compressed */
+
+struct shim_cp_streams;
+
 struct shim_cp_store {
     /* checkpoint data mapping */
     void * cp_map;
@@ -136,6 +157,20 @@ struct shim_cp_store {
     /* entries of pal handles to send */
     struct shim_palhdl_entry * last_palhdl_entry;
     int palhdl_nentries;
+
+    /* large anonymous memory sent after the checkpoint, except for the
+       ranges hinted as the working set of the new process */
+    bool use_postcopy;
+    int postcopy_nentries;
+    int postcopy_nhints;
+    struct { void * start, * end; } postcopy_hints[POSTCOPY_MAX_HINTS];
+
+    /* memory entries sent by worker threads while the checkpoint is still
+       being created */
+    struct shim_cp_streams * streams;
+
+    /* residency of the pages in the host, if available */
+    PAL_HANDLE pagemap;
 };
 
 #define CP_FUNC_ARGS                                    \
@@ -420,10 +455,19 @@ struct newproc_cp_header {
         int nentries;
     } palhdl;
     struct gipc_header {
-        char uri[16];
+        char uri[32];
         unsigned long entoffset;
         int nentries;
     } gipc;
+    struct postcopy_header {
+        char uri[24];
+    } postcopy;
+    struct stream_header {
+        int nstreams;
+        int compress;
+        int nranges;    /* followed by the ranges sent on the streams */
+        char uri[CP_MAX_STREAMS][24];
+    } streams;
 };
 
 struct newproc_header {
@@ -462,6 +506,18 @@ int restore_from_file (const char * filename, struct newproc_cp_header * hdr,
 
 void restore_context (struct shim_context * context);
 
+int init_postcopy (void);
+int init_postcopy_helper (void);
+bool postcopy_enabled (void);
+bool start_postcopy (struct shim_cp_store * store, struct shim_thread * thread,
+                     char * uri, size_t size);
+int run_postcopy (void);
+void abort_postcopy (void);
+int open_postcopy (struct postcopy_header * hdr);
+int fetch_postcopy_range (void * addr, size_t size);
+void release_postcopy_range (void * addr, size_t size, bool keep);
+bool postcopy_fault (void * addr, PAL_CONTEXT * context);
+
 int create_checkpoint (const char * cpdir, IDTYPE * session);
 int join_checkpoint (struct shim_thread * cur, ucontext_t * context,
                      IDTYPE sid);
@@ -57,6 +57,14 @@ struct shim_fs_ops {
     /* write: the content from the file opened as handle */
     int (*write) (struct shim_handle * hdl, const void * buf, size_t count);
 
+    /* readv, writev: read or write a vector of buffers in one operation;
+       if offset is not NULL, access the file at *offset without moving
+       the file marker (for preadv and pwritev) */
+    int (*readv) (struct shim_handle * hdl, const struct iovec * iov,
+                  int iovcnt, off_t * offset);
+    int (*writev) (struct shim_handle * hdl, const struct iovec * iov,
+                   int iovcnt, off_t * offset);
+
     /* mmap: mmap handle to address */
     int (*mmap) (struct shim_handle * hdl, void ** addr, size_t size,
                  int prot, int flags, off_t offset);
@@ -131,8 +139,8 @@ struct shim_fs_ops {
 // Catch memory corruption issues by checking for invalid state values
 #define DENTRY_INVALID_FLAGS ~0x7FFF
 
+/* initial number of buckets in the dcache hash table */
 #define DCACHE_HASH_SIZE    1024
-#define DCACHE_HASH(hash) ((hash) & (DCACHE_HASH_SIZE - 1))
 
 DEFINE_LIST(shim_dentry);
 DEFINE_LISTP(shim_dentry);
@@ -145,10 +153,8 @@ struct shim_dentry {
     struct shim_qstr name;          /* caching the file's name. */
 
 
-    /* DEP 6/16/17: For now, let's try not hashing; I suspect it is 
-     * overkill for most purposes.  I'll leave the field here for now,
-     * but propose we move to a per-directory table to accelerate lookups,
-     * rather than a global table, since this just supports one process.
+    /* The dentries with a parent are in a global hash table, keyed by
+     * the parent and the name (name.hash holds the hash of the name).
      */
     LIST_TYPE(shim_dentry) hlist;    /* to resolve collisions in
                                        the hash table */
@@ -186,6 +192,11 @@ struct shim_d_ops {
      * Maybe drop force?
      */
     int (*lookup) (struct shim_dentry * dent, bool force);
+
+    /* whether the cached result of a lookup (positive or negative) is too
+       old to be used, and has to be looked up again. Must not block or
+       take locks: it is also called on the lockless path walk. */
+    bool (*revalidate) (struct shim_dentry * dent);
     
     /* this is to check file type and access, returning the stat.st_mode */
     int (*mode) (struct shim_dentry * dent, mode_t * mode, bool force);
@@ -306,6 +317,7 @@ struct lookup {
 int init_fs (void);
 int init_mount_root (void);
 int init_mount (void);
+int init_chroot_cache (void);
 
 /* path utilities */
 const char * get_file_name (const char * path, size_t len);
@@ -332,6 +344,15 @@ static inline void set_handle_fs (struct shim_handle * hdl,
     memcpy(hdl->fs_type, fs->type, sizeof(hdl->fs_type));
 }
 
+/* total number of bytes in a vector of buffers */
+static inline size_t iov_length (const struct iovec * iov, int iovcnt)
+{
+    size_t count = 0;
+    for (int i = 0 ; i < iovcnt ; i++)
+        count += iov[i].iov_len;
+    return count;
+}
+
 int walk_mounts (int (*walk) (struct shim_mount * mount, void * arg),
                  void * arg);
 
@@ -534,6 +555,20 @@ struct shim_dentry *
 __lookup_dcache (struct shim_dentry * start, const char * name, int namelen,
                  const char * path, int pathlen, HASHTYPE * hashptr);
 
+/* Lookups without dcache_lock: dcache_read_begin() returns a sequence
+ * number, which is odd while the dcache is being changed.
+ * __lookup_dcache_lockless() finds a child of start (without taking a
+ * reference), and returns NULL if it is not cached or if the dcache has
+ * changed since seq. get_dentry_lockless() takes a reference on a dentry
+ * found this way, and fails if the dcache has changed since seq.
+ */
+unsigned long dcache_read_begin (void);
+bool dcache_read_retry (unsigned long seq);
+struct shim_dentry *
+__lookup_dcache_lockless (struct shim_dentry * start, const char * name,
+                          int namelen, unsigned long seq);
+bool get_dentry_lockless (struct shim_dentry * dent, unsigned long seq);
+
 /* This function recursively deletes and frees all dentries under root 
  * 
  * XXX: Current code doesn't do a free..
@@ -580,6 +615,10 @@ extern struct shim_mount pipe_builtin_fs;
 extern struct shim_mount socket_builtin_fs;
 extern struct shim_mount epoll_builtin_fs;
 
+/* pipe file system */
+int create_pipe_ring (struct shim_handle * rd, struct shim_handle * wr);
+bool pipe_in_ring (struct shim_handle * hdl);
+
 /* proc file system */
 struct proc_nm_ops {
     int (*match_name) (const char * name);
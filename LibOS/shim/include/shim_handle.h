@@ -50,7 +50,6 @@ enum shim_handle_type {
     TYPE_SHM,
     TYPE_SEM,
     TYPE_MSG,
-    TYPE_FUTEX,
     TYPE_STR,
     TYPE_EPOLL,
 };
@@ -67,10 +66,14 @@ enum shim_file_type {
     FILE_TTY,
 };
 
+DEFINE_LIST(shim_file_page);
+DEFINE_LISTP(shim_file_page);
+
 struct shim_file_data {
     LOCKTYPE            lock;
     struct atomic_int   version;
     bool                queried;
+    uint64_t            query_time; /* when the host was last asked */
     enum shim_file_type type;
     mode_t     mode;
     struct atomic_int   size;
@@ -79,6 +82,12 @@ struct shim_file_data {
     unsigned long       mtime;
     unsigned long       ctime;
     unsigned long       nlink;
+    /* pages of the file content cached by the chroot filesystem, shared
+       by all the handles opened on the dentry */
+    LISTP_TYPE(shim_file_page) pages;
+    unsigned long       cache_gen;  /* bumped when the cached content
+                                       changes, guarded by the cache lock */
+    bool                uncached;
 };
 
 struct shim_file_handle {
@@ -89,10 +98,12 @@ struct shim_file_handle {
     uint64_t		size;
     uint64_t 		marker;
 
-    enum { FILEBUF_MAP, FILEBUF_NONE } buf_type;
-    uint64_t 		mapsize;
-    uint64_t 		mapoffset;
-    void *              mapbuf;
+    enum { FILEBUF_CACHE, FILEBUF_NONE } buf_type;
+
+    /* sequential readahead */
+    uint64_t            ra_next;    /* where a sequential read would start */
+    uint64_t            ra_end;     /* end of the range read ahead */
+    uint64_t            ra_size;    /* current readahead window */
 };
 
 #define FILE_HANDLE_DATA(hdl)   ((hdl)->info.file.data)
@@ -131,12 +142,16 @@ struct shim_dev_handle {
     struct shim_dev_ops     dev_ops;
 };
 
+struct shim_pipe_ring;
+
 struct shim_pipe_handle {
 #if USE_SIMPLE_PIPE == 1
     struct shim_handle *    pair;
 #else
     IDTYPE                  pipeid;
 #endif
+    /* the LibOS buffer, while both ends are in this process */
+    struct shim_pipe_ring * ring;
 };
 
 #define SOCK_STREAM     1
@@ -279,16 +294,6 @@ struct shim_sem_handle {
     LIST_TYPE(shim_sem_handle) key_hlist;
     LIST_TYPE(shim_sem_handle) sid_hlist;
 };
-DEFINE_LIST(futex_waiter);
-DEFINE_LISTP(futex_waiter);
-DEFINE_LIST(shim_futex_handle);
-struct shim_futex_handle {
-    unsigned int *      uaddr;
-    LISTP_TYPE(futex_waiter) waiters;
-    struct shim_vma *   vma;
-    LIST_TYPE(shim_futex_handle) list;
-};
-
 struct shim_str_data {
     REFTYPE ref_count;
     char * str;
@@ -313,12 +318,12 @@ struct shim_epoll_handle {
     LISTP_TYPE(shim_epoll_fd) fds; /* this list contains all the
                                     * shim_epoll_fd objects in correspondence
                                     * with the registered handles. */
-    FDTYPE *            pal_fds;
-    PAL_HANDLE *        pal_handles;
-    int                 npals;
-    int                 nread;
+    LISTP_TYPE(shim_epoll_fd) ready; /* registered handles with pending
+                                      * events, in the order to report. */
+    LISTP_TYPE(shim_epoll_fd) zombies; /* deleted handles, which may still
+                                        * be returned by a concurrent wait */
+    struct shim_waitset waitset;    /* registered PAL handles */
     int                 nwaiters;
-    AEVENTTYPE          event;
 };
 
 struct shim_mount;
@@ -329,11 +334,14 @@ struct shim_dentry;
  */
 struct shim_handle {
     enum shim_handle_type   type;
+    char                    fs_type[8];
+    struct shim_mount *     fs;
 
+    /* get_fd_handle may still take a reference on a freed handle: the
+     * count is kept clear of the free-list pointers of handle_mgr, which
+     * overwrite the start of a freed handle */
     REFTYPE             ref_count;
 
-    char                    fs_type[8];
-    struct shim_mount *     fs;
     struct shim_qstr        path;
     struct shim_dentry *    dentry;
 
@@ -355,7 +363,6 @@ struct shim_handle {
         struct shim_shm_handle    shm;
         struct shim_msg_handle    msg;
         struct shim_sem_handle    sem;
-        struct shim_futex_handle  futex;
         struct shim_str_handle    str;
         struct shim_epoll_handle  epoll;
     } info;
@@ -394,10 +401,14 @@ struct shim_handle_map {
 
     /* refrence count and lock */
     REFTYPE     ref_count;
-    LOCKTYPE    lock;
+    RWLOCKTYPE  lock;
 
     /* An array of file descriptor belong to this mapping */
     struct shim_fd_handle ** map;
+
+    /* arrays replaced when the map was enlarged; get_fd_handle reads the
+       map without the lock, so they are only freed with the map */
+    struct shim_retired_fd_map * retired;
 };
 
 /* allocating file descriptors */
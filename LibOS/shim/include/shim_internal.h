@@ -468,22 +468,49 @@ static inline void enable_preempt (shim_tcb_t * tcb)
 
 #define DEBUG_LOCK      0
 
-#define lock_created(l)  ((l).lock != NULL)
+/*
+ * A LibOS lock is a word in the lock itself: taking and releasing an
+ * uncontended lock is a single atomic instruction, without calling into
+ * the PAL. A contended lock spins for a while, then parks the thread with
+ * DkFutexWait until the holder releases it. On hosts without futexes,
+ * create_lock falls back to a PAL mutex.
+ */
+#define LOCK_UNUSED         0   /* not created, lock() does nothing */
+#define LOCK_UNLOCKED       1
+#define LOCK_LOCKED         2
+#define LOCK_CONTENDED      3   /* locked, with threads waiting */
 
-#define clear_lock(l)  do { (l).lock = NULL; (l).owner = 0; } while (0)
+bool host_futex_supported (void);
+void __lock_contended (LOCKTYPE * l);
+void __unlock_contended (LOCKTYPE * l);
 
-#define create_lock(l)                          \
-    do {                                        \
-        (l).lock = DkMutexCreate(0);               \
-        /* (l).owner = LOCK_FREE;               */ \
-        /* (l).reowned = 0;                     */ \
-    } while (0)
+#define lock_created(l)  (atomic_read(&(l).state) != LOCK_UNUSED)
 
-#define destroy_lock(l)                         \
+#define clear_lock(l)                           \
     do {                                        \
-        DkObjectClose((l).lock);                \
+        atomic_set(&(l).state, LOCK_UNUSED);    \
+        (l).lock = NULL;                        \
+        (l).owner = 0;                          \
     } while (0)
 
+#define create_lock(l)      __create_lock(&(l))
+#define destroy_lock(l)     __destroy_lock(&(l))
+
+static inline void __create_lock (LOCKTYPE * l)
+{
+    l->owner = 0;
+    l->lock = host_futex_supported() ? NULL : DkMutexCreate(0);
+    atomic_set(&l->state, LOCK_UNLOCKED);
+}
+
+static inline void __destroy_lock (LOCKTYPE * l)
+{
+    if (l->lock) {
+        DkObjectClose(l->lock);
+        l->lock = NULL;
+    }
+}
+
 #define try_create_lock(l)              \
     do { if (!lock_created(l)) create_lock(l); } while (0)
 
@@ -496,7 +523,7 @@ static inline void __lock (LOCKTYPE * l,
 static inline void __lock (LOCKTYPE * l)
 #endif
 {
-    if (!lock_enabled || !l->lock)
+    if (!lock_enabled || !lock_created(*l))
         return;
 
     shim_tcb_t * tcb = SHIM_GET_TLS();
@@ -506,7 +533,12 @@ static inline void __lock (LOCKTYPE * l)
     debug("try lock(%s=%p) %s:%d\n", name, l, file, line);
 #endif
 
-    while (!DkObjectsWaitAny(1, &l->lock, NO_TIMEOUT));
+    if (l->lock)
+        while (!DkObjectsWaitAny(1, &l->lock, NO_TIMEOUT));
+    else if (atomic_cmpxchg(&l->state, LOCK_UNLOCKED, LOCK_LOCKED)
+             != LOCK_UNLOCKED)
+        __lock_contended(l);
+
     l->owner = tcb->tid;
 #if DEBUG_LOCK == 1
     debug("lock(%s=%p) by %s:%d\n", name, l, file, line);
@@ -522,7 +554,7 @@ static inline void __unlock (LOCKTYPE * l,
 static inline void __unlock (LOCKTYPE * l)
 #endif
 {
-    if (!lock_enabled || !l->lock)
+    if (!lock_enabled || !lock_created(*l))
         return;
 
     shim_tcb_t * tcb = SHIM_GET_TLS();
@@ -532,13 +564,17 @@ static inline void __unlock (LOCKTYPE * l)
 #endif
 
     l->owner = 0;
-    DkMutexRelease(l->lock);
+    if (l->lock)
+        DkMutexRelease(l->lock);
+    else if (atomic_cmpxchg(&l->state, LOCK_LOCKED, LOCK_UNLOCKED)
+             != LOCK_LOCKED)
+        __unlock_contended(l);
     enable_preempt(tcb);
 }
 
 static inline bool __locked (LOCKTYPE * l)
 {
-    if (!lock_enabled || !l->lock)
+    if (!lock_enabled || !lock_created(*l))
         return false;
 
     shim_tcb_t * tcb = SHIM_GET_TLS();
@@ -547,6 +583,184 @@ static inline bool __locked (LOCKTYPE * l)
 
 #define locked(l) __locked(&(l))
 
+/*
+ * A reader-writer lock, for read-mostly structures. The state counts the
+ * readers, with bits for a writer holding the lock and for threads parked
+ * on it. Readers do not wait for parked writers, so writers may starve
+ * under a constant stream of readers. On hosts without futexes, readers
+ * and writers alike take a PAL mutex.
+ */
+#define RWLOCK_READERS      0x0fffffff
+#define RWLOCK_WRITER       0x10000000
+#define RWLOCK_WAITERS      0x20000000
+#define RWLOCK_CREATED      0x40000000
+
+void __read_lock_contended (RWLOCKTYPE * l);
+void __read_unlock_contended (RWLOCKTYPE * l);
+void __write_lock_contended (RWLOCKTYPE * l);
+void __write_unlock_contended (RWLOCKTYPE * l);
+
+#define rwlock_created(l)   (atomic_read(&(l).state) != 0)
+
+#define clear_rwlock(l)                         \
+    do {                                        \
+        atomic_set(&(l).state, 0);              \
+        (l).lock = NULL;                        \
+        (l).owner = 0;                          \
+    } while (0)
+
+#define create_rwlock(l)    __create_rwlock(&(l))
+#define destroy_rwlock(l)   __destroy_rwlock(&(l))
+
+static inline void __create_rwlock (RWLOCKTYPE * l)
+{
+    l->owner = 0;
+    l->lock = host_futex_supported() ? NULL : DkMutexCreate(0);
+    atomic_set(&l->state, RWLOCK_CREATED);
+}
+
+static inline void __destroy_rwlock (RWLOCKTYPE * l)
+{
+    if (l->lock) {
+        DkObjectClose(l->lock);
+        l->lock = NULL;
+    }
+}
+
+#if DEBUG_LOCK == 1
+# define read_lock(l) __read_lock(&(l), #l, __FILE__, __LINE__)
+static inline void __read_lock (RWLOCKTYPE * l,
+                                const char * name, const char * file, int line)
+#else
+# define read_lock(l) __read_lock(&(l))
+static inline void __read_lock (RWLOCKTYPE * l)
+#endif
+{
+    if (!lock_enabled || !rwlock_created(*l))
+        return;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+    disable_preempt(tcb);
+
+#if DEBUG_LOCK == 1
+    debug("try read_lock(%s=%p) %s:%d\n", name, l, file, line);
+#endif
+
+    if (l->lock) {
+        while (!DkObjectsWaitAny(1, &l->lock, NO_TIMEOUT));
+    } else {
+        int64_t state = atomic_read(&l->state);
+        if ((state & RWLOCK_WRITER) ||
+            atomic_cmpxchg(&l->state, state, state + 1) != state)
+            __read_lock_contended(l);
+    }
+
+#if DEBUG_LOCK == 1
+    debug("read_lock(%s=%p) by %s:%d\n", name, l, file, line);
+#endif
+}
+
+#if DEBUG_LOCK == 1
+# define read_unlock(l) __read_unlock(&(l), #l, __FILE__, __LINE__)
+static inline void __read_unlock (RWLOCKTYPE * l,
+                                  const char * name, const char * file,
+                                  int line)
+#else
+# define read_unlock(l) __read_unlock(&(l))
+static inline void __read_unlock (RWLOCKTYPE * l)
+#endif
+{
+    if (!lock_enabled || !rwlock_created(*l))
+        return;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+
+#if DEBUG_LOCK == 1
+    debug("read_unlock(%s=%p) %s:%d\n", name, l, file, line);
+#endif
+
+    if (l->lock) {
+        DkMutexRelease(l->lock);
+    } else {
+        int64_t state = atomic_read(&l->state);
+        if ((state & RWLOCK_WAITERS) ||
+            atomic_cmpxchg(&l->state, state, state - 1) != state)
+            __read_unlock_contended(l);
+    }
+    enable_preempt(tcb);
+}
+
+#if DEBUG_LOCK == 1
+# define write_lock(l) __write_lock(&(l), #l, __FILE__, __LINE__)
+static inline void __write_lock (RWLOCKTYPE * l,
+                                 const char * name, const char * file,
+                                 int line)
+#else
+# define write_lock(l) __write_lock(&(l))
+static inline void __write_lock (RWLOCKTYPE * l)
+#endif
+{
+    if (!lock_enabled || !rwlock_created(*l))
+        return;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+    disable_preempt(tcb);
+
+#if DEBUG_LOCK == 1
+    debug("try write_lock(%s=%p) %s:%d\n", name, l, file, line);
+#endif
+
+    if (l->lock)
+        while (!DkObjectsWaitAny(1, &l->lock, NO_TIMEOUT));
+    else if (atomic_cmpxchg(&l->state, RWLOCK_CREATED,
+                            RWLOCK_CREATED|RWLOCK_WRITER) != RWLOCK_CREATED)
+        __write_lock_contended(l);
+
+    l->owner = tcb->tid;
+#if DEBUG_LOCK == 1
+    debug("write_lock(%s=%p) by %s:%d\n", name, l, file, line);
+#endif
+}
+
+#if DEBUG_LOCK == 1
+# define write_unlock(l) __write_unlock(&(l), #l, __FILE__, __LINE__)
+static inline void __write_unlock (RWLOCKTYPE * l,
+                                   const char * name, const char * file,
+                                   int line)
+#else
+# define write_unlock(l) __write_unlock(&(l))
+static inline void __write_unlock (RWLOCKTYPE * l)
+#endif
+{
+    if (!lock_enabled || !rwlock_created(*l))
+        return;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+
+#if DEBUG_LOCK == 1
+    debug("write_unlock(%s=%p) %s:%d\n", name, l, file, line);
+#endif
+
+    l->owner = 0;
+    if (l->lock)
+        DkMutexRelease(l->lock);
+    else if (atomic_cmpxchg(&l->state, RWLOCK_CREATED|RWLOCK_WRITER,
+                            RWLOCK_CREATED) != (RWLOCK_CREATED|RWLOCK_WRITER))
+        __write_unlock_contended(l);
+    enable_preempt(tcb);
+}
+
+static inline bool __write_locked (RWLOCKTYPE * l)
+{
+    if (!lock_enabled || !rwlock_created(*l))
+        return false;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+    return tcb->tid == l->owner;
+}
+
+#define write_locked(l) __write_locked(&(l))
+
 #define DEBUG_MASTER_LOCK       0
 
 extern LOCKTYPE __master_lock;
@@ -652,6 +866,20 @@ static inline int __ref_inc (REFTYPE * ref)
 
 #define REF_INC(ref)  __ref_inc(&(ref))
 
+/* take a reference only if the object is still alive; returns 0 if not */
+static inline int __ref_inc_not_zero (REFTYPE * ref)
+{
+    register int _c;
+    do {
+        _c = atomic_read(ref);
+        if (!_c)
+            return 0;
+    } while (atomic_cmpxchg(ref, _c, _c + 1) != _c);
+    return _c + 1;
+}
+
+#define REF_INC_NOT_ZERO(ref)  __ref_inc_not_zero(&(ref))
+
 static inline int __ref_dec (REFTYPE * ref)
 {
     register int _c;
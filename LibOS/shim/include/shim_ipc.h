@@ -96,12 +96,16 @@ struct shim_ipc_port {
     REFTYPE             ref_count;
     LIST_TYPE(shim_ipc_port) hlist;
     LIST_TYPE(shim_ipc_port) list;
+    LIST_TYPE(shim_ipc_port) queue;     /* in the ipc worker queue */
     LISTP_TYPE(shim_ipc_msg_obj) msgs;
     LOCKTYPE            msgs_lock;
 
     port_fini           fini[MAX_IPC_PORT_FINI_CB];
 
     bool                update, recent, deleted;
+    /* polling: listened by the ipc helper; dispatched: handed to an ipc
+       worker, and out of the wait set until the worker is done */
+    bool                polling, dispatched;
     struct {
         unsigned int    type;
         IDTYPE          vmid;
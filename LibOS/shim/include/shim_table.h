@@ -495,6 +495,10 @@ int shim_do_accept4 (int sockfd, struct sockaddr * addr, socklen_t * addrlen,
 int shim_do_dup3 (int oldfd, int newfd, int flags);
 int shim_do_epoll_create1 (int flags);
 int shim_do_pipe2 (int * fildes, int flags);
+ssize_t shim_do_preadv (int fd, const struct iovec * vec, int vlen,
+                        unsigned long pos_l, unsigned long pos_h);
+ssize_t shim_do_pwritev (int fd, const struct iovec * vec, int vlen,
+                         unsigned long pos_l, unsigned long pos_h);
 int shim_do_recvmmsg (int sockfd, struct mmsghdr * msg, int vlen, int flags,
                       struct __kernel_timespec * timeout);
 int shim_do_sendmmsg (int sockfd, struct mmsghdr * msg, int vlen, int flags);
@@ -859,10 +863,10 @@ int shim_epoll_create1 (int flags);
 int shim_dup3 (int oldfd, int newfd, int flags);
 int shim_pipe2 (int * fildes, int flags);
 int shim_inotify_init1 (int flags);
-int shim_preadv (unsigned long fd, const struct iovec * vec,
-                 unsigned long vlen, unsigned long pos_l, unsigned long pos_h);
-int shim_pwritev (unsigned long fd, const struct iovec * vec,
-                  unsigned long vlen, unsigned long pos_l, unsigned long pos_h);
+ssize_t shim_preadv (int fd, const struct iovec * vec, int vlen,
+                     unsigned long pos_l, unsigned long pos_h);
+ssize_t shim_pwritev (int fd, const struct iovec * vec, int vlen,
+                      unsigned long pos_l, unsigned long pos_h);
 int shim_rt_tgsigqueueinfo (pid_t tgid, pid_t pid, int sig, siginfo_t * uinfo);
 int shim_perf_event_open (struct perf_event_attr * attr_uptr, pid_t pid,
                           int cpu, int group_fd, int flags);
@@ -48,6 +48,8 @@ struct shim_thread {
     LIST_TYPE(shim_thread) siblings;
     /* nodes in global handles; protected by thread_list_lock */
     LIST_TYPE(shim_thread) list;
+    /* nodes in the tid hash table; protected by thread_list_lock */
+    LIST_TYPE(shim_thread) hlist;
 
     struct shim_handle_map * handle_map;
 
@@ -110,6 +112,8 @@ struct shim_simple_thread {
 
     /* nodes in global handles */
     LIST_TYPE(shim_simple_thread) list;
+    /* nodes in the tid hash table */
+    LIST_TYPE(shim_simple_thread) hlist;
 
     REFTYPE ref_count;
     LOCKTYPE lock;
@@ -229,7 +233,7 @@ static inline void thread_wakeup (struct shim_thread * thread)
     DkEventSet(thread->scheduler_event);
 }
 
-extern LOCKTYPE thread_list_lock;
+extern RWLOCKTYPE thread_list_lock;
 
 struct shim_thread * __lookup_thread (IDTYPE tid);
 struct shim_thread * lookup_thread (IDTYPE tid);
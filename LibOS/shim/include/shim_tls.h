@@ -81,6 +81,10 @@ typedef struct {
         void * start, * end;
         void * cont_addr;
     } test_range;
+
+    /* Free objects cached by this thread for the slab allocator
+     * (see shim_malloc.c) */
+    struct slab_magazine * slab_magazine;
 } shim_tcb_t;
 
 #ifdef IN_SHIM
@@ -465,16 +465,42 @@ typedef unsigned long HASHTYPE;
 typedef struct atomic_int REFTYPE;
 
 #include <pal.h>
+#include <atomic.h>
 
+/* The LibOS locks are words parked on with PAL futexes (see
+ * shim_internal.h); the low 32 bits of the state are the futex word. On
+ * hosts without futexes, they are backed by a PAL mutex instead. */
 typedef struct shim_lock {
+    struct atomic_int state;
     PAL_HANDLE lock;
     IDTYPE owner;
 } LOCKTYPE;
 
+typedef struct shim_rwlock {
+    struct atomic_int state;
+    PAL_HANDLE lock;
+    IDTYPE owner;       /* the writer */
+} RWLOCKTYPE;
+
 typedef struct shim_aevent {
     PAL_HANDLE event;
 } AEVENTTYPE;
 
+/* A set of PAL handles to wait on (see utils/waitset.c). The handles are
+ * also kept in the arrays, for hosts without PAL wait sets. */
+struct shim_waitset {
+    LOCKTYPE        lock;
+    PAL_HANDLE      pal_handle;     /* NULL if the PAL has no wait sets */
+    int             nhandles, size;
+    PAL_HANDLE *    handles;
+    PAL_FLG *       events;
+    void **         data;
+    PAL_FLG *       reported;       /* edge-triggered events reported, for
+                                       hosts without PAL wait sets */
+    int             nwaiters;
+    AEVENTTYPE      update;         /* wakes up the waiters on changes */
+};
+
 #define STR_SIZE    256
 
 struct shim_str {
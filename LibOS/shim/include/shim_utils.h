@@ -156,6 +156,7 @@ static inline int qstrcmpstr (const struct shim_qstr * qstr,
 
 /* heap allocation functions */
 int init_slab (void);
+void flush_slab_magazine (void);
 
 #if defined(SLAB_DEBUG_PRINT) || defined(SLAB_DEBUG_TRACE)
 void * __malloc_debug (size_t size, const char * file, int line);
@@ -205,6 +206,12 @@ void md5_update (struct shim_md5_ctx * mdContext, const void * buf,
                        size_t len);
 void md5_final (struct shim_md5_ctx * mdContext);
 
+/* LZ4-style block compression, for the memory sent in checkpoints */
+#define LZ_WORK_SIZE    (sizeof(uint32_t) << 12)
+size_t lz_compress (const void * src, size_t size, void * dst, size_t dst_size,
+                    void * work);
+int lz_decompress (const void * src, size_t size, void * dst, size_t dst_size);
+
 /* prompt user for confirmation */
 int message_confirm (const char * message, const char * options);
 
@@ -245,6 +252,17 @@ uint64_t install_async_event (PAL_HANDLE object, unsigned long time,
 int create_async_helper (void);
 int terminate_async_helper (void);
 
+/* Wait sets: persistent sets of PAL handles to wait on */
+int create_waitset (struct shim_waitset * ws);
+void destroy_waitset (struct shim_waitset * ws);
+int add_to_waitset (struct shim_waitset * ws, PAL_HANDLE handle,
+                    PAL_FLG events, void * data);
+int modify_waitset (struct shim_waitset * ws, PAL_HANDLE handle,
+                    PAL_FLG events, void * data);
+int remove_from_waitset (struct shim_waitset * ws, PAL_HANDLE handle);
+int wait_on_waitset (struct shim_waitset * ws, int max, void ** data,
+                     PAL_FLG * events, uint64_t timeout);
+
 extern struct config_store * root_config;
 
 #endif /* _SHIM_UTILS_H */
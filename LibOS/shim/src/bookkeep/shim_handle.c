@@ -128,8 +128,17 @@ static int __set_new_fd_handle(struct shim_fd_handle ** fdhdl, FDTYPE fd,
 static struct shim_handle_map * __enlarge_handle_map
                      (struct shim_handle_map * map, FDTYPE size);
 
+struct shim_retired_fd_map {
+    struct shim_retired_fd_map * next;
+    struct shim_fd_handle ** map;
+};
+
 int init_handle (void)
 {
+    /* see get_fd_handle */
+    assert(offsetof(struct shim_handle, ref_count) >=
+           sizeof(LIST_TYPE(mem_obj)));
+
     create_lock(handle_mgr_lock);
     handle_mgr = create_mem_mgr(init_align_up(HANDLE_MGR_ALLOC));
     if (!handle_mgr)
@@ -154,11 +163,11 @@ int init_important_handles (void)
         set_handle_map(thread, handle_map);
     }
 
-    lock(handle_map->lock);
+    write_lock(handle_map->lock);
 
     if (handle_map->fd_size < 3) {
         if (!__enlarge_handle_map(handle_map, INIT_HANDLE_MAP_SIZE)) {
-            unlock(handle_map->lock);
+            write_unlock(handle_map->lock);
             return -ENOMEM;
         }
     }
@@ -170,11 +179,14 @@ int init_important_handles (void)
         if (!HANDLE_ALLOCATED(handle_map->map[fd])) {
             if (!hdl) {
                 hdl = get_new_handle();
-                if (!hdl)
+                if (!hdl) {
+                    write_unlock(handle_map->lock);
                     return -ENOMEM;
+                }
 
                 if ((ret = init_tty_handle(hdl, fd)) < 0) {
                     put_handle(hdl);
+                    write_unlock(handle_map->lock);
                     return ret;
                 }
             } else {
@@ -193,7 +205,7 @@ int init_important_handles (void)
     if (handle_map->fd_top == FD_NULL || handle_map->fd_top < 2)
         handle_map->fd_top = 2;
 
-    unlock(handle_map->lock);
+    write_unlock(handle_map->lock);
 
 done:
     init_exec_handle(thread);
@@ -219,17 +231,60 @@ struct shim_handle * __get_fd_handle (FDTYPE fd, int * flags,
     return NULL;
 }
 
+/*
+ * get_fd_handle does not take the map lock. This is safe because:
+ *  - the shim_fd_handle objects live as long as the map, and the arrays
+ *    replaced by __enlarge_handle_map are only freed with the map;
+ *  - writers publish a handle before its vfd, and retract the vfd before
+ *    the handle;
+ *  - handles are type-stable: handle_mgr never unmaps their memory, and
+ *    only reuses it for other handles. The free list of handle_mgr only
+ *    overwrites the start of a freed handle, before ref_count, so the
+ *    count of a freed handle stays 0 and REF_INC_NOT_ZERO fails on it.
+ *    If the handle was reused in the meantime, the reference taken is a
+ *    real one on the new handle; the fd is checked again once it is taken,
+ *    and the reference is dropped if the fd has changed.
+ */
 struct shim_handle * get_fd_handle (FDTYPE fd, int * flags,
                                     struct shim_handle_map * map)
 {
     if (!map)
         map = get_cur_handle_map(NULL);
 
-    struct shim_handle * hdl = NULL;
-    lock(map->lock);
-    if ((hdl = __get_fd_handle(fd, flags, map)))
-        get_handle(hdl);
-    unlock(map->lock);
+    struct shim_fd_handle * fd_handle;
+    struct shim_handle * hdl;
+    int fd_flags;
+
+retry:
+    if (fd >= map->fd_size)
+        return NULL;
+
+    /* the array is published before its size */
+    rmb();
+    fd_handle = map->map[fd];
+
+    if (!fd_handle || fd_handle->vfd != fd)
+        return NULL;
+
+    rmb();
+    hdl = fd_handle->handle;
+    fd_flags = fd_handle->flags;
+
+    if (!hdl)
+        return NULL;
+
+    if (!REF_INC_NOT_ZERO(hdl->ref_count))
+        goto retry;
+
+    rmb();
+    if (fd_handle->vfd != fd || fd_handle->handle != hdl) {
+        put_handle(hdl);
+        goto retry;
+    }
+
+    if (flags)
+        *flags = fd_flags;
+
     return hdl;
 }
 
@@ -246,6 +301,7 @@ __detach_fd_handle (struct shim_fd_handle * fd, int * flags,
             *flags = fd->flags;
 
         fd->vfd = FD_NULL;
+        wmb();
         fd->handle = NULL;
         fd->flags = 0;
 
@@ -268,13 +324,13 @@ struct shim_handle * detach_fd_handle (FDTYPE fd, int * flags,
     if (!handle_map && !(handle_map = get_cur_handle_map(NULL)))
         return NULL;
 
-    lock(handle_map->lock);
+    write_lock(handle_map->lock);
 
     if (fd < handle_map->fd_size)
         handle = __detach_fd_handle(handle_map->map[fd], flags,
                                     handle_map);
 
-    unlock(handle_map->lock);
+    write_unlock(handle_map->lock);
     return handle;
 }
 
@@ -303,13 +359,19 @@ static int __set_new_fd_handle(struct shim_fd_handle ** fdhdl, FDTYPE fd,
         new_handle = malloc(sizeof(struct shim_fd_handle));
         if (!new_handle)
             return -ENOMEM;
-        *fdhdl = new_handle;
+        new_handle->vfd = FD_NULL;
     }
 
-    new_handle->vfd    = fd;
     new_handle->flags  = flags;
     open_handle(hdl);
     new_handle->handle = hdl;
+
+    /* get_fd_handle reads the map without the lock: publish the handle
+       before the vfd, and the vfd before the new object */
+    wmb();
+    new_handle->vfd    = fd;
+    wmb();
+    *fdhdl = new_handle;
     return 0;
 }
 
@@ -323,7 +385,7 @@ int set_new_fd_handle (struct shim_handle * hdl, int flags,
     if (!handle_map && !(handle_map = get_cur_handle_map(NULL)))
         return -EBADF;
 
-    lock(handle_map->lock);
+    write_lock(handle_map->lock);
 
     if (!handle_map->map ||
         handle_map->fd_size < INIT_HANDLE_MAP_SIZE)
@@ -359,7 +421,7 @@ extend:
     } else
         ret = fd;
 out:
-    unlock(handle_map->lock);
+    write_unlock(handle_map->lock);
     return ret;
 }
 
@@ -372,7 +434,7 @@ int set_new_fd_handle_by_fd (FDTYPE fd, struct shim_handle * hdl, int flags,
     if (!handle_map && !(handle_map = get_cur_handle_map(NULL)))
         return -EBADF;
 
-    lock(handle_map->lock);
+    write_lock(handle_map->lock);
 
     if (!handle_map->map ||
         handle_map->fd_size < INIT_HANDLE_MAP_SIZE)
@@ -405,17 +467,6 @@ extend:
         fd > handle_map->fd_top)
         handle_map->fd_top = fd;
 
-    struct shim_fd_handle * new_handle = handle_map->map[fd];
-
-    if (!new_handle) {
-        new_handle = malloc(sizeof(struct shim_fd_handle));
-        if (!new_handle) {
-            ret = -ENOMEM;
-            goto out;
-        }
-        handle_map->map[fd] = new_handle;
-    }
-
     ret = __set_new_fd_handle(&handle_map->map[fd], fd, hdl, flags);
     if (ret < 0) {
         if (fd == handle_map->fd_top)
@@ -423,7 +474,7 @@ extend:
     } else
         ret = fd;
 out:
-    unlock(handle_map->lock);
+    write_unlock(handle_map->lock);
     return ret;
 }
 
@@ -586,7 +637,7 @@ void dup_fd_handle (struct shim_handle_map * map,
 {
     struct shim_handle * replaced = NULL;
 
-    lock(map->lock);
+    write_lock(map->lock);
 
     if (old->vfd != FD_NULL) {
         open_handle(old->handle);
@@ -594,7 +645,7 @@ void dup_fd_handle (struct shim_handle_map * map,
         new->handle = old->handle;
     }
 
-    unlock(map->lock);
+    write_unlock(map->lock);
 
     if (replaced)
         close_handle(replaced);
@@ -617,7 +668,7 @@ static struct shim_handle_map * get_new_handle_map (FDTYPE size)
 
     handle_map->fd_top  = FD_NULL;
     handle_map->fd_size = size;
-    create_lock(handle_map->lock);
+    create_rwlock(handle_map->lock);
 
     return handle_map;
 }
@@ -633,11 +684,26 @@ static struct shim_handle_map * __enlarge_handle_map
     if (!new_map)
         return NULL;
 
+    /* get_fd_handle may still be reading the old array */
+    struct shim_retired_fd_map * retired =
+                malloc(sizeof(struct shim_retired_fd_map));
+
+    if (!retired) {
+        free(new_map);
+        return NULL;
+    }
+
     memcpy(new_map, map->map, map->fd_size * sizeof(new_map[0]));
     memset(new_map + map->fd_size, 0,
            (size - map->fd_size) * sizeof(new_map[0]));
-    free(map->map);
+
+    retired->map  = map->map;
+    retired->next = map->retired;
+    map->retired  = retired;
+
+    /* publish the array before its size, for get_fd_handle */
     map->map = new_map;
+    wmb();
     map->fd_size = size;
     return map;
 }
@@ -645,7 +711,7 @@ static struct shim_handle_map * __enlarge_handle_map
 int dup_handle_map (struct shim_handle_map ** new,
                     struct shim_handle_map * old_map)
 {
-    lock(old_map->lock);
+    read_lock(old_map->lock);
 
     /* allocate a new handle mapping with the same size as
        the old one */
@@ -674,7 +740,7 @@ int dup_handle_map (struct shim_handle_map ** new,
                     close_handle(new_map->map[j]->handle);
                     free(new_map->map[j]);
                 }
-                unlock(old_map->lock);
+                read_unlock(old_map->lock);
                 *new = NULL;
                 return -ENOMEM;
             }
@@ -688,7 +754,7 @@ int dup_handle_map (struct shim_handle_map ** new,
     }
 
 done:
-    unlock(old_map->lock);
+    read_unlock(old_map->lock);
     *new = new_map;
     return 0;
 }
@@ -703,10 +769,7 @@ void put_handle_map (struct shim_handle_map * map)
     int ref_count = REF_DEC(map->ref_count);
 
     if (!ref_count) {
-        if (map->fd_top == FD_NULL)
-            goto done;
-
-        for (int i = 0 ; i <= map->fd_top ; i++) {
+        for (int i = 0 ; i < map->fd_size ; i++) {
             if (!map->map[i])
                 continue;
 
@@ -720,8 +783,14 @@ void put_handle_map (struct shim_handle_map * map)
             free(map->map[i]);
         }
 
-done:
-        destroy_lock(map->lock);
+        while (map->retired) {
+            struct shim_retired_fd_map * retired = map->retired;
+            map->retired = retired->next;
+            free(retired->map);
+            free(retired);
+        }
+
+        destroy_rwlock(map->lock);
         free(map->map);
         free(map);
     }
@@ -730,7 +799,7 @@ done:
 int flush_handle_map (struct shim_handle_map * map)
 {
     get_handle_map(map);
-    lock(map->lock);
+    read_lock(map->lock);
 
     if (map->fd_top == FD_NULL)
         goto done;
@@ -747,7 +816,7 @@ int flush_handle_map (struct shim_handle_map * map)
     }
 
 done:
-    unlock(map->lock);
+    read_unlock(map->lock);
     put_handle_map(map);
     return 0;
 }
@@ -757,7 +826,7 @@ int walk_handle_map (int (*callback) (struct shim_fd_handle *,
                      struct shim_handle_map * map, void * arg)
 {
     int ret = 0;
-    lock(map->lock);
+    write_lock(map->lock);
 
     if (map->fd_top == FD_NULL)
         goto done;
@@ -771,7 +840,7 @@ int walk_handle_map (int (*callback) (struct shim_fd_handle *,
     }
 
 done:
-    unlock(map->lock);
+    write_unlock(map->lock);
     return ret;
 }
 
@@ -890,7 +959,7 @@ BEGIN_CP_FUNC(handle_map)
     struct shim_handle_map * new_handle_map = NULL;
     struct shim_fd_handle ** ptr_array;
 
-    lock(handle_map->lock);
+    read_lock(handle_map->lock);
 
     int fd_size = handle_map->fd_top != FD_NULL ?
                   handle_map->fd_top + 1 : 0;
@@ -912,8 +981,9 @@ BEGIN_CP_FUNC(handle_map)
         new_handle_map->fd_size = fd_size;
         new_handle_map->map = fd_size ? ptr_array : NULL;
 
+        new_handle_map->retired = NULL;
         REF_SET(new_handle_map->ref_count, 0);
-        clear_lock(new_handle_map->lock);
+        clear_rwlock(new_handle_map->lock);
 
         for (int i = 0 ; i < fd_size ; i++) {
             if (HANDLE_ALLOCATED(handle_map->map[i]))
@@ -927,7 +997,7 @@ BEGIN_CP_FUNC(handle_map)
         new_handle_map = (struct shim_handle_map *) (base + off);
     }
 
-    unlock(handle_map->lock);
+    read_unlock(handle_map->lock);
 
     if (objp)
         *objp = (void *) new_handle_map;
@@ -943,8 +1013,8 @@ BEGIN_RS_FUNC(handle_map)
 
     DEBUG_RS("size=%d,top=%d", handle_map->fd_size, handle_map->fd_top);
 
-    create_lock(handle_map->lock);
-    lock(handle_map->lock);
+    create_rwlock(handle_map->lock);
+    write_lock(handle_map->lock);
 
     if (handle_map->fd_top != FD_NULL)
         for (int i = 0 ; i <= handle_map->fd_top ; i++) {
@@ -959,6 +1029,6 @@ BEGIN_RS_FUNC(handle_map)
             }
         }
 
-    unlock(handle_map->lock);
+    write_unlock(handle_map->lock);
 }
 END_RS_FUNC(handle_map)
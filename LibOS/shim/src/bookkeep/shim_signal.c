@@ -247,6 +247,10 @@ ret_exception:
 
 static void memfault_upcall (PAL_PTR event, PAL_NUM arg, PAL_CONTEXT * context)
 {
+    /* the memory is being migrated from or to another process */
+    if (arg && postcopy_fault((void *) arg, context))
+        goto ret_exception;
+
     shim_tcb_t * tcb = SHIM_GET_TLS();
     if (tcb->test_range.cont_addr && arg
         && (void *) arg >= tcb->test_range.start
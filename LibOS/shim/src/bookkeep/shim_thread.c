@@ -36,10 +36,20 @@
 
 static IDTYPE tid_alloc_idx __attribute_migratable = 0;
 
+#define THREAD_HASH_LEN     10
+#define THREAD_HASH_NUM     (1 << THREAD_HASH_LEN)
+#define THREAD_HASH_MASK    (THREAD_HASH_NUM - 1)
+#define THREAD_HASH(tid)    ((tid) & THREAD_HASH_MASK)
+
+/* The thread_list links shim_thread objects by the list field, sorted by
+ * tid, for walk_thread_list. The thread_hlist indexes them by tid through
+ * the hlist field, for lookup_thread. The same goes for simple threads. */
 static LISTP_TYPE(shim_thread) thread_list = LISTP_INIT;
+static LISTP_TYPE(shim_thread) thread_hlist [THREAD_HASH_NUM];
 DEFINE_LISTP(shim_simple_thread);
 static LISTP_TYPE(shim_simple_thread) simple_thread_list = LISTP_INIT;
-LOCKTYPE thread_list_lock;
+static LISTP_TYPE(shim_simple_thread) simple_thread_hlist [THREAD_HASH_NUM];
+RWLOCKTYPE thread_list_lock;
 
 static IDTYPE internal_tid_alloc_idx = INTERNAL_TID_BASE;
 
@@ -49,7 +59,7 @@ PAL_HANDLE thread_start_event = NULL;
 
 int init_thread (void)
 {
-    create_lock(thread_list_lock);
+    create_rwlock(thread_list_lock);
 
     struct shim_thread * cur_thread = get_cur_thread();
     if (cur_thread)
@@ -69,19 +79,19 @@ void dump_threads (void)
 {
     struct shim_thread * tmp;
 
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
     listp_for_each_entry(tmp, &thread_list, list) {
         debug("thread %d, vmid = %d, pgid = %d, ppid = %d, tgid = %d, in_vm = %d\n",
                 tmp->tid, tmp->vmid, tmp->pgid, tmp->ppid, tmp->tgid, tmp->in_vm);
     }
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
 }
 
 struct shim_thread * __lookup_thread (IDTYPE tid)
 {
     struct shim_thread * tmp;
 
-    listp_for_each_entry(tmp, &thread_list, list) {
+    listp_for_each_entry(tmp, &thread_hlist[THREAD_HASH(tid)], hlist) {
         if (tmp->tid == tid) {
             get_thread(tmp);
             return tmp;
@@ -93,9 +103,9 @@ struct shim_thread * __lookup_thread (IDTYPE tid)
 
 struct shim_thread * lookup_thread (IDTYPE tid)
 {
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
     struct shim_thread * thread = __lookup_thread(tid);
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
     return thread;
 }
 
@@ -144,10 +154,10 @@ IDTYPE get_pid (void)
 
 static IDTYPE get_internal_pid (void)
 {
-    lock(thread_list_lock);
+    write_lock(thread_list_lock);
     internal_tid_alloc_idx++;
     IDTYPE idx = internal_tid_alloc_idx;
-    unlock(thread_list_lock);
+    write_unlock(thread_list_lock);
     return idx;
 }
 
@@ -162,6 +172,7 @@ struct shim_thread * alloc_new_thread (void)
     INIT_LIST_HEAD(thread, siblings);
     INIT_LISTP(&thread->exited_children);
     INIT_LIST_HEAD(thread, list);
+    INIT_LIST_HEAD(thread, hlist);
     return thread;
 }
 
@@ -264,7 +275,7 @@ struct shim_simple_thread * __lookup_simple_thread (IDTYPE tid)
 {
     struct shim_simple_thread * tmp;
 
-    listp_for_each_entry(tmp, &simple_thread_list, list) {
+    listp_for_each_entry(tmp, &simple_thread_hlist[THREAD_HASH(tid)], hlist) {
         if (tmp->tid == tid) {
             get_simple_thread(tmp);
             return tmp;
@@ -276,9 +287,9 @@ struct shim_simple_thread * __lookup_simple_thread (IDTYPE tid)
 
 struct shim_simple_thread * lookup_simple_thread (IDTYPE tid)
 {
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
     struct shim_simple_thread * thread = __lookup_simple_thread(tid);
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
     return thread;
 }
 
@@ -293,6 +304,7 @@ struct shim_simple_thread * get_new_simple_thread (void)
     memset(thread, 0, sizeof(struct shim_simple_thread));
 
     INIT_LIST_HEAD(thread, list);
+    INIT_LIST_HEAD(thread, hlist);
 
     create_lock(thread->lock);
     thread->exit_event = DkNotificationEventCreate(PAL_FALSE);
@@ -389,24 +401,27 @@ void add_thread (struct shim_thread * thread)
     if (IS_INTERNAL(thread) || !list_empty(thread, list))
         return;
 
+    LISTP_TYPE(shim_thread) * head = &thread_hlist[THREAD_HASH(thread->tid)];
     struct shim_thread * tmp, * prev = NULL;
-    lock(thread_list_lock);
+    write_lock(thread_list_lock);
 
-    /* keep it sorted */
-    listp_for_each_entry_reverse(tmp, &thread_list, list) {
+    listp_for_each_entry(tmp, head, hlist)
         if (tmp->tid == thread->tid) {
-            unlock(thread_list_lock);
+            write_unlock(thread_list_lock);
             return;
         }
+
+    /* keep it sorted; new threads usually go last */
+    listp_for_each_entry_reverse(tmp, &thread_list, list)
         if (tmp->tid < thread->tid) {
             prev = tmp;
             break;
         }
-    }
 
     get_thread(thread);
     listp_add_after(thread, prev, &thread_list, list);
-    unlock(thread_list_lock);
+    listp_add(thread, head, hlist);
+    write_unlock(thread_list_lock);
 }
 
 void del_thread (struct shim_thread * thread)
@@ -419,10 +434,11 @@ void del_thread (struct shim_thread * thread)
         return;
     }
 
-    lock(thread_list_lock);
+    write_lock(thread_list_lock);
     /* thread->list goes on the thread_list */
     listp_del_init(thread, &thread_list, list);
-    unlock(thread_list_lock);
+    listp_del_init(thread, &thread_hlist[THREAD_HASH(thread->tid)], hlist);
+    write_unlock(thread_list_lock);
     put_thread(thread);
 }
 
@@ -431,24 +447,28 @@ void add_simple_thread (struct shim_simple_thread * thread)
     if (!list_empty(thread, list))
         return;
 
+    LISTP_TYPE(shim_simple_thread) * head =
+                &simple_thread_hlist[THREAD_HASH(thread->tid)];
     struct shim_simple_thread * tmp, * prev = NULL;
-    lock(thread_list_lock);
+    write_lock(thread_list_lock);
 
-    /* keep it sorted */
-    listp_for_each_entry_reverse(tmp, &simple_thread_list, list) {
+    listp_for_each_entry(tmp, head, hlist)
         if (tmp->tid == thread->tid) {
-            unlock(thread_list_lock);
+            write_unlock(thread_list_lock);
             return;
         }
+
+    /* keep it sorted; new threads usually go last */
+    listp_for_each_entry_reverse(tmp, &simple_thread_list, list)
         if (tmp->tid < thread->tid) {
             prev = tmp;
             break;
         }
-    }
 
     get_simple_thread(thread);
     listp_add_after(thread, prev, &simple_thread_list, list);
-    unlock(thread_list_lock);
+    listp_add(thread, head, hlist);
+    write_unlock(thread_list_lock);
 }
 
 void del_simple_thread (struct shim_simple_thread * thread)
@@ -456,9 +476,11 @@ void del_simple_thread (struct shim_simple_thread * thread)
     if (list_empty(thread, list))
         return;
 
-    lock(thread_list_lock);
+    write_lock(thread_list_lock);
     listp_del_init(thread, &simple_thread_list, list);
-    unlock(thread_list_lock);
+    listp_del_init(thread, &simple_thread_hlist[THREAD_HASH(thread->tid)],
+                   hlist);
+    write_unlock(thread_list_lock);
     put_simple_thread(thread);
 }
 
@@ -466,7 +488,7 @@ int check_last_thread (struct shim_thread * self)
 {
     struct shim_thread * tmp;
 
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
     /* find out if there is any thread that is
        1) no current thread 2) in current vm
        3) still alive */
@@ -474,13 +496,13 @@ int check_last_thread (struct shim_thread * self)
         if (tmp->tid &&
             (!self || tmp->tid != self->tid) && tmp->in_vm && tmp->is_alive) {
             debug("check_last_thread: thread %d is alive\n", tmp->tid);
-            unlock(thread_list_lock);
+            read_unlock(thread_list_lock);
             return tmp->tid;
         }
     }
 
     debug("this is the only thread\n", self->tid);
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
     return 0;
 }
 
@@ -493,7 +515,7 @@ int walk_thread_list (int (*callback) (struct shim_thread *, void *, bool *),
     IDTYPE min_tid = 0;
 
 relock:
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
 
     debug("walk_thread_list(callback=%p)\n", callback);
 
@@ -519,7 +541,7 @@ relock:
 
     ret = srched ? 0 : -ESRCH;
 out_locked:
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
 out:
     return ret;
 }
@@ -534,7 +556,7 @@ int walk_simple_thread_list (int (*callback) (struct shim_simple_thread *,
     IDTYPE min_tid = 0;
 
 relock:
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
 
     listp_for_each_entry_safe(tmp, n, &simple_thread_list, list) {
         if (tmp->tid <= min_tid)
@@ -557,7 +579,7 @@ relock:
 
     ret = srched ? 0 : -ESRCH;
 out_locked:
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
 out:
     return ret;
 }
@@ -614,6 +636,7 @@ BEGIN_CP_FUNC(thread)
         INIT_LIST_HEAD(new_thread, siblings);
         INIT_LISTP(&new_thread->exited_children);
         INIT_LIST_HEAD(new_thread, list);
+        INIT_LIST_HEAD(new_thread, hlist);
 
         new_thread->in_vm  = false;
         new_thread->parent = NULL;
@@ -771,7 +794,7 @@ END_RS_FUNC(running_thread)
 BEGIN_CP_FUNC(all_running_threads)
 {
     struct shim_thread * thread;
-    lock(thread_list_lock);
+    read_lock(thread_list_lock);
 
     listp_for_each_entry(thread, &thread_list, list) {
         if (!thread->in_vm || !thread->is_alive)
@@ -781,6 +804,6 @@ BEGIN_CP_FUNC(all_running_threads)
         DO_CP(handle_map, thread->handle_map, NULL);
     }
 
-    unlock(thread_list_lock);
+    read_unlock(thread_list_lock);
 }
 END_CP_FUNC_NO_RS(all_running_threads)
@@ -41,6 +41,12 @@
  * Internal bookkeeping for VMAs (virtual memory areas). This data
  * structure can only be accessed in this source file, with vma_list_lock
  * held. No reference counting needed in this data structure.
+ *
+ * Each VMA is linked on both a sorted list (for walking neighbors) and an
+ * AVL tree keyed by the starting address (for O(log n) searches). The tree
+ * is augmented with the free gap below each VMA, and the largest gap within
+ * each subtree, so that bkeep_unmapped() can find free space without
+ * walking the whole list.
  */
 DEFINE_LIST(shim_vma);
 /* struct shim_vma tracks the area of [start, end) */
@@ -53,6 +59,14 @@ struct shim_vma {
     uint64_t                offset;
     struct shim_handle *    file;
     char                    comment[VMA_COMMENT_LEN];
+
+    /* Tree index; only accessed by the __vma_tree_* functions */
+    struct shim_vma *       tree_left;
+    struct shim_vma *       tree_right;
+    struct shim_vma *       tree_parent;
+    int                     tree_height;
+    uint64_t                gap;            /* free space below start */
+    uint64_t                subtree_gap;    /* largest gap in subtree */
 };
 
 #define VMA_MGR_ALLOC   DEFAULT_VMA_COUNT
@@ -115,6 +129,12 @@ DEFINE_LISTP(shim_vma);
 static LISTP_TYPE(shim_vma) vma_list = LISTP_INIT;
 static LOCKTYPE vma_list_lock;
 
+/*
+ * "vma_tree_root" indexes the same VMAs as vma_list. It is also protected
+ * by vma_list_lock.
+ */
+static struct shim_vma * vma_tree_root = NULL;
+
 /*
  * Return true if [s, e) is exactly the area represented by vma.
  */
@@ -171,6 +191,9 @@ static inline void __assert_vma_list (void)
         /* Assert we are really sorted */
         assert(tmp->end > tmp->start);
         assert(!prev || prev->end <= tmp->start);
+        /* Assert the gaps in the tree are up-to-date */
+        assert(tmp->gap == (uint64_t) tmp->start -
+                           (prev ? (uint64_t) prev->end : 0));
         prev = tmp;
     }
 }
@@ -184,6 +207,190 @@ static inline void assert_vma_list (void)
 #endif
 }
 
+static inline int __vma_tree_height (struct shim_vma * node)
+{
+    return node ? node->tree_height : 0;
+}
+
+static inline uint64_t __vma_tree_gap (struct shim_vma * node)
+{
+    return node ? node->subtree_gap : 0;
+}
+
+/* Recalculate the height and the largest gap of the subtree at "node" */
+static inline void __vma_tree_update (struct shim_vma * node)
+{
+    int lh = __vma_tree_height(node->tree_left);
+    int rh = __vma_tree_height(node->tree_right);
+    uint64_t lgap = __vma_tree_gap(node->tree_left);
+    uint64_t rgap = __vma_tree_gap(node->tree_right);
+
+    node->tree_height = (lh > rh ? lh : rh) + 1;
+    node->subtree_gap = node->gap;
+    if (lgap > node->subtree_gap)
+        node->subtree_gap = lgap;
+    if (rgap > node->subtree_gap)
+        node->subtree_gap = rgap;
+}
+
+/* Replace "old" with "new" as a child of "parent" (or as the root) */
+static inline void __vma_tree_replace_child (struct shim_vma * parent,
+                                             struct shim_vma * old,
+                                             struct shim_vma * new)
+{
+    if (!parent)
+        vma_tree_root = new;
+    else if (parent->tree_left == old)
+        parent->tree_left = new;
+    else
+        parent->tree_right = new;
+
+    if (new)
+        new->tree_parent = parent;
+}
+
+static struct shim_vma * __vma_tree_rotate_left (struct shim_vma * node)
+{
+    struct shim_vma * parent = node->tree_parent;
+    struct shim_vma * right = node->tree_right;
+
+    node->tree_right = right->tree_left;
+    if (node->tree_right)
+        node->tree_right->tree_parent = node;
+
+    __vma_tree_replace_child(parent, node, right);
+    right->tree_left = node;
+    node->tree_parent = right;
+
+    __vma_tree_update(node);
+    __vma_tree_update(right);
+    return right;
+}
+
+static struct shim_vma * __vma_tree_rotate_right (struct shim_vma * node)
+{
+    struct shim_vma * parent = node->tree_parent;
+    struct shim_vma * left = node->tree_left;
+
+    node->tree_left = left->tree_right;
+    if (node->tree_left)
+        node->tree_left->tree_parent = node;
+
+    __vma_tree_replace_child(parent, node, left);
+    left->tree_right = node;
+    node->tree_parent = left;
+
+    __vma_tree_update(node);
+    __vma_tree_update(left);
+    return left;
+}
+
+/*
+ * __vma_tree_rebalance() walks from "node" up to the root, restoring the
+ * AVL balance and recalculating the augmented gaps on the way. It must be
+ * called whenever the tree shape or the gap of "node" is changed.
+ */
+static void __vma_tree_rebalance (struct shim_vma * node)
+{
+    while (node) {
+        __vma_tree_update(node);
+
+        int balance = __vma_tree_height(node->tree_left) -
+                      __vma_tree_height(node->tree_right);
+
+        if (balance > 1) {
+            struct shim_vma * left = node->tree_left;
+            if (__vma_tree_height(left->tree_left) <
+                __vma_tree_height(left->tree_right))
+                __vma_tree_rotate_left(left);
+            node = __vma_tree_rotate_right(node);
+        } else if (balance < -1) {
+            struct shim_vma * right = node->tree_right;
+            if (__vma_tree_height(right->tree_right) <
+                __vma_tree_height(right->tree_left))
+                __vma_tree_rotate_right(right);
+            node = __vma_tree_rotate_left(node);
+        }
+
+        node = node->tree_parent;
+    }
+}
+
+static void __vma_tree_insert (struct shim_vma * vma)
+{
+    struct shim_vma ** link = &vma_tree_root, * parent = NULL;
+
+    while (*link) {
+        parent = *link;
+        link = vma->start < parent->start ?
+               &parent->tree_left : &parent->tree_right;
+    }
+
+    vma->tree_left   = NULL;
+    vma->tree_right  = NULL;
+    vma->tree_parent = parent;
+    *link = vma;
+    __vma_tree_rebalance(vma);
+}
+
+static void __vma_tree_remove (struct shim_vma * vma)
+{
+    struct shim_vma * parent = vma->tree_parent;
+    struct shim_vma * fixup;
+
+    if (!vma->tree_left || !vma->tree_right) {
+        __vma_tree_replace_child(parent, vma,
+                                 vma->tree_left ? : vma->tree_right);
+        fixup = parent;
+    } else {
+        /* Replace "vma" with its in-order successor */
+        struct shim_vma * succ = vma->tree_right;
+        while (succ->tree_left)
+            succ = succ->tree_left;
+
+        if (succ->tree_parent != vma) {
+            fixup = succ->tree_parent;
+            __vma_tree_replace_child(fixup, succ, succ->tree_right);
+            succ->tree_right = vma->tree_right;
+            succ->tree_right->tree_parent = succ;
+        } else {
+            fixup = succ;
+        }
+
+        succ->tree_left = vma->tree_left;
+        succ->tree_left->tree_parent = succ;
+        __vma_tree_replace_child(parent, vma, succ);
+    }
+
+    vma->tree_left = vma->tree_right = vma->tree_parent = NULL;
+    __vma_tree_rebalance(fixup);
+}
+
+/*
+ * Set the gap between "vma" and the immediately precedent vma "prev" (or
+ * the bottom of the address space if "prev" is NULL).
+ */
+static inline void __set_vma_gap (struct shim_vma * vma,
+                                  struct shim_vma * prev)
+{
+    vma->gap = (uint64_t) vma->start - (prev ? (uint64_t) prev->end : 0);
+    __vma_tree_rebalance(vma);
+}
+
+/*
+ * __update_vma_gaps() must be called after the boundaries of "vma" are
+ * changed in place. The gaps below "vma" and below its next vma are
+ * refreshed.
+ */
+static inline void __update_vma_gaps (struct shim_vma * vma)
+{
+    struct shim_vma * next = listp_next_entry(vma, &vma_list, list);
+
+    __set_vma_gap(vma, listp_prev_entry(vma, &vma_list, list));
+    if (next)
+        __set_vma_gap(next, vma);
+}
+
 /*
  * __lookup_vma() returns the VMA that contains the address; otherwise,
  * returns NULL. "pprev" returns the highest VMA below the address.
@@ -195,26 +402,78 @@ static inline void assert_vma_list (void)
 static inline struct shim_vma *
 __lookup_vma (void * addr, struct shim_vma ** pprev)
 {
-    struct shim_vma * vma, * prev = NULL;
+    struct shim_vma * node = vma_tree_root, * below = NULL;
+    struct shim_vma * vma = NULL, * prev;
 
-    listp_for_each_entry(vma, &vma_list, list) {
-        if (addr < vma->start)
-            goto none;
-        if (test_vma_contain(vma, addr, addr + 1))
-            goto out;
+    /* Find the highest VMA which starts at or below the address */
+    while (node) {
+        if (addr < node->start) {
+            node = node->tree_left;
+        } else {
+            below = node;
+            node = node->tree_right;
+        }
+    }
 
-        assert(vma->end > vma->start);
-        assert(!prev || prev->end <= vma->start);
-        prev = vma;
+    prev = below;
+    if (below && test_vma_contain(below, addr, addr + 1)) {
+        vma = below;
+        prev = listp_prev_entry(below, &vma_list, list);
     }
 
-none:
-    vma = NULL;
-out:
+    assert(!prev || prev->end <= addr);
     if (pprev) *pprev = prev;
     return vma;
 }
 
+/*
+ * __lookup_vma_above() returns the lowest VMA that ends above the address,
+ * i.e., either the VMA containing the address or the next VMA above it.
+ * Returns NULL if no such VMA exists.
+ *
+ * vma_list_lock must be held when calling this function.
+ */
+static inline struct shim_vma * __lookup_vma_above (void * addr)
+{
+    struct shim_vma * node = vma_tree_root, * above = NULL;
+
+    while (node) {
+        if (node->end > addr) {
+            above = node;
+            node = node->tree_left;
+        } else {
+            node = node->tree_right;
+        }
+    }
+
+    return above;
+}
+
+/*
+ * __lookup_vma_gap() searches the subtree at "node" for the highest VMA
+ * starting at or below "limit", which has a gap of at least "length"
+ * bytes below it. Subtrees with no gap large enough are skipped.
+ */
+static struct shim_vma *
+__lookup_vma_gap (struct shim_vma * node, void * limit, uint64_t length)
+{
+    if (!node || node->subtree_gap < length)
+        return NULL;
+
+    if (node->start > limit)
+        return __lookup_vma_gap(node->tree_left, limit, length);
+
+    struct shim_vma * found = __lookup_vma_gap(node->tree_right, limit,
+                                               length);
+    if (found)
+        return found;
+
+    if (node->gap >= length)
+        return node;
+
+    return __lookup_vma_gap(node->tree_left, limit, length);
+}
+
 /*
  * __insert_vma() places "vma" after "prev", or at the beginning of
  * vma_list if "prev" is NULL. vma_list_lock must be held when calling
@@ -237,6 +496,11 @@ __insert_vma (struct shim_vma * vma, struct shim_vma * prev)
         listp_add_after(vma, prev, &vma_list, list);
     else
         listp_add(vma, &vma_list, list);
+
+    vma->gap = (uint64_t) vma->start - (prev ? (uint64_t) prev->end : 0);
+    __vma_tree_insert(vma);
+    if (next)
+        __set_vma_gap(next, vma);
 }
 
 /*
@@ -248,7 +512,14 @@ static inline void
 __remove_vma (struct shim_vma * vma, struct shim_vma * prev)
 {
     assert(vma != prev);
+    assert(prev == listp_prev_entry(vma, &vma_list, list));
+
+    struct shim_vma * next = listp_next_entry(vma, &vma_list, list);
+
     listp_del(vma, &vma_list, list);
+    __vma_tree_remove(vma);
+    if (next)
+        __set_vma_gap(next, prev);
 }
 
 /*
@@ -584,6 +855,7 @@ static inline void __shrink_vma (struct shim_vma * vma, void * start, void * end
 finish:
     assert(!test_vma_overlap(vma, start, end));
     assert(vma->start < vma->end);
+    __update_vma_gaps(vma);
 }
 
 /*
@@ -810,38 +1082,52 @@ static void * __bkeep_unmapped (void * top_addr, void * bottom_addr,
     if (!length || length > top_addr - bottom_addr)
         return NULL;
 
-    struct shim_vma * prev = NULL;
-    struct shim_vma * cur = __lookup_vma(top_addr, &prev);
+    /*
+     * First, check the space right below "top_addr", which is bounded by
+     * the VMA containing "top_addr", or the next VMA above it.
+     */
+    struct shim_vma * cur = __lookup_vma_above(top_addr);
+    struct shim_vma * prev = cur ? listp_prev_entry(cur, &vma_list, list) :
+                             listp_empty(&vma_list) ? NULL :
+                             listp_last_entry(&vma_list, struct shim_vma,
+                                              list);
 
-    while (true) {
-        /* Set the range for searching */
-        void * end = cur ? cur->start : top_addr;
-        void * start =
-            (prev && prev->end > bottom_addr) ? prev->end : bottom_addr;
+    void * end = (cur && cur->start < top_addr) ? cur->start : top_addr;
+    void * start =
+        (prev && prev->end > bottom_addr) ? prev->end : bottom_addr;
 
-        assert(start <= end);
+    if (start < end && length <= end - start)
+        goto found;
 
-        /* Check if there is enough space between prev and cur */
-        if (length <= end - start) {
-            /* create a new VMA at the top of the range */
-            __bkeep_mmap(prev, end - length, end, prot, flags,
-                         file, offset, comment);
-            assert_vma_list();
+    if (!prev || prev->start <= bottom_addr)
+        return NULL;
 
-            debug("bkeep_unmapped: %p-%p%s%s\n", end - length, end,
-                  comment ? " => " : "", comment ? : "");
+    /*
+     * Otherwise, use the tree to find the highest VMA below "top_addr"
+     * which has a large enough gap below. If the gap is cut off by
+     * "bottom_addr", no lower gap can fit either.
+     */
+    cur = __lookup_vma_gap(vma_tree_root, prev->start, length);
+    if (!cur || cur->start <= bottom_addr)
+        return NULL;
 
-            return end - length;
-        }
+    prev = listp_prev_entry(cur, &vma_list, list);
+    end = cur->start;
+    start = (prev && prev->end > bottom_addr) ? prev->end : bottom_addr;
 
-        if (!prev || prev->start <= bottom_addr)
-            break;
+    if (length > end - start)
+        return NULL;
 
-        cur = prev;
-        prev = listp_prev_entry(cur, &vma_list, list);
-    }
+found:
+    /* create a new VMA at the top of the range */
+    __bkeep_mmap(prev, end - length, end, prot, flags,
+                 file, offset, comment);
+    assert_vma_list();
 
-    return NULL;
+    debug("bkeep_unmapped: %p-%p%s%s\n", end - length, end,
+          comment ? " => " : "", comment ? : "");
+
+    return end - length;
 }
 
 void * bkeep_unmapped (void * top_addr, void * bottom_addr, uint64_t length,
@@ -959,16 +1245,11 @@ int lookup_vma (void * addr, struct shim_vma_val * res)
 int lookup_overlap_vma (void * addr, uint64_t length,
                         struct shim_vma_val * res)
 {
-    struct shim_vma * tmp, * vma = NULL;
-
     lock(vma_list_lock);
 
-    listp_for_each_entry(tmp, &vma_list, list)
-        if (test_vma_overlap (tmp, addr, addr + length)) {
-            vma = tmp;
-            break;
-        }
-
+    struct shim_vma * vma = __lookup_vma_above(addr);
+    if (vma && vma->start >= addr + length)
+        vma = NULL;
 
     if (!vma) {
         unlock(vma_list_lock);
@@ -1073,6 +1354,19 @@ BEGIN_CP_FUNC(vma)
         if (!send_size)
             goto no_mem;
 
+        /* the memory may be still coming from the parent */
+        int ret = fetch_postcopy_range(send_addr, send_size);
+        if (ret < 0)
+            return ret;
+
+        if (store->use_postcopy && !vma->file &&
+            !(vma->flags & VMA_INTERNAL) && (pal_prot & PAL_PROT_READ) &&
+            send_size >= POSTCOPY_MIN_SIZE) {
+            DO_CP_SIZE(postcopy, vma, send_size, NULL);
+            need_mapped = vma->addr + vma->length;
+            goto no_mem;
+        }
+
 #if HASH_GIPC == 1
         if (!(pal_prot & PAL_PROT_READ)) {
 #else
@@ -1091,6 +1385,7 @@ BEGIN_CP_FUNC(vma)
             struct shim_mem_entry * mem;
             DO_CP_SIZE(memory, send_addr, send_size, &mem);
             mem->prot = pal_prot;
+            mem->anonymous = !vma->file && !(vma->flags & MAP_SHARED);
         }
 
         need_mapped = vma->addr + vma->length;
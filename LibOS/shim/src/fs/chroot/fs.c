@@ -48,13 +48,20 @@
 
 #define TTY_FILE_MODE   0666
 
-#define FILE_BUFMAP_SIZE (PAL_CB(pagesize) * 4)
 #define FILE_BUF_SIZE (PAL_CB(pagesize))
 
+#define DEFAULT_READAHEAD_SIZE  (128 * 1024)
+
+/* a lookup on a mount that never revalidates stays valid forever */
+#define REVALIDATE_NEVER        ((uint64_t) -1)
+
 struct mount_data {
     int                 data_size;
     enum shim_file_type base_type;
     unsigned long       ino_base;
+    uint64_t            readahead;
+    uint64_t            revalidate; /* microseconds the result of a host
+                                       lookup can be reused for */
     int                 root_uri_len;
     char                root_uri[];
 };
@@ -62,6 +69,82 @@ struct mount_data {
 #define HANDLE_MOUNT_DATA(h) ((struct mount_data *) (h)->fs->data)
 #define DENTRY_MOUNT_DATA(d) ((struct mount_data *) (d)->fs->data)
 
+/* the option of a mount is given by "fs.root.<name>" for the root, or by
+   "fs.mount.<mount>.<name>" for the others. Returns the length of the value
+   in cfg, or 0 if it is not set. */
+static int get_mount_config (const char * root, const char * name,
+                             char * cfg)
+{
+    char k[CONFIG_MAX];
+    int len = 0;
+
+    if (!root_config || !root)
+        return 0;
+
+    if (strcmp_static(root, "/")) {
+        snprintf(k, CONFIG_MAX, "fs.root.%s", name);
+        len = get_config(root_config, k, cfg, CONFIG_MAX);
+        return len > 0 ? len : 0;
+    }
+
+    ssize_t keybuf_size = get_config_entries_size(root_config, "fs.mount");
+    if (keybuf_size <= 0)
+        return 0;
+
+    char * keybuf = malloc(keybuf_size);
+    if (!keybuf)
+        return 0;
+
+    int nkeys = get_config_entries(root_config, "fs.mount", keybuf,
+                                   keybuf_size);
+    int root_len = strlen(root);
+
+    const char * key = keybuf, * next = NULL;
+    for (int n = 0 ; n < nkeys ; key = next, n++) {
+        for (next = key ; *next ; next++);
+        next++;
+
+        snprintf(k, CONFIG_MAX, "fs.mount.%s.path", key);
+        if (get_config(root_config, k, cfg, CONFIG_MAX) != root_len ||
+            memcmp(cfg, root, root_len))
+            continue;
+
+        snprintf(k, CONFIG_MAX, "fs.mount.%s.%s", key, name);
+        len = get_config(root_config, k, cfg, CONFIG_MAX);
+        break;
+    }
+
+    free(keybuf);
+    return len > 0 ? len : 0;
+}
+
+static uint64_t get_readahead_config (const char * root)
+{
+    char cfg[CONFIG_MAX];
+
+    if (get_mount_config(root, "readahead", cfg) > 0)
+        return parse_int(cfg);
+
+    return DEFAULT_READAHEAD_SIZE;
+}
+
+/* how long the host lookups on a mount are trusted: "never" revalidated
+   (the default, for mounts only changed through the LibOS), "always", or
+   a number of milliseconds */
+static uint64_t get_revalidate_config (const char * root)
+{
+    char cfg[CONFIG_MAX];
+
+    if (get_mount_config(root, "revalidate", cfg) <= 0 ||
+        strcmp_static(cfg, "never"))
+        return REVALIDATE_NEVER;
+
+    if (strcmp_static(cfg, "always"))
+        return 0;
+
+    return parse_int(cfg) * 1000;
+}
+
 static int chroot_mount (const char * uri, const char * root,
                          void ** mount_data)
 {
@@ -88,6 +171,8 @@ static int chroot_mount (const char * uri, const char * root,
     mdata->data_size = data_size;
     mdata->base_type = type;
     mdata->ino_base = hash_path(uri, uri_len, NULL);
+    mdata->readahead = get_readahead_config(root);
+    mdata->revalidate = get_revalidate_config(root);
     mdata->root_uri_len = uri_len;
     memcpy(mdata->root_uri, uri, uri_len + 1);
 
@@ -143,6 +228,301 @@ static inline int concat_uri (char * buffer, int size, int type,
     return tmp - buffer;
 }
 
+/*
+ * The content of regular files is cached in chunks, which hang off the
+ * file data of the dentry, so all the handles opened on the same file
+ * share them. The cache is write-through: the host file is always up to
+ * date, and a write only refreshes the chunks it covers. All the chunks
+ * are kept on a global LRU list, and once the cache reaches the size given
+ * by "fs.cache.size" in the manifest, the least recently used chunk is
+ * reused. Setting the size to 0 turns off the cache.
+ */
+#define FILE_CACHE_CHUNK        (PAL_CB(pagesize) * 4)
+#define FILE_CACHE_HASH_LEN     8
+#define FILE_CACHE_HASH_SIZE    (1 << FILE_CACHE_HASH_LEN)
+#define FILE_CACHE_HASH_MASK    (FILE_CACHE_HASH_SIZE - 1)
+#define DEFAULT_FILE_CACHE_SIZE (4 * 1024 * 1024)
+
+struct shim_file_page {
+    struct shim_file_data *     data;
+    uint64_t                    offset;     /* aligned to FILE_CACHE_CHUNK */
+    size_t                      len;        /* bytes valid in the buffer */
+    void *                      buf;
+    LIST_TYPE(shim_file_page)   list;       /* data->pages */
+    LIST_TYPE(shim_file_page)   hash;       /* file_cache_hash */
+    LIST_TYPE(shim_file_page)   lru;        /* file_cache_lru */
+};
+
+static LOCKTYPE file_cache_lock;
+static LISTP_TYPE(shim_file_page) file_cache_hash[FILE_CACHE_HASH_SIZE];
+/* the most recently used chunk is at the head */
+static LISTP_TYPE(shim_file_page) file_cache_lru;
+static long file_cache_max = -1;    /* in chunks */
+static long file_cache_used;
+
+/* the ranges to read ahead into the cache, served by a helper thread */
+DEFINE_LIST(readahead_req);
+struct readahead_req {
+    struct shim_handle *        hdl;
+    uint64_t                    offset;
+    uint64_t                    end;
+    LIST_TYPE(readahead_req)    list;
+};
+
+DEFINE_LISTP(readahead_req);
+static LISTP_TYPE(readahead_req) readahead_list;
+static LOCKTYPE readahead_lock;
+static AEVENTTYPE readahead_event;
+static struct shim_thread * readahead_thread;
+
+int init_chroot_cache (void)
+{
+    create_lock(file_cache_lock);
+    create_lock(readahead_lock);
+    return 0;
+}
+
+/* the size is read from the manifest the first time the cache is used
+   after the manifest is loaded. file_cache_lock needs to be held */
+static long __file_cache_max (void)
+{
+    if (file_cache_max >= 0)
+        return file_cache_max;
+
+    uint64_t size = DEFAULT_FILE_CACHE_SIZE;
+    char cfg[CONFIG_MAX];
+
+    if (!root_config)
+        return size / FILE_CACHE_CHUNK;
+
+    if (get_config(root_config, "fs.cache.size", cfg, CONFIG_MAX) > 0)
+        size = parse_int(cfg);
+
+    file_cache_max = size / FILE_CACHE_CHUNK;
+    debug("file cache: %ld chunks of %lu bytes\n", file_cache_max,
+          FILE_CACHE_CHUNK);
+    return file_cache_max;
+}
+
+static inline LISTP_TYPE(shim_file_page) *
+file_cache_bucket (struct shim_file_data * data, uint64_t offset)
+{
+    unsigned long key = ((unsigned long) data >> 4) +
+                        offset / FILE_CACHE_CHUNK;
+    return &file_cache_hash[(key ^ (key >> FILE_CACHE_HASH_LEN)) &
+                            FILE_CACHE_HASH_MASK];
+}
+
+static struct shim_file_page *
+__lookup_file_page (struct shim_file_data * data, uint64_t offset)
+{
+    LISTP_TYPE(shim_file_page) * head = file_cache_bucket(data, offset);
+    struct shim_file_page * page;
+
+    listp_for_each_entry(page, head, hash)
+        if (page->data == data && page->offset == offset)
+            return page;
+
+    return NULL;
+}
+
+static void __unlink_file_page (struct shim_file_page * page)
+{
+    listp_del_init(page, &page->data->pages, list);
+    listp_del_init(page, file_cache_bucket(page->data, page->offset), hash);
+    listp_del_init(page, &file_cache_lru, lru);
+}
+
+static void __drop_file_page (struct shim_file_page * page)
+{
+    __unlink_file_page(page);
+    system_free(page->buf, FILE_CACHE_CHUNK);
+    free(page);
+    file_cache_used--;
+}
+
+/* get an empty chunk for the given offset of the file, either newly
+   allocated or taken from the tail of the LRU list */
+static struct shim_file_page *
+__get_file_page (struct shim_file_data * data, uint64_t offset)
+{
+    struct shim_file_page * page;
+    long max = __file_cache_max();
+
+    if (!max)
+        return NULL;
+
+    if (file_cache_used >= max && !listp_empty(&file_cache_lru)) {
+        page = listp_last_entry(&file_cache_lru, struct shim_file_page, lru);
+        __unlink_file_page(page);
+    } else {
+        page = malloc(sizeof(struct shim_file_page));
+        if (!page)
+            return NULL;
+
+        page->buf = system_malloc(FILE_CACHE_CHUNK);
+        if (!page->buf) {
+            free(page);
+            return NULL;
+        }
+
+        INIT_LIST_HEAD(page, list);
+        INIT_LIST_HEAD(page, hash);
+        INIT_LIST_HEAD(page, lru);
+        file_cache_used++;
+    }
+
+    page->data   = data;
+    page->offset = offset;
+    page->len    = 0;
+    listp_add(page, &data->pages, list);
+    listp_add(page, file_cache_bucket(data, offset), hash);
+    listp_add(page, &file_cache_lru, lru);
+    return page;
+}
+
+static inline void __touch_file_page (struct shim_file_page * page)
+{
+    if (listp_first_entry(&file_cache_lru, struct shim_file_page, lru)
+        != page) {
+        listp_del(page, &file_cache_lru, lru);
+        listp_add(page, &file_cache_lru, lru);
+    }
+}
+
+/* drop the cached chunks of the file that hold any byte from offset on */
+static void drop_file_pages (struct shim_file_data * data, uint64_t offset)
+{
+    struct shim_file_page * page, * n;
+
+    lock(file_cache_lock);
+    data->cache_gen++;
+    listp_for_each_entry_safe(page, n, &data->pages, list)
+        if (page->offset + FILE_CACHE_CHUNK > offset)
+            __drop_file_page(page);
+    unlock(file_cache_lock);
+}
+
+/* read from the cached chunks, filling the missing ones from the host.
+   The caller bounds the read by the file size. As in readahead_range, the
+   host is read without the cache lock held, and a chunk read from the host
+   is only cached if the cached content has not changed in the meantime. */
+static int file_cache_read (struct shim_handle * hdl, void * buf,
+                            size_t count, uint64_t offset)
+{
+    struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
+    void * spare = NULL;
+    size_t bytes = 0;
+    int ret = 0;
+
+    while (bytes < count) {
+        uint64_t pos = offset + bytes;
+        uint64_t start = pos - pos % FILE_CACHE_CHUNK;
+        size_t copy;
+
+        lock(file_cache_lock);
+        struct shim_file_page * page = __lookup_file_page(data, start);
+
+        if (page && pos < start + page->len) {
+            copy = start + page->len - pos;
+            if (copy > count - bytes)
+                copy = count - bytes;
+
+            memcpy(buf + bytes, page->buf + (pos - start), copy);
+            __touch_file_page(page);
+            unlock(file_cache_lock);
+            bytes += copy;
+            continue;
+        }
+
+        /* a short chunk is refilled, in case the file has grown */
+        unsigned long gen = data->cache_gen;
+        unlock(file_cache_lock);
+
+        if (!spare && !(spare = system_malloc(FILE_CACHE_CHUNK))) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        PAL_NUM len = DkStreamRead(hdl->pal_handle, start, FILE_CACHE_CHUNK,
+                                   spare, NULL, 0);
+        if (!len) {
+            if (PAL_NATIVE_ERRNO != PAL_ERROR_ENDOFSTREAM)
+                ret = -PAL_ERRNO;
+            break;
+        }
+
+        copy = 0;
+        if (pos < start + len) {
+            copy = start + len - pos;
+            if (copy > count - bytes)
+                copy = count - bytes;
+
+            memcpy(buf + bytes, spare + (pos - start), copy);
+        }
+
+        lock(file_cache_lock);
+        if (data->cache_gen == gen) {
+            page = __lookup_file_page(data, start);
+            if ((page && page->len < len) ||
+                (!page && (page = __get_file_page(data, start)))) {
+                void * old = page->buf;
+                page->buf = spare;
+                page->len = len;
+                spare = old;
+            }
+        }
+        unlock(file_cache_lock);
+
+        if (!copy)
+            break;
+
+        bytes += copy;
+    }
+
+    if (spare)
+        system_free(spare, FILE_CACHE_CHUNK);
+
+    return bytes ? : ret;
+}
+
+/* refresh the cached chunks after a write to the host; a chunk that
+   would be left with a hole is dropped */
+static void file_cache_write (struct shim_file_data * data, const void * buf,
+                              size_t count, uint64_t offset)
+{
+    uint64_t end = offset + count;
+    uint64_t start = offset - offset % FILE_CACHE_CHUNK;
+
+    lock(file_cache_lock);
+    data->cache_gen++;
+
+    if (listp_empty(&data->pages))
+        goto out;
+
+    for ( ; start < end ; start += FILE_CACHE_CHUNK) {
+        struct shim_file_page * page = __lookup_file_page(data, start);
+        if (!page)
+            continue;
+
+        uint64_t from = offset > start ? offset : start;
+        uint64_t to = end < start + FILE_CACHE_CHUNK ?
+                      end : start + FILE_CACHE_CHUNK;
+
+        if (from > start + page->len) {
+            __drop_file_page(page);
+            continue;
+        }
+
+        memcpy(page->buf + (from - start), buf + (from - offset), to - from);
+        if (to - start > page->len)
+            page->len = to - start;
+    }
+
+out:
+    unlock(file_cache_lock);
+}
+
 /* simply just create data, sometimes it is individually called when the
    handle is not linked to a dentry */
 static struct shim_file_data * __create_data (void)
@@ -157,6 +537,7 @@ static struct shim_file_data * __create_data (void)
 
 static void __destroy_data (struct shim_file_data * data)
 {
+    drop_file_pages(data, 0);
     qstrfree(&data->host_uri);
     destroy_lock(data->lock);
     free(data);
@@ -219,23 +600,41 @@ static int __query_attr (struct shim_dentry * dent,
     PAL_STREAM_ATTR pal_attr;
     enum shim_file_type old_type = data->type;
 
+    /* a failed query is as good as a successful one for a negative
+       dentry, so the time is taken before */
+    if (DENTRY_MOUNT_DATA(dent)->revalidate != REVALIDATE_NEVER)
+        data->query_time = DkSystemTimeQuery();
+
     if (pal_handle ?
         !DkStreamAttributesQuerybyHandle(pal_handle, &pal_attr) :
         !DkStreamAttributesQuery(qstrgetstr(&data->host_uri), &pal_attr))
         return -PAL_ERRNO;
 
-    /* need to correct the data type */
-    if (data->type == FILE_UNKNOWN)
+    /* need to correct the data type; a revalidated file may also have been
+       replaced by a directory on the host, or the other way around */
+    if (data->type == FILE_UNKNOWN || data->type == FILE_REGULAR ||
+        data->type == FILE_DIR)
         switch (pal_attr.handle_type) {
             case pal_type_file: data->type = FILE_REGULAR;  break;
             case pal_type_dir:  data->type = FILE_DIR;      break;
             case pal_type_dev:  data->type = FILE_DEV;      break;
         }
 
+    if (old_type == FILE_DIR && data->type != FILE_DIR) {
+        int ret;
+        dent->state &= ~DENTRY_ISDIRECTORY;
+        if ((ret = make_uri(dent)) < 0)
+            return ret;
+    }
+
     data->mode = (pal_attr.readable  ? S_IRUSR : 0) |
                  (pal_attr.writeable ? S_IWUSR : 0) |
                  (pal_attr.runnable  ? S_IXUSR : 0);
 
+    /* the file was changed on the host since it was last queried */
+    if (data->queried && atomic_read(&data->size) != pal_attr.pending_size)
+        drop_file_pages(data, 0);
+
     atomic_set(&data->size, pal_attr.pending_size);
 
     if (data->type == FILE_DIR) {
@@ -244,32 +643,16 @@ static int __query_attr (struct shim_dentry * dent,
          * directives to 'dir:' uris */
         if (old_type != FILE_DIR) {
             dent->state |= DENTRY_ISDIRECTORY;
-            if ((ret = make_uri(dent)) < 0) {
-                unlock(data->lock);
+            if ((ret = make_uri(dent)) < 0)
                 return ret;
-            }
         }
 
-        /* DEP 3/18/17: If we have a directory, we need to find out how many
-         * children it has by hand. */
-        /* XXX: Keep coherent with rmdir/mkdir/creat, etc */
-        struct shim_dirent *d, *dbuf = NULL;
-        int nlink = 0;
-        int rv = chroot_readdir(dent, &dbuf);
-        if (rv != 0)
-            return rv;
-        if (dbuf) {
-            for (d = dbuf; d; d = d->next)
-                nlink++;
-            free(dbuf);
-        } else
-            nlink = 2; // Educated guess...
-        data->nlink = nlink;
+        /* The host reports the link count of a directory (2 plus its
+         * subdirectories); if it cannot, leave it to __count_dir_links
+         * when stat() really asks for it. */
+        data->nlink = pal_attr.nlink;
     } else {
-        /* DEP 3/18/17: Right now, we don't support hard links,
-         * so just return 1;
-         */ 
-        data->nlink = 1;
+        data->nlink = pal_attr.nlink ? : 1;
     }
 
     data->queried = true;
@@ -277,6 +660,53 @@ static int __query_attr (struct shim_dentry * dent,
     return 0;
 }
 
+/* count the subdirectories by hand, for hosts that do not report the link
+   count of a directory. Must be called with data->lock held. */
+static int __count_dir_links (struct shim_dentry * dent,
+                              struct shim_file_data * data)
+{
+    struct shim_dirent * d, * dbuf = NULL;
+    int ret = chroot_readdir(dent, &dbuf);
+    if (ret < 0)
+        return ret;
+
+    unsigned long nlink = 2;
+    for (d = dbuf; d; d = d->next)
+        if (d->type == LINUX_DT_DIR)
+            nlink++;
+
+    free(dbuf);
+    data->nlink = nlink;
+    return 0;
+}
+
+/* the attributes of a directory change with its entries; query them again
+   from the host on the next lookup */
+static void invalidate_dir_attr (struct shim_dentry * dir)
+{
+    struct shim_file_data * data = dir ? FILE_DENTRY_DATA(dir) : NULL;
+    if (!data)
+        return;
+
+    lock(data->lock);
+    data->queried = false;
+    unlock(data->lock);
+}
+
+/* whether the host has to be asked again about the dentry, according to
+   the revalidation policy of the mount */
+static inline bool attr_stale (struct shim_dentry * dent,
+                               struct shim_file_data * data)
+{
+    uint64_t revalidate = DENTRY_MOUNT_DATA(dent)->revalidate;
+
+    if (revalidate == REVALIDATE_NEVER)
+        return false;
+
+    return !revalidate ||
+           DkSystemTimeQuery() - data->query_time >= revalidate;
+}
+
 /* do not need any lock */
 static void chroot_update_ino (struct shim_dentry * dent)
 {
@@ -325,7 +755,8 @@ static int query_dentry (struct shim_dentry * dent, PAL_HANDLE pal_handle,
 
     lock(data->lock);
 
-    if (!data->queried && (ret = __query_attr(dent, data, pal_handle)) < 0) {
+    if ((!data->queried || attr_stale(dent, data)) &&
+        (ret = __query_attr(dent, data, pal_handle)) < 0) {
         unlock(data->lock);
         return ret;
     }
@@ -334,6 +765,12 @@ static int query_dentry (struct shim_dentry * dent, PAL_HANDLE pal_handle,
         *mode = data->mode;
 
     if (stat) {
+        if (data->type == FILE_DIR && !data->nlink &&
+            (ret = __count_dir_links(dent, data)) < 0) {
+            unlock(data->lock);
+            return ret;
+        }
+
         struct mount_data * mdata = DENTRY_MOUNT_DATA(dent);
         chroot_update_ino(dent);
 
@@ -386,6 +823,12 @@ static int chroot_lookup (struct shim_dentry * dent, bool force)
     return query_dentry(dent, NULL, NULL, NULL);
 }
 
+static bool chroot_revalidate (struct shim_dentry * dent)
+{
+    struct shim_file_data * data = FILE_DENTRY_DATA(dent);
+    return data && attr_stale(dent, data);
+}
+
 static int __chroot_open (struct shim_dentry * dent,
                           const char * uri, int len, int flags, mode_t mode,
                           struct shim_handle * hdl,
@@ -463,7 +906,7 @@ static int chroot_open (struct shim_handle * hdl, struct shim_dentry * dent,
     hdl->type       = TYPE_FILE;
     file->marker    = (flags & O_APPEND) ? size : 0;
     file->size      = size;
-    file->buf_type  = (data->type == FILE_REGULAR) ? FILEBUF_MAP : FILEBUF_NONE;
+    file->buf_type  = (data->type == FILE_REGULAR) ? FILEBUF_CACHE : FILEBUF_NONE;
     hdl->flags      = flags;
     hdl->acc_mode   = ACC_MODE(flags & O_ACCMODE);
     qstrcopy(&hdl->uri, &data->host_uri);
@@ -493,19 +936,12 @@ static int chroot_creat (struct shim_handle * hdl, struct shim_dentry * dir,
     hdl->type       = TYPE_FILE;
     file->marker    = (flags & O_APPEND) ? size : 0;
     file->size      = size;
-    file->buf_type  = (data->type == FILE_REGULAR) ? FILEBUF_MAP : FILEBUF_NONE;
+    file->buf_type  = (data->type == FILE_REGULAR) ? FILEBUF_CACHE : FILEBUF_NONE;
     hdl->flags      = flags;
     hdl->acc_mode   = ACC_MODE(flags & O_ACCMODE);
     qstrcopy(&hdl->uri, &data->host_uri);
 
-    /* Increment the parent's link count */
-    struct shim_file_data *parent_data = FILE_DENTRY_DATA(dir);
-    if (parent_data) {
-        lock(parent_data->lock);
-        if (parent_data->queried)
-            parent_data->nlink++;
-        unlock(parent_data->lock);
-    }
+    invalidate_dir_attr(dir);
     return 0;
 }
 
@@ -526,14 +962,7 @@ static int chroot_mkdir (struct shim_dentry * dir, struct shim_dentry * dent,
 
     ret = __chroot_open(dent, NULL, 0, O_CREAT|O_EXCL, mode, NULL, data);
 
-    /* Increment the parent's link count */
-    struct shim_file_data *parent_data = FILE_DENTRY_DATA(dir);
-    if (parent_data) {
-        lock(parent_data->lock);
-        if (parent_data->queried)
-            parent_data->nlink++;
-        unlock(parent_data->lock);
-    }
+    invalidate_dir_attr(dir);
     return ret;
 }
 
@@ -575,203 +1004,274 @@ static inline bool check_version (struct shim_handle * hdl)
            == hdl->info.file.version;
 }
 
-static int chroot_hstat (struct shim_handle * hdl, struct stat * stat)
-{
-    int ret;
-    if (NEED_RECREATE(hdl) && (ret = chroot_recreate(hdl)) < 0)
-        return ret;
+/* the helper exits after staying idle for this long (in microseconds) */
+#define READAHEAD_IDLE_TIME     1000000
 
-    if (!check_version(hdl) || !hdl->dentry) {
-        struct shim_file_handle * file = &hdl->info.file;
-        struct shim_dentry * dent = hdl->dentry;
-        struct mount_data * mdata = dent ? DENTRY_MOUNT_DATA(dent) : NULL;
+/* read the chunks of the range that are not cached yet. The host is read
+   without the cache lock held, so a chunk is only inserted if the cached
+   content has not changed in the meantime. spare is a free chunk buffer,
+   swapped with the buffer of the inserted chunk. */
+static void readahead_range (struct readahead_req * req, void ** spare)
+{
+    struct shim_handle * hdl = req->hdl;
+    struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
+    uint64_t start = req->offset - req->offset % FILE_CACHE_CHUNK;
 
-        if (dent)
-            chroot_update_ino(dent);
+    if (!data || !hdl->pal_handle || !check_version(hdl))
+        return;
 
-        if (stat) {
-            memset(stat, 0, sizeof(struct stat));
-            stat->st_dev  = mdata ? (dev_t) mdata->ino_base : 0;
-            stat->st_ino  = dent ? (ino_t) dent->ino : 0;
-            stat->st_size = file->size;
-            stat->st_mode |= (file->buf_type == FILEBUF_MAP) ? S_IFREG : S_IFCHR;
+    for ( ; start < req->end ; start += FILE_CACHE_CHUNK) {
+        lock(file_cache_lock);
+        bool cached = __lookup_file_page(data, start) != NULL;
+        unsigned long gen = data->cache_gen;
+        unlock(file_cache_lock);
+
+        if (cached)
+            continue;
+
+        if (!*spare && !(*spare = system_malloc(FILE_CACHE_CHUNK)))
+            return;
+
+        PAL_NUM len = DkStreamRead(hdl->pal_handle, start, FILE_CACHE_CHUNK,
+                                   *spare, NULL, 0);
+        if (!len)
+            return;
+
+        lock(file_cache_lock);
+        struct shim_file_page * page;
+        if (data->cache_gen == gen && !__lookup_file_page(data, start) &&
+            (page = __get_file_page(data, start))) {
+            void * buf = page->buf;
+            page->buf = *spare;
+            page->len = len;
+            *spare = buf;
         }
+        unlock(file_cache_lock);
 
-        return 0;
+        if (len < FILE_CACHE_CHUNK)
+            return;
     }
-
-    return query_dentry(hdl->dentry, hdl->pal_handle, NULL, stat);
 }
 
-static int chroot_flush (struct shim_handle * hdl)
+static void readahead_helper (void * arg)
 {
-    struct shim_file_handle * file = &hdl->info.file;
+    struct shim_thread * self = (struct shim_thread *) arg;
+    if (!arg)
+        return;
 
-    if (file->buf_type == FILEBUF_MAP) {
-        lock(hdl->lock);
-        void * mapbuf = file->mapbuf;
-        int mapsize = file->mapsize;
-        file->mapoffset = 0;
-        file->mapbuf = NULL;
-        unlock(hdl->lock);
+    __libc_tcb_t tcb;
+    allocate_tls(&tcb, false, self);
+    debug_setbuf(&tcb.shim_tcb, true);
+    debug("readahead helper thread started\n");
 
-        if (mapbuf) {
-            DkStreamUnmap(mapbuf, mapsize);
+    PAL_HANDLE event = event_handle(&readahead_event);
+    void * spare = NULL;
 
-            if (bkeep_munmap(mapbuf, mapsize, VMA_INTERNAL) < 0)
-                bug();
-        }
-    }
+    while (true) {
+        lock(readahead_lock);
 
-    return 0;
-}
+        if (listp_empty(&readahead_list)) {
+            unlock(readahead_lock);
 
-static inline int __map_buffer (struct shim_handle * hdl, int size)
-{
-    struct shim_file_handle * file = &hdl->info.file;
+            if (DkObjectsWaitAny(1, &event, READAHEAD_IDLE_TIME)) {
+                clear_event(&readahead_event);
+                continue;
+            }
 
-    if (file->mapbuf) {
-        if (file->marker >= file->mapoffset &&
-            file->marker + size <= file->mapoffset + file->mapsize)
-            return 0;
+            /* walk away if nothing came in while waiting; the next request
+               creates another helper */
+            lock(readahead_lock);
+            if (listp_empty(&readahead_list)) {
+                readahead_thread = NULL;
+                unlock(readahead_lock);
+                break;
+            }
 
-        DkStreamUnmap(file->mapbuf, file->mapsize);
+            unlock(readahead_lock);
+            continue;
+        }
 
-        if (bkeep_munmap(file->mapbuf, file->mapsize, VMA_INTERNAL) < 0)
-            bug();
+        struct readahead_req * req =
+                listp_first_entry(&readahead_list, struct readahead_req, list);
+        listp_del(req, &readahead_list, list);
+        unlock(readahead_lock);
 
-        file->mapbuf    = NULL;
-        file->mapoffset = 0;
+        readahead_range(req, &spare);
+        put_handle(req->hdl);
+        free(req);
     }
 
-    /* second, reallocate the buffer */
-    uint64_t bufsize = file->mapsize ? : FILE_BUFMAP_SIZE;
-    uint64_t mapoff = file->marker & ~(bufsize - 1);
-    uint64_t maplen = bufsize;
-    int flags = MAP_FILE | MAP_PRIVATE | VMA_INTERNAL;
-    int prot = PROT_READ;
+    if (spare)
+        system_free(spare, FILE_CACHE_CHUNK);
 
-    if (hdl->acc_mode & MAY_WRITE) {
-        flags = MAP_FILE | MAP_SHARED | VMA_INTERNAL;
-        prot |= PROT_WRITE;
-    }
+    put_thread(self);
+    debug("readahead helper thread terminated\n");
+    flush_slab_magazine();
+    DkThreadExit();
+}
 
-    while (mapoff + maplen < file->marker + size)
-        maplen *= 2;
+/* queue a range to read ahead; a range that continues the last queued
+   one of the same handle is merged into it */
+static void readahead_async (struct shim_handle * hdl, uint64_t offset,
+                             uint64_t end)
+{
+    lock(readahead_lock);
+
+    if (!listp_empty(&readahead_list)) {
+        struct readahead_req * last =
+                listp_last_entry(&readahead_list, struct readahead_req, list);
+        if (last->hdl == hdl && last->end >= offset) {
+            if (last->end < end)
+                last->end = end;
+            goto out;
+        }
+    }
 
-    /* create the bookkeeping before allocating the memory */
-    void * mapbuf = bkeep_unmapped_any(maplen, prot, flags, hdl, mapoff,
-                                       "filebuf");
-    if (!mapbuf)
-        return -ENOMEM;
+    struct readahead_req * req = malloc(sizeof(struct readahead_req));
+    if (!req)
+        goto out;
 
-    PAL_PTR mapped = DkStreamMap(hdl->pal_handle, mapbuf, PAL_PROT(prot, flags),
-                                 mapoff, maplen);
+    get_handle(hdl);
+    req->hdl    = hdl;
+    req->offset = offset;
+    req->end    = end;
+    INIT_LIST_HEAD(req, list);
+    listp_add_tail(req, &readahead_list, list);
+
+    if (!readahead_thread) {
+        if (!event_created(&readahead_event))
+            create_event(&readahead_event);
+
+        enable_locking();
+
+        struct shim_thread * new = get_new_internal_thread();
+        PAL_HANDLE handle = new ? thread_create(readahead_helper, new, 0) :
+                            NULL;
+        if (!handle) {
+            if (new)
+                put_thread(new);
+            listp_del(req, &readahead_list, list);
+            put_handle(hdl);
+            free(req);
+            goto out;
+        }
 
-    if (!mapped) {
-        bkeep_munmap(mapbuf, maplen, flags);
-        return -PAL_ERRNO;
+        new->pal_handle = handle;
+        readahead_thread = new;
     }
 
-    assert((void *) mapped == mapbuf);
-
-    file->mapbuf    = mapbuf;
-    file->mapoffset = mapoff;
-    file->mapsize   = maplen;
-
-    return 0;
+out:
+    unlock(readahead_lock);
+    set_event(&readahead_event, 1);
 }
 
-static int map_read (struct shim_handle * hdl, void * buf, size_t count)
+/* detect the sequential reads of the handle, and read ahead of them in the
+   background, in a window that doubles on every sequential read up to the
+   readahead size of the mount. A new range is only queued once half of
+   the window has been consumed. hdl->lock needs to be held */
+static void __readahead (struct shim_handle * hdl, uint64_t offset,
+                         size_t count)
 {
     struct shim_file_handle * file = &hdl->info.file;
-    int ret = 0;
-    lock(hdl->lock);
-
-    struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
-    uint64_t size = atomic_read(&data->size);
-
-    if (check_version(hdl) &&
-        file->size < size)
-        file->size = size;
-
-    uint64_t marker = file->marker;
-
-    if (marker >= file->size) {
-        count = 0;
-        goto out;
+    struct mount_data * mdata = hdl->fs ? HANDLE_MOUNT_DATA(hdl) : NULL;
+    uint64_t max = mdata ? mdata->readahead : 0;
+    uint64_t end = offset + count;
+
+    /* the window should not take more than half of the cache */
+    long cache_max = file_cache_max;
+    if (cache_max >= 0 && max > cache_max * FILE_CACHE_CHUNK / 2)
+        max = cache_max * FILE_CACHE_CHUNK / 2;
+
+    if (!max || offset != file->ra_next) {
+        file->ra_next = end;
+        file->ra_end  = 0;
+        file->ra_size = 0;
+        return;
     }
 
-    if ((ret = __map_buffer(hdl, count)) < 0) {
-        unlock(hdl->lock);
-        return ret;
-    }
+    file->ra_next = end;
+    file->ra_size = file->ra_size ? file->ra_size * 2 : FILE_CACHE_CHUNK;
+    if (file->ra_size > max)
+        file->ra_size = max;
 
-    if (marker + count > file->size)
-        count = file->size - marker;
+    uint64_t ra_start = file->ra_end > end ? file->ra_end : end;
+    uint64_t ra_end = end + file->ra_size;
+    if (ra_end > file->size)
+        ra_end = file->size;
 
-    if (count) {
-        memcpy(buf, file->mapbuf + (marker - file->mapoffset), count);
-        file->marker = marker + count;
+    if (ra_end > ra_start &&
+        (ra_end - ra_start >= file->ra_size / 2 || ra_end == file->size)) {
+        readahead_async(hdl, ra_start, ra_end);
+        file->ra_end = ra_end;
     }
-
-out:
-    unlock(hdl->lock);
-    return count;
 }
 
-static int map_write (struct shim_handle * hdl, const void * buf,
-                      size_t count)
+static int chroot_hstat (struct shim_handle * hdl, struct stat * stat)
 {
-    struct shim_file_handle * file = &hdl->info.file;
-    int ret = 0;
+    int ret;
+    if (NEED_RECREATE(hdl) && (ret = chroot_recreate(hdl)) < 0)
+        return ret;
 
-    lock(hdl->lock);
+    if (!check_version(hdl) || !hdl->dentry) {
+        struct shim_file_handle * file = &hdl->info.file;
+        struct shim_dentry * dent = hdl->dentry;
+        struct mount_data * mdata = dent ? DENTRY_MOUNT_DATA(dent) : NULL;
 
-    struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
-    uint64_t marker = file->marker;
+        if (dent)
+            chroot_update_ino(dent);
 
-    if (file->marker + count > file->size) {
-        file->size = file->marker + count;
+        if (stat) {
+            memset(stat, 0, sizeof(struct stat));
+            stat->st_dev  = mdata ? (dev_t) mdata->ino_base : 0;
+            stat->st_ino  = dent ? (ino_t) dent->ino : 0;
+            stat->st_size = file->size;
+            stat->st_mode |= (file->buf_type == FILEBUF_CACHE) ? S_IFREG : S_IFCHR;
+        }
 
-        ret = DkStreamWrite(hdl->pal_handle, file->marker, count, (void *) buf, NULL);
+        return 0;
+    }
 
-        if (!ret) {
-            ret = -PAL_ERRNO;
-            goto out;
-        }
+    return query_dentry(hdl->dentry, hdl->pal_handle, NULL, stat);
+}
 
-        if (ret < count) {
-           file->size -= count - ret;
-        }
+static int chroot_flush (struct shim_handle * hdl)
+{
+    /* let the following reads see what has been written on the host
+       behind the cache, by other processes or by the host itself */
+    if (hdl->info.file.buf_type == FILEBUF_CACHE && FILE_HANDLE_DATA(hdl))
+        drop_file_pages(FILE_HANDLE_DATA(hdl), 0);
 
-        if (check_version(hdl)) {
-            uint64_t size;
-            do {
-                if ((size = atomic_read(&data->size)) >= file->size) {
-                    file->size = size;
-                    break;
-                }
-            } while (atomic_cmpxchg(&data->size, size, file->size) != size);
-        }
+    return 0;
+}
 
-        file->marker = marker + ret;
-        goto out;
-    }
+/* grow the size of the file after a write ends at the given offset; the
+   file size is used to bound the cached reads. hdl->lock needs to be
+   held */
+static void __update_size (struct shim_handle * hdl, uint64_t end)
+{
+    struct shim_file_handle * file = &hdl->info.file;
 
-    if ((ret = __map_buffer(hdl, count)) < 0)
-        goto out;
+    if (end <= file->size)
+        return;
 
+    file->size = end;
 
-    if (count) {
-        memcpy(file->mapbuf + (marker - file->mapoffset), buf, count);
-        file->marker = marker + count;
+    if (check_version(hdl)) {
+        struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
+        uint64_t size;
+        do {
+            if ((size = atomic_read(&data->size)) >= file->size) {
+                file->size = size;
+                break;
+            }
+        } while (atomic_cmpxchg(&data->size, size, file->size) != size);
     }
+}
 
-    ret = count;
-out:
-    unlock(hdl->lock);
-    return ret;
+static inline bool use_file_cache (struct shim_handle * hdl)
+{
+    return hdl->info.file.buf_type == FILEBUF_CACHE && check_version(hdl) &&
+           !FILE_HANDLE_DATA(hdl)->uncached;
 }
 
 static int chroot_read (struct shim_handle * hdl, void * buf,
@@ -792,24 +1292,34 @@ static int chroot_read (struct shim_handle * hdl, void * buf,
     }
 
     struct shim_file_handle * file = &hdl->info.file;
+    lock(hdl->lock);
 
-    if (file->buf_type == FILEBUF_MAP) {
-        ret = map_read(hdl, buf, count);
-        if (ret != -EACCES)
-            goto out;
+    if (use_file_cache(hdl)) {
+        uint64_t size = atomic_read(&FILE_HANDLE_DATA(hdl)->size);
+        if (file->size < size)
+            file->size = size;
 
-        lock(hdl->lock);
-        file->buf_type = FILEBUF_NONE;
-    } else {
-        lock(hdl->lock);
+        if (file->marker >= file->size)
+            goto out_unlock;
+
+        if (count > file->size - file->marker)
+            count = file->size - file->marker;
+
+        ret = file_cache_read(hdl, buf, count, file->marker);
+        if (ret > 0)
+            __readahead(hdl, file->marker, ret);
+        if (ret != -ENOMEM)
+            goto done;
     }
 
     ret = DkStreamRead(hdl->pal_handle, file->marker, count, buf, NULL, 0) ? :
            (PAL_NATIVE_ERRNO == PAL_ERROR_ENDOFSTREAM ? 0 : -PAL_ERRNO);
 
+done:
     if (ret > 0)
         file->marker += ret;
 
+out_unlock:
     unlock(hdl->lock);
 out:
     return ret;
@@ -833,28 +1343,111 @@ static int chroot_write (struct shim_handle * hdl, const void * buf,
     }
 
     struct shim_file_handle * file = &hdl->info.file;
-
-    if (hdl->info.file.buf_type == FILEBUF_MAP) {
-        ret = map_write(hdl, buf, count);
-        if (ret != -EACCES)
-            goto out;
-
-        lock(hdl->lock);
-        file->buf_type = FILEBUF_NONE;
-    } else {
-        lock(hdl->lock);
-    }
+    lock(hdl->lock);
 
     ret = DkStreamWrite(hdl->pal_handle, file->marker, count, (void *) buf, NULL) ? :
           -PAL_ERRNO;
 
-    if (ret > 0)
+    if (ret > 0) {
+        if (file->buf_type == FILEBUF_CACHE) {
+            if (check_version(hdl))
+                file_cache_write(FILE_HANDLE_DATA(hdl), buf, ret,
+                                 file->marker);
+            __update_size(hdl, file->marker + ret);
+        }
+
         file->marker += ret;
+    }
+
+    unlock(hdl->lock);
+out:
+    return ret;
+
+}
+
+/* readv and writev go to the PAL stream in one call, at the marker or at
+   the given offset. The file cache is write-through, so the reads can
+   bypass it. */
+static int chroot_readv (struct shim_handle * hdl, const struct iovec * iov,
+                         int iovcnt, off_t * offset)
+{
+    int ret = 0;
+
+    if (!iov_length(iov, iovcnt))
+        goto out;
+
+    if (NEED_RECREATE(hdl) && (ret = chroot_recreate(hdl)) < 0)
+        goto out;
+
+    if (!(hdl->acc_mode & MAY_READ)) {
+        ret = -EBADF;
+        goto out;
+    }
+
+    struct shim_file_handle * file = &hdl->info.file;
+    lock(hdl->lock);
+
+    uint64_t marker = offset ? *offset : file->marker;
+
+    ret = DkStreamReadv(hdl->pal_handle, marker, iovcnt, (PAL_IOVEC *) iov,
+                        NULL, 0) ? :
+          (PAL_NATIVE_ERRNO == PAL_ERROR_ENDOFSTREAM ? 0 : -PAL_ERRNO);
+
+    if (ret > 0 && !offset)
+        file->marker = marker + ret;
 
     unlock(hdl->lock);
 out:
     return ret;
+}
+
+static int chroot_writev (struct shim_handle * hdl, const struct iovec * iov,
+                          int iovcnt, off_t * offset)
+{
+    int ret = 0;
+
+    if (!iov_length(iov, iovcnt))
+        goto out;
+
+    if (NEED_RECREATE(hdl) && (ret = chroot_recreate(hdl)) < 0)
+        goto out;
+
+    if (!(hdl->acc_mode & MAY_WRITE)) {
+        ret = -EBADF;
+        goto out;
+    }
+
+    struct shim_file_handle * file = &hdl->info.file;
+    lock(hdl->lock);
+
+    uint64_t marker = offset ? *offset : file->marker;
+
+    ret = DkStreamWritev(hdl->pal_handle, marker, iovcnt, (PAL_IOVEC *) iov,
+                         NULL) ? : -PAL_ERRNO;
+
+    if (ret > 0) {
+        if (!offset)
+            file->marker = marker + ret;
+
+        if (file->buf_type == FILEBUF_CACHE) {
+            if (check_version(hdl)) {
+                uint64_t pos = marker;
+                for (int i = 0 ; i < iovcnt && pos < marker + ret ; i++) {
+                    size_t len = iov[i].iov_len;
+                    if (len > marker + ret - pos)
+                        len = marker + ret - pos;
+                    file_cache_write(FILE_HANDLE_DATA(hdl), iov[i].iov_base,
+                                     len, pos);
+                    pos += len;
+                }
+            }
+            __update_size(hdl, marker + ret);
+        }
+    }
 
+    unlock(hdl->lock);
+out:
+    return ret;
 }
 
 static int chroot_mmap (struct shim_handle * hdl, void ** addr, size_t size,
@@ -879,6 +1472,15 @@ static int chroot_mmap (struct shim_handle * hdl, void ** addr, size_t size,
     if (!alloc_addr)
         return -PAL_ERRNO;
 
+    /* stores to a shared, writable mapping go straight to the host file,
+       behind the cache, so the file is no longer cached from now on */
+    if ((prot & PROT_WRITE) && !(flags & MAP_PRIVATE) &&
+        hdl->info.file.buf_type == FILEBUF_CACHE && check_version(hdl)) {
+        struct shim_file_data * data = FILE_HANDLE_DATA(hdl);
+        data->uncached = true;
+        drop_file_pages(data, 0);
+    }
+
     *addr = alloc_addr;
     return 0;
 }
@@ -951,6 +1553,9 @@ static int chroot_truncate (struct shim_handle * hdl, uint64_t len)
         goto out;
     }
 
+    if (check_version(hdl))
+        drop_file_pages(FILE_HANDLE_DATA(hdl), len);
+
     // DEP 10/25/16: Truncate returns 0 on success, not the length
     ret = 0;
 
@@ -991,7 +1596,7 @@ static int chroot_readdir (struct shim_dentry * dent,
     if (!pal_hdl)
         return -PAL_ERRNO;
 
-    size_t buf_size = MAX_PATH, bytes = 0;
+    size_t buf_size = MAX_PATH * 4, bytes = 0;
     char * buf = malloc(buf_size);
     if (!buf) {
         ret = -ENOMEM;
@@ -999,39 +1604,51 @@ static int chroot_readdir (struct shim_dentry * dent,
     }
 
     /*
-     * Try to read the directory list from the host. DkStreamRead
-     * does not accept offset for directory listing. Therefore, we retry
-     * several times if the buffer is not large enough.
+     * Read the whole directory list from the host. DkStreamRead does not
+     * accept offset for directory listing, but continues where the last
+     * read stopped. The buffer grows whenever it has no room left for
+     * the next name.
      */
-retry_read:
-    bytes = DkStreamRead(pal_hdl, 0, buf_size, buf, NULL, 0);
-    if (!bytes) {
-        ret = 0;
-        if (PAL_NATIVE_ERRNO == PAL_ERROR_ENDOFSTREAM)
-            goto out;
-
-        if (PAL_NATIVE_ERRNO == PAL_ERROR_OVERFLOW) {
+    while (true) {
+        if (buf_size - bytes < MAX_PATH) {
             char * new_buf = malloc(buf_size * 2);
             if (!new_buf) {
                 ret = -ENOMEM;
                 goto out;
             }
 
+            memcpy(new_buf, buf, bytes);
             free(buf);
             buf_size *= 2;
             buf = new_buf;
-            goto retry_read;
         }
 
-        ret = -PAL_ERRNO;
-        goto out;
+        PAL_NUM nread = DkStreamRead(pal_hdl, 0, buf_size - bytes,
+                                     buf + bytes, NULL, 0);
+        if (!nread) {
+            if (PAL_NATIVE_ERRNO == PAL_ERROR_ENDOFSTREAM)
+                break;
+
+            /* there is always room for a name of MAX_PATH */
+            ret = PAL_NATIVE_ERRNO == PAL_ERROR_OVERFLOW ? -ENAMETOOLONG :
+                  -PAL_ERRNO;
+            goto out;
+        }
+
+        bytes += nread;
     }
 
+    ret = 0;
+    if (!bytes)
+        goto out;
+
     /* Now emitting the dirent data */
     size_t dbuf_size = MAX_PATH;
     struct shim_dirent * dbuf = malloc(dbuf_size);
-    if (!dbuf)
+    if (!dbuf) {
+        ret = -ENOMEM;
         goto out;
+    }
 
     struct shim_dirent * d = dbuf, ** last = NULL;
     char * b = buf, * next_b;
@@ -1087,7 +1704,9 @@ retry_read:
 
         d->next = (void *) (d + 1) + blen + 1;
         d->ino = hash;
-        d->type = isdir ? LINUX_DT_DIR : LINUX_DT_REG;
+        /* the PAL only marks directories: anything else may as well be
+           a link, and is looked up when it is used */
+        d->type = isdir ? LINUX_DT_DIR : LINUX_DT_UNKNOWN;
         memcpy(d->name, b, blen + 1);
 
         b = next_b;
@@ -1126,9 +1745,6 @@ static int chroot_checkout (struct shim_handle * hdl)
             hdl->pal_handle = NULL;
     }
 
-    hdl->info.file.mapsize = 0;
-    hdl->info.file.mapoffset = 0;
-    hdl->info.file.mapbuf = NULL;
     return 0;
 }
 
@@ -1176,15 +1792,9 @@ static int chroot_unlink (struct shim_dentry * dir, struct shim_dentry * dent)
 
     atomic_inc(&data->version);
     atomic_set(&data->size, 0);
+    drop_file_pages(data, 0);
 
-    /* Drop the parent's link count */
-    struct shim_file_data *parent_data = FILE_DENTRY_DATA(dir);
-    if (parent_data) {
-        lock(parent_data->lock);
-        if (parent_data->queried)
-            parent_data->nlink--;
-        unlock(parent_data->lock);
-    }
+    invalidate_dir_attr(dir);
 
     return 0;
 }
@@ -1210,7 +1820,7 @@ static int chroot_poll (struct shim_handle * hdl, int poll_type)
 
     int marker = file->marker;
 
-    if (file->buf_type == FILEBUF_MAP) {
+    if (file->buf_type == FILEBUF_CACHE) {
         ret = poll_type & FS_POLL_WR;
         if ((poll_type & FS_POLL_RD) && file->size > marker)
             ret |= FS_POLL_RD;
@@ -1254,7 +1864,13 @@ static int chroot_rename (struct shim_dentry * old, struct shim_dentry * new)
 
     atomic_inc(&old_data->version);
     atomic_set(&old_data->size, 0);
+    drop_file_pages(old_data, 0);
     atomic_inc(&new_data->version);
+    drop_file_pages(new_data, 0);
+
+    invalidate_dir_attr(old->parent);
+    if (new->parent != old->parent)
+        invalidate_dir_attr(new->parent);
 
     return 0;
 }
@@ -1287,9 +1903,10 @@ struct shim_fs_ops chroot_fs_ops = {
         .mount       = &chroot_mount,
         .unmount     = &chroot_unmount,
         .flush       = &chroot_flush,
-        .close       = &chroot_flush,
         .read        = &chroot_read,
         .write       = &chroot_write,
+        .readv       = &chroot_readv,
+        .writev      = &chroot_writev,
         .mmap        = &chroot_mmap,
         .seek        = &chroot_seek,
         .hstat       = &chroot_hstat,
@@ -1304,6 +1921,7 @@ struct shim_d_ops chroot_d_ops = {
         .open       = &chroot_open,
         .mode       = &chroot_mode,
         .lookup     = &chroot_lookup,
+        .revalidate = &chroot_revalidate,
         .creat      = &chroot_creat,
         .mkdir      = &chroot_mkdir,
         .stat       = &chroot_stat,
@@ -1314,7 +1932,9 @@ struct shim_d_ops chroot_d_ops = {
         .chmod      = &chroot_chmod,
     };
 
-struct mount_data chroot_data = { .root_uri_len = 5,
+struct mount_data chroot_data = { .readahead = DEFAULT_READAHEAD_SIZE,
+                                  .revalidate = REVALIDATE_NEVER,
+                                  .root_uri_len = 5,
                                   .root_uri = "file:", };
 
 struct shim_mount chroot_builtin_fs = { .type   = "chroot",
@@ -43,8 +43,340 @@
 #include <asm/unistd.h>
 #include <asm/prctl.h>
 #include <asm/fcntl.h>
+#include <linux/limits.h>
 #include <shim_profile.h>
 
+/*
+ * While both ends of a pipe are in the current process, the data goes
+ * through a ring buffer in the LibOS, without calling into the host. The
+ * host pipe is still created, and is used as a doorbell: it holds a single
+ * byte whenever the ring has data for the reader (or the writer has
+ * closed), so that a blocked reader, poll and epoll can wait on the PAL
+ * handle of the read end as before. A blocked writer waits on a PAL event
+ * for the reader to make room.
+ *
+ * When an end is checkpointed into another process (fork, execve), the
+ * ring is promoted: the doorbell byte is taken out, the buffered data is
+ * written into the host pipe, and both ends use the host pipe from then on.
+ * The ring is no larger than the host pipe buffer, so that promotion never
+ * blocks.
+ *
+ * The write end of the host pipe is always writable, so poll and epoll may
+ * report a write end as writable while the ring is full.
+ */
+
+#define PIPE_RING_SIZE      32768
+
+struct shim_pipe_ring {
+    LOCKTYPE                lock;
+    REFTYPE                 ref_count;  /* one for each end */
+    struct shim_handle *    reader;     /* NULL once closed */
+    /* the writer is held until the reader is closed or the ring is
+       promoted, to write the doorbell and the buffered data */
+    struct shim_handle *    writer;
+    bool                    writer_closed;
+    bool                    promoted;
+    bool                    signaled;   /* the doorbell byte is in the pipe */
+    int                     writers_waiting;
+    PAL_HANDLE              space;      /* set when the reader made room */
+    uint64_t                head, tail; /* read and write positions */
+    char                    buf[PIPE_RING_SIZE];
+};
+
+static inline struct shim_pipe_ring * get_ring (struct shim_handle * hdl)
+{
+    return hdl->type == TYPE_PIPE ? hdl->info.pipe.ring : NULL;
+}
+
+bool pipe_in_ring (struct shim_handle * hdl)
+{
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    return ring && !ring->promoted;
+}
+
+int create_pipe_ring (struct shim_handle * rd, struct shim_handle * wr)
+{
+    struct shim_pipe_ring * ring = malloc(sizeof(struct shim_pipe_ring));
+    if (!ring)
+        return -ENOMEM;
+
+    ring->space = DkNotificationEventCreate(PAL_FALSE);
+    if (!ring->space) {
+        free(ring);
+        return -PAL_ERRNO;
+    }
+
+    create_lock(ring->lock);
+    REF_SET(ring->ref_count, 2);
+    get_handle(wr);
+    ring->reader = rd;
+    ring->writer = wr;
+    ring->writer_closed = false;
+    ring->promoted = false;
+    ring->signaled = false;
+    ring->writers_waiting = 0;
+    ring->head = ring->tail = 0;
+
+    rd->info.pipe.ring = ring;
+    wr->info.pipe.ring = ring;
+    return 0;
+}
+
+static void put_ring (struct shim_pipe_ring * ring)
+{
+    if (REF_DEC(ring->ref_count))
+        return;
+
+    DkObjectClose(ring->space);
+    destroy_lock(ring->lock);
+    free(ring);
+}
+
+/* The doorbell byte is written and taken out with the ring locked, so it
+   is in the host pipe exactly when signaled is set. */
+static void __ring_signal (struct shim_pipe_ring * ring)
+{
+    char byte = 0;
+
+    if (!ring->signaled && ring->reader && ring->writer &&
+        DkStreamWrite(ring->writer->pal_handle, 0, 1, &byte, NULL))
+        ring->signaled = true;
+}
+
+static void __ring_unsignal (struct shim_pipe_ring * ring)
+{
+    char byte;
+
+    if (ring->signaled && ring->reader &&
+        DkStreamRead(ring->reader->pal_handle, 0, 1, &byte, NULL, 0))
+        ring->signaled = false;
+}
+
+static void __ring_wake_writers (struct shim_pipe_ring * ring)
+{
+    if (ring->writers_waiting) {
+        ring->writers_waiting = 0;
+        DkEventSet(ring->space);
+    }
+}
+
+/* Returns the writer to put, if the ring no longer needs it. */
+static struct shim_handle * __ring_promote (struct shim_pipe_ring * ring)
+{
+    if (ring->promoted)
+        return NULL;
+
+    ring->promoted = true;
+    __ring_unsignal(ring);
+
+    while (ring->reader && ring->writer && ring->head != ring->tail) {
+        uint64_t off = ring->head % PIPE_RING_SIZE;
+        uint64_t bytes = ring->tail - ring->head;
+
+        if (bytes > PIPE_RING_SIZE - off)
+            bytes = PIPE_RING_SIZE - off;
+
+        bytes = DkStreamWrite(ring->writer->pal_handle, 0, bytes,
+                              ring->buf + off, NULL);
+        if (!bytes) {
+            debug("pipe data lost in promotion (%d)\n", PAL_NATIVE_ERRNO);
+            break;
+        }
+
+        ring->head += bytes;
+    }
+
+    __ring_wake_writers(ring);
+
+    struct shim_handle * writer = ring->writer;
+    ring->writer = NULL;
+    return writer;
+}
+
+/* Close one end of the ring; the host pipe is closed with the handle. */
+static void ring_detach (struct shim_handle * hdl, struct shim_pipe_ring * ring)
+{
+    struct shim_handle * writer = NULL;
+
+    lock(ring->lock);
+
+    if (ring->reader == hdl) {
+        ring->reader = NULL;
+        ring->signaled = false;
+        writer = ring->writer;
+        ring->writer = NULL;
+        __ring_wake_writers(ring);
+    } else if ((hdl->acc_mode & MAY_WRITE) && !ring->writer_closed) {
+        /* the reader sees the end of the pipe once the ring is drained */
+        ring->writer_closed = true;
+        if (!ring->promoted)
+            __ring_signal(ring);
+    }
+
+    unlock(ring->lock);
+
+    if (writer)
+        put_handle(writer);
+}
+
+/* Copy between the ring and an iovec, skipping done bytes of the iovec. */
+static uint64_t ring_copy (struct shim_pipe_ring * ring, uint64_t pos,
+                           const struct iovec * iov, int iovcnt,
+                           size_t done, uint64_t bytes, bool out)
+{
+    uint64_t copied = 0;
+
+    for (int i = 0 ; i < iovcnt && copied < bytes ; i++) {
+        if (done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
+            continue;
+        }
+
+        char * ptr = iov[i].iov_base + done;
+        uint64_t len = iov[i].iov_len - done;
+        done = 0;
+
+        if (len > bytes - copied)
+            len = bytes - copied;
+
+        while (len) {
+            uint64_t off = (pos + copied) % PIPE_RING_SIZE;
+            uint64_t chunk = len < PIPE_RING_SIZE - off ?
+                             len : PIPE_RING_SIZE - off;
+
+            if (out)
+                memcpy(ptr, ring->buf + off, chunk);
+            else
+                memcpy(ring->buf + off, ptr, chunk);
+
+            ptr += chunk;
+            len -= chunk;
+            copied += chunk;
+        }
+    }
+
+    return copied;
+}
+
+/* Returns false if the ring is promoted, to go through the host pipe. */
+static bool ring_read (struct shim_handle * hdl, struct shim_pipe_ring * ring,
+                       const struct iovec * iov, int iovcnt, size_t count,
+                       int * ret)
+{
+    lock(ring->lock);
+
+    while (!ring->promoted) {
+        uint64_t bytes = ring->tail - ring->head;
+
+        if (bytes) {
+            if (bytes > count)
+                bytes = count;
+
+            ring->head += ring_copy(ring, ring->head, iov, iovcnt, 0, bytes,
+                                    true);
+
+            if (ring->head == ring->tail && !ring->writer_closed)
+                __ring_unsignal(ring);
+
+            __ring_wake_writers(ring);
+            *ret = bytes;
+            goto out;
+        }
+
+        if (ring->writer_closed) {
+            *ret = 0;
+            goto out;
+        }
+
+        if (hdl->flags & O_NONBLOCK) {
+            *ret = -EAGAIN;
+            goto out;
+        }
+
+        /* wait for the doorbell */
+        unlock(ring->lock);
+
+        if (!DkObjectsWaitAny(1, &hdl->pal_handle, NO_TIMEOUT)) {
+            *ret = -PAL_ERRNO;
+            return true;
+        }
+
+        lock(ring->lock);
+    }
+
+    unlock(ring->lock);
+    return false;
+out:
+    unlock(ring->lock);
+    return true;
+}
+
+static bool ring_write (struct shim_handle * hdl,
+                        struct shim_pipe_ring * ring,
+                        const struct iovec * iov, int iovcnt, size_t count,
+                        int * ret)
+{
+    size_t written = 0;
+
+    lock(ring->lock);
+
+    while (!ring->promoted) {
+        if (!ring->reader) {
+            *ret = written ? : -EPIPE;
+            goto out;
+        }
+
+        uint64_t space = PIPE_RING_SIZE - (ring->tail - ring->head);
+
+        /* writes of up to PIPE_BUF bytes are not interleaved */
+        if (space && (count > PIPE_BUF || space >= count - written)) {
+            uint64_t bytes = count - written;
+            if (bytes > space)
+                bytes = space;
+
+            ring->tail += ring_copy(ring, ring->tail, iov, iovcnt, written,
+                                    bytes, false);
+            written += bytes;
+            __ring_signal(ring);
+
+            if (written == count) {
+                *ret = written;
+                goto out;
+            }
+        }
+
+        if (hdl->flags & O_NONBLOCK) {
+            *ret = written ? : -EAGAIN;
+            goto out;
+        }
+
+        /* wait for the reader to make room */
+        ring->writers_waiting++;
+        DkEventClear(ring->space);
+        unlock(ring->lock);
+
+        if (!DkObjectsWaitAny(1, &ring->space, NO_TIMEOUT)) {
+            *ret = written ? : -PAL_ERRNO;
+            return true;
+        }
+
+        lock(ring->lock);
+    }
+
+    unlock(ring->lock);
+
+    /* the rest goes through the host pipe */
+    if (written) {
+        *ret = written;
+        return true;
+    }
+
+    return false;
+out:
+    unlock(ring->lock);
+    return true;
+}
+
 static int pipe_read (struct shim_handle * hdl, void * buf,
                       size_t count)
 {
@@ -53,6 +385,13 @@ static int pipe_read (struct shim_handle * hdl, void * buf,
     if (!count)
         goto out;
 
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring) {
+        struct iovec iov = { .iov_base = buf, .iov_len = count };
+        if (ring_read(hdl, ring, &iov, 1, count, &rv))
+            goto out;
+    }
+
     rv = DkStreamRead(hdl->pal_handle, 0, count, buf, NULL, 0) ? :
          -PAL_ERRNO;
 out:
@@ -65,6 +404,14 @@ static int pipe_write (struct shim_handle * hdl, const void * buf,
     if (!count)
         return 0;
 
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring) {
+        struct iovec iov = { .iov_base = (void *) buf, .iov_len = count };
+        int ret;
+        if (ring_write(hdl, ring, &iov, 1, count, &ret))
+            return ret;
+    }
+
     int bytes = DkStreamWrite(hdl->pal_handle, 0, count, (void *) buf, NULL);
 
     if (!bytes)
@@ -73,6 +420,53 @@ static int pipe_write (struct shim_handle * hdl, const void * buf,
     return bytes;
 }
 
+static int pipe_readv (struct shim_handle * hdl, const struct iovec * iov,
+                       int iovcnt, off_t * offset)
+{
+    if (offset)
+        return -ESPIPE;
+
+    size_t count = iov_length(iov, iovcnt);
+    if (!count)
+        return 0;
+
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring) {
+        int ret;
+        if (ring_read(hdl, ring, iov, iovcnt, count, &ret))
+            return ret;
+    }
+
+    return DkStreamReadv(hdl->pal_handle, 0, iovcnt, (PAL_IOVEC *) iov,
+                         NULL, 0) ? : -PAL_ERRNO;
+}
+
+static int pipe_writev (struct shim_handle * hdl, const struct iovec * iov,
+                        int iovcnt, off_t * offset)
+{
+    if (offset)
+        return -ESPIPE;
+
+    size_t count = iov_length(iov, iovcnt);
+    if (!count)
+        return 0;
+
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring) {
+        int ret;
+        if (ring_write(hdl, ring, iov, iovcnt, count, &ret))
+            return ret;
+    }
+
+    int bytes = DkStreamWritev(hdl->pal_handle, 0, iovcnt, (PAL_IOVEC *) iov,
+                               NULL);
+
+    if (!bytes)
+        return -PAL_ERRNO;
+
+    return bytes;
+}
+
 static int pipe_hstat (struct shim_handle * hdl, struct stat * stat)
 {
     if (!stat)
@@ -97,14 +491,49 @@ static int pipe_hstat (struct shim_handle * hdl, struct stat * stat)
     return 0;
 }
 
+static int pipe_close (struct shim_handle * hdl)
+{
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring)
+        ring_detach(hdl, ring);
+    return 0;
+}
+
+static void pipe_hput (struct shim_handle * hdl)
+{
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (!ring)
+        return;
+
+    /* in case the handle was never installed */
+    ring_detach(hdl, ring);
+    hdl->info.pipe.ring = NULL;
+    put_ring(ring);
+}
+
 static int pipe_checkout (struct shim_handle * hdl)
 {
+    /* hdl is the copy in the checkpoint, which shares the ring with the
+       handle of this process until the ring is promoted */
+    struct shim_pipe_ring * ring = get_ring(hdl);
+    if (ring) {
+        lock(ring->lock);
+        struct shim_handle * writer = __ring_promote(ring);
+        unlock(ring->lock);
+
+        if (writer)
+            put_handle(writer);
+
+        hdl->info.pipe.ring = NULL;
+    }
+
     hdl->fs = NULL;
     return 0;
 }
 
 static int pipe_poll (struct shim_handle * hdl, int poll_type)
 {
+    struct shim_pipe_ring * ring = get_ring(hdl);
     int ret = 0;
 
     lock(hdl->lock);
@@ -114,6 +543,33 @@ static int pipe_poll (struct shim_handle * hdl, int poll_type)
         goto out;
     }
 
+    if (ring) {
+        lock(ring->lock);
+
+        if (!ring->promoted) {
+            uint64_t bytes = ring->tail - ring->head;
+
+            if (poll_type == FS_POLL_SZ) {
+                ret = bytes;
+            } else {
+                if ((poll_type & FS_POLL_RD) &&
+                    (bytes || ring->writer_closed))
+                    ret |= FS_POLL_RD;
+                if (poll_type & FS_POLL_WR) {
+                    if (!ring->reader)
+                        ret |= FS_POLL_ER;
+                    else if (bytes < PIPE_RING_SIZE)
+                        ret |= FS_POLL_WR;
+                }
+            }
+
+            unlock(ring->lock);
+            goto out;
+        }
+
+        unlock(ring->lock);
+    }
+
     PAL_STREAM_ATTR attr;
     if (!DkStreamAttributesQuerybyHandle(hdl->pal_handle, &attr)) {
         ret = -PAL_ERRNO;
@@ -167,9 +623,13 @@ static int pipe_setflags (struct shim_handle * hdl, int flags)
 }
 
 struct shim_fs_ops pipe_fs_ops = {
+        .close      = &pipe_close,
         .read       = &pipe_read,
         .write      = &pipe_write,
+        .readv      = &pipe_readv,
+        .writev     = &pipe_writev,
         .hstat      = &pipe_hstat,
+        .hput       = &pipe_hput,
         .checkout   = &pipe_checkout,
         .poll       = &pipe_poll,
         .setflags   = &pipe_setflags,
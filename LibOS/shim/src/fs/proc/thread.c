@@ -252,12 +252,12 @@ static int parse_thread_fd (const char * name, const char ** rest,
 
     struct shim_handle_map * handle_map = get_cur_handle_map(thread);
 
-    lock(handle_map->lock);
+    read_lock(handle_map->lock);
 
     if (fd >= handle_map->fd_top ||
         handle_map->map[fd] == NULL ||
         handle_map->map[fd]->handle == NULL) {
-        unlock(handle_map->lock);
+        read_unlock(handle_map->lock);
         return -ENOENT;
     }
 
@@ -266,7 +266,7 @@ static int parse_thread_fd (const char * name, const char ** rest,
         get_handle(*phdl);
     }
 
-    unlock(handle_map->lock);
+    read_unlock(handle_map->lock);
 
     if (rest)
         *rest = *p ? p + 1 : NULL;
@@ -300,7 +300,7 @@ static int proc_list_thread_each_fd (const char * name,
     int err = 0, bytes = 0;
     struct shim_dirent * dirent = *buf, ** last = NULL;
 
-    lock(handle_map->lock);
+    read_lock(handle_map->lock);
 
     for (int i = 0 ; i < handle_map->fd_size ; i++)
         if (handle_map->map[i] &&
@@ -326,7 +326,7 @@ static int proc_list_thread_each_fd (const char * name,
             dirent = dirent->next;
         }
 
-    unlock(handle_map->lock);
+    read_unlock(handle_map->lock);
     put_thread(thread);
 
     if (last)
@@ -51,6 +51,125 @@ HASHTYPE hash_dentry (struct shim_dentry * start, const char * path, int len)
                        path, len, NULL);
 }
 
+/*
+ * The dentries linked to a parent are also kept in a global hash table,
+ * keyed by the parent and the name, so looking up a name does not walk the
+ * children of the parent. The table doubles once it holds more than
+ * DCACHE_HASH_LOAD dentries per bucket.
+ *
+ * The table is only changed with dcache_lock held, and every change is
+ * bracketed by incrementing dcache_seq, so the sequence number is odd
+ * while the table is inconsistent. This lets the path walk look up the
+ * dcache without the lock, and retry with the lock if the table changed
+ * underneath. The dentries are never unmapped (they come from a memory
+ * manager), and the old tables are not freed after a resize either, so a
+ * lockless reader never faults on stale pointers; the tables grow
+ * geometrically, so the old ones take less space than the current one.
+ */
+#define DCACHE_HASH_LOAD    2
+
+struct dcache_table {
+    size_t                  size;
+    LISTP_TYPE(shim_dentry) buckets[];
+};
+
+static struct dcache_table * dcache_table = NULL;
+static size_t dcache_count = 0;
+static unsigned long dcache_seq = 0;
+
+static inline LISTP_TYPE(shim_dentry) *
+dcache_bucket (struct dcache_table * table, struct shim_dentry * parent,
+               HASHTYPE hash)
+{
+    return &table->buckets[(hash ^ ((unsigned long) parent >> 4)) &
+                           (table->size - 1)];
+}
+
+static inline void dcache_write_begin (void)
+{
+    dcache_seq++;
+    wmb();
+}
+
+static inline void dcache_write_end (void)
+{
+    wmb();
+    dcache_seq++;
+}
+
+unsigned long dcache_read_begin (void)
+{
+    unsigned long seq = *(volatile unsigned long *) &dcache_seq;
+    rmb();
+    return seq;
+}
+
+bool dcache_read_retry (unsigned long seq)
+{
+    rmb();
+    return *(volatile unsigned long *) &dcache_seq != seq;
+}
+
+static struct dcache_table * alloc_dcache_table (size_t size)
+{
+    struct dcache_table * table =
+            malloc(sizeof(struct dcache_table) +
+                   sizeof(LISTP_TYPE(shim_dentry)) * size);
+    if (!table)
+        return NULL;
+
+    table->size = size;
+    for (size_t i = 0 ; i < size ; i++)
+        INIT_LISTP(&table->buckets[i]);
+    return table;
+}
+
+/* dcache_lock and the write side of dcache_seq need to be held */
+static void __resize_dcache (void)
+{
+    struct dcache_table * old = dcache_table;
+    struct dcache_table * new = alloc_dcache_table(old->size * 2);
+    if (!new)
+        return;
+
+    for (size_t i = 0 ; i < old->size ; i++) {
+        struct shim_dentry * dent, * n;
+        listp_for_each_entry_safe(dent, n, &old->buckets[i], hlist) {
+            listp_del_init(dent, &old->buckets[i], hlist);
+            listp_add(dent, dcache_bucket(new, dent->parent, dent->name.hash),
+                      hlist);
+        }
+    }
+
+    dcache_table = new;
+}
+
+/* dcache_lock needs to be held */
+static void __add_dcache (struct shim_dentry * dent)
+{
+    dent->name.hash = rehash_name(0, qstrgetstr(&dent->name), dent->name.len);
+
+    dcache_write_begin();
+    if (++dcache_count > dcache_table->size * DCACHE_HASH_LOAD)
+        __resize_dcache();
+    listp_add(dent, dcache_bucket(dcache_table, dent->parent, dent->name.hash),
+              hlist);
+    dcache_write_end();
+}
+
+/* dcache_lock needs to be held */
+static void __del_dcache (struct shim_dentry * dent)
+{
+    if (list_empty(dent, hlist))
+        return;
+
+    dcache_write_begin();
+    listp_del_init(dent, dcache_bucket(dcache_table, dent->parent,
+                                       dent->name.hash), hlist);
+    dcache_count--;
+    dcache_write_end();
+}
+
 static struct shim_dentry * alloc_dentry (void)
 {
     struct shim_dentry * dent =
@@ -79,6 +198,10 @@ int init_dcache (void)
 
     create_lock(dcache_lock);
 
+    dcache_table = alloc_dcache_table(DCACHE_HASH_SIZE);
+    if (!dcache_table)
+        return -ENOMEM;
+
     dentry_root = alloc_dentry();
 
     /* The root is special; we assume it won't change or be freed, and 
@@ -198,6 +321,7 @@ struct shim_dentry * get_new_dentry (struct shim_mount *mount,
         listp_add_tail(dent, &parent->children, siblings);
         dent->parent = parent;
         parent->nchildren++;
+        __add_dcache(dent);
 
         if (!qstrempty(&parent->rel_path)) {
             const char * strs[] = { qstrgetstr(&parent->rel_path), "/", name };
@@ -231,52 +355,39 @@ struct shim_dentry *
 __lookup_dcache (struct shim_dentry * start, const char * name, int namelen,
                  const char * path, int pathlen, HASHTYPE * hashptr) {
 
-    /* In this implementation, we just look at the children 
-     * under the parent and see if there are matches.  It so,
-     * return it; if not, don't.  
-     * 
-     * To minimize disruption (and possibly for future optimization)
-     * we are keeping hashes, so let's start with that for a marginally
-     * faster comparison 
+    /* The children of all the directories are in the global hash table,
+     * keyed by the parent and the name, so a lookup only walks one bucket.
+     * We assume a parent has children with unique names.
      */
-    HASHTYPE hash = hash_dentry(start, name, namelen);
     struct shim_dentry *dent, *found = NULL;
 
     /* If start is NULL, there will be no hit in the cache.
      * This mainly happens when boostrapping; in general, we assume the 
      * caller will use the current root or cwd.
      */
-    if (!start) return NULL;
+    if (!start) goto out;
 
     /* If we are looking up an empty string, return start */
     if (namelen == 0) {
         found = start;
         goto out;
     }
-    
-    listp_for_each_entry(dent, &start->children, siblings) {
-        /* DEP 6/20/XX: The old code skipped mountpoints; I don't see any good
-         * reason for mount point lookup to fail, at least in this code.
-         * Keeping a note just in case.  That is why you always leave a note.
-         */
-        //if (dent->state & DENTRY_MOUNTPOINT)
-        //continue;
 
+    const char * filename = get_file_name(name, namelen);
+    int fname_len = name + namelen - filename;
+    HASHTYPE hash = rehash_name(0, filename, fname_len);
+
+    listp_for_each_entry(dent, dcache_bucket(dcache_table, start, hash),
+                         hlist) {
         // Check for memory corruption
         assert(0 == (dent->state & DENTRY_INVALID_FLAGS));
-        
+
         /* Compare the hash first */
-        if (dent->rel_path.hash != hash)
+        if (dent->parent != start || dent->name.hash != hash)
             continue;
 
-        /* I think comparing the relative path is adequate; with a global 
-         * hash table, a full path comparison may be needed, but I think 
-         * we can assume a parent has children with unique names */
-        const char * filename = get_file_name(name, namelen);
-        const char * dname = dentry_get_name(dent);
-        int dname_len = strlen(dname);
-        int fname_len = name + namelen - filename;
-        if (dname_len != fname_len || memcmp(dname, filename, fname_len))
+        if (dent->name.len != fname_len ||
+            memcmp(qstrgetstr(&dent->name), filename, fname_len))
             continue;
 
         /* If we get this far, we have a match */
@@ -287,11 +398,59 @@ __lookup_dcache (struct shim_dentry * start, const char * name, int namelen,
 
 out:
     if (hashptr)
-        *hashptr = hash;
+        *hashptr = hash_dentry(start, name, namelen);
 
     return found;
 }
 
+struct shim_dentry *
+__lookup_dcache_lockless (struct shim_dentry * start, const char * name,
+                          int namelen, unsigned long seq)
+{
+    if (seq & 1)
+        return NULL;
+
+    HASHTYPE hash = rehash_name(0, name, namelen);
+    struct dcache_table * table = *(struct dcache_table * volatile *)
+                                  &dcache_table;
+    struct shim_dentry * first = dcache_bucket(table, start, hash)->first;
+    struct shim_dentry * dent = first;
+
+    /* The dentries may be moved or unlinked under us; the walk stops as
+     * soon as the sequence number changes. */
+    while (dent && !dcache_read_retry(seq)) {
+        if (dent->parent == start && dent->name.hash == hash &&
+            dent->name.len == namelen &&
+            !memcmp(qstrgetstr(&dent->name), name, namelen))
+            return dent;
+
+        dent = dent->hlist.next;
+        if (dent == first)
+            break;
+    }
+
+    return NULL;
+}
+
+bool get_dentry_lockless (struct shim_dentry * dent, unsigned long seq)
+{
+    int count;
+
+    /* a dentry in the hash table holds a reference from its parent, so a
+     * count of zero means it has been freed in the meantime */
+    do {
+        count = REF_GET(dent->ref_count);
+        if (count <= 0)
+            return false;
+    } while (atomic_cmpxchg(&dent->ref_count, count, count + 1) != count);
+
+    if (!dcache_read_retry(seq))
+        return true;
+
+    put_dentry(dent);
+    return false;
+}
+
 /* This function recursively removes children and drops the reference count
  * under root (but not the root itself).
  *
@@ -309,6 +468,7 @@ int __del_dentry_tree(struct shim_dentry * root) {
         if (!listp_empty(&cursor->children))
             __del_dentry_tree(cursor);
 
+        __del_dcache(cursor);
         listp_del_init(cursor, &root->children, siblings);
         cursor->parent = NULL;
         root->nchildren--;
@@ -389,6 +549,7 @@ BEGIN_RS_FUNC(dentry)
         get_dentry(dent->parent);
         get_dentry(dent);
         listp_add_tail(dent, &dent->parent->children, siblings);
+        __add_dcache(dent);
     }
 
     DEBUG_RS("hash=%08x,path=%s,fs=%s", dent->rel_path.hash,
@@ -83,7 +83,7 @@ int init_fs (void)
 
     create_lock(mount_mgr_lock);
     create_lock(mount_list_lock);
-    return 0;
+    return init_chroot_cache();
 }
 
 static struct shim_mount * alloc_mount (void)
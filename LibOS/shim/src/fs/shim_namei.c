@@ -41,6 +41,12 @@
 
 #include <asm/fcntl.h>
 
+DEFINE_PROFILE_CATAGORY(dcache, );
+DEFINE_PROFILE_OCCURENCE(dcache_hit, dcache);
+DEFINE_PROFILE_OCCURENCE(dcache_negative_hit, dcache);
+DEFINE_PROFILE_OCCURENCE(dcache_miss, dcache);
+DEFINE_PROFILE_OCCURENCE(dcache_revalidate, dcache);
+
 /* Advances a char pointer (string) past any repeated slashes and returns the result.
  * Must be a null-terminated string. */
 static inline const char * eat_slashes (const char * string)
@@ -49,6 +55,18 @@ static inline const char * eat_slashes (const char * string)
     return string;
 }
 
+/* Whether a cached dentry has to be looked up again, as told by the
+ * revalidation policy of its file system. Mount points and ancestors are
+ * made up by the LibOS, so they are always kept. */
+static inline bool dentry_stale (struct shim_dentry * dent)
+{
+    if (dent->state & (DENTRY_MOUNTPOINT|DENTRY_ANCESTOR))
+        return false;
+
+    return dent->fs && dent->fs->d_ops && dent->fs->d_ops->revalidate &&
+           dent->fs->d_ops->revalidate(dent);
+}
+
 static inline int __lookup_flags (int flags)
 {
     int retval = LOOKUP_FOLLOW;
@@ -154,7 +172,9 @@ int permission (struct shim_dentry * dent, int mask, bool force) {
  * The force flag causes the libOS to query the underlying file system for the
  * existence of the dentry, even on a dcache hit, whereas without force, a
  * negative dentry is treated as definitive.  A hit with a valid dentry is
- * _always_ treated as definitive, even if force is set.
+ * treated as definitive, even if force is set, unless the file system says
+ * it is stale (see d_ops->revalidate); a stale dentry, positive or negative,
+ * is looked up again.
  *
  * XXX: The original code returned whether the process can exec the task?
  *       Not clear this is needed; try not doing this.
@@ -183,11 +203,24 @@ int lookup_dentry (struct shim_dentry * parent, const char * name, int namelen,
         // In the case we make a new dentry, go ahead and increment the
         // ref count; in other cases, __lookup_dcache does this
         get_dentry(dent);
+        INC_PROFILE_OCCURENCE(dcache_miss);
     } else {
-        if (!(dent->state & DENTRY_VALID))
+        if (!(dent->state & DENTRY_VALID)) {
+            do_fs_lookup = 1;
+            INC_PROFILE_OCCURENCE(dcache_miss);
+        } else if (force && (dent->state & DENTRY_NEGATIVE)) {
             do_fs_lookup = 1;
-        else if (force && (dent->state & DENTRY_NEGATIVE))
+            INC_PROFILE_OCCURENCE(dcache_miss);
+        } else if (dentry_stale(dent)) {
+            /* the lookup below decides again whether it is negative */
+            dent->state &= ~DENTRY_NEGATIVE;
             do_fs_lookup = 1;
+            INC_PROFILE_OCCURENCE(dcache_revalidate);
+        } else if (dent->state & DENTRY_NEGATIVE) {
+            INC_PROFILE_OCCURENCE(dcache_negative_hit);
+        } else {
+            INC_PROFILE_OCCURENCE(dcache_hit);
+        }
     }
 
     if (do_fs_lookup) {
@@ -207,6 +240,7 @@ int lookup_dentry (struct shim_dentry * parent, const char * name, int namelen,
                 // Let ENOENT fall through so we can get negative dentries in
                 // the cache
                 dent->state |= DENTRY_NEGATIVE;
+                dent->mode = NO_MODE;
             } else {
 
                 /* Trying to weed out ESKIPPED */
@@ -443,12 +477,81 @@ out:
     return err;
 }
 
+/* Walks the path without dcache_lock, through the dentries already in the
+ * dcache. This only succeeds if every atom is a valid, positive dentry, no
+ * symlink is crossed and the dcache does not change during the walk;
+ * anything else is left to __path_lookupat.
+ *
+ * The refcount is raised by one on the returned dentry.
+ */
+static bool path_lookupat_lockless (struct shim_dentry * start,
+                                    const char * path, int flags,
+                                    struct shim_dentry ** dent)
+{
+    if (!start) {
+        struct shim_thread * cur_thread = get_cur_thread();
+        if (!cur_thread)
+            return false;
+        start = *path == '/' ? cur_thread->root : cur_thread->cwd;
+        if (!start)
+            return false;
+    }
+
+    unsigned long seq = dcache_read_begin();
+    struct shim_dentry * cur = start;
+
+    path = eat_slashes(path);
+
+    while (*path) {
+        const char * next = path;
+        while (*next != '/' && *next != '\0')
+            next++;
+
+        int len = next - path;
+        if (len > MAX_FILENAME || !(cur->state & DENTRY_ISDIRECTORY))
+            return false;
+
+        if (len == 1 && path[0] == '.') {
+            /* stay in the directory */
+        } else if (len == 2 && path[0] == '.' && path[1] == '.') {
+            if (cur->parent)
+                cur = cur->parent;
+        } else {
+            cur = __lookup_dcache_lockless(cur, path, len, seq);
+            if (!cur)
+                return false;
+
+            int state = cur->state;
+            if ((state & (DENTRY_VALID|DENTRY_NEGATIVE)) != DENTRY_VALID ||
+                (state & DENTRY_ISLINK) || dentry_stale(cur))
+                return false;
+        }
+
+        path = eat_slashes(next);
+    }
+
+    if ((flags & LOOKUP_DIRECTORY) && !(cur->state & DENTRY_ISDIRECTORY))
+        return false;
+
+    if (!get_dentry_lockless(cur, seq))
+        return false;
+
+    INC_PROFILE_OCCURENCE(dcache_hit);
+    *dent = cur;
+    return true;
+}
+
 /* Just wraps __path_lookupat, but also acquires and releases the dcache_lock.
+ * Paths that are fully cached are looked up without the lock.
  */
 int path_lookupat (struct shim_dentry * start, const char * name, int flags,
                    struct shim_dentry ** dent, struct shim_mount * fs)
 {
     int ret = 0;
+
+    if (dent && path_lookupat_lockless(start, name, flags, dent))
+        return 0;
+
     lock(dcache_lock);
     ret = __path_lookupat (start, name, flags, dent, 0, fs, 0);
     unlock(dcache_lock);
@@ -635,6 +738,9 @@ static inline void set_dirent_type (mode_t * type, int d_type)
         case LINUX_DT_CHR:
             *type = S_IFCHR;
             return;
+        case LINUX_DT_DIR:
+            *type = S_IFDIR;
+            return;
         case LINUX_DT_BLK:
             *type = S_IFBLK;
             return;
@@ -655,26 +761,36 @@ static inline void set_dirent_type (mode_t * type, int d_type)
 
 /* This function enumerates a directory and caches the results in the cache.
  * 
- * Input: A dentry for a directory in the DENTRY_ISDIRECTORY and not in the
- * DENTRY_LISTED state.  The dentry DENTRY_LISTED flag is set upon success.
+ * Input: A dentry for a directory in the DENTRY_ISDIRECTORY state.  The
+ * dentry DENTRY_LISTED flag is set upon success; a listed directory is
+ * served from the dcache until the file system says it is stale.
  * 
  * Return value: 0 on success, <0 on error
  * 
  * DEP 7/9/17: This work was once done as part of open, but, since getdents*
  * have no consistency semantics, we can apply the principle of laziness and
  * not do the work until we are sure we really need to.  
+ *
+ * The children are added from the listing without looking each of them up
+ * in the file system. A child whose type comes with the listing is valid
+ * right away; a child listed as DT_UNKNOWN is left for a real lookup when
+ * it is walked, and getdents reports it as DT_UNKNOWN until then.
  */
 int list_directory_dentry (struct shim_dentry *dent) {
 
     int ret = 0;
     struct shim_mount * fs = dent->fs;
+
+    if ((dent->state & DENTRY_LISTED) && !dentry_stale(dent))
+        return 0;
+
     lock(dcache_lock);
 
     /* DEP 8/4/17: Another process could list this directory 
      * while we are waiting on the dcache lock.  This is ok, 
      * no need to blow an assert.
      */
-    if (dent->state & DENTRY_LISTED){
+    if ((dent->state & DENTRY_LISTED) && !dentry_stale(dent)) {
         unlock(dcache_lock);
         return 0;
     }
@@ -699,16 +815,32 @@ int list_directory_dentry (struct shim_dentry *dent) {
     
     struct shim_dirent * d = dirent;
     for ( ; d ; d = d->next) {
-        struct shim_dentry * child;
-        if ((ret = lookup_dentry(dent, d->name, strlen(d->name), false,
-                                 &child, fs)) < 0)
-            goto done_read;
+        int namelen = strlen(d->name);
+        struct shim_dentry * child = __lookup_dcache(dent, d->name, namelen,
+                                                     NULL, 0, NULL);
+        if (child) {
+            /* a negative dentry stays so until it is looked up again */
+            if (!(child->state & DENTRY_NEGATIVE) &&
+                d->type != LINUX_DT_UNKNOWN)
+                set_dirent_type(&child->type, d->type);
+            put_dentry(child);
+        } else {
+            child = get_new_dentry(fs, dent, d->name, namelen, NULL);
+            if (!child) {
+                ret = -ENOMEM;
+                goto done_read;
+            }
+            set_dirent_type(&child->type, d->type);
+        }
 
         if (child->state & DENTRY_NEGATIVE)
             continue;
 
-        if (!(child->state & DENTRY_VALID)) {
-            set_dirent_type(&child->type, d->type);
+        if (!(child->state & DENTRY_VALID) && d->type != LINUX_DT_UNKNOWN) {
+            if (d->type == LINUX_DT_DIR)
+                child->state |= DENTRY_ISDIRECTORY;
+            if (d->type == LINUX_DT_LNK)
+                child->state |= DENTRY_ISLINK;
             child->state |= DENTRY_VALID|DENTRY_RECENTLY;
         }
 
@@ -763,7 +895,9 @@ int list_directory_handle (struct shim_dentry * dent, struct shim_handle * hdl)
         while (c->state & DENTRY_MOUNTPOINT)
             c = c->mounted->root;
 
-        if (c->state & DENTRY_VALID) {
+        /* the children not looked up yet were added by the listing */
+        if ((c->state & DENTRY_VALID) ||
+            (c == child && !(c->state & DENTRY_NEGATIVE))) {
             get_dentry(c);
             children[count++] = c;
         }
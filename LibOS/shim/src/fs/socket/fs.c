@@ -45,13 +45,16 @@ static int socket_close (struct shim_handle * hdl)
     return 0;
 }
 
-static int socket_read (struct shim_handle * hdl, void * buf,
-                        size_t count)
+static int socket_readv (struct shim_handle * hdl, const struct iovec * iov,
+                         int iovcnt, off_t * offset)
 {
     int bytes = 0;
     struct shim_sock_handle * sock = &hdl->info.sock;
 
-    if (!count)
+    if (offset)
+        return -ESPIPE;
+
+    if (!iov_length(iov, iovcnt))
         return 0;
 
     lock(hdl->lock);
@@ -75,7 +78,8 @@ static int socket_read (struct shim_handle * hdl, void * buf,
 
     unlock(hdl->lock);
 
-    bytes = DkStreamRead(hdl->pal_handle, 0, count, buf, NULL, 0);
+    bytes = DkStreamReadv(hdl->pal_handle, 0, iovcnt, (PAL_IOVEC *) iov,
+                          NULL, 0);
 
     if (!bytes)
         switch(PAL_NATIVE_ERRNO) {
@@ -93,11 +97,21 @@ static int socket_read (struct shim_handle * hdl, void * buf,
     return bytes;
 }
 
-static int socket_write (struct shim_handle * hdl, const void * buf,
-                         size_t count)
+static int socket_read (struct shim_handle * hdl, void * buf,
+                        size_t count)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = count };
+    return socket_readv(hdl, &iov, 1, NULL);
+}
+
+static int socket_writev (struct shim_handle * hdl, const struct iovec * iov,
+                          int iovcnt, off_t * offset)
 {
     struct shim_sock_handle * sock = &hdl->info.sock;
 
+    if (offset)
+        return -ESPIPE;
+
     lock(hdl->lock);
 
     if (sock->sock_type == SOCK_STREAM &&
@@ -119,10 +133,11 @@ static int socket_write (struct shim_handle * hdl, const void * buf,
 
     unlock(hdl->lock);
 
-    if (!count)
+    if (!iov_length(iov, iovcnt))
         return 0;
 
-    int bytes = DkStreamWrite(hdl->pal_handle, 0, count, (void *) buf, NULL);
+    int bytes = DkStreamWritev(hdl->pal_handle, 0, iovcnt, (PAL_IOVEC *) iov,
+                               NULL);
 
     if (!bytes) {
         int err;
@@ -143,6 +158,13 @@ static int socket_write (struct shim_handle * hdl, const void * buf,
     return bytes;
 }
 
+static int socket_write (struct shim_handle * hdl, const void * buf,
+                         size_t count)
+{
+    struct iovec iov = { .iov_base = (void *) buf, .iov_len = count };
+    return socket_writev(hdl, &iov, 1, NULL);
+}
+
 static int socket_hstat (struct shim_handle * hdl, struct stat * stat)
 {
     if (!stat)
@@ -277,6 +299,8 @@ struct shim_fs_ops socket_fs_ops = {
         .close    = &socket_close,
         .read     = &socket_read,
         .write    = &socket_write,
+        .readv    = &socket_readv,
+        .writev   = &socket_writev,
         .hstat    = &socket_hstat,
         .checkout = &socket_checkout,
         .poll     = &socket_poll,
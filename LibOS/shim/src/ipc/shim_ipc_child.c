@@ -46,7 +46,7 @@ static int ipc_thread_exit (IDTYPE vmid, IDTYPE ppid, IDTYPE tid,
         exit_time = GET_PROFILE_INTERVAL();
 #endif
 
-    struct shim_thread * thread = __lookup_thread(tid);
+    struct shim_thread * thread = lookup_thread(tid);
 
     if (thread) {
         int ret = 0;
@@ -61,7 +61,7 @@ static int ipc_thread_exit (IDTYPE vmid, IDTYPE ppid, IDTYPE tid,
         return ret;
     }
 
-    struct shim_simple_thread * sthread = __lookup_simple_thread(tid);
+    struct shim_simple_thread * sthread = lookup_simple_thread(tid);
 
     if (!sthread) {
         sthread = get_new_simple_thread();
@@ -77,6 +77,24 @@ static LOCKTYPE ipc_helper_lock;
 
 static struct shim_ipc_port * broadcast_port;
 
+/* The ipc helper only waits on the ports, and hands the readable ones to a
+ * small pool of ipc workers to run the callbacks, so a slow callback only
+ * holds up the messages of its own port. A dispatched port is taken out of
+ * the wait set until its worker is done with it, so the messages of a port
+ * are still handled one at a time, in order. */
+#define IPC_WORKER_MAX          4
+
+static LOCKTYPE              ipc_worker_lock;
+static AEVENTTYPE            ipc_worker_event;
+static LISTP_TYPE(shim_ipc_port) ipc_worker_queue;
+static int                   ipc_nworkers, ipc_idle_workers;
+static int                   ipc_nqueued;
+/* number of dispatched ports, modified with the ipc_helper_lock held;
+   ipc_dispatch_event is set whenever it drops to zero */
+static int                   ipc_ndispatched;
+static PAL_HANDLE            ipc_dispatch_event;
+static struct shim_waitset   ipc_helper_waitset;
+
 //#define DEBUG_REF
 
 static int init_ipc_port (struct shim_ipc_info * info, PAL_HANDLE hdl, int type)
@@ -158,6 +176,9 @@ int init_ipc_helper (void)
     ipc_helper_state = HELPER_NOTALIVE;
     create_lock(ipc_helper_lock);
     create_event(&ipc_helper_event);
+    create_lock(ipc_worker_lock);
+    create_event(&ipc_worker_event);
+    ipc_dispatch_event = DkNotificationEventCreate(PAL_TRUE);
     if (need_helper) {
         /*
          * we are enabling multi-threading, must turn on threading
@@ -319,6 +340,7 @@ static struct shim_ipc_port * __get_new_ipc_port (PAL_HANDLE hdl)
     port->update = true;
     INIT_LIST_HEAD(port, hlist);
     INIT_LIST_HEAD(port, list);
+    INIT_LIST_HEAD(port, queue);
     INIT_LISTP(&port->msgs);
     REF_SET(port->ref_count, 1);
     create_lock(port->msgs_lock);
@@ -779,6 +801,158 @@ next:
 
 #define IPC_HELPER_STACK_SIZE       (allocsize * 4)
 #define IPC_HELPER_LIST_INIT_SIZE   32
+#define IPC_HELPER_MAX_POLLED       32
+
+/* receive the messages of a port found readable by the ipc helper, and then
+   put the port back in the wait set, unless the helper has dropped it */
+static void handle_ipc_port (struct shim_ipc_port * pobj)
+{
+    PAL_STREAM_ATTR attr;
+    bool deleted = false;
+
+    if (!DkStreamAttributesQuerybyHandle(pobj->pal_handle, &attr)) {
+        debug("port %p (handle %p) is removed at querying\n",
+              pobj, pobj->pal_handle);
+        del_ipc_port_fini(pobj, -PAL_ERRNO);
+        deleted = true;
+    } else {
+        if (attr.readable)
+            receive_ipc_message(pobj, 0, NULL);
+
+        if (attr.disconnected) {
+            debug("port %p (handle %p) is disconnected\n",
+                  pobj, pobj->pal_handle);
+            del_ipc_port_fini(pobj, -ECONNRESET);
+            deleted = true;
+        }
+    }
+
+    lock(ipc_helper_lock);
+    pobj->dispatched = false;
+    /* let the ipc helper drop the port from its list */
+    if (deleted && !IN_HELPER()) {
+        ipc_helper_update = true;
+        set_event(&ipc_helper_event, 1);
+    }
+    if (pobj->polling && !list_empty(pobj, list) &&
+        add_to_waitset(&ipc_helper_waitset, pobj->pal_handle, PAL_WAIT_READ,
+                       pobj) < 0)
+        debug("failed to listen on port %p (handle %p)\n",
+              pobj, pobj->pal_handle);
+    if (!--ipc_ndispatched)
+        DkEventSet(ipc_dispatch_event);
+    unlock(ipc_helper_lock);
+    put_ipc_port(pobj);
+}
+
+static void shim_ipc_worker (void * arg)
+{
+    struct shim_thread * self = (struct shim_thread *) arg;
+    if (!arg)
+        return;
+
+    __libc_tcb_t tcb;
+    allocate_tls(&tcb, false, self);
+    debug_setbuf(&tcb.shim_tcb, true);
+    debug("ipc worker thread started\n");
+
+    /* the callbacks need more stack than the PAL gives to a thread */
+    void * stack = allocate_stack(IPC_HELPER_STACK_SIZE, allocsize, false);
+
+    if (!stack) {
+        lock(ipc_worker_lock);
+        ipc_nworkers--;
+        unlock(ipc_worker_lock);
+        goto end;
+    }
+
+    self->stack_top = stack + IPC_HELPER_STACK_SIZE;
+    self->stack = stack;
+    switch_stack(stack + IPC_HELPER_STACK_SIZE);
+    self = get_cur_thread();
+
+    /* the workers stay around once created, as their stacks are never
+       freed; every queued port posts the event once */
+    lock(ipc_worker_lock);
+    while (true) {
+        if (listp_empty(&ipc_worker_queue)) {
+            ipc_idle_workers++;
+            unlock(ipc_worker_lock);
+            wait_event(&ipc_worker_event);
+            lock(ipc_worker_lock);
+            ipc_idle_workers--;
+            continue;
+        }
+
+        struct shim_ipc_port * pobj =
+                listp_first_entry(&ipc_worker_queue, struct shim_ipc_port,
+                                  queue);
+        listp_del_init(pobj, &ipc_worker_queue, queue);
+        ipc_nqueued--;
+        unlock(ipc_worker_lock);
+
+        handle_ipc_port(pobj);
+
+        lock(ipc_worker_lock);
+    }
+
+end:
+    put_thread(self);
+    debug("ipc worker thread terminated\n");
+    flush_slab_magazine();
+    DkThreadExit();
+}
+
+/* This function should be called with the ipc_worker_lock held */
+static int create_ipc_worker (void)
+{
+    struct shim_thread * new = get_new_internal_thread();
+    if (!new)
+        return -ENOMEM;
+
+    PAL_HANDLE handle = thread_create(shim_ipc_worker, new, 0);
+
+    if (!handle) {
+        put_thread(new);
+        return -PAL_ERRNO;
+    }
+
+    new->pal_handle = handle;
+    ipc_nworkers++;
+    return 0;
+}
+
+/* hand a readable port to the ipc workers; the port has been taken out of
+   the wait set by the ipc helper */
+static void dispatch_ipc_port (struct shim_ipc_port * pobj)
+{
+    get_ipc_port(pobj);
+    lock(ipc_worker_lock);
+
+    listp_add_tail(pobj, &ipc_worker_queue, queue);
+    ipc_nqueued++;
+
+    if (ipc_nqueued > ipc_idle_workers && ipc_nworkers < IPC_WORKER_MAX)
+        create_ipc_worker();
+
+    /* without any worker, the ipc helper handles the ports by itself */
+    if (!ipc_nworkers) {
+        while (!listp_empty(&ipc_worker_queue)) {
+            pobj = listp_first_entry(&ipc_worker_queue, struct shim_ipc_port,
+                                     queue);
+            listp_del_init(pobj, &ipc_worker_queue, queue);
+            ipc_nqueued--;
+            unlock(ipc_worker_lock);
+            handle_ipc_port(pobj);
+            lock(ipc_worker_lock);
+        }
+        unlock(ipc_worker_lock);
+        return;
+    }
+
+    unlock(ipc_worker_lock);
+    set_event(&ipc_worker_event, 1);
+}
 
 static void shim_ipc_helper (void * arg)
 {
@@ -798,6 +972,7 @@ static void shim_ipc_helper (void * arg)
 
     if (notme) {
         put_thread(self);
+        flush_slab_magazine();
         DkThreadExit();
         return;
     }
@@ -816,18 +991,31 @@ static void shim_ipc_helper (void * arg)
     stack = self->stack;
 
     int port_num = 0, port_size = IPC_HELPER_LIST_INIT_SIZE;
-    struct shim_ipc_port ** local_pobjs = stack, * pobj;
-    PAL_HANDLE * local_ports;
+    struct shim_ipc_port ** local_pobjs, * pobj;
     PAL_HANDLE ipc_event_handle = event_handle(&ipc_helper_event);
 
+    /* The ports are registered in the wait set with the port objects as the
+     * data pointers, and the ipc helper event with NULL. */
+    struct shim_waitset * waitset = &ipc_helper_waitset;
+    PAL_PTR polled[IPC_HELPER_MAX_POLLED];
+    PAL_FLG polled_events[IPC_HELPER_MAX_POLLED];
+    int npolled;
     int nalive = 0;
-    PAL_HANDLE polled = NULL;
-    int count = -1;
+    bool notified = true;
+
+    local_pobjs = malloc(sizeof(struct shim_ipc_port *) * port_size);
+    if (!local_pobjs)
+        goto end;
 
-    local_ports = (PAL_HANDLE *) (local_pobjs + port_size);
-    local_ports[0] = ipc_event_handle;
+    if (create_waitset(waitset) < 0) {
+        free(local_pobjs);
+        goto end;
+    }
+
+    if (add_to_waitset(waitset, ipc_event_handle, PAL_WAIT_READ, NULL) < 0)
+        goto out;
 
-    goto update_status;
+    goto update_list;
 
     /* The compiler should be careful not to cache the ipc_helper_state or
      * else ths loop could fail to terminate on update.  Use a compiler
@@ -835,76 +1023,68 @@ static void shim_ipc_helper (void * arg)
     while ((ipc_helper_state == HELPER_ALIVE) ||
            nalive) {
         /* do a global poll on all the ports */
-        polled = DkObjectsWaitAny(port_num + 1, local_ports, NO_TIMEOUT);
+        npolled = wait_on_waitset(waitset, IPC_HELPER_MAX_POLLED, polled,
+                                  polled_events, NO_TIMEOUT);
         barrier();
 
-        if (!polled)
+        if (npolled <= 0)
             continue;
 
-        /* before we locking pobj list, at least we can look at the returned
-           port if it is the ipc helper event */
-        if (polled == ipc_event_handle) {
-            clear_event(&ipc_helper_event);
-update_status:
-            barrier();
-            if (ipc_helper_state == HELPER_NOTALIVE)
-                goto end;
-            else
-                goto update_list;
-        }
+        bool update = false;
+        notified = false;
 
-        pobj = NULL;
-        count = -1;
-        for (int i = 0 ; i < port_num ; i++)
-            if (polled == local_pobjs[i]->pal_handle) {
-                pobj = local_pobjs[i];
-                count = i;
-                break;
+        for (int i = 0 ; i < npolled ; i++) {
+            /* before we locking pobj list, at least we can look at the
+               returned port if it is the ipc helper event */
+            if (!polled[i]) {
+                clear_event(&ipc_helper_event);
+                notified = update = true;
+                continue;
             }
 
-        if (!pobj)
-            continue;
-
-        /* if the polled port is a server port, accept a client and add it
-           to the port list */
-        if (pobj->private.type & IPC_PORT_SERVER) {
-            PAL_HANDLE cli = DkStreamWaitForClient(polled);
-            if (cli) {
-                int type = (pobj->private.type & ~IPC_PORT_SERVER) |
-                           IPC_PORT_LISTEN;
-                add_ipc_port_by_id(pobj->private.vmid, cli, type,
-                                   NULL, NULL);
-            } else {
-                debug("port %p (handle %p) is removed at accepting\n",
-                      pobj, polled);
-                del_ipc_port_fini(pobj, -ECHILD);
+            pobj = polled[i];
+
+            /* if the polled port is a server port, accept a client and add
+               it to the port list */
+            if (pobj->private.type & IPC_PORT_SERVER) {
+                PAL_HANDLE cli = DkStreamWaitForClient(pobj->pal_handle);
+                if (cli) {
+                    int type = (pobj->private.type & ~IPC_PORT_SERVER) |
+                               IPC_PORT_LISTEN;
+                    add_ipc_port_by_id(pobj->private.vmid, cli, type,
+                                       NULL, NULL);
+                } else {
+                    debug("port %p (handle %p) is removed at accepting\n",
+                          pobj, pobj->pal_handle);
+                    del_ipc_port_fini(pobj, -ECHILD);
+                }
+                update = true;
+                continue;
             }
-            polled = NULL;
-            count = -1;
-            goto update_list;
-        }
-
-        PAL_STREAM_ATTR attr;
-        if (!DkStreamAttributesQuerybyHandle(polled, &attr)) {
-            debug("port %p (handle %p) is removed at querying\n",
-                  pobj, polled);
-            del_ipc_port_fini(pobj, -PAL_ERRNO);
-            goto update_list;
-        }
 
-        if (attr.readable)
-            receive_ipc_message(pobj, 0, NULL);
+            /* stop listening on the port until a worker is done with it;
+               the workers wake up the helper if they delete the port */
+            lock(ipc_helper_lock);
+            bool dispatch = !pobj->dispatched;
+            if (dispatch) {
+                remove_from_waitset(waitset, pobj->pal_handle);
+                pobj->dispatched = true;
+                if (!ipc_ndispatched++)
+                    DkEventClear(ipc_dispatch_event);
+            }
+            unlock(ipc_helper_lock);
 
-        if (attr.disconnected) {
-            debug("port %p (handle %p) is disconnected\n",
-                  pobj, polled);
-            del_ipc_port_fini(pobj, -ECONNRESET);
-            goto update_list;
+            if (dispatch)
+                dispatch_ipc_port(pobj);
         }
 
-        if (!ipc_helper_update)
+        if (!update && !ipc_helper_update)
             continue;
 update_list:
+        barrier();
+        if (notified && ipc_helper_state == HELPER_NOTALIVE)
+            break;
+
         ipc_helper_update = false;
         lock(ipc_helper_lock);
 
@@ -915,10 +1095,8 @@ update_list:
             struct shim_ipc_port * pobj = local_pobjs[i];
 
             if (list_empty(pobj, list)) {
-                if (polled == pobj->pal_handle) {
-                    polled = NULL;
-                    count = -1;
-                }
+                remove_from_waitset(waitset, pobj->pal_handle);
+                pobj->polling = false;
                 local_pobjs[i] = NULL;
                 if (pobj->private.type & IPC_PORT_KEEPALIVE)
                     nalive--;
@@ -939,12 +1117,8 @@ update_list:
                 pobj->update = false;
             }
 
-            if (compact) {
-                if (polled == pobj->pal_handle)
-                    count -= compact;
+            if (compact)
                 local_pobjs[i - compact] = pobj;
-                local_ports[i - compact + 1] = pobj->pal_handle;
-            }
         }
         port_num -= compact;
 
@@ -960,18 +1134,38 @@ update_list:
 
             assert(pobj->private.type & IPC_PORT_IFPOLL);
 
+            /* the port may be recent again while listened */
+            if (pobj->polling) {
+                pobj->recent = false;
+                continue;
+            }
+
             if (port_num == port_size) {
+                struct shim_ipc_port ** new_pobjs =
+                        malloc(sizeof(struct shim_ipc_port *) * port_size * 2);
+                if (!new_pobjs)
+                    break;
+                memcpy(new_pobjs, local_pobjs,
+                       sizeof(struct shim_ipc_port *) * port_num);
+                free(local_pobjs);
+                local_pobjs = new_pobjs;
                 port_size *= 2;
-                memmove(local_pobjs + port_size,
-                        local_ports,
-                        (port_num + 1) * sizeof(PAL_HANDLE));
-                local_ports = (PAL_HANDLE *) (local_pobjs + port_size);
+            }
+
+            /* a port dropped and added back while dispatched is put back
+               in the wait set by its worker */
+            if (!pobj->dispatched &&
+                add_to_waitset(waitset, pobj->pal_handle, PAL_WAIT_READ,
+                               pobj) < 0) {
+                debug("failed to listen on port %p (handle %p)\n",
+                      pobj, pobj->pal_handle);
+                break;
             }
 
             pobj->recent = false;
+            pobj->polling = true;
             __get_ipc_port(pobj);
             local_pobjs[port_num] = pobj;
-            local_ports[port_num + 1] = pobj->pal_handle;
             port_num++;
 
             if (pobj->private.type & IPC_PORT_KEEPALIVE)
@@ -987,11 +1181,27 @@ update_list:
         unlock(ipc_helper_lock);
     }
 
+out:
+    /* the workers put the dispatched ports back in the wait set; the last
+       one sets the event */
+    lock(ipc_helper_lock);
+    while (ipc_ndispatched) {
+        unlock(ipc_helper_lock);
+        DkObjectsWaitAny(1, &ipc_dispatch_event, NO_TIMEOUT);
+        lock(ipc_helper_lock);
+    }
+    unlock(ipc_helper_lock);
+
     for (int i = 0 ; i < port_num ; i++) {
         struct shim_ipc_port * pobj = local_pobjs[i];
+        remove_from_waitset(waitset, pobj->pal_handle);
+        pobj->polling = false;
         __put_ipc_port(pobj);
     }
 
+    destroy_waitset(waitset);
+    free(local_pobjs);
+
 end:
     /* DP: Put our handle map reference */
     if (self->handle_map)
@@ -1013,6 +1223,7 @@ end:
     unlock(ipc_helper_lock);
     put_thread(self);
     debug("ipc helper thread terminated\n");
+    flush_slab_magazine();
 
     DkThreadExit();
 }
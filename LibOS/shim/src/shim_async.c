@@ -130,6 +130,7 @@ int init_async (void)
 
 #define IDLE_SLEEP_TIME     1000
 #define MAX_IDLE_CYCLES     100
+#define ASYNC_MAX_POLLED    16
 
 static void shim_async_helper (void * arg)
 {
@@ -148,6 +149,7 @@ static void shim_async_helper (void * arg)
 
     if (notme) {
         put_thread(self);
+        flush_slab_magazine();
         DkThreadExit();
         return;
     }
@@ -162,11 +164,19 @@ static void shim_async_helper (void * arg)
     struct async_event * next_event = NULL;
     PAL_HANDLE async_event_handle = event_handle(&async_helper_event);
 
-    int object_list_size = 32, object_num;
-    PAL_HANDLE polled;
-    PAL_HANDLE * local_objects =
-            malloc(sizeof(PAL_HANDLE) * (1 + object_list_size));
-    local_objects[0] = async_event_handle;
+    /* The objects of the async events are registered in the wait set, with
+     * the objects themselves as the data pointers */
+    struct shim_waitset waitset;
+    PAL_PTR polled[ASYNC_MAX_POLLED];
+    PAL_FLG polled_events[ASYNC_MAX_POLLED];
+    int npolled;
+
+    if (create_waitset(&waitset) < 0)
+        goto out;
+
+    if (add_to_waitset(&waitset, async_event_handle, PAL_WAIT_READ,
+                       async_event_handle) < 0)
+        goto done;
 
     goto update_status;
 
@@ -178,7 +188,7 @@ static void shim_async_helper (void * arg)
         if (next_event) {
             sleep_time = next_event->expire_time - latest_time;
             idle_cycles = 0;
-        } else if (object_num) {
+        } else if (waitset.nhandles > 1) {
             sleep_time = NO_TIMEOUT;
             idle_cycles = 0;
         } else {
@@ -186,11 +196,12 @@ static void shim_async_helper (void * arg)
             idle_cycles++;
         }
 
-        polled = DkObjectsWaitAny(object_num + 1, local_objects, sleep_time);
+        npolled = wait_on_waitset(&waitset, ASYNC_MAX_POLLED, polled,
+                                  polled_events, sleep_time);
         barrier();
-        
-        if (!polled) {
-            if (next_event) {
+
+        if (npolled <= 0) {
+            if (!npolled && next_event) {
                 debug("async event trigger at %llu\n",
                       next_event->expire_time);
 
@@ -205,46 +216,73 @@ static void shim_async_helper (void * arg)
             continue;
         }
 
-        if (polled == async_event_handle) {
-            clear_event(&async_helper_event);
-update_status:
-            latest_time = DkSystemTimeQuery();
-            if (async_helper_state == HELPER_NOTALIVE) {
-                break;
-            } else {
-                lock(async_helper_lock);
-                goto update_list;
+        bool update = false;
+
+        for (int i = 0 ; i < npolled ; i++) {
+            if (polled[i] == async_event_handle) {
+                update = true;
+                continue;
             }
-        }
 
-        struct async_event * tmp, * n;
+            struct async_event * tmp, * n;
 
-        lock(async_helper_lock);
+            lock(async_helper_lock);
 
-        listp_for_each_entry_safe(tmp, n, &async_list, list) {
-            if (tmp->object == polled) {
-                debug("async event trigger at %llu\n",
-                      latest_time);
-                unlock(async_helper_lock);
-                tmp->callback(tmp->caller, tmp->arg);
-                lock(async_helper_lock);
-                break;
+            listp_for_each_entry_safe(tmp, n, &async_list, list) {
+                if (tmp->object == polled[i]) {
+                    debug("async event trigger at %llu\n",
+                          latest_time);
+                    unlock(async_helper_lock);
+                    tmp->callback(tmp->caller, tmp->arg);
+                    lock(async_helper_lock);
+                    break;
+                }
             }
+
+            unlock(async_helper_lock);
         }
 
+        if (!update)
+            continue;
+
+        clear_event(&async_helper_event);
+update_status:
+        latest_time = DkSystemTimeQuery();
+        if (async_helper_state == HELPER_NOTALIVE)
+            break;
+
+        lock(async_helper_lock);
+
 update_list:
         next_event = NULL;
-        object_num = 0;
+
+        /* unregister the objects whose events are gone */
+        for (int i = waitset.nhandles - 1 ; i >= 0 ; i--) {
+            PAL_HANDLE object = waitset.handles[i];
+            struct async_event * tmp;
+            bool found = (object == async_event_handle);
+
+            listp_for_each_entry(tmp, &async_list, list)
+                if (tmp->object == object) {
+                    found = true;
+                    break;
+                }
+
+            if (!found)
+                remove_from_waitset(&waitset, object);
+        }
 
         if (!listp_empty(&async_list)) {
             struct async_event * tmp, * n;
 
-            listp_for_each_entry_safe(tmp, n, &async_list, list) {
-                if (tmp->object) {
-                    local_objects[object_num + 1] = tmp->object;
-                    object_num++;
-                }
+            /* register the new objects; the registered ones are skipped
+               (add_to_waitset returns -EEXIST) */
+            listp_for_each_entry(tmp, &async_list, list)
+                if (tmp->object)
+                    add_to_waitset(&waitset, tmp->object, PAL_WAIT_READ,
+                                   tmp->object);
 
+            listp_for_each_entry_safe(tmp, n, &async_list, list) {
                 if (!tmp->install_time)
                     continue;
 
@@ -275,12 +313,16 @@ update_list:
         }
     }
 
+done:
+    destroy_waitset(&waitset);
+out:
     lock(async_helper_lock);
     async_helper_state = HELPER_NOTALIVE;
     async_helper_thread = NULL;
     unlock(async_helper_lock);
     put_thread(self);
     debug("async helper thread terminated\n");
+    flush_slab_magazine();
 
     DkThreadExit();
 }
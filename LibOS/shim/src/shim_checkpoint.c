@@ -57,10 +57,13 @@ DEFINE_PROFILE_INTERVAL(child_created_in_new_process,  resume);
 DEFINE_PROFILE_INTERVAL(child_wait_header,             resume);
 DEFINE_PROFILE_INTERVAL(child_receive_header,          resume);
 DEFINE_PROFILE_INTERVAL(do_migration,                  resume);
+DEFINE_PROFILE_INTERVAL(child_open_streams,            resume);
+DEFINE_PROFILE_INTERVAL(child_wait_checkpoint,         resume);
 DEFINE_PROFILE_INTERVAL(child_load_checkpoint_by_gipc, resume);
 DEFINE_PROFILE_INTERVAL(child_load_memory_by_gipc,     resume);
 DEFINE_PROFILE_INTERVAL(child_load_checkpoint_on_pipe, resume);
 DEFINE_PROFILE_INTERVAL(child_receive_handles,         resume);
+DEFINE_PROFILE_INTERVAL(child_receive_streams,         resume);
 DEFINE_PROFILE_INTERVAL(restore_checkpoint,            resume);
 DEFINE_PROFILE_CATAGORY(resume_func,                   resume);
 DEFINE_PROFILE_INTERVAL(child_total_migration_time,    resume);
@@ -176,8 +179,363 @@ get_cp_map_entry (void * map, void * addr, bool create)
     return e;
 }
 
+/*
+ * The pages of the memory entries that are all zero are left out of the
+ * checkpoint, and recreated as anonymous memory in the new process. The
+ * pages of private anonymous memory which the host reports as neither
+ * present nor swapped out have never been touched, and are not read.
+ */
+#define CP_PAGEMAP_BATCH    256
+#define PAGEMAP_PRESENT     (1ULL << 63)
+#define PAGEMAP_SWAPPED     (1ULL << 62)
+
+struct cp_page_scan {
+    PAL_HANDLE pagemap;
+    void * start;       /* page of the first cached entry */
+    int nentries;
+    uint64_t entries[CP_PAGEMAP_BATCH];
+};
+
+static bool zero_page (struct cp_page_scan * scan, void * addr)
+{
+    if (scan->pagemap) {
+        if (addr < scan->start ||
+            addr >= scan->start + scan->nentries * allocsize) {
+            PAL_NUM bytes = DkStreamRead(scan->pagemap,
+                                ((ptr_t) addr / allocsize) * sizeof(uint64_t),
+                                sizeof(scan->entries), scan->entries,
+                                NULL, 0);
+            scan->start = addr;
+            scan->nentries = bytes / sizeof(uint64_t);
+        }
+
+        if (scan->nentries) {
+            uint64_t entry = scan->entries[(addr - scan->start) / allocsize];
+            if (!(entry & (PAGEMAP_PRESENT|PAGEMAP_SWAPPED)))
+                return true;
+        } else {
+            scan->pagemap = NULL;
+        }
+    }
+
+    const unsigned long * p = addr, * end = addr + allocsize;
+    for ( ; p < end ; p++)
+        if (*p)
+            return false;
+
+    return true;
+}
+
+/* Split the entry into runs of pages, alternately with data and all zero,
+   starting with data. Returns the number of runs. */
+static int scan_cp_memory (struct shim_cp_store * store,
+                           struct shim_mem_entry * ent, unsigned int ** runs)
+{
+    struct cp_page_scan scan;
+    int nruns = 0, maxruns = 0;
+    unsigned int npages = 0;
+    bool zero = false;
+
+    scan.pagemap = ent->anonymous ? store->pagemap : NULL;
+    scan.nentries = 0;
+    *runs = NULL;
+
+    for (void * addr = ent->addr ; addr <= ent->addr + ent->size ;
+         addr += allocsize) {
+        if (addr < ent->addr + ent->size && zero_page(&scan, addr) == zero) {
+            npages++;
+            continue;
+        }
+
+        if (nruns == maxruns) {
+            maxruns = maxruns ? maxruns * 2 : 16;
+            unsigned int * new_runs = malloc(sizeof(unsigned int) * maxruns);
+            if (!new_runs) {
+                free(*runs);
+                *runs = NULL;
+                return -ENOMEM;
+            }
+
+            if (*runs) {
+                memcpy(new_runs, *runs, sizeof(unsigned int) * nruns);
+                free(*runs);
+            }
+
+            *runs = new_runs;
+        }
+
+        (*runs)[nruns++] = npages;
+        npages = 1;
+        zero = !zero;
+    }
+
+    return nruns;
+}
+
+/* the bytes of data sent for the entry */
+static size_t mem_entry_data_size (struct shim_mem_entry * ent)
+{
+    if (!ent->pagemap)
+        return ent->size;
+
+    size_t size = 0;
+    for (int i = 0 ; i < ent->nruns ; i += 2)
+        size += (size_t) ent->pagemap[i] * allocsize;
+
+    return size;
+}
+
+static int alloc_cp_space (struct shim_cp_store * store, size_t size,
+                           ptr_t * off)
+{
+    *off = __ADD_CP_OFFSET((size + sizeof(void *) - 1) &
+                           ~(sizeof(void *) - 1));
+    return 0;
+}
+
+/*
+ * Record the page maps of the memory entries sent with the checkpoint,
+ * after the last checkpoint entry.
+ */
+static int map_cp_memory (struct shim_cp_store * store)
+{
+    struct shim_mem_entry * ent = store->last_mem_entry;
+    size_t left_out = 0;
+    int ret;
+
+    for (; ent ; ent = ent->prev) {
+        if (ent->paddr || ent->streamed ||
+            !ALIGNED(ent->addr) || !ALIGNED(ent->size))
+            continue;
+
+        unsigned int * runs;
+        int nruns = scan_cp_memory(store, ent, &runs);
+        if (nruns < 0)
+            return nruns;
+
+        /* no page to leave out */
+        if (nruns == 1) {
+            free(runs);
+            continue;
+        }
+
+        size_t size = sizeof(unsigned int) * nruns;
+        ptr_t off;
+        if ((ret = alloc_cp_space(store, size, &off)) < 0) {
+            free(runs);
+            return ret;
+        }
+
+        ent->pagemap = (void *) store->base + off;
+        ent->nruns = nruns;
+        memcpy(ent->pagemap, runs, size);
+        free(runs);
+
+        left_out += ent->size - mem_entry_data_size(ent);
+        store->mem_size -= ent->size - mem_entry_data_size(ent);
+    }
+
+    debug("left %lu bytes of zero pages out of the checkpoint\n", left_out);
+    return 0;
+}
+
+/*
+ * Without GIPC, the memory entries are sent by worker threads over parallel
+ * streams while the checkpoint is still being created. Each entry is queued
+ * in chunks as soon as the next one is created, when its caller is done
+ * with it. On each stream, a chunk header is followed by the data, and a
+ * NULL address ends the stream.
+ *
+ * Only the memory of the VMAs listed after the first header goes on the
+ * streams. The new process reserves these ranges before it receives
+ * anything, so its own allocations cannot take them.
+ */
+#define CP_STREAM_CHUNK         (1024 * 1024)
+#define CP_STREAM_WAIT_TIME     100000  /* microseconds */
+#define CP_DEFAULT_STREAMS      2
+
+struct cp_stream_chunk {
+    void * addr;
+    size_t size;
+    int prot;
+    bool zero;      /* no data follows */
+    size_t csize;   /* size of the data if compressed */
+};
+
+struct cp_stream_range {
+    void * addr;
+    size_t size;
+};
+
+struct shim_cp_streams {
+    int nstreams;
+    struct cp_stream {
+        struct shim_cp_streams * streams;
+        struct shim_thread * thread;
+        PAL_HANDLE handle;
+        bool running;
+        void * buf;     /* compressed data, in the new process */
+        int nchunks, ncompressed;
+        int ret;
+    } stream[CP_MAX_STREAMS];
+    int compress;
+
+    /* the queue of chunks, in the parent */
+    LOCKTYPE lock;
+    AEVENTTYPE event;
+    PAL_HANDLE proc;
+    struct cp_stream_chunk * chunks;
+    int nchunks, maxchunks, next;
+    int nwaiting;
+    bool finished;
+    volatile bool aborted;
+    struct shim_mem_entry * last_queued;
+    struct cp_stream_range * ranges;
+    int nranges;
+
+    struct atomic_int nrunning;
+    PAL_HANDLE done;
+};
+
+static int cp_nstreams = -1;
+static int cp_compress;
+/* the manifest asks for the memory to be copied on the streams, rather than
+   shared through the physical memory channel */
+static bool cp_copy_memory;
+
+static void read_cp_stream_config (void)
+{
+    char cfg[CONFIG_MAX];
+
+    if (cp_nstreams >= 0)
+        return;
+
+    cp_nstreams = CP_DEFAULT_STREAMS;
+    if (root_config &&
+        get_config(root_config, "sys.fork_streams", cfg, CONFIG_MAX) > 0) {
+        cp_nstreams = parse_int(cfg);
+        cp_copy_memory = true;
+    }
+    if (cp_nstreams > CP_MAX_STREAMS)
+        cp_nstreams = CP_MAX_STREAMS;
+
+    cp_compress = root_config &&
+        get_config(root_config, "sys.fork_compress", cfg, CONFIG_MAX) > 0 &&
+        parse_int(cfg) > 0;
+    if (cp_compress)
+        cp_copy_memory = true;
+}
+
+/* streams->lock needs to be held */
+static void wake_cp_streams (struct shim_cp_streams * streams, int n)
+{
+    if (n > streams->nwaiting)
+        n = streams->nwaiting;
+
+    if (n) {
+        streams->nwaiting -= n;
+        set_event(&streams->event, n);
+    }
+}
+
+static bool cp_stream_reserved (struct shim_cp_streams * streams,
+                                void * addr, size_t size)
+{
+    for (int i = 0 ; i < streams->nranges ; i++)
+        if (addr >= streams->ranges[i].addr &&
+            addr + size <= streams->ranges[i].addr + streams->ranges[i].size)
+            return true;
+
+    return false;
+}
+
+/* queue the last memory entry, which is complete once another one is
+   created, or the checkpoint is */
+static void queue_cp_memory (struct shim_cp_store * store)
+{
+    struct shim_cp_streams * streams = store->streams;
+    struct shim_mem_entry * ent = store->last_mem_entry;
+
+    if (!ent || ent == streams->last_queued)
+        return;
+
+    streams->last_queued = ent;
+
+    /* the data pointed to by the checkpoint, or sharing pages with other
+       data, is loaded with the checkpoint */
+    if (ent->paddr || !ALIGNED(ent->addr) || !ALIGNED(ent->size))
+        return;
+
+    /* so is the memory which the new process has not reserved */
+    if (!cp_stream_reserved(streams, ent->addr, ent->size))
+        return;
+
+    /* a run of zero pages is only allocated by the new process */
+    unsigned int * runs;
+    int nruns = scan_cp_memory(store, ent, &runs);
+    if (nruns < 0)
+        return;
+
+    int n = 0;
+    for (int i = 0 ; i < nruns ; i++)
+        if (runs[i])
+            n += (i & 1) ? 1 : ((size_t) runs[i] * allocsize +
+                                CP_STREAM_CHUNK - 1) / CP_STREAM_CHUNK;
+
+    lock(streams->lock);
+    if (streams->aborted)
+        goto out;
+
+    if (streams->nchunks + n > streams->maxchunks) {
+        int maxchunks = streams->maxchunks ? : 64;
+        while (streams->nchunks + n > maxchunks)
+            maxchunks *= 2;
+
+        struct cp_stream_chunk * chunks =
+                malloc(sizeof(struct cp_stream_chunk) * maxchunks);
+        if (!chunks)
+            goto out;
+
+        if (streams->chunks) {
+            memcpy(chunks, streams->chunks,
+                   sizeof(struct cp_stream_chunk) * streams->nchunks);
+            free(streams->chunks);
+        }
+
+        streams->chunks = chunks;
+        streams->maxchunks = maxchunks;
+    }
+
+    void * addr = ent->addr;
+    for (int i = 0 ; i < nruns ; i++) {
+        void * end = addr + (size_t) runs[i] * allocsize;
+
+        while (addr < end) {
+            struct cp_stream_chunk * chunk =
+                    &streams->chunks[streams->nchunks++];
+            chunk->addr = addr;
+            chunk->size = (i & 1) || end - addr < CP_STREAM_CHUNK ?
+                          end - addr : CP_STREAM_CHUNK;
+            chunk->prot = ent->prot;
+            chunk->zero = i & 1;
+            chunk->csize = 0;
+            addr += chunk->size;
+        }
+    }
+
+    ent->streamed = true;
+    store->mem_size -= ent->size;
+    wake_cp_streams(streams, n);
+out:
+    unlock(streams->lock);
+    free(runs);
+}
+
 BEGIN_CP_FUNC(memory)
 {
+    if (store->streams)
+        queue_cp_memory(store);
+
     struct shim_mem_entry * entry =
             (void *) (base + ADD_CP_OFFSET(sizeof(struct shim_mem_entry)));
 
@@ -186,6 +544,10 @@ BEGIN_CP_FUNC(memory)
     entry->paddr = NULL;
     entry->prot  = PAL_PROT_READ|PAL_PROT_WRITE;
     entry->data  = NULL;
+    entry->streamed = false;
+    entry->anonymous = false;
+    entry->pagemap = NULL;
+    entry->nruns = 0;
     entry->prev  = store->last_mem_entry;
     store->last_mem_entry = entry;
     store->mem_nentries++;
@@ -462,9 +824,10 @@ static int send_checkpoint_on_stream (PAL_HANDLE stream,
         mem_nentries -= mem_cnt;
 
         for (int i = 0 ; i < mem_nentries ; i++) {
-            int mem_size = mem_entries[i]->size;
+            if (mem_entries[i]->streamed)
+                continue;
             mem_entries[i]->data = mem_addr;
-            mem_addr += mem_size;
+            mem_addr += mem_entry_data_size(mem_entries[i]);
         }
     }
 
@@ -484,23 +847,37 @@ static int send_checkpoint_on_stream (PAL_HANDLE stream,
     ADD_PROFILE_OCCURENCE(migrate_send_on_stream, total_bytes);
 
     for (int i = 0 ; i < mem_nentries ; i++) {
-        size_t mem_size = mem_entries[i]->size;
-        void * mem_addr = mem_entries[i]->addr;
-        bytes = 0;
-        do {
-            size_t ret = DkStreamWrite(stream, 0, mem_size - bytes,
-                                       mem_addr + bytes, NULL);
-            if (!ret)
-                return -PAL_ERRNO;
+        struct shim_mem_entry * ent = mem_entries[i];
+        if (ent->streamed)
+            continue;
+
+        /* with a page map, only the runs of pages with data are sent */
+        void * mem_addr = ent->addr;
+        int nruns = ent->pagemap ? ent->nruns : 1;
+
+        for (int j = 0 ; j < nruns ; j++) {
+            size_t mem_size = ent->pagemap ?
+                              (size_t) ent->pagemap[j] * allocsize : ent->size;
 
-            bytes += ret;
-        } while (bytes < mem_entries[i]->size);
+            if (!(j & 1)) {
+                bytes = 0;
+                while (bytes < mem_size) {
+                    size_t ret = DkStreamWrite(stream, 0, mem_size - bytes,
+                                               mem_addr + bytes, NULL);
+                    if (!ret)
+                        return -PAL_ERRNO;
 
-        if (!(mem_entries[i]->prot & PAL_PROT_READ))
-            DkVirtualMemoryProtect(mem_addr, mem_size, mem_entries[i]->prot);
+                    bytes += ret;
+                }
+
+                ADD_PROFILE_OCCURENCE(migrate_send_on_stream, mem_size);
+            }
+
+            mem_addr += mem_size;
+        }
 
-        mem_entries[i]->size = mem_size;
-        ADD_PROFILE_OCCURENCE(migrate_send_on_stream, mem_size);
+        if (!(ent->prot & PAL_PROT_READ))
+            DkVirtualMemoryProtect(ent->addr, ent->size, ent->prot);
     }
 
     return 0;
@@ -580,6 +957,8 @@ int restore_checkpoint (struct cp_header * cphdr, struct mem_header * memhdr,
 
             if (entry->paddr) {
                 *entry->paddr = entry->data;
+            } else if (entry->streamed) {
+                continue;
             } else {
                 debug("memory entry [%p]: %p-%p\n", entry, entry->addr,
                       entry->addr + entry->size);
@@ -595,7 +974,28 @@ int restore_checkpoint (struct cp_header * cphdr, struct mem_header * memhdr,
                 }
 
                 CP_REBASE(entry->data);
-                memcpy(entry->addr, entry->data, entry->size);
+
+                if (entry->pagemap) {
+                    /* the pages left out are all zero */
+                    CP_REBASE(entry->pagemap);
+                    void * mem_addr = entry->addr, * data = entry->data;
+
+                    for (int i = 0 ; i < entry->nruns ; i++) {
+                        size_t mem_size =
+                                (size_t) entry->pagemap[i] * allocsize;
+                        if (!(i & 1)) {
+                            memcpy(mem_addr, data, mem_size);
+                            data += mem_size;
+                        }
+                        mem_addr += mem_size;
+                    }
+
+                    debug("memory entry [%p]: %lu bytes of zero pages "
+                          "left out\n", entry,
+                          entry->size - (data - entry->data));
+                } else {
+                    memcpy(entry->addr, entry->data, entry->size);
+                }
 
                 if (!(entry->prot & PAL_PROT_WRITE) &&
                     !DkVirtualMemoryProtect(addr, size, prot)) {
@@ -804,6 +1204,488 @@ int receive_handles_on_stream (struct palhdl_header * hdr, ptr_t base,
     return 0;
 }
 
+static int cp_stream_read (PAL_HANDLE stream, void * buf, size_t size)
+{
+    while (size) {
+        PAL_NUM bytes = DkStreamRead(stream, 0, size, buf, NULL, 0);
+        if (!bytes) {
+            if (PAL_NATIVE_ERRNO == PAL_ERROR_INTERRUPTED ||
+                PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN)
+                continue;
+            return PAL_NATIVE_ERRNO ? -PAL_ERRNO : -ECONNRESET;
+        }
+
+        buf += bytes;
+        size -= bytes;
+    }
+
+    return 0;
+}
+
+static int cp_stream_write (PAL_HANDLE stream, const void * buf, size_t size)
+{
+    while (size) {
+        PAL_NUM bytes = DkStreamWrite(stream, 0, size, (void *) buf, NULL);
+        if (!bytes) {
+            if (PAL_NATIVE_ERRNO == PAL_ERROR_INTERRUPTED ||
+                PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN)
+                continue;
+            return PAL_NATIVE_ERRNO ? -PAL_ERRNO : -ECONNRESET;
+        }
+
+        buf += bytes;
+        size -= bytes;
+    }
+
+    return 0;
+}
+
+static int serve_cp_stream (struct cp_stream * stream)
+{
+    struct shim_cp_streams * streams = stream->streams;
+    PAL_HANDLE srv = stream->handle;
+
+    /* the new process sends nothing before it is done with the streams,
+       so a readable process stream means it is gone */
+    PAL_HANDLE handles[2] = { srv, streams->proc };
+    PAL_HANDLE polled = NULL;
+
+    while (!polled) {
+        if (streams->aborted)
+            return -ECONNRESET;
+        polled = DkObjectsWaitAny(2, handles, CP_STREAM_WAIT_TIME);
+    }
+
+    if (polled != srv)
+        return -ECONNRESET;
+
+    PAL_HANDLE client = DkStreamWaitForClient(srv);
+    if (!client)
+        return -PAL_ERRNO;
+
+    struct cp_stream_chunk chunk;
+    void * buf = NULL;
+    int ret = 0;
+
+    /* without the buffers, the data is sent as it is */
+    if (streams->compress)
+        buf = malloc(CP_STREAM_CHUNK + LZ_WORK_SIZE);
+
+    while (true) {
+        lock(streams->lock);
+        while (!streams->aborted && !streams->finished &&
+               streams->next == streams->nchunks) {
+            streams->nwaiting++;
+            unlock(streams->lock);
+            wait_event(&streams->event);
+            lock(streams->lock);
+        }
+
+        if (streams->aborted) {
+            unlock(streams->lock);
+            ret = -ECONNRESET;
+            break;
+        }
+
+        if (streams->next == streams->nchunks) {
+            unlock(streams->lock);
+            memset(&chunk, 0, sizeof(chunk));
+            ret = cp_stream_write(client, &chunk, sizeof(chunk));
+            break;
+        }
+
+        chunk = streams->chunks[streams->next++];
+        unlock(streams->lock);
+
+        if (buf && !chunk.zero)
+            chunk.csize = lz_compress(chunk.addr, chunk.size, buf,
+                                      chunk.size - 1, buf + CP_STREAM_CHUNK);
+
+        if ((ret = cp_stream_write(client, &chunk, sizeof(chunk))) < 0)
+            break;
+
+        stream->nchunks++;
+        if (chunk.csize) {
+            stream->ncompressed++;
+            ret = cp_stream_write(client, buf, chunk.csize);
+        } else if (!chunk.zero)
+            ret = cp_stream_write(client, chunk.addr, chunk.size);
+        if (ret < 0)
+            break;
+
+        /* the area was made readable for the checkpoint */
+        if (!(chunk.prot & PAL_PROT_READ))
+            DkVirtualMemoryProtect(chunk.addr, chunk.size, chunk.prot);
+
+        if (!chunk.zero)
+            ADD_PROFILE_OCCURENCE(migrate_send_on_streams,
+                                  chunk.csize ? : chunk.size);
+    }
+
+    free(buf);
+    DkObjectClose(client);
+    return ret;
+}
+
+static void abort_cp_streams (struct shim_cp_streams * streams)
+{
+    lock(streams->lock);
+    streams->aborted = true;
+    wake_cp_streams(streams, streams->nwaiting);
+    unlock(streams->lock);
+}
+
+static void cp_stream_helper (void * arg)
+{
+    struct cp_stream * stream = (struct cp_stream *) arg;
+    struct shim_cp_streams * streams = stream->streams;
+    struct shim_thread * self = stream->thread;
+
+    __libc_tcb_t tcb;
+    allocate_tls(&tcb, false, self);
+    debug_setbuf(&tcb.shim_tcb, true);
+    debug("checkpoint stream helper thread started\n");
+
+    stream->ret = serve_cp_stream(stream);
+    if (stream->ret < 0) {
+        debug("failed sending memory on stream (ret = %d)\n", stream->ret);
+        abort_cp_streams(streams);
+    }
+
+    DkObjectClose(stream->handle);
+    stream->handle = NULL;
+
+    /* the streams are freed once the last helper is done */
+    if (atomic_dec_and_test(&streams->nrunning))
+        DkEventSet(streams->done);
+
+    put_thread(self);
+    debug("checkpoint stream helper thread terminated\n");
+    flush_slab_magazine();
+    DkThreadExit();
+}
+
+static void free_cp_streams (struct shim_cp_streams * streams)
+{
+    DkObjectClose(streams->done);
+    destroy_event(&streams->event);
+    destroy_lock(streams->lock);
+    free(streams->chunks);
+    free(streams->ranges);
+    free(streams);
+}
+
+/* list the VMAs whose memory can go on the streams */
+static int get_cp_stream_ranges (struct shim_cp_streams * streams)
+{
+    size_t count = DEFAULT_VMA_COUNT;
+    struct shim_vma_val * vmas;
+    int ret;
+
+    while (true) {
+        if (!(vmas = malloc(sizeof(*vmas) * count)))
+            return -ENOMEM;
+
+        if ((ret = dump_all_vmas(vmas, count)) != -EOVERFLOW)
+            break;
+
+        free(vmas);
+        count *= 2;
+    }
+
+    if (ret < 0) {
+        free(vmas);
+        return ret;
+    }
+
+    count = ret;
+    streams->ranges = malloc(sizeof(struct cp_stream_range) * (count ? : 1));
+    if (!streams->ranges) {
+        free_vma_val_array(vmas, count);
+        return -ENOMEM;
+    }
+
+    for (int i = 0 ; i < count ; i++)
+        if (NEED_MIGRATE_MEMORY(&vmas[i])) {
+            streams->ranges[streams->nranges].addr = vmas[i].addr;
+            streams->ranges[streams->nranges].size = vmas[i].length;
+            streams->nranges++;
+        }
+
+    free_vma_val_array(vmas, count);
+    return 0;
+}
+
+/*
+ * Create the streams and their helper threads in the parent. The URIs are
+ * passed in the header sent to the new process before the checkpoint.
+ */
+static int start_cp_streams (struct shim_cp_store * store, PAL_HANDLE proc,
+                             struct stream_header * hdr)
+{
+    read_cp_stream_config();
+
+    /* the memory is compressed by the helper threads */
+    int nstreams = cp_nstreams ? : (cp_compress ? 1 : 0);
+    if (!nstreams)
+        return 0;
+
+    struct shim_cp_streams * streams = malloc(sizeof(struct shim_cp_streams));
+    if (!streams)
+        return -ENOMEM;
+
+    memset(streams, 0, sizeof(struct shim_cp_streams));
+    create_lock(streams->lock);
+    create_event(&streams->event);
+    streams->proc = proc;
+
+    /* without the streams, the memory goes with the checkpoint */
+    if (!event_created(&streams->event) ||
+        !(streams->done = DkNotificationEventCreate(PAL_FALSE))) {
+        destroy_event(&streams->event);
+        destroy_lock(streams->lock);
+        free(streams);
+        return 0;
+    }
+
+    if (get_cp_stream_ranges(streams) < 0) {
+        free_cp_streams(streams);
+        return 0;
+    }
+
+    enable_locking();
+
+    for (int i = 0 ; i < nstreams ; i++) {
+        struct cp_stream * stream = &streams->stream[streams->nstreams];
+        PAL_HANDLE srv;
+
+        if (create_pipe(NULL, hdr->uri[streams->nstreams],
+                        sizeof(hdr->uri[0]), &srv, NULL) < 0)
+            break;
+
+        struct shim_thread * new = get_new_internal_thread();
+        if (!new) {
+            DkObjectClose(srv);
+            break;
+        }
+
+        stream->streams = streams;
+        stream->thread = new;
+        stream->handle = srv;
+        atomic_inc(&streams->nrunning);
+
+        PAL_HANDLE handle = thread_create(cp_stream_helper, stream, 0);
+        if (!handle) {
+            atomic_dec(&streams->nrunning);
+            put_thread(new);
+            DkObjectClose(srv);
+            break;
+        }
+
+        new->pal_handle = handle;
+        streams->nstreams++;
+    }
+
+    if (!streams->nstreams) {
+        free_cp_streams(streams);
+        return 0;
+    }
+
+    streams->compress = cp_compress ? CP_COMPRESS_LZ : 0;
+    debug("sending memory on %d streams%s\n", streams->nstreams,
+          streams->compress ? " compressed" : "");
+    hdr->nstreams = streams->nstreams;
+    hdr->compress = streams->compress;
+    hdr->nranges = streams->nranges;
+    store->streams = streams;
+    return 0;
+}
+
+/* Wait for the helper threads, in the parent, or for the receivers, in the
+   new process. */
+static int wait_cp_streams (struct shim_cp_streams * streams)
+{
+    int ret = 0, nchunks = 0, ncompressed = 0;
+
+    if (atomic_read(&streams->nrunning))
+        DkObjectsWaitAny(1, &streams->done, NO_TIMEOUT);
+
+    for (int i = 0 ; i < streams->nstreams ; i++) {
+        if (streams->stream[i].ret < 0)
+            ret = streams->stream[i].ret;
+        nchunks += streams->stream[i].nchunks;
+        ncompressed += streams->stream[i].ncompressed;
+    }
+
+    debug("%s %d chunks of memory (%d compressed) on %d streams\n",
+          streams->proc ? "sent" : "received", nchunks, ncompressed,
+          streams->nstreams);
+    return ret;
+}
+
+/* all the memory entries are queued */
+static void finish_cp_streams (struct shim_cp_store * store)
+{
+    struct shim_cp_streams * streams = store->streams;
+
+    queue_cp_memory(store);
+
+    lock(streams->lock);
+    streams->finished = true;
+    wake_cp_streams(streams, streams->nwaiting);
+    unlock(streams->lock);
+}
+
+/*
+ * In the new process, the memory is received by threads running only PAL
+ * calls, while the checkpoint is created and loaded.
+ */
+static struct shim_cp_streams incoming_streams;
+
+static int receive_cp_stream (struct cp_stream * stream)
+{
+    PAL_HANDLE handle = stream->handle;
+    void * buf = stream->buf;
+    struct cp_stream_chunk chunk;
+    int ret;
+
+    while (true) {
+        if ((ret = cp_stream_read(handle, &chunk, sizeof(chunk))) < 0)
+            return ret;
+
+        if (!chunk.addr)
+            return 0;
+
+        stream->nchunks++;
+
+        if (!DkVirtualMemoryAlloc(chunk.addr, chunk.size, 0,
+                                  chunk.prot|PAL_PROT_WRITE))
+            return -PAL_ERRNO;
+
+        if (chunk.csize) {
+            if (!buf || chunk.csize >= chunk.size ||
+                chunk.size > CP_STREAM_CHUNK)
+                return -EINVAL;
+
+            if ((ret = cp_stream_read(handle, buf, chunk.csize)) < 0)
+                return ret;
+
+            if (lz_decompress(buf, chunk.csize, chunk.addr, chunk.size)
+                != chunk.size)
+                return -EINVAL;
+
+            stream->ncompressed++;
+        } else if (!chunk.zero &&
+            (ret = cp_stream_read(handle, chunk.addr, chunk.size)) < 0) {
+            return ret;
+        }
+
+        if (!(chunk.prot & PAL_PROT_WRITE))
+            DkVirtualMemoryProtect(chunk.addr, chunk.size, chunk.prot);
+    }
+}
+
+static int cp_stream_receiver (void * arg)
+{
+    struct cp_stream * stream = (struct cp_stream *) arg;
+    struct shim_cp_streams * streams = stream->streams;
+
+    stream->ret = receive_cp_stream(stream);
+    DkObjectClose(stream->handle);
+    stream->handle = NULL;
+
+    if (atomic_dec_and_test(&streams->nrunning))
+        DkEventSet(streams->done);
+
+    DkThreadExit();
+    return 0;
+}
+
+static int open_cp_streams (struct stream_header * hdr)
+{
+    struct shim_cp_streams * streams = &incoming_streams;
+
+    if (hdr->nstreams > CP_MAX_STREAMS ||
+        (hdr->compress && hdr->compress != CP_COMPRESS_LZ))
+        return -EINVAL;
+
+    streams->compress = hdr->compress;
+
+    /* reserve the memory coming on the streams before allocating anything,
+       and in particular the buffers below; the restored VMAs replace the
+       reservations */
+    for (int i = 0 ; i < hdr->nranges ; ) {
+        struct cp_stream_range ranges[16];
+        int n = hdr->nranges - i < 16 ? hdr->nranges - i : 16;
+        int ret;
+
+        if ((ret = cp_stream_read(PAL_CB(parent_process), ranges,
+                                  sizeof(struct cp_stream_range) * n)) < 0)
+            return ret;
+
+        for (int j = 0 ; j < n ; j++, i++)
+            if ((ret = bkeep_mmap(ranges[j].addr, ranges[j].size, PROT_NONE,
+                                  MAP_PRIVATE|MAP_ANONYMOUS|VMA_UNMAPPED,
+                                  NULL, 0, "cpstream")) < 0)
+                return ret;
+    }
+
+    if (!(streams->done = DkNotificationEventCreate(PAL_FALSE)))
+        return -PAL_ERRNO;
+
+    for (int i = 0 ; i < hdr->nstreams ; i++) {
+        struct cp_stream * stream = &streams->stream[i];
+
+        debug("open checkpoint stream: %s\n", hdr->uri[i]);
+
+        if (!(stream->handle = DkStreamOpen(hdr->uri[i], 0, 0, 0, 0)))
+            return -PAL_ERRNO;
+
+        /* the receivers only make PAL calls */
+        if (streams->compress && !(stream->buf = malloc(CP_STREAM_CHUNK)))
+            return -ENOMEM;
+
+        stream->streams = streams;
+        stream->running = true;
+        streams->nstreams++;
+        atomic_inc(&streams->nrunning);
+
+        /* without a thread, the stream is read after the checkpoint */
+        if (!DkThreadCreate(cp_stream_receiver, stream, 0)) {
+            atomic_dec(&streams->nrunning);
+            stream->running = false;
+        }
+    }
+
+    return 0;
+}
+
+static int close_cp_streams (void)
+{
+    struct shim_cp_streams * streams = &incoming_streams;
+
+    if (!streams->nstreams)
+        return 0;
+
+    for (int i = 0 ; i < streams->nstreams ; i++) {
+        struct cp_stream * stream = &streams->stream[i];
+        if (!stream->running) {
+            stream->ret = receive_cp_stream(stream);
+            DkObjectClose(stream->handle);
+            stream->handle = NULL;
+        }
+    }
+
+    int ret = wait_cp_streams(streams);
+
+    for (int i = 0 ; i < streams->nstreams ; i++)
+        free(streams->stream[i].buf);
+
+    DkObjectClose(streams->done);
+    memset(streams, 0, sizeof(struct shim_cp_streams));
+    return ret;
+}
+
 static void * cp_alloc (struct shim_cp_store * store, void * addr, size_t size)
 {
     if (addr) {
@@ -860,13 +1742,16 @@ DEFINE_PROFILE_INTERVAL(migrate_create_process,   migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_create_gipc,      migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_connect_ipc,      migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_init_checkpoint,  migrate_proc);
+DEFINE_PROFILE_INTERVAL(migrate_start_streams,    migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_save_checkpoint,  migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_send_header,      migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_send_checkpoint,  migrate_proc);
 DEFINE_PROFILE_OCCURENCE(migrate_send_on_stream,  migrate_proc);
+DEFINE_PROFILE_OCCURENCE(migrate_send_on_streams, migrate_proc);
 DEFINE_PROFILE_OCCURENCE(migrate_send_gipc_pages, migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_send_pal_handles, migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_free_checkpoint,  migrate_proc);
+DEFINE_PROFILE_INTERVAL(migrate_wait_streams,     migrate_proc);
 DEFINE_PROFILE_INTERVAL(migrate_wait_response,    migrate_proc);
 
 static bool warn_no_gipc __attribute_migratable = true;
@@ -921,17 +1806,22 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
     /*
      * Detect if GIPC is supported by the host. If GIPC is not supported
      * forking may be slow because we have to use RPC streams for migrating
-     * user memory.
+     * user memory. Post-copy migration, if enabled, goes without GIPC, and
+     * so does the memory if the manifest sets "sys.fork_streams" or
+     * "sys.fork_compress".
      */
+    read_cp_stream_config();
+
     bool use_gipc = false;
     PAL_NUM gipc_key;
-    PAL_HANDLE gipc_hdl = DkCreatePhysicalMemoryChannel(&gipc_key);
+    PAL_HANDLE gipc_hdl = postcopy_enabled() || cp_copy_memory ? NULL :
+                          DkCreatePhysicalMemoryChannel(&gipc_key);
 
     if (gipc_hdl) {
         debug("created gipc store: gipc:%lu\n", gipc_key);
         use_gipc = true;
         SAVE_PROFILE_INTERVAL(migrate_create_gipc);
-    } else {
+    } else if (!postcopy_enabled() && !cp_copy_memory) {
         if (warn_no_gipc) {
             warn_no_gipc = false;
             sys_printf("WARNING: no physical memory support, process creation "
@@ -959,6 +1849,12 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
     cpstore->use_gipc = use_gipc;
     cpstore->bound    = CP_INIT_VMA_SIZE;
 
+    /* Without GIPC, the large anonymous memory is sent after the new
+       process starts, and fetched by it on demand */
+    if (!use_gipc)
+        start_postcopy(cpstore, thread, hdr.checkpoint.postcopy.uri,
+                       sizeof(hdr.checkpoint.postcopy.uri));
+
     while (1) {
         /*
          * Try allocating a space of a certain size. If the allocation fails,
@@ -981,6 +1877,49 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
 
     SAVE_PROFILE_INTERVAL(migrate_init_checkpoint);
 
+    /*
+     * Without GIPC, the new process is told where to receive the memory
+     * before the checkpoint is created, so the memory is sent over parallel
+     * streams while the rest is serialized. The checkpoint follows another
+     * header later.
+     */
+    if (!use_gipc) {
+        cpstore->pagemap = DkStreamOpen("file:/proc/self/pagemap",
+                                        PAL_ACCESS_RDONLY, 0, 0, 0);
+
+        if ((ret = start_cp_streams(cpstore, proc,
+                                    &hdr.checkpoint.streams)) < 0)
+            goto err;
+
+        if (hdr.checkpoint.streams.nstreams) {
+#ifdef PROFILE
+            hdr.begin_create_time  = begin_create_time;
+            hdr.create_time = create_time;
+            hdr.write_proc_time = GET_PROFILE_INTERVAL();
+#endif
+            struct shim_cp_streams * streams = cpstore->streams;
+            size_t ranges_size =
+                    sizeof(struct cp_stream_range) * streams->nranges;
+
+            if ((ret = cp_stream_write(proc, &hdr,
+                                       sizeof(struct newproc_header))) < 0 ||
+                (ret = cp_stream_write(proc, streams->ranges,
+                                       ranges_size)) < 0) {
+                debug("failed writing to process stream (ret = %d)\n", ret);
+                goto err;
+            }
+
+            ADD_PROFILE_OCCURENCE(migrate_send_on_stream,
+                                  sizeof(struct newproc_header) + ranges_size);
+        }
+
+        SAVE_PROFILE_INTERVAL(migrate_start_streams);
+    }
+
+    /* Return the objects cached by this thread to the slab manager, so the
+     * checkpoint sees a consistent heap. */
+    flush_slab_magazine();
+
     /* Calling the migration function defined by the caller. */
     va_list ap;
     va_start(ap, thread);
@@ -991,6 +1930,20 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
         goto err;
     }
 
+    if (cpstore->streams)
+        finish_cp_streams(cpstore);
+
+    /* Leave the zero pages out of the memory sent with the checkpoint */
+    if (!use_gipc && (ret = map_cp_memory(cpstore)) < 0) {
+        debug("failed mapping checkpoint memory (ret = %d)\n", ret);
+        goto err;
+    }
+
+    if (cpstore->pagemap) {
+        DkObjectClose(cpstore->pagemap);
+        cpstore->pagemap = NULL;
+    }
+
     SAVE_PROFILE_INTERVAL(migrate_save_checkpoint);
 
     unsigned long checkpoint_time = GET_PROFILE_INTERVAL();
@@ -1020,6 +1973,12 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
         }
     }
 
+    if (cpstore->use_postcopy && !cpstore->postcopy_nentries) {
+        abort_postcopy();
+        cpstore->use_postcopy = false;
+        hdr.checkpoint.postcopy.uri[0] = 0;
+    }
+
     if (cpstore->palhdl_nentries) {
         hdr.checkpoint.palhdl.entoffset =
                     (ptr_t) cpstore->last_palhdl_entry - cpstore->base;
@@ -1034,16 +1993,28 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
 
     /*
      * Sending a header to the new process through the RPC stream to
-     * notify the process to start receiving the checkpoint.
+     * notify the process to start receiving the checkpoint. If the
+     * process has got a header already, only the checkpoint part is sent.
      */
-    bytes = DkStreamWrite(proc, 0, sizeof(struct newproc_header), &hdr, NULL);
-    if (!bytes) {
-        ret = -PAL_ERRNO;
-        debug("failed writing to process stream (ret = %d)\n", ret);
-        goto err;
-    } else if (bytes < sizeof(struct newproc_header)) {
-        ret = -EACCES;
-        goto err;
+    if (hdr.checkpoint.streams.nstreams) {
+        if ((ret = cp_stream_write(proc, &hdr.checkpoint,
+                                   sizeof(struct newproc_cp_header))) < 0) {
+            debug("failed writing to process stream (ret = %d)\n", ret);
+            goto err;
+        }
+
+        bytes = sizeof(struct newproc_cp_header);
+    } else {
+        bytes = DkStreamWrite(proc, 0, sizeof(struct newproc_header), &hdr,
+                              NULL);
+        if (!bytes) {
+            ret = -PAL_ERRNO;
+            debug("failed writing to process stream (ret = %d)\n", ret);
+            goto err;
+        } else if (bytes < sizeof(struct newproc_header)) {
+            ret = -EACCES;
+            goto err;
+        }
     }
 
     ADD_PROFILE_OCCURENCE(migrate_send_on_stream, bytes);
@@ -1069,6 +2040,12 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
 
     SAVE_PROFILE_INTERVAL(migrate_send_pal_handles);
 
+    /* Start sending the rest of the memory */
+    if (cpstore->use_postcopy && (ret = run_postcopy()) < 0) {
+        debug("failed post-copy migration (ret = %d)\n", ret);
+        goto err;
+    }
+
     /* Free the checkpoint space */
     if ((ret = bkeep_munmap((void *) cpstore->base, cpstore->bound,
                             CP_VMA_FLAGS)) < 0) {
@@ -1080,6 +2057,19 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
 
     SAVE_PROFILE_INTERVAL(migrate_free_checkpoint);
 
+    /* The memory has to be sent before the process goes on */
+    if (cpstore->streams) {
+        ret = wait_cp_streams(cpstore->streams);
+        free_cp_streams(cpstore->streams);
+        cpstore->streams = NULL;
+        if (ret < 0) {
+            debug("failed sending memory on streams (ret = %d)\n", ret);
+            goto err;
+        }
+
+        SAVE_PROFILE_INTERVAL(migrate_wait_streams);
+    }
+
     /* Wait for the response from the new process */
     struct newproc_response res;
     bytes = DkStreamRead(proc, 0, sizeof(struct newproc_response), &res,
@@ -1108,6 +2098,15 @@ int do_migrate_process (int (*migrate) (struct shim_cp_store *,
     destroy_process(new_process);
     return 0;
 err:
+    if (cpstore && cpstore->use_postcopy)
+        abort_postcopy();
+    if (cpstore && cpstore->pagemap)
+        DkObjectClose(cpstore->pagemap);
+    if (cpstore && cpstore->streams) {
+        abort_cp_streams(cpstore->streams);
+        wait_cp_streams(cpstore->streams);
+        free_cp_streams(cpstore->streams);
+    }
     if (gipc_hdl)
         DkObjectClose(gipc_hdl);
     if (proc)
@@ -1128,15 +2127,35 @@ err:
 int do_migration (struct newproc_cp_header * hdr, void ** cpptr)
 {
     void * base = NULL;
-    size_t size = hdr->hdr.size;
+    size_t size;
     PAL_PTR mapaddr;
     PAL_NUM mapsize;
     long rebase;
-    bool use_gipc = !!hdr->gipc.uri[0];
+    bool use_gipc;
     PAL_HANDLE gipc_store;
     int ret = 0;
     BEGIN_PROFILE_INTERVAL();
 
+    /*
+     * The memory is received over parallel streams while the parent is
+     * creating the checkpoint, which follows another header.
+     */
+    if (hdr->streams.nstreams) {
+        if ((ret = open_cp_streams(&hdr->streams)) < 0)
+            return ret;
+
+        SAVE_PROFILE_INTERVAL(child_open_streams);
+
+        if ((ret = cp_stream_read(PAL_CB(parent_process), hdr,
+                                  sizeof(struct newproc_cp_header))) < 0)
+            return ret;
+
+        SAVE_PROFILE_INTERVAL(child_wait_checkpoint);
+    }
+
+    size = hdr->hdr.size;
+    use_gipc = !!hdr->gipc.uri[0];
+
     /*
      * Allocate a large enough space to load the checkpoint data.
      *
@@ -1235,6 +2254,16 @@ int do_migration (struct newproc_cp_header * hdr, void ** cpptr)
 
     SAVE_PROFILE_INTERVAL(child_receive_handles);
 
+    /* The checkpoint is restored once the memory is in place */
+    if ((ret = close_cp_streams()) < 0)
+        return ret;
+
+    SAVE_PROFILE_INTERVAL(child_receive_streams);
+
+    /* The rest of the memory comes after the checkpoint */
+    if (hdr->postcopy.uri[0] && (ret = open_postcopy(&hdr->postcopy)) < 0)
+        return ret;
+
     migrated_memory_start = (void *) mapaddr;
     migrated_memory_end = (void *) mapaddr + mapsize;
     *cpptr = (void *) base;
@@ -184,6 +184,7 @@ void init_tcb (shim_tcb_t * tcb)
 {
     tcb->canary = SHIM_TLS_CANARY;
     tcb->self = tcb;
+    tcb->slab_magazine = NULL;
 }
 
 void copy_tcb (shim_tcb_t * new_tcb, const shim_tcb_t * old_tcb)
@@ -224,7 +225,12 @@ void populate_tls (void * tcb_location, bool user)
     __libc_tcb_t * tcb = (__libc_tcb_t *) tcb_location;
     assert(tcb);
     tcb->tcb = tcb;
-    copy_tcb(&tcb->shim_tcb, SHIM_GET_TLS());
+    shim_tcb_t * cur_tcb = SHIM_GET_TLS();
+    copy_tcb(&tcb->shim_tcb, cur_tcb);
+
+    /* The slab magazine moves to the new TCB */
+    tcb->shim_tcb.slab_magazine = cur_tcb->slab_magazine;
+    cur_tcb->slab_magazine = NULL;
 
     struct shim_thread * thread = (struct shim_thread *) tcb->shim_tcb.tp;
     if (thread) {
@@ -630,6 +636,7 @@ DEFINE_PROFILE_INTERVAL(init_internal_map,          init);
 DEFINE_PROFILE_INTERVAL(init_fs,                    init);
 DEFINE_PROFILE_INTERVAL(init_dcache,                init);
 DEFINE_PROFILE_INTERVAL(init_handle,                init);
+DEFINE_PROFILE_INTERVAL(init_postcopy,              init);
 DEFINE_PROFILE_INTERVAL(read_from_checkpoint,       init);
 DEFINE_PROFILE_INTERVAL(read_from_file,             init);
 DEFINE_PROFILE_INTERVAL(init_newproc,               init);
@@ -647,6 +654,7 @@ DEFINE_PROFILE_INTERVAL(read_environs,              init);
 DEFINE_PROFILE_INTERVAL(init_loader,                init);
 DEFINE_PROFILE_INTERVAL(init_ipc_helper,            init);
 DEFINE_PROFILE_INTERVAL(init_signal,                init);
+DEFINE_PROFILE_INTERVAL(init_postcopy_helper,       init);
 
 #define CALL_INIT(func, args ...)   func(args)
 
@@ -717,6 +725,7 @@ int shim_init (int argc, void * args, void ** return_stack)
     RUN_INIT(init_fs);
     RUN_INIT(init_dcache);
     RUN_INIT(init_handle);
+    RUN_INIT(init_postcopy);
 
     debug("shim loaded at %p, ready to initialize\n", &__load_address);
 
@@ -740,7 +749,7 @@ int shim_init (int argc, void * args, void ** return_stack)
         begin_create_time = hdr.begin_create_time;
 #endif
 
-        if (hdr.checkpoint.hdr.size)
+        if (hdr.checkpoint.hdr.size || hdr.checkpoint.streams.nstreams)
             RUN_INIT(do_migration, &hdr.checkpoint, &cpaddr);
     }
 
@@ -765,6 +774,7 @@ restore:
     RUN_INIT(init_loader);
     RUN_INIT(init_ipc_helper);
     RUN_INIT(init_signal);
+    RUN_INIT(init_postcopy_helper);
 
     if (PAL_CB(parent_process)) {
         /* Notify the parent process */
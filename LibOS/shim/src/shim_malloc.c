@@ -40,9 +40,30 @@
 
 static LOCKTYPE slab_mgr_lock;
 
-#define system_lock()       lock(slab_mgr_lock)
-#define system_unlock()     unlock(slab_mgr_lock)
-#define PAGE_SIZE           allocsize
+/*
+ * Once the library OS becomes multi-threaded (i.e., lock_enabled is set),
+ * each thread caches free objects in a slab magazine stored in its TCB, to
+ * avoid taking slab_mgr_lock for most allocations. Before that, locking
+ * slab_mgr_lock is a no-op, so the magazines are not needed.
+ */
+static inline struct slab_magazine ** get_slab_magazine (void)
+{
+    if (!lock_enabled)
+        return NULL;
+
+    shim_tcb_t * tcb = SHIM_GET_TLS();
+    if (!tcb || tcb->canary != SHIM_TLS_CANARY)
+        return NULL;
+
+    return &tcb->slab_magazine;
+}
+
+#define system_lock()           lock(slab_mgr_lock)
+#define system_unlock()         unlock(slab_mgr_lock)
+#define system_magazine()       get_slab_magazine()
+#define system_magazine_enter() disable_preempt(NULL)
+#define system_magazine_exit()  enable_preempt(NULL)
+#define PAGE_SIZE               allocsize
 
 #ifdef SLAB_DEBUG_TRACE
 # define SLAB_DEBUG
@@ -115,6 +136,16 @@ int init_slab (void)
 
 extern_alias(init_slab);
 
+/*
+ * Return the objects cached by the current thread to the slab manager.
+ * Must be called before a thread exits, so the objects are not leaked.
+ */
+void flush_slab_magazine (void)
+{
+    if (slab_mgr)
+        slab_flush_magazine(slab_mgr);
+}
+
 int reinit_slab (void)
 {
     if (slab_mgr) {
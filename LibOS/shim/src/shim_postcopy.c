@@ -0,0 +1,923 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+/* Copyright (C) 2014 Stony Brook University
+   This file is part of Graphene Library OS.
+
+   Graphene Library OS is free software: you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   Graphene Library OS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+ * shim_postcopy.c
+ *
+ * This file contains the post-copy migration of memory for fork without
+ * GIPC. The large anonymous VMAs are left out of the checkpoint, except
+ * for the working set hinted by the parent; the child maps them without
+ * access and fetches them in chunks on first touch, while a helper thread
+ * of the parent streams the rest over a dedicated pipe.
+ *
+ * Until a chunk is sent, the parent write-protects it, and saves a copy
+ * of it on the first write. The child installs a chunk through
+ * /proc/self/mem, so the pages only become accessible once filled.
+ */
+
+#include <shim_internal.h>
+#include <shim_utils.h>
+#include <shim_thread.h>
+#include <shim_vma.h>
+#include <shim_checkpoint.h>
+#include <shim_profile.h>
+
+#include <pal.h>
+#include <pal_error.h>
+
+#include <errno.h>
+
+#define POSTCOPY_CHUNK_SIZE     (64 * 1024)
+#define POSTCOPY_WAIT_TIME      10000   /* microseconds, without futexes */
+
+/* states of a chunk */
+#define POSTCOPY_DONE       1   /* sent to (or installed by) the child */
+#define POSTCOPY_SAVED      2   /* the parent keeps a copy of it */
+#define POSTCOPY_RELEASED   4   /* remapped or reprotected since */
+
+/* requests from the child */
+enum {
+    POSTCOPY_FETCH = 1,     /* send the chunks of the range right away */
+    POSTCOPY_DROP,          /* the range is no longer needed */
+};
+
+struct postcopy_req {
+    void * addr;
+    size_t size;
+    int    type;
+};
+
+/* chunks sent to the child; followed by the data, a NULL address ends
+   the session */
+struct postcopy_msg {
+    void * addr;
+    size_t size;
+};
+
+struct postcopy_range {
+    void *          addr;
+    size_t          size;
+    int             prot;
+    unsigned char * chunks;     /* states of the chunks */
+    void **         saved;      /* copies kept by the parent */
+};
+
+static struct postcopy_session {
+    LOCKTYPE                lock;
+    volatile bool           active;
+    bool                    running;    /* served by a helper thread */
+    PAL_HANDLE              stream;
+    PAL_HANDLE              memfile;
+    struct postcopy_range * ranges;
+    int                     nranges, maxranges;
+    unsigned long           nleft;      /* chunks not sent yet */
+    unsigned int            seq;        /* bumped on every chunk installed */
+} outgoing, incoming;
+
+static int postcopy_state = -1;   /* 0: disabled, 1: enabled */
+
+#define CHUNK_COUNT(r)   \
+    (((r)->size + POSTCOPY_CHUNK_SIZE - 1) / POSTCOPY_CHUNK_SIZE)
+#define CHUNK_INDEX(r, a)   (((void *) (a) - (r)->addr) / POSTCOPY_CHUNK_SIZE)
+#define CHUNK_ADDR(r, i)    ((r)->addr + (size_t) (i) * POSTCOPY_CHUNK_SIZE)
+#define CHUNK_SIZE(r, i)                                            \
+    ((r)->size - (size_t) (i) * POSTCOPY_CHUNK_SIZE < POSTCOPY_CHUNK_SIZE ? \
+     (r)->size - (size_t) (i) * POSTCOPY_CHUNK_SIZE : POSTCOPY_CHUNK_SIZE)
+
+/* session->lock needs to be held */
+static struct postcopy_range *
+lookup_range (struct postcopy_session * session, void * addr)
+{
+    int lo = 0, hi = session->nranges;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        struct postcopy_range * r = &session->ranges[mid];
+
+        if (addr < r->addr)
+            hi = mid;
+        else if (addr >= r->addr + r->size)
+            lo = mid + 1;
+        else
+            return r;
+    }
+
+    return NULL;
+}
+
+/* session->lock needs to be held */
+static int add_range (struct postcopy_session * session, void * addr,
+                      size_t size, int prot)
+{
+    if (session->nranges == session->maxranges) {
+        int max = session->maxranges ? session->maxranges * 2 : 8;
+        struct postcopy_range * ranges =
+                malloc(sizeof(struct postcopy_range) * max);
+        if (!ranges)
+            return -ENOMEM;
+
+        if (session->ranges) {
+            memcpy(ranges, session->ranges,
+                   sizeof(struct postcopy_range) * session->nranges);
+            free(session->ranges);
+        }
+
+        session->ranges = ranges;
+        session->maxranges = max;
+    }
+
+    struct postcopy_range * r = session->ranges;
+    while (r < session->ranges + session->nranges && r->addr < addr)
+        r++;
+
+    unsigned long nchunks = (size + POSTCOPY_CHUNK_SIZE - 1) /
+                            POSTCOPY_CHUNK_SIZE;
+    unsigned char * chunks = malloc(nchunks);
+    if (!chunks)
+        return -ENOMEM;
+    memset(chunks, 0, nchunks);
+
+    memmove(r + 1, r, (void *) (session->ranges + session->nranges) -
+            (void *) r);
+    session->nranges++;
+
+    r->addr   = addr;
+    r->size   = size;
+    r->prot   = prot;
+    r->chunks = chunks;
+    r->saved  = NULL;
+    session->nleft += nchunks;
+    return 0;
+}
+
+/* session->lock needs to be held */
+static void free_ranges (struct postcopy_session * session)
+{
+    for (int i = 0 ; i < session->nranges ; i++) {
+        struct postcopy_range * r = &session->ranges[i];
+
+        if (r->saved) {
+            for (unsigned long j = 0 ; j < CHUNK_COUNT(r) ; j++)
+                if (r->saved[j])
+                    free(r->saved[j]);
+            free(r->saved);
+        }
+
+        free(r->chunks);
+    }
+
+    if (session->ranges)
+        free(session->ranges);
+
+    session->ranges = NULL;
+    session->nranges = session->maxranges = 0;
+    session->nleft = 0;
+}
+
+static int postcopy_read (PAL_HANDLE stream, void * buf, size_t size)
+{
+    while (size) {
+        PAL_NUM bytes = DkStreamRead(stream, 0, size, buf, NULL, 0);
+        if (!bytes) {
+            if (PAL_NATIVE_ERRNO == PAL_ERROR_INTERRUPTED ||
+                PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN)
+                continue;
+            return PAL_NATIVE_ERRNO ? -PAL_ERRNO : -ECONNRESET;
+        }
+
+        buf += bytes;
+        size -= bytes;
+    }
+
+    return 0;
+}
+
+static int postcopy_write (PAL_HANDLE stream, const void * buf, size_t size)
+{
+    while (size) {
+        PAL_NUM bytes = DkStreamWrite(stream, 0, size, (void *) buf, NULL);
+        if (!bytes) {
+            if (PAL_NATIVE_ERRNO == PAL_ERROR_INTERRUPTED ||
+                PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN)
+                continue;
+            return PAL_NATIVE_ERRNO ? -PAL_ERRNO : -ECONNRESET;
+        }
+
+        buf += bytes;
+        size -= bytes;
+    }
+
+    return 0;
+}
+
+/*
+ * The parent side
+ */
+
+/* outgoing.lock needs to be held */
+static bool save_chunk (struct postcopy_range * r, unsigned long i)
+{
+    size_t size = CHUNK_SIZE(r, i);
+
+    if (!r->saved) {
+        unsigned long nchunks = CHUNK_COUNT(r);
+        if (!(r->saved = malloc(sizeof(void *) * nchunks)))
+            return false;
+        memset(r->saved, 0, sizeof(void *) * nchunks);
+    }
+
+    void * copy = malloc(size);
+    if (!copy)
+        return false;
+
+    memcpy(copy, CHUNK_ADDR(r, i), size);
+    r->saved[i] = copy;
+    r->chunks[i] |= POSTCOPY_SAVED;
+
+    if (r->prot & PAL_PROT_WRITE)
+        DkVirtualMemoryProtect(CHUNK_ADDR(r, i), size, r->prot);
+    return true;
+}
+
+/* give back the write access to the chunks not sent yet; outgoing.lock
+   needs to be held */
+static void unprotect_pending (struct postcopy_range * r)
+{
+    unsigned long nchunks = CHUNK_COUNT(r);
+
+    if (!(r->prot & PAL_PROT_WRITE))
+        return;
+
+    for (unsigned long i = 0 ; i < nchunks ; ) {
+        if (r->chunks[i]) {
+            i++;
+            continue;
+        }
+
+        unsigned long j = i;
+        while (j < nchunks && !r->chunks[j])
+            j++;
+
+        DkVirtualMemoryProtect(CHUNK_ADDR(r, i),
+                               CHUNK_ADDR(r, j - 1) + CHUNK_SIZE(r, j - 1) -
+                               CHUNK_ADDR(r, i), r->prot);
+        i = j;
+    }
+}
+
+/* outgoing.lock needs to be held */
+static int send_chunk (struct postcopy_range * r, unsigned long i)
+{
+    unsigned char state = r->chunks[i];
+    if (state & POSTCOPY_DONE)
+        return 0;
+
+    struct postcopy_msg msg = { .addr = CHUNK_ADDR(r, i),
+                                .size = CHUNK_SIZE(r, i) };
+    void * data = (state & POSTCOPY_SAVED) ? r->saved[i] : msg.addr;
+    int ret;
+
+    if ((ret = postcopy_write(outgoing.stream, &msg, sizeof(msg))) < 0 ||
+        (ret = postcopy_write(outgoing.stream, data, msg.size)) < 0)
+        return ret;
+
+    r->chunks[i] |= POSTCOPY_DONE;
+    outgoing.nleft--;
+
+    if (state & POSTCOPY_SAVED) {
+        free(r->saved[i]);
+        r->saved[i] = NULL;
+    } else if (r->prot & PAL_PROT_WRITE) {
+        DkVirtualMemoryProtect(msg.addr, msg.size, r->prot);
+    }
+
+    return 0;
+}
+
+/* iterate over the chunks overlapping [addr, addr + size); session->lock
+   needs to be held */
+#define FOR_EACH_CHUNK(session, start, len, r, i)                           \
+    for (struct postcopy_range * r = (session)->ranges ;                    \
+         r < (session)->ranges + (session)->nranges ; r++)                  \
+        if (r->addr < (start) + (len) && r->addr + r->size > (start))       \
+            for (unsigned long i = (start) > r->addr ?                      \
+                                   CHUNK_INDEX(r, (start)) : 0 ;            \
+                 i < CHUNK_COUNT(r) && CHUNK_ADDR(r, i) < (start) + (len) ; \
+                 i++)
+
+static int serve_request (struct postcopy_req * req)
+{
+    int ret = 0;
+
+    lock(outgoing.lock);
+    FOR_EACH_CHUNK(&outgoing, req->addr, req->size, r, i) {
+        if (req->type == POSTCOPY_FETCH) {
+            if ((ret = send_chunk(r, i)) < 0)
+                goto out;
+            continue;
+        }
+
+        /* the child doesn't need the chunk anymore */
+        unsigned char state = r->chunks[i];
+        if (state & POSTCOPY_DONE)
+            continue;
+
+        if (state & POSTCOPY_SAVED) {
+            free(r->saved[i]);
+            r->saved[i] = NULL;
+        } else if (r->prot & PAL_PROT_WRITE) {
+            DkVirtualMemoryProtect(CHUNK_ADDR(r, i), CHUNK_SIZE(r, i),
+                                   r->prot);
+        }
+
+        r->chunks[i] |= POSTCOPY_DONE;
+        outgoing.nleft--;
+    }
+out:
+    unlock(outgoing.lock);
+    return ret;
+}
+
+static int serve_postcopy (void)
+{
+    PAL_HANDLE client = DkStreamWaitForClient(outgoing.stream);
+    if (!client)
+        return -PAL_ERRNO;
+
+    lock(outgoing.lock);
+    DkObjectClose(outgoing.stream);
+    outgoing.stream = client;
+    unlock(outgoing.lock);
+
+    int cur = 0;
+    unsigned long next = 0;
+    int ret;
+
+    while (true) {
+        /* the requests of the child go before pushing the rest */
+        if (DkObjectsWaitAny(1, &client, 0)) {
+            struct postcopy_req req;
+            if ((ret = postcopy_read(client, &req, sizeof(req))) < 0 ||
+                (ret = serve_request(&req)) < 0)
+                return ret;
+            continue;
+        }
+
+        lock(outgoing.lock);
+        if (!outgoing.nleft) {
+            unlock(outgoing.lock);
+            break;
+        }
+
+        while (cur < outgoing.nranges) {
+            struct postcopy_range * r = &outgoing.ranges[cur];
+            if (next < CHUNK_COUNT(r) && (r->chunks[next] & POSTCOPY_DONE)) {
+                next++;
+                continue;
+            }
+            if (next == CHUNK_COUNT(r)) {
+                cur++;
+                next = 0;
+                continue;
+            }
+            break;
+        }
+
+        ret = cur < outgoing.nranges ?
+              send_chunk(&outgoing.ranges[cur], next) : -EINVAL;
+        unlock(outgoing.lock);
+        if (ret < 0)
+            return ret;
+    }
+
+    struct postcopy_msg end = { .addr = NULL, .size = 0 };
+    return postcopy_write(client, &end, sizeof(end));
+}
+
+static void finish_outgoing (void)
+{
+    lock(outgoing.lock);
+    for (int i = 0 ; i < outgoing.nranges ; i++)
+        unprotect_pending(&outgoing.ranges[i]);
+    free_ranges(&outgoing);
+
+    if (outgoing.stream) {
+        DkObjectClose(outgoing.stream);
+        outgoing.stream = NULL;
+    }
+
+    outgoing.running = false;
+    outgoing.active = false;
+    unlock(outgoing.lock);
+}
+
+static void postcopy_helper (void * arg);
+
+bool postcopy_enabled (void)
+{
+    if (postcopy_state < 0) {
+        char cfg[CONFIG_MAX];
+
+        postcopy_state = root_config &&
+            get_config(root_config, "sys.fork_postcopy", cfg, CONFIG_MAX) > 0 &&
+            parse_int(cfg) > 0;
+    }
+
+    return postcopy_state > 0;
+}
+
+/* start sending the memory of the store after the checkpoint; only one
+   process is served at a time, the other ones get their memory copied */
+bool start_postcopy (struct shim_cp_store * store, struct shim_thread * thread,
+                     char * uri, size_t size)
+{
+    if (!postcopy_enabled())
+        return false;
+
+    lock(outgoing.lock);
+    if (outgoing.active) {
+        unlock(outgoing.lock);
+        return false;
+    }
+
+    PAL_HANDLE stream;
+    if (create_pipe(NULL, uri, size, &stream, NULL) < 0) {
+        unlock(outgoing.lock);
+        return false;
+    }
+
+    outgoing.stream = stream;
+    outgoing.running = false;
+    outgoing.active = true;
+    unlock(outgoing.lock);
+
+    /* the tcb and the stack of the thread are its working set */
+    store->use_postcopy = true;
+    store->postcopy_nhints = 0;
+
+    if (thread->tcb) {
+        store->postcopy_hints[store->postcopy_nhints].start = thread->tcb;
+        store->postcopy_hints[store->postcopy_nhints].end =
+                thread->tcb + sizeof(__libc_tcb_t);
+        store->postcopy_nhints++;
+    }
+
+    if (thread->stack && thread->stack_top > thread->stack) {
+        store->postcopy_hints[store->postcopy_nhints].start = thread->stack;
+        store->postcopy_hints[store->postcopy_nhints].end = thread->stack_top;
+        store->postcopy_nhints++;
+    }
+
+    debug("post-copy migration on %s\n", uri);
+    return true;
+}
+
+/* serve the child, which has received the checkpoint */
+int run_postcopy (void)
+{
+    lock(outgoing.lock);
+    outgoing.running = true;
+    unlock(outgoing.lock);
+
+    enable_locking();
+
+    struct shim_thread * new = get_new_internal_thread();
+    PAL_HANDLE handle = new ? thread_create(postcopy_helper, new, 0) : NULL;
+
+    if (!handle) {
+        /* push everything before going on */
+        if (new)
+            put_thread(new);
+
+        int ret = serve_postcopy();
+        finish_outgoing();
+        return ret;
+    }
+
+    new->pal_handle = handle;
+    return 0;
+}
+
+/* give up on the session before the child is served */
+void abort_postcopy (void)
+{
+    lock(outgoing.lock);
+    bool running = outgoing.running;
+    unlock(outgoing.lock);
+
+    if (!running)
+        finish_outgoing();
+}
+
+static bool outgoing_fault (void * addr)
+{
+    bool handled = false;
+
+    lock(outgoing.lock);
+    struct postcopy_range * r = lookup_range(&outgoing, addr);
+    if (!r || !(r->prot & PAL_PROT_WRITE))
+        goto out;
+
+    unsigned long i = CHUNK_INDEX(r, addr);
+    unsigned char state = r->chunks[i];
+
+    if (state & POSTCOPY_RELEASED)
+        goto out;
+
+    /* otherwise, the chunk is either write-protected for the child, or
+       was just made writable by another thread */
+    handled = state ? true : save_chunk(r, i);
+out:
+    unlock(outgoing.lock);
+    return handled;
+}
+
+static void release_outgoing (void * addr, size_t size)
+{
+    lock(outgoing.lock);
+    FOR_EACH_CHUNK(&outgoing, addr, size, r, i) {
+        if (!r->chunks[i] && !save_chunk(r, i))
+            continue;
+        r->chunks[i] |= POSTCOPY_RELEASED;
+    }
+    unlock(outgoing.lock);
+}
+
+static void postcopy_helper (void * arg)
+{
+    struct shim_thread * self = (struct shim_thread *) arg;
+    if (!arg)
+        return;
+
+    __libc_tcb_t tcb;
+    allocate_tls(&tcb, false, self);
+    debug_setbuf(&tcb.shim_tcb, true);
+    debug("postcopy helper thread started\n");
+
+    int ret = serve_postcopy();
+    if (ret < 0)
+        debug("post-copy migration failed (ret = %d)\n", ret);
+
+    finish_outgoing();
+
+    put_thread(self);
+    debug("postcopy helper thread terminated\n");
+    flush_slab_magazine();
+    DkThreadExit();
+}
+
+BEGIN_CP_FUNC(postcopy)
+{
+    struct shim_vma_val * vma = (struct shim_vma_val *) obj;
+    void * start = vma->addr, * end = vma->addr + size;
+    int prot = PAL_PROT(vma->prot, 0);
+
+    while (start < end) {
+        /* look for the first hinted range, which is copied now */
+        void * hint_start = end, * hint_end = end;
+
+        for (int i = 0 ; i < store->postcopy_nhints ; i++) {
+            void * s = (void *) ALIGN_DOWN(store->postcopy_hints[i].start);
+            void * e = (void *) ALIGN_UP(store->postcopy_hints[i].end);
+
+            if (e <= start || s >= end)
+                continue;
+            if (s < start)
+                s = start;
+            if (e > end)
+                e = end;
+            if (s < hint_start) {
+                hint_start = s;
+                hint_end = e;
+            }
+        }
+
+        if (start < hint_start) {
+            ptr_t off = ADD_CP_OFFSET(sizeof(struct shim_postcopy_entry));
+            struct shim_postcopy_entry * entry = (void *) (base + off);
+
+            entry->addr = start;
+            entry->size = hint_start - start;
+            entry->prot = prot;
+            ADD_CP_FUNC_ENTRY(off);
+
+            lock(outgoing.lock);
+            int ret = add_range(&outgoing, entry->addr, entry->size, prot);
+            unlock(outgoing.lock);
+            if (ret < 0)
+                return ret;
+
+            if (prot & PAL_PROT_WRITE)
+                DkVirtualMemoryProtect(entry->addr, entry->size,
+                                       prot & ~PAL_PROT_WRITE);
+            store->postcopy_nentries++;
+        }
+
+        if (hint_start < hint_end) {
+            struct shim_mem_entry * mem;
+            DO_CP_SIZE(memory, hint_start, hint_end - hint_start, &mem);
+            mem->prot = prot;
+        }
+
+        start = hint_end;
+    }
+}
+END_CP_FUNC(postcopy)
+
+/*
+ * The child side
+ */
+
+BEGIN_RS_FUNC(postcopy)
+{
+    struct shim_postcopy_entry * ent = (void *) (base + GET_CP_FUNC_ENTRY());
+
+    if (!incoming.active)
+        return -EINVAL;
+
+    /* the range is filled as the chunks come */
+    if (!DkVirtualMemoryAlloc(ent->addr, ent->size, 0, PAL_PROT_NONE))
+        return -PAL_ERRNO;
+
+    lock(incoming.lock);
+    int ret = add_range(&incoming, ent->addr, ent->size, ent->prot);
+    unlock(incoming.lock);
+    if (ret < 0)
+        return ret;
+
+    DEBUG_RS("%p-%p,prot=%08x", ent->addr, ent->addr + ent->size,
+             ent->prot);
+}
+END_RS_FUNC(postcopy)
+
+int open_postcopy (struct postcopy_header * hdr)
+{
+    debug("open post-copy stream: %s\n", hdr->uri);
+
+    PAL_HANDLE stream = DkStreamOpen(hdr->uri, 0, 0, 0, 0);
+    if (!stream)
+        return -PAL_ERRNO;
+
+    lock(incoming.lock);
+    incoming.stream = stream;
+    /* without /proc/self/mem, the chunks are filled in place */
+    incoming.memfile = DkStreamOpen("file:/proc/self/mem", PAL_ACCESS_RDWR,
+                                    0, 0, 0);
+    incoming.active = true;
+    unlock(incoming.lock);
+    return 0;
+}
+
+/* incoming.lock needs to be held */
+static void install_chunk (struct postcopy_range * r, unsigned long i,
+                           void * data, size_t size)
+{
+    void * addr = CHUNK_ADDR(r, i);
+
+    if (!incoming.memfile ||
+        DkStreamWrite(incoming.memfile, (PAL_NUM) addr, size, data, NULL)
+        != size) {
+        /* another thread touching the chunk meanwhile may see it
+           partially filled */
+        DkVirtualMemoryProtect(addr, size, PAL_PROT_READ|PAL_PROT_WRITE);
+        memcpy(addr, data, size);
+    }
+
+    DkVirtualMemoryProtect(addr, size, r->prot);
+}
+
+static inline void wake_waiters (void)
+{
+    incoming.seq++;
+    DkFutexWake(&incoming.seq, 0x7fffffff, FUTEX_BITSET_MATCH_ANY);
+}
+
+/* request and wait for the missing chunks overlapping [addr, addr + size);
+   incoming.lock needs to be held, and is released while waiting */
+static int wait_chunks (void * addr, size_t size)
+{
+    struct postcopy_req req = { .addr = addr, .size = size,
+                                .type = POSTCOPY_FETCH };
+    bool requested = false;
+
+    while (incoming.active) {
+        bool missing = false;
+
+        FOR_EACH_CHUNK(&incoming, addr, size, r, i)
+            if (!(r->chunks[i] & (POSTCOPY_DONE|POSTCOPY_RELEASED))) {
+                missing = true;
+                break;
+            }
+
+        if (!missing)
+            return 0;
+
+        if (!requested) {
+            int ret = postcopy_write(incoming.stream, &req, sizeof(req));
+            if (ret < 0)
+                return ret;
+            requested = true;
+        }
+
+        unsigned int seq = incoming.seq;
+        unlock(incoming.lock);
+        if (host_futex_supported())
+            DkFutexWait(&incoming.seq, seq, NO_TIMEOUT,
+                        FUTEX_BITSET_MATCH_ANY);
+        else
+            DkThreadDelayExecution(POSTCOPY_WAIT_TIME);
+        lock(incoming.lock);
+    }
+
+    return -ECONNRESET;
+}
+
+static bool incoming_fault (void * addr, bool write)
+{
+    bool handled = false;
+
+    lock(incoming.lock);
+    struct postcopy_range * r = lookup_range(&incoming, addr);
+    if (!r)
+        goto out;
+
+    unsigned char state = r->chunks[CHUNK_INDEX(r, addr)];
+
+    if (state & POSTCOPY_RELEASED)
+        goto out;
+
+    if (state & POSTCOPY_DONE) {
+        /* installed by the helper meanwhile */
+        handled = (r->prot & (write ? PAL_PROT_WRITE : PAL_PROT_READ));
+        goto out;
+    }
+
+    handled = !wait_chunks(addr, 1);
+out:
+    unlock(incoming.lock);
+    return handled;
+}
+
+int fetch_postcopy_range (void * addr, size_t size)
+{
+    if (!incoming.active)
+        return 0;
+
+    lock(incoming.lock);
+    int ret = wait_chunks(addr, size);
+    unlock(incoming.lock);
+    return ret == -ECONNRESET ? 0 : ret;
+}
+
+static void release_incoming (void * addr, size_t size)
+{
+    bool missing = false;
+
+    lock(incoming.lock);
+    FOR_EACH_CHUNK(&incoming, addr, size, r, i) {
+        if (!(r->chunks[i] & POSTCOPY_DONE))
+            missing = true;
+        r->chunks[i] |= POSTCOPY_RELEASED;
+    }
+
+    if (missing && incoming.active) {
+        struct postcopy_req req = { .addr = addr, .size = size,
+                                    .type = POSTCOPY_DROP };
+        postcopy_write(incoming.stream, &req, sizeof(req));
+        wake_waiters();
+    }
+    unlock(incoming.lock);
+}
+
+static void postcopy_receiver (void * arg)
+{
+    struct shim_thread * self = (struct shim_thread *) arg;
+    if (!arg)
+        return;
+
+    __libc_tcb_t tcb;
+    allocate_tls(&tcb, false, self);
+    debug_setbuf(&tcb.shim_tcb, true);
+    debug("postcopy helper thread started\n");
+
+    void * buf = malloc(POSTCOPY_CHUNK_SIZE);
+    int ret = buf ? 0 : -ENOMEM;
+
+    while (!ret) {
+        struct postcopy_msg msg;
+        if ((ret = postcopy_read(incoming.stream, &msg, sizeof(msg))) < 0)
+            break;
+        if (!msg.addr)
+            break;
+        if (msg.size > POSTCOPY_CHUNK_SIZE) {
+            ret = -EINVAL;
+            break;
+        }
+        if ((ret = postcopy_read(incoming.stream, buf, msg.size)) < 0)
+            break;
+
+        lock(incoming.lock);
+        struct postcopy_range * r = lookup_range(&incoming, msg.addr);
+        if (r) {
+            unsigned long i = CHUNK_INDEX(r, msg.addr);
+            if (!(r->chunks[i] & (POSTCOPY_DONE|POSTCOPY_RELEASED)))
+                install_chunk(r, i, buf, msg.size);
+            r->chunks[i] |= POSTCOPY_DONE;
+            wake_waiters();
+        }
+        unlock(incoming.lock);
+    }
+
+    if (ret < 0)
+        debug("post-copy migration lost the parent (ret = %d)\n", ret);
+
+    if (buf)
+        free(buf);
+
+    lock(incoming.lock);
+    incoming.active = false;
+    free_ranges(&incoming);
+    DkObjectClose(incoming.stream);
+    incoming.stream = NULL;
+    if (incoming.memfile) {
+        DkObjectClose(incoming.memfile);
+        incoming.memfile = NULL;
+    }
+    wake_waiters();
+    unlock(incoming.lock);
+
+    put_thread(self);
+    debug("postcopy helper thread terminated\n");
+    flush_slab_magazine();
+    DkThreadExit();
+}
+
+/* a memory fault on a chunk being migrated, in either process */
+bool postcopy_fault (void * addr, PAL_CONTEXT * context)
+{
+    /* bit 1 of the page fault error code is set on writes */
+    bool write = context && (context->err & 2);
+
+    if (outgoing.active && outgoing_fault(addr))
+        return true;
+
+    return incoming.active && incoming_fault(addr, write);
+}
+
+/* the range is unmapped, remapped or reprotected by the application; with
+   keep, its current content is needed first */
+void release_postcopy_range (void * addr, size_t size, bool keep)
+{
+    if (outgoing.active)
+        release_outgoing(addr, size);
+
+    if (incoming.active) {
+        if (keep)
+            fetch_postcopy_range(addr, size);
+        release_incoming(addr, size);
+    }
+}
+
+int init_postcopy (void)
+{
+    create_lock(outgoing.lock);
+    create_lock(incoming.lock);
+    return 0;
+}
+
+int init_postcopy_helper (void)
+{
+    if (!incoming.active)
+        return 0;
+
+    enable_locking();
+
+    struct shim_thread * new = get_new_internal_thread();
+    if (!new)
+        return -ENOMEM;
+
+    PAL_HANDLE handle = thread_create(postcopy_receiver, new, 0);
+    if (!handle) {
+        put_thread(new);
+        return -PAL_ERRNO;
+    }
+
+    new->pal_handle = handle;
+    return 0;
+}
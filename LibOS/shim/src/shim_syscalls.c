@@ -1114,13 +1114,15 @@ DEFINE_SHIM_SYSCALL (pipe2, 2, shim_do_pipe2, int, int *, fildes, int, flags)
 
 SHIM_SYSCALL_PASSTHROUGH (inotify_init1, 1, int, int, flags)
 
-SHIM_SYSCALL_PASSTHROUGH (preadv, 5, int, unsigned long, fd,
-                          const struct iovec *, vec, unsigned long, vlen,
-                          unsigned long, pos_l, unsigned long, pos_h)
-
-SHIM_SYSCALL_PASSTHROUGH (pwritev, 5, int, unsigned long, fd,
-                          const struct iovec *, vec, unsigned long, vlen,
-                          unsigned long, pos_l, unsigned long, pos_h)
+/* preadv: sys/shim_wrappers.c */
+DEFINE_SHIM_SYSCALL (preadv, 5, shim_do_preadv, ssize_t, int, fd,
+                     const struct iovec *, vec, int, vlen,
+                     unsigned long, pos_l, unsigned long, pos_h)
+
+/* pwritev: sys/shim_wrappers.c */
+DEFINE_SHIM_SYSCALL (pwritev, 5, shim_do_pwritev, ssize_t, int, fd,
+                     const struct iovec *, vec, int, vlen,
+                     unsigned long, pos_l, unsigned long, pos_h)
 
 SHIM_SYSCALL_PASSTHROUGH (rt_tgsigqueueinfo, 4, int, pid_t, tgid, pid_t, pid,
                           int, sig, siginfo_t *, uinfo)
@@ -30,6 +30,7 @@
 #include <shim_handle.h>
 #include <shim_fs.h>
 #include <shim_checkpoint.h>
+#include <shim_utils.h>
 
 #include <pal.h>
 #include <pal_error.h>
@@ -48,25 +49,176 @@
 #define EPOLLERR        0x008
 #define EPOLLHUP        0x010
 #define EPOLLRDHUP      0x2000
+#ifndef EPOLLONESHOT
+# define EPOLLONESHOT   (1U << 30)
+#endif
+#ifndef EPOLLET
+# define EPOLLET        (1U << 31)
+#endif
 
 #define MAX_EPOLL_FDS       1024
+#define MAX_EPOLL_POLLED    64
 
 struct shim_mount epoll_builtin_fs;
 
 /* shim_epoll_fds are linked as a list (by the list field), 
- * hanging off of a shim_epoll_handle (by the fds field) */
+ * hanging off of a shim_epoll_handle (by the fds field). Those with pending
+ * events are also queued on the ready list of the epoll handle. The PAL
+ * handles are registered in the wait set of the epoll handle, with the
+ * shim_epoll_fds as the data pointers. Dup'd fds share a PAL handle, which
+ * is registered once: the shim_epoll_fds polling it are chained by the
+ * shared field, from the one registered as the data pointer. */
 struct shim_epoll_fd {
     FDTYPE                      fd;
     unsigned int                events;
     __u64                       data;
     unsigned int                revents;
+    bool                        disabled;   /* fired with EPOLLONESHOT */
+    bool                        registered; /* the data in the wait set */
+    struct shim_epoll_fd *      shared;     /* polling the same PAL handle */
     struct shim_handle *        handle;
     struct shim_handle *        epoll;
     PAL_HANDLE                  pal_handle;
     LIST_TYPE(shim_epoll_fd)    list;
     LIST_TYPE(shim_epoll_fd)    back;
+    LIST_TYPE(shim_epoll_fd)    ready;
 };
 
+/* The events to be reported for a registered handle; errors and hang-ups
+ * are always reported, unless the handle is disabled by EPOLLONESHOT. */
+static inline unsigned int epoll_fd_mask (struct shim_epoll_fd * epoll_fd)
+{
+    if (epoll_fd->disabled)
+        return 0;
+
+    return (epoll_fd->events & ~(EPOLLET|EPOLLONESHOT)) | EPOLLERR | EPOLLHUP;
+}
+
+static inline PAL_FLG epoll_fd_pal_events (struct shim_epoll_fd * epoll_fd)
+{
+    PAL_FLG events = 0;
+
+    if (epoll_fd->events & (EPOLLIN|EPOLLRDNORM|EPOLLRDBAND|EPOLLPRI))
+        events |= PAL_WAIT_READ;
+    if (epoll_fd->events & (EPOLLOUT|EPOLLWRNORM))
+        events |= PAL_WAIT_WRITE;
+    if (epoll_fd->events & EPOLLET)
+        events |= PAL_WAIT_EDGE;
+
+    return events;
+}
+
+static inline void __dequeue_ready (struct shim_epoll_handle * epoll,
+                                    struct shim_epoll_fd * epoll_fd)
+{
+    if (!list_empty(epoll_fd, ready))
+        listp_del_init(epoll_fd, &epoll->ready, ready);
+}
+
+/* Update the wait set entry of a PAL handle after any of the
+ * shim_epoll_fds on it is changed, and chain the ones which are not
+ * disabled. The entry polls the events of all of them, and is only
+ * edge-triggered if all of them are. The registered shim_epoll_fd stays
+ * the data pointer while it is polled, since a concurrent wait may return
+ * it. gone is a shim_epoll_fd about to be deleted. */
+static int __update_registration (struct shim_epoll_handle * epoll,
+                                  PAL_HANDLE pal_handle,
+                                  struct shim_epoll_fd * gone)
+{
+    struct shim_epoll_fd * epoll_fd, * reg = NULL, * head = NULL;
+    struct shim_epoll_fd ** last = &head;
+    PAL_FLG events = 0;
+    bool edge = true;
+    int ret;
+
+    if (!pal_handle)
+        return 0;
+
+    if (gone && gone->registered)
+        reg = gone;
+
+    listp_for_each_entry(epoll_fd, &epoll->fds, list)
+        if (epoll_fd->pal_handle == pal_handle && epoll_fd->registered)
+            reg = epoll_fd;
+
+    if (reg && reg != gone && !reg->disabled) {
+        head = reg;
+        last = &reg->shared;
+    }
+
+    listp_for_each_entry(epoll_fd, &epoll->fds, list) {
+        if (epoll_fd->pal_handle != pal_handle || epoll_fd == gone ||
+            epoll_fd->disabled)
+            continue;
+
+        if (epoll_fd != head) {
+            *last = epoll_fd;
+            last = &epoll_fd->shared;
+        }
+
+        PAL_FLG fd_events = epoll_fd_pal_events(epoll_fd);
+        events |= fd_events & ~PAL_WAIT_EDGE;
+        if (!(fd_events & PAL_WAIT_EDGE))
+            edge = false;
+    }
+
+    *last = NULL;
+
+    if (!head) {
+        if (reg) {
+            remove_from_waitset(&epoll->waitset, pal_handle);
+            reg->registered = false;
+        }
+        return 0;
+    }
+
+    if (edge)
+        events |= PAL_WAIT_EDGE;
+
+    if (reg) {
+        ret = modify_waitset(&epoll->waitset, pal_handle, events, head);
+        if (ret < 0)
+            return ret;
+        reg->registered = false;
+    } else {
+        ret = add_to_waitset(&epoll->waitset, pal_handle, events, head);
+        if (ret < 0)
+            return ret;
+    }
+
+    head->registered = true;
+    return 0;
+}
+
+/* Remove a shim_epoll_fd from the epoll handle. A concurrent epoll_wait
+ * may still return it from the wait set, so it is only freed when there is
+ * no waiter. */
+static void __delete_epoll_fd (struct shim_epoll_handle * epoll,
+                               struct shim_epoll_fd * epoll_fd)
+{
+    __update_registration(epoll, epoll_fd->pal_handle, epoll_fd);
+    listp_del(epoll_fd, &epoll->fds, list);
+    __dequeue_ready(epoll, epoll_fd);
+    epoll->nfds--;
+
+    if (epoll->nwaiters) {
+        INIT_LIST_HEAD(epoll_fd, list);
+        listp_add(epoll_fd, &epoll->zombies, list);
+    } else {
+        free(epoll_fd);
+    }
+}
+
+static void __free_epoll_zombies (struct shim_epoll_handle * epoll)
+{
+    struct shim_epoll_fd * epoll_fd, * n;
+
+    listp_for_each_entry_safe(epoll_fd, n, &epoll->zombies, list) {
+        listp_del(epoll_fd, &epoll->zombies, list);
+        free(epoll_fd);
+    }
+}
+
 int shim_do_epoll_create1 (int flags)
 {
     if ((flags & ~EPOLL_CLOEXEC))
@@ -77,15 +229,20 @@ int shim_do_epoll_create1 (int flags)
         return -ENOMEM;
 
     struct shim_epoll_handle * epoll = &hdl->info.epoll;
+    int ret = create_waitset(&epoll->waitset);
+    if (ret < 0) {
+        put_handle(hdl);
+        return ret;
+    }
 
     hdl->type = TYPE_EPOLL;
     set_handle_fs(hdl, &epoll_builtin_fs);
     epoll->maxfds = MAX_EPOLL_FDS;
     epoll->nfds = 0;
-    epoll->pal_fds = malloc(sizeof(FDTYPE) * MAX_EPOLL_FDS);
-    epoll->pal_handles = malloc(sizeof(PAL_HANDLE) * MAX_EPOLL_FDS);
-    create_event(&epoll->event);
+    epoll->nwaiters = 0;
     INIT_LISTP(&epoll->fds);
+    INIT_LISTP(&epoll->ready);
+    INIT_LISTP(&epoll->zombies);
 
     int vfd = set_new_fd_handle(hdl, (flags & EPOLL_CLOEXEC) ? FD_CLOEXEC : 0,
                                 NULL);
@@ -102,32 +259,6 @@ int shim_do_epoll_create (int size)
     return shim_do_epoll_create1(0);
 }
 
-static void update_epoll (struct shim_epoll_handle * epoll)
-{
-    struct shim_epoll_fd * tmp;
-    int npals = 0;
-    epoll->nread = 0;
-
-    listp_for_each_entry(tmp, &epoll->fds, list) {
-        if (!tmp->pal_handle)
-            continue;
-
-        debug("found handle %p (pal handle %p) from epoll handle %p\n",
-              tmp->handle, tmp->pal_handle, epoll);
-
-        epoll->pal_fds[npals] = tmp->fd;
-        epoll->pal_handles[npals] = tmp->pal_handle;
-        npals++;
-        if (tmp->handle->acc_mode & MAY_READ)
-            epoll->nread++;
-    }
-
-    epoll->npals = npals;
-
-    if (epoll->nwaiters)
-        set_event(&epoll->event, epoll->nwaiters);
-}
-
 int delete_from_epoll_handles (struct shim_handle * handle)
 {
     while (1) {
@@ -152,12 +283,7 @@ int delete_from_epoll_handles (struct shim_handle * handle)
               &epoll_hdl->info.epoll);
 
         lock(epoll_hdl->lock);
-
-        listp_del(epoll_fd, &epoll->fds, list);
-        free(epoll_fd);
-
-        epoll_hdl->info.epoll.nfds--;
-        update_epoll(&epoll_hdl->info.epoll);
+        __delete_epoll_fd(epoll, epoll_fd);
         unlock(epoll_hdl->lock);
         put_handle(epoll_hdl);
     }
@@ -216,9 +342,24 @@ int shim_do_epoll_ctl (int epfd, int op, int fd,
             epoll_fd->events = event->events;
             epoll_fd->data = event->data;
             epoll_fd->revents = 0;
+            epoll_fd->disabled = false;
+            epoll_fd->registered = false;
+            epoll_fd->shared = NULL;
             epoll_fd->handle = hdl;
             epoll_fd->epoll = epoll_hdl;
             epoll_fd->pal_handle = hdl->pal_handle;
+            INIT_LIST_HEAD(epoll_fd, ready);
+            INIT_LIST_HEAD(epoll_fd, list);
+            listp_add_tail(epoll_fd, &epoll->fds, list);
+
+            ret = __update_registration(epoll, epoll_fd->pal_handle, NULL);
+            if (ret < 0) {
+                listp_del(epoll_fd, &epoll->fds, list);
+                __update_registration(epoll, epoll_fd->pal_handle, NULL);
+                free(epoll_fd);
+                put_handle(hdl);
+                goto out;
+            }
 
             /* Register the epoll handle */
             get_handle(epoll_hdl);
@@ -227,10 +368,8 @@ int shim_do_epoll_ctl (int epfd, int op, int fd,
             listp_add_tail(epoll_fd, &hdl->epolls, back);
             unlock(hdl->lock);
 
-            INIT_LIST_HEAD(epoll_fd, list);
-            listp_add_tail(epoll_fd, &epoll->fds, list);
             epoll->nfds++;
-            goto update;
+            goto out;
         }
 
         case EPOLL_CTL_MOD: {
@@ -238,7 +377,15 @@ int shim_do_epoll_ctl (int epfd, int op, int fd,
                 if (epoll_fd->fd == fd) {
                     epoll_fd->events = event->events;
                     epoll_fd->data = event->data;
-                    goto update;
+                    /* Re-arm the handle; readiness is polled again */
+                    epoll_fd->disabled = false;
+                    epoll_fd->revents &= EPOLLERR|EPOLLHUP|EPOLLRDHUP;
+                    __dequeue_ready(epoll, epoll_fd);
+                    if (epoll_fd->revents & epoll_fd_mask(epoll_fd))
+                        listp_add_tail(epoll_fd, &epoll->ready, ready);
+                    ret = __update_registration(epoll, epoll_fd->pal_handle,
+                                                NULL);
+                    goto out;
                 }
 
             ret = -ENOENT;
@@ -259,10 +406,8 @@ int shim_do_epoll_ctl (int epfd, int op, int fd,
                     debug("delete handle %p from epoll handle %p\n",
                           hdl, epoll);
 
-                    listp_del(epoll_fd, &epoll->fds, list);
-                    epoll->nfds--;
-                    free(epoll_fd);
-                    goto update;
+                    __delete_epoll_fd(epoll, epoll_fd);
+                    goto out;
                 }
 
             ret = -ENOENT;
@@ -274,8 +419,6 @@ int shim_do_epoll_ctl (int epfd, int op, int fd,
             goto out;
     }
 
-update:
-    update_epoll(epoll);
 out:
     unlock(epoll_hdl->lock);
     put_handle(epoll_hdl);
@@ -283,9 +426,11 @@ out:
 }
 
 int shim_do_epoll_wait (int epfd, struct __kernel_epoll_event * events,
-                        int maxevents, int timeout)
+                        int maxevents, int timeout_ms)
 {
-    int ret = 0;
+    if (maxevents <= 0)
+        return -EINVAL;
+
     struct shim_handle * epoll_hdl = get_fd_handle(epfd, NULL, NULL);
     if (!epoll_hdl)
         return -EBADF;
@@ -295,87 +440,120 @@ int shim_do_epoll_wait (int epfd, struct __kernel_epoll_event * events,
     }
 
     struct shim_epoll_handle * epoll = &epoll_hdl->info.epoll;
-    struct shim_epoll_fd * epoll_fd;
+    struct shim_epoll_fd * epoll_fd, * n;
+    LISTP_TYPE(shim_epoll_fd) requeue;
+    uint64_t timeout = timeout_ms < 0 ? NO_TIMEOUT : timeout_ms * 1000ULL;
+    int max = maxevents < MAX_EPOLL_POLLED ? maxevents : MAX_EPOLL_POLLED;
+    PAL_PTR polled[MAX_EPOLL_POLLED];
+    PAL_FLG polled_events[MAX_EPOLL_POLLED];
     int nevents = 0;
-    int npals, nread;
-    bool need_update = false;
+    int ret;
 
     lock(epoll_hdl->lock);
-retry:
-    if (!(npals = epoll->npals))
-        goto reply;
 
-    PAL_HANDLE * pal_handles = __alloca(sizeof(PAL_HANDLE) * (npals + 1));
-    FDTYPE * fds = __alloca(sizeof(FDTYPE) * npals);
-    memcpy(fds, epoll->pal_fds, sizeof(FDTYPE) * npals);
-    memcpy(pal_handles, epoll->pal_handles, sizeof(PAL_HANDLE) * npals);
-    pal_handles[npals] = epoll->event.event;
+    /* Level-triggered readiness left from the previous calls is polled
+     * again, since the wait set reports the handles that are still ready.
+     * Edge-triggered events, errors and hang-ups stay queued. */
+    listp_for_each_entry_safe(epoll_fd, n, &epoll->ready, ready) {
+        if (epoll_fd->events & EPOLLET)
+            continue;
+
+        epoll_fd->revents &= EPOLLERR|EPOLLHUP|EPOLLRDHUP;
+        if (!(epoll_fd->revents & epoll_fd_mask(epoll_fd)))
+            listp_del_init(epoll_fd, &epoll->ready, ready);
+    }
 
-    if ((nread = epoll->nread))
-        epoll->nwaiters++;
+    /* Events still queued are reported right away, but the wait set is
+     * still polled to pick up new events. */
+    if (!listp_empty(&epoll->ready))
+        timeout = 0;
 
+    epoll->nwaiters++;
     unlock(epoll_hdl->lock);
 
-    PAL_HANDLE polled = DkObjectsWaitAny(nread ? npals + 1 : npals, pal_handles,
-                                         nread ? NO_TIMEOUT : 0);
+    ret = wait_on_waitset(&epoll->waitset, max, polled, polled_events,
+                          timeout);
 
     lock(epoll_hdl->lock);
 
-    if (nread)
-        epoll->nwaiters--;
-
-    if (!polled)
-        goto reply;
-
-    if (polled == epoll->event.event) {
-        wait_event(&epoll->event);
-        goto retry;
-    }
+    for (int i = 0 ; i < ret ; i++) {
+        struct shim_epoll_fd * reg = polled[i];
 
-    PAL_STREAM_ATTR attr;
-    if (!DkStreamAttributesQuerybyHandle(polled, &attr))
-        goto reply;
+        /* The handle may be deleted or disabled during the wait */
+        if (!reg->registered)
+            continue;
 
-    listp_for_each_entry(epoll_fd, &epoll->fds, list)
-        if (polled == epoll_fd->pal_handle) {
+        PAL_HANDLE pal_handle = reg->pal_handle;
 
+        /* the events are reported to all the fds on the PAL handle */
+        for (epoll_fd = reg ; epoll_fd ; epoll_fd = epoll_fd->shared) {
             debug("epoll: fd %d (handle %p) polled\n", epoll_fd->fd,
                   epoll_fd->handle);
 
-            if (attr.disconnected) {
+            if (polled_events[i] & PAL_WAIT_ERROR) {
+                /* errors are not polled any more, and stay queued */
                 epoll_fd->revents |= EPOLLERR|EPOLLHUP|EPOLLRDHUP;
                 epoll_fd->pal_handle = NULL;
-                need_update = true;
             }
-            if (attr.readable)
-                epoll_fd->revents |= EPOLLIN;
-            if (attr.writeable)
-                epoll_fd->revents |= EPOLLOUT;
-            break;
+            if (polled_events[i] & PAL_WAIT_READ)
+                epoll_fd->revents |= EPOLLIN|EPOLLRDNORM;
+            if (polled_events[i] & PAL_WAIT_WRITE)
+                epoll_fd->revents |= EPOLLOUT|EPOLLWRNORM;
+
+            if ((epoll_fd->revents & epoll_fd_mask(epoll_fd)) &&
+                list_empty(epoll_fd, ready))
+                listp_add_tail(epoll_fd, &epoll->ready, ready);
         }
 
-reply:
-    listp_for_each_entry(epoll_fd, &epoll->fds, list) {
-        if (nevents == maxevents)
-            break;
-
-        if ((epoll_fd->events|EPOLLERR|EPOLLHUP) & epoll_fd->revents) {
-            events[nevents].events =
-                    (epoll_fd->events|EPOLLERR|EPOLLHUP) & epoll_fd->revents;
-            events[nevents].data = epoll_fd->data;
-            nevents++;
-            epoll_fd->revents &= ~epoll_fd->events;
+        if (polled_events[i] & PAL_WAIT_ERROR) {
+            remove_from_waitset(&epoll->waitset, pal_handle);
+            reg->registered = false;
         }
+    }
+
+    if (!--epoll->nwaiters)
+        __free_epoll_zombies(epoll);
+
+    INIT_LISTP(&requeue);
+
+    while (nevents < maxevents && !listp_empty(&epoll->ready)) {
+        epoll_fd = listp_first_entry(&epoll->ready, struct shim_epoll_fd,
+                                     ready);
+        listp_del_init(epoll_fd, &epoll->ready, ready);
+
+        unsigned int revents = epoll_fd->revents & epoll_fd_mask(epoll_fd);
+        if (!revents)
+            continue;
+
+        events[nevents].events = revents;
+        events[nevents].data = epoll_fd->data;
+        nevents++;
+
+        /* Readiness is polled again in the next call, except for errors
+         * and hang-ups, which are no longer polled, so they stay queued. */
+        epoll_fd->revents &= EPOLLERR|EPOLLHUP|EPOLLRDHUP;
 
+        if (epoll_fd->events & EPOLLONESHOT) {
+            epoll_fd->disabled = true;
+            __update_registration(epoll, epoll_fd->pal_handle, NULL);
+        } else if (epoll_fd->revents & epoll_fd_mask(epoll_fd)) {
+            listp_add_tail(epoll_fd, &requeue, ready);
+        }
     }
 
-    if (need_update)
-        update_epoll(epoll);
+    while (!listp_empty(&requeue)) {
+        epoll_fd = listp_first_entry(&requeue, struct shim_epoll_fd, ready);
+        listp_del(epoll_fd, &requeue, ready);
+        listp_add_tail(epoll_fd, &epoll->ready, ready);
+    }
 
     unlock(epoll_hdl->lock);
-    ret = nevents;
     put_handle(epoll_hdl);
-    return ret;
+
+    if (!nevents && ret == -EINTR)
+        return -EINTR;
+
+    return nevents;
 }
 
 int shim_do_epoll_pwait (int epfd, struct __kernel_epoll_event * events,
@@ -391,8 +569,17 @@ static int epoll_close (struct shim_handle * hdl)
     return 0;
 }
 
+static void epoll_hput (struct shim_handle * hdl)
+{
+    struct shim_epoll_handle * epoll = &hdl->info.epoll;
+
+    __free_epoll_zombies(epoll);
+    destroy_waitset(&epoll->waitset);
+}
+
 struct shim_fs_ops epoll_fs_ops = {
         .close    = &epoll_close,
+        .hput     = &epoll_hput,
     };
 
 struct shim_mount epoll_builtin_fs = { .type = "epoll",
@@ -420,7 +607,11 @@ BEGIN_CP_FUNC(epoll_fd)
         new_epoll_fd->events  = epoll_fd->events;
         new_epoll_fd->data    = epoll_fd->data;
         new_epoll_fd->revents = epoll_fd->revents;
+        new_epoll_fd->disabled = epoll_fd->disabled;
+        new_epoll_fd->registered = false;
+        new_epoll_fd->shared = NULL;
         new_epoll_fd->pal_handle = NULL;
+        INIT_LIST_HEAD(new_epoll_fd, ready);
 
         listp_add(new_epoll_fd, new_list, list);
 
@@ -434,9 +625,19 @@ END_CP_FUNC(epoll_fd)
 BEGIN_RS_FUNC(epoll_fd)
 {
     LISTP_TYPE(shim_epoll_fd) * list = (void *) (base + GET_CP_FUNC_ENTRY());
+    struct shim_epoll_handle * epoll =
+            container_of(list, struct shim_epoll_handle, fds);
     struct shim_epoll_fd * epoll_fd;
 
     CP_REBASE(*list);
+    INIT_LISTP(&epoll->ready);
+    INIT_LISTP(&epoll->zombies);
+    epoll->nwaiters = 0;
+
+    /* The wait set is not checkpointed */
+    int ret = create_waitset(&epoll->waitset);
+    if (ret < 0)
+        return ret;
 
     listp_for_each_entry(epoll_fd, list, list) {
 
@@ -445,6 +646,13 @@ BEGIN_RS_FUNC(epoll_fd)
         epoll_fd->pal_handle = epoll_fd->handle->pal_handle;
         CP_REBASE(epoll_fd->list);
 
+        ret = __update_registration(epoll, epoll_fd->pal_handle, NULL);
+        if (ret < 0)
+            return ret;
+
+        if (epoll_fd->revents & epoll_fd_mask(epoll_fd))
+            listp_add_tail(epoll_fd, &epoll->ready, ready);
+
         DEBUG_RS("fd=%d,path=%s,type=%s,uri=%s",
                  epoll_fd->fd, qstrgetstr(&epoll_fd->handle->path),
                  epoll_fd->handle->fs_type,
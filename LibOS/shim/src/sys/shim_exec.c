@@ -29,6 +29,7 @@
 #include <shim_fs.h>
 #include <shim_ipc.h>
 #include <shim_profile.h>
+#include <shim_checkpoint.h>
 
 #include <pal.h>
 #include <pal_error.h>
@@ -166,8 +167,10 @@ retry_dump_vmas:
             continue;
 
         /* Free all the mapped VMAs */
-        if (!(vma->flags & VMA_UNMAPPED))
+        if (!(vma->flags & VMA_UNMAPPED)) {
+            release_postcopy_range(vma->addr, vma->length, false);
             DkVirtualMemoryFree(vma->addr, vma->length);
+        }
 
         /* Remove the VMAs */
         bkeep_munmap(vma->addr, vma->length, vma->flags);
@@ -199,8 +202,6 @@ retry_dump_vmas:
     return 0;
 }
 
-#include <shim_checkpoint.h>
-
 DEFINE_PROFILE_CATAGORY(exec, );
 DEFINE_PROFILE_INTERVAL(search_and_check_file_for_exec, exec);
 DEFINE_PROFILE_INTERVAL(open_file_for_exec, exec);
@@ -138,6 +138,8 @@ int try_process_exit (int error_code, int term_signal)
     if (cur_thread->in_vm)
         thread_exit(cur_thread, true);
 
+    flush_slab_magazine();
+
     if (check_last_thread(cur_thread))
         return 0;
 
@@ -106,10 +106,10 @@ int shim_do_fcntl (int fd, int cmd, unsigned long arg)
          *   Set the file descriptor flags to the value specified by arg.
          */
         case F_SETFD:
-            lock(handle_map->lock);
+            write_lock(handle_map->lock);
             if (HANDLE_ALLOCATED(handle_map->map[fd]))
                 handle_map->map[fd]->flags = arg & FD_CLOEXEC;
-            unlock(handle_map->lock);
+            write_unlock(handle_map->lock);
             ret = 0;
             break;
 
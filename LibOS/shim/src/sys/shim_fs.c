@@ -424,6 +424,16 @@ static ssize_t handle_copy (struct shim_handle * hdli, off_t * offseti,
             }
         } while(0);
 
+    /* Copy inside the host if both handles are backed by PAL streams, so
+       the data never enters the LibOS. A seekable input must have a known
+       size, and a seekable output must have been extended to fit the copy
+       above, to keep the cached file sizes up to date. Pipes buffered in
+       the LibOS are copied through the LibOS. */
+    bool do_host = hdli->pal_handle && hdlo->pal_handle &&
+                   !pipe_in_ring(hdli) && !pipe_in_ring(hdlo) &&
+                   (do_mapi || !fsi->fs_ops->seek) &&
+                   ((do_mapo && count > 0) || !fso->fs_ops->seek);
+
     void * bufi = NULL, * bufo = NULL;
     int bytes = 0;
     int bufsize = MAP_SIZE;
@@ -455,6 +465,27 @@ static ssize_t handle_copy (struct shim_handle * hdli, off_t * offseti,
         if (count > 0 && bufsize > count - bytes)
             expectsize = bufsize = count - bytes;
 
+        if (do_host) {
+            if (count > 0)
+                expectsize = count - bytes;
+
+            copysize = DkStreamCopy(hdli->pal_handle, offi,
+                                    hdlo->pal_handle, offo, expectsize);
+            if (!copysize) {
+                /* the host cannot copy between these streams (e.g. a pipe
+                   whose data goes through a shared ring), so copy through
+                   the LibOS instead */
+                if (PAL_NATIVE_ERRNO == PAL_ERROR_NOTSUPPORT) {
+                    do_host = false;
+                    continue;
+                }
+                if (PAL_NATIVE_ERRNO != PAL_ERROR_ENDOFSTREAM)
+                    copysize = -PAL_ERRNO;
+                break;
+            }
+            goto done_copy;
+        }
+
         if (do_mapi && !bufi) {
             boffi = offi - ALIGN_DOWN(offi);
 
@@ -543,9 +574,14 @@ done_copy:
         bytes += copysize;
         offi += copysize;
         offo += copysize;
-        if (copysize < expectsize)
+        /* the host may copy less than asked without reaching the end */
+        if (copysize < expectsize && !do_host)
             break;
-    } while (bytes < count);
+    } while (count < 0 || bytes < count);
+
+    /* the host copy went behind any content cached for the output */
+    if (do_host && bytes && fso->fs_ops->flush)
+        fso->fs_ops->flush(hdlo);
 
     if (copysize < 0 || (count > 0 && bytes < count)) {
         int ret = copysize < 0 ? copysize : -EAGAIN;
@@ -43,90 +43,410 @@
 #define FUTEX_MIN_VALUE 0
 #define FUTEX_MAX_VALUE 255
 
-/* futex_waiters are linked off of shim_futex_handle by the waiters 
- * listp */
+/*
+ * Futexes are kept in a hash table indexed by the user address. Each bucket
+ * has its own lock, so operations on unrelated futexes do not contend with
+ * each other. A futex record is created when the first thread waits on the
+ * address, and freed as soon as its last waiter leaves.
+ */
+#define FUTEX_HASH_BITS     8
+#define FUTEX_HASH_SIZE     (1 << FUTEX_HASH_BITS)
+#define FUTEX_HASH_MASK     (FUTEX_HASH_SIZE - 1)
+#define FUTEX_HASH(uaddr)   (hash64((uint64_t) (uaddr)) & FUTEX_HASH_MASK)
+
+#define FUTEX_WAKE_ALL      0x7fffffff
+
+DEFINE_LIST(futex_waiter);
+DEFINE_LISTP(futex_waiter);
+DEFINE_LIST(shim_futex);
+struct shim_futex {
+    unsigned int *              uaddr;
+    LISTP_TYPE(futex_waiter)    waiters;
+    LIST_TYPE(shim_futex)       hlist;
+};
+
+/* futex_waiters are linked off of shim_futex by the waiters listp. Both
+ * "futex" and "uaddr" may only be changed with the bucket lock held;
+ * "futex" is cleared once the waiter is dequeued. */
 struct futex_waiter {
-    struct shim_thread * thread;
-    uint32_t bitset;
+    struct shim_thread *    thread;
+    uint32_t                bitset;
+    struct shim_futex *     futex;
+    unsigned int *          uaddr;
     LIST_TYPE(futex_waiter) list;
 };
 
-// Links shim_futex_handle by the list field
-DEFINE_LISTP(shim_futex_handle);
-static LISTP_TYPE(shim_futex_handle) futex_list = LISTP_INIT;
-static LOCKTYPE futex_list_lock;
+DEFINE_LISTP(shim_futex);
+struct futex_bucket {
+    LOCKTYPE                lock;
+    LISTP_TYPE(shim_futex)  futexes;
+};
+
+static struct futex_bucket futex_table[FUTEX_HASH_SIZE];
 
-int shim_do_futex (unsigned int * uaddr, int op, int val, void * utime,
-                   unsigned int * uaddr2, int val3)
+static inline struct futex_bucket * get_futex_bucket (unsigned int * uaddr)
 {
-    struct shim_futex_handle * tmp = NULL, * futex = NULL, * futex2 = NULL;
-    struct shim_handle * hdl = NULL, * hdl2 = NULL;
-    uint32_t futex_op = (op & FUTEX_CMD_MASK);
+    struct futex_bucket * bucket = &futex_table[FUTEX_HASH(uaddr)];
+    create_lock_runtime(&bucket->lock);
+    return bucket;
+}
 
-    uint32_t val2 = 0;
-    int ret = 0;
+/* Lock the buckets of two futexes in a fixed order, to avoid deadlocks. */
+static void lock_futex_buckets (struct futex_bucket * bucket1,
+                                struct futex_bucket * bucket2)
+{
+    if (bucket1 == bucket2) {
+        lock(bucket1->lock);
+    } else if (bucket1 < bucket2) {
+        lock(bucket1->lock);
+        lock(bucket2->lock);
+    } else {
+        lock(bucket2->lock);
+        lock(bucket1->lock);
+    }
+}
 
-    if (!uaddr || ((uintptr_t) uaddr % sizeof(unsigned int)))
-        return -EINVAL;
+static void unlock_futex_buckets (struct futex_bucket * bucket1,
+                                  struct futex_bucket * bucket2)
+{
+    if (bucket1 != bucket2)
+        unlock(bucket2->lock);
+    unlock(bucket1->lock);
+}
+
+/* Find the futex at "uaddr", and create it if "create" is true. Must be
+ * called with the bucket lock held. */
+static struct shim_futex * __lookup_futex (struct futex_bucket * bucket,
+                                           unsigned int * uaddr, bool create)
+{
+    struct shim_futex * futex;
+
+    listp_for_each_entry(futex, &bucket->futexes, hlist)
+        if (futex->uaddr == uaddr)
+            return futex;
 
-    create_lock_runtime(&futex_list_lock);
-    lock(futex_list_lock);
+    if (!create)
+        return NULL;
 
-    listp_for_each_entry(tmp, &futex_list, list)
-        if (tmp->uaddr == uaddr) {
-            futex = tmp;
+    if (!(futex = malloc(sizeof(struct shim_futex))))
+        return NULL;
+
+    futex->uaddr = uaddr;
+    INIT_LISTP(&futex->waiters);
+    INIT_LIST_HEAD(futex, hlist);
+    listp_add(futex, &bucket->futexes, hlist);
+    return futex;
+}
+
+/* Free the futex if no thread is waiting on it. Must be called with the
+ * bucket lock held. */
+static void __put_futex (struct futex_bucket * bucket,
+                         struct shim_futex * futex)
+{
+    if (!futex || !listp_empty(&futex->waiters))
+        return;
+
+    listp_del(futex, &bucket->futexes, hlist);
+    free(futex);
+}
+
+static void __wake_waiter (struct shim_futex * futex,
+                           struct futex_waiter * waiter)
+{
+    struct shim_thread * thread = waiter->thread;
+
+    debug("FUTEX_WAKE wake thread %d: %p (val = %d)\n",
+          thread->tid, futex->uaddr, *futex->uaddr);
+
+    listp_del_init(waiter, &futex->waiters, list);
+    thread_wakeup(thread);
+
+    /* The waiter may return (and its stack be reused) as soon as the field
+     * is cleared, so it must be the last access to the waiter. */
+    barrier();
+    waiter->futex = NULL;
+}
+
+/* Wake up at most "count" (but at least one) waiters matching "bitset".
+ * Must be called with the bucket lock held. */
+static int __wake_futex (struct shim_futex * futex, int count,
+                         uint32_t bitset)
+{
+    struct futex_waiter * waiter, * wtmp;
+    int nwaken = 0;
+
+    if (!futex)
+        return 0;
+
+    listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
+        if (!(bitset & waiter->bitset))
+            continue;
+
+        __wake_waiter(futex, waiter);
+        if (++nwaken >= count)
             break;
-        }
+    }
 
-    if (futex) {
-        hdl = container_of(futex, struct shim_handle, info.futex);
-        get_handle(hdl);
-    } else {
-        if (!(hdl = get_new_handle())) {
-            unlock(futex_list_lock);
-            return -ENOMEM;
+    return nwaken;
+}
+
+static int futex_wait (unsigned int * uaddr, int val, uint64_t timeout_us,
+                       uint32_t bitset)
+{
+    struct futex_bucket * bucket = get_futex_bucket(uaddr);
+    struct shim_futex * futex;
+    struct futex_waiter waiter;
+    int ret;
+
+    lock(bucket->lock);
+
+    if (*uaddr != val) {
+        unlock(bucket->lock);
+        return -EAGAIN;
+    }
+
+    if (!(futex = __lookup_futex(bucket, uaddr, true))) {
+        unlock(bucket->lock);
+        return -ENOMEM;
+    }
+
+    thread_setwait(&waiter.thread, NULL);
+    INIT_LIST_HEAD(&waiter, list);
+    waiter.bitset = bitset;
+    waiter.futex  = futex;
+    waiter.uaddr  = uaddr;
+    listp_add_tail(&waiter, &futex->waiters, list);
+    unlock(bucket->lock);
+
+    ret = thread_sleep(timeout_us);
+    /* DEP 1/28/17: Should return ETIMEDOUT, not EAGAIN, on timeout. */
+    if (ret == -EAGAIN)
+        ret = -ETIMEDOUT;
+
+    /* If the waiter was not woken by FUTEX_WAKE (e.g., timed out), it is
+     * still queued, possibly on another futex after FUTEX_REQUEUE. Retry
+     * until we hold the bucket lock of the futex the waiter is queued on. */
+    while (*(struct shim_futex * volatile *) &waiter.futex) {
+        unsigned int * cur_uaddr = waiter.uaddr;
+        bucket = get_futex_bucket(cur_uaddr);
+        lock(bucket->lock);
+
+        if (waiter.futex && waiter.uaddr == cur_uaddr) {
+            futex = waiter.futex;
+            listp_del_init(&waiter, &futex->waiters, list);
+            waiter.futex = NULL;
+            __put_futex(bucket, futex);
         }
 
-        hdl->type = TYPE_FUTEX;
-        futex = &hdl->info.futex;
-        futex->uaddr = uaddr;
-        get_handle(hdl);
-        INIT_LISTP(&futex->waiters);
-        INIT_LIST_HEAD(futex, list);
-        listp_add_tail(futex, &futex_list, list);
+        unlock(bucket->lock);
     }
 
-    if (futex_op == FUTEX_WAKE_OP || futex_op == FUTEX_REQUEUE ||
-            futex_op == FUTEX_CMP_REQUEUE) {
-        listp_for_each_entry(tmp, &futex_list, list)
-            if (tmp->uaddr == uaddr2) {
-                futex2 = tmp;
-                break;
-            }
+    put_thread(waiter.thread);
+    return ret;
+}
 
-        if (futex2) {
-            hdl2 = container_of(futex2, struct shim_handle, info.futex);
-            get_handle(hdl2);
-        } else {
-            if (!(hdl2 = get_new_handle())) {
-                unlock(futex_list_lock);
-                return -ENOMEM;
-            }
+static int futex_wake (unsigned int * uaddr, int count, uint32_t bitset)
+{
+    struct futex_bucket * bucket = get_futex_bucket(uaddr);
+    struct shim_futex * futex;
+    int nwaken;
+
+    lock(bucket->lock);
+    futex = __lookup_futex(bucket, uaddr, false);
+    nwaken = __wake_futex(futex, count, bitset);
+    __put_futex(bucket, futex);
+    unlock(bucket->lock);
+    return nwaken;
+}
 
-            hdl2->type = TYPE_FUTEX;
-            futex2 = &hdl2->info.futex;
-            futex2->uaddr = uaddr2;
-            get_handle(hdl2);
-            INIT_LISTP(&futex2->waiters);
-            INIT_LIST_HEAD(futex2, list);
-            listp_add_tail(futex2, &futex_list, list);
-        }
+/* Compute the new value of FUTEX_WAKE_OP from the old one, and return the
+ * result of the comparison. */
+static int futex_op_value (int oldval, int val3, int * newval)
+{
+    int cmpval;
+
+    *newval = (val3 >> 12) & 0xfff;
+    switch ((val3 >> 28) & 0xf) {
+        case FUTEX_OP_SET:  break;
+        case FUTEX_OP_ADD:  *newval = oldval + *newval;  break;
+        case FUTEX_OP_OR:   *newval = oldval | *newval;  break;
+        case FUTEX_OP_ANDN: *newval = oldval & ~*newval; break;
+        case FUTEX_OP_XOR:  *newval = oldval ^ *newval;  break;
+    }
+
+    cmpval = val3 & 0xfff;
+    switch ((val3 >> 24) & 0xf) {
+        case FUTEX_OP_CMP_EQ: cmpval = (oldval == cmpval); break;
+        case FUTEX_OP_CMP_NE: cmpval = (oldval != cmpval); break;
+        case FUTEX_OP_CMP_LT: cmpval = (oldval < cmpval);  break;
+        case FUTEX_OP_CMP_LE: cmpval = (oldval <= cmpval); break;
+        case FUTEX_OP_CMP_GT: cmpval = (oldval > cmpval);  break;
+        case FUTEX_OP_CMP_GE: cmpval = (oldval >= cmpval); break;
+    }
+
+    return cmpval;
+}
+
+static int futex_wake_op (unsigned int * uaddr, unsigned int * uaddr2,
+                          int count, int count2, int val3)
+{
+    struct futex_bucket * bucket  = get_futex_bucket(uaddr);
+    struct futex_bucket * bucket2 = get_futex_bucket(uaddr2);
+    struct shim_futex * futex, * futex2;
+    int oldval, newval, cmpval, nwaken;
+
+    lock_futex_buckets(bucket, bucket2);
+
+    oldval = *(int *) uaddr2;
+    cmpval = futex_op_value(oldval, val3, &newval);
+    *(int *) uaddr2 = newval;
+
+    debug("FUTEX_WAKE_OP: %p (val = %d) count = %d\n", uaddr, *uaddr, count);
+    futex = __lookup_futex(bucket, uaddr, false);
+    nwaken = __wake_futex(futex, count, FUTEX_BITSET_MATCH_ANY);
+    __put_futex(bucket, futex);
+
+    if (cmpval) {
+        debug("FUTEX_WAKE_OP(2): %p (val = %d) count = %d\n", uaddr2,
+              *uaddr2, count2);
+        futex2 = __lookup_futex(bucket2, uaddr2, false);
+        nwaken += __wake_futex(futex2, count2, FUTEX_BITSET_MATCH_ANY);
+        __put_futex(bucket2, futex2);
+    }
+
+    unlock_futex_buckets(bucket, bucket2);
+    return nwaken;
+}
+
+static int futex_requeue (unsigned int * uaddr, unsigned int * uaddr2,
+                          int count, int count2, bool cmp, int val3)
+{
+    struct futex_bucket * bucket  = get_futex_bucket(uaddr);
+    struct futex_bucket * bucket2 = get_futex_bucket(uaddr2);
+    struct shim_futex * futex, * futex2 = NULL;
+    struct futex_waiter * waiter, * wtmp;
+    int nwaken = 0, nrequeued = 0;
+
+    lock_futex_buckets(bucket, bucket2);
+
+    if (cmp && *uaddr != val3) {
+        unlock_futex_buckets(bucket, bucket2);
+        return -EAGAIN;
+    }
+
+    if (!(futex = __lookup_futex(bucket, uaddr, false)))
+        goto out;
+
+    nwaken = __wake_futex(futex, count, FUTEX_BITSET_MATCH_ANY);
+
+    listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
+        if (nrequeued >= count2)
+            break;
+
+        if (!futex2 && !(futex2 = __lookup_futex(bucket2, uaddr2, true)))
+            break;
+
+        if (futex2 == futex)
+            break;
+
+        listp_del_init(waiter, &futex->waiters, list);
+        listp_add_tail(waiter, &futex2->waiters, list);
+        waiter->futex = futex2;
+        waiter->uaddr = uaddr2;
+        nrequeued++;
+    }
+
+    __put_futex(bucket, futex);
+    __put_futex(bucket2, futex2);
+out:
+    unlock_futex_buckets(bucket, bucket2);
+    return nwaken;
+}
+
+/*
+ * Private futexes are only shared by the threads of the current process,
+ * which are all host threads of the same host process. If the PAL provides
+ * host futexes, waiting and waking on private futexes go straight to the
+ * host, without the emulation above.
+ */
+static int host_futex_wait (unsigned int * uaddr, int val,
+                            uint64_t timeout_us, uint32_t bitset)
+{
+    if (DkFutexWait(uaddr, val, timeout_us, bitset))
+        return 0;
+
+    switch (PAL_NATIVE_ERRNO) {
+        case PAL_ERROR_INCONSIST:
+            return -EAGAIN;
+        case PAL_ERROR_TRYAGAIN:
+            return -ETIMEDOUT;
+        default:
+            return -PAL_ERRNO;
+    }
+}
+
+static int host_futex_wake_op (unsigned int * uaddr, unsigned int * uaddr2,
+                               int count, int count2, int val3)
+{
+    int oldval, newval, cmpval, nwaken;
+
+    do {
+        oldval = *(volatile int *) uaddr2;
+        cmpval = futex_op_value(oldval, val3, &newval);
+    } while (__sync_val_compare_and_swap((int *) uaddr2, oldval, newval)
+             != oldval);
+
+    nwaken = DkFutexWake(uaddr, count, FUTEX_BITSET_MATCH_ANY);
+    if (cmpval)
+        nwaken += DkFutexWake(uaddr2, count2, FUTEX_BITSET_MATCH_ANY);
+
+    return nwaken;
+}
+
+/* The waiters are moved by the host. A PAL which cannot move them has all
+ * of them woken up instead; they recheck their condition and wait again. */
+static int host_futex_requeue (unsigned int * uaddr, unsigned int * uaddr2,
+                               int count, int count2, bool cmp, int val3)
+{
+    PAL_NUM nwaiters;
+
+    if (DkFutexRequeue(uaddr, count, uaddr2, count2, cmp, val3, &nwaiters))
+        return nwaiters;
+
+    switch (PAL_NATIVE_ERRNO) {
+        case PAL_ERROR_INCONSIST:
+            return -EAGAIN;
+        case PAL_ERROR_NOTIMPLEMENTED:
+            break;
+        default:
+            return -PAL_ERRNO;
+    }
+
+    if (cmp && *(volatile unsigned int *) uaddr != val3)
+        return -EAGAIN;
+
+    return DkFutexWake(uaddr, FUTEX_WAKE_ALL, FUTEX_BITSET_MATCH_ANY);
+}
+
+int shim_do_futex (unsigned int * uaddr, int op, int val, void * utime,
+                   unsigned int * uaddr2, int val3)
+{
+    uint32_t futex_op = (op & FUTEX_CMD_MASK);
+    uint32_t val2 = 0;
+    bool host = (op & FUTEX_PRIVATE_FLAG) && host_futex_supported();
+    int ret = 0;
+
+    if (!uaddr || ((uintptr_t) uaddr % sizeof(unsigned int)))
+        return -EINVAL;
+
+    if (futex_op == FUTEX_WAKE_OP || futex_op == FUTEX_REQUEUE ||
+            futex_op == FUTEX_CMP_REQUEUE) {
+        if (!uaddr2 || ((uintptr_t) uaddr2 % sizeof(unsigned int)))
+            return -EINVAL;
 
         val2 = (uint32_t)(uint64_t) utime;
     }
 
-    unlock(futex_list_lock);
-    lock(hdl->lock);
     uint64_t timeout_us = NO_TIMEOUT;
 
     switch (futex_op) {
@@ -170,152 +490,47 @@ int shim_do_futex (unsigned int * uaddr, int op, int val, void * utime,
             debug("FUTEX_WAIT: %p (val = %d) vs %d mask = %08x, timeout ptr %p\n",
                   uaddr, *uaddr, val, bitset, utime);
 
-            if (*uaddr != val) {
-                ret = -EAGAIN;
-                break;
-            }
-
-            struct futex_waiter waiter;
-            thread_setwait(&waiter.thread, NULL);
-            INIT_LIST_HEAD(&waiter, list);
-            waiter.bitset = bitset;
-            listp_add_tail(&waiter, &futex->waiters, list);
-
-            unlock(hdl->lock);
-            ret = thread_sleep(timeout_us);
-            /* DEP 1/28/17: Should return ETIMEDOUT, not EAGAIN, on timeout. */
-            if (ret == -EAGAIN)
-                ret = -ETIMEDOUT;
-            if (ret == -ETIMEDOUT)
-                listp_del(&waiter, &futex->waiters, list);
-            lock(hdl->lock);
-            /* Chia-Che 10/17/17: FUTEX_WAKE should remove the waiter
-             * from the list; if not, we should remove it now. */
-            if (!list_empty(&waiter, list))
-                listp_del(&waiter, &futex->waiters, list);
+            ret = host ? host_futex_wait(uaddr, val, timeout_us, bitset) :
+                  futex_wait(uaddr, val, timeout_us, bitset);
             break;
         }
 
         case FUTEX_WAKE:
         case FUTEX_WAKE_BITSET: {
-            struct futex_waiter * waiter, * wtmp;
-            int nwaken = 0;
             uint32_t bitset = (futex_op == FUTEX_WAKE_BITSET) ? val3 :
                               0xffffffff;
-            
+
             debug("FUTEX_WAKE: %p (val = %d) count = %d mask = %08x\n",
                   uaddr, *uaddr, val, bitset);
 
-            listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
-                if (!(bitset & waiter->bitset))
-                    continue;
-
-                debug("FUTEX_WAKE wake thread %d: %p (val = %d)\n",
-                      waiter->thread->tid, uaddr, *uaddr);
-
-                listp_del_init(waiter, &futex->waiters, list);
-                thread_wakeup(waiter->thread);
-                nwaken++;
-                if (nwaken >= val) break;
-            }
-
-            ret = nwaken;
+            ret = host ? (int) DkFutexWake(uaddr, val, bitset) :
+                  futex_wake(uaddr, val, bitset);
             debug("FUTEX_WAKE done: %p (val = %d) woke %d threads\n", uaddr, *uaddr, ret);
             break;
         }
 
-        case FUTEX_WAKE_OP: {
-            assert(futex2);
-            int oldval = *(int *) uaddr2, newval, cmpval;
-
-            newval = (val3 >> 12) & 0xfff;
-            switch ((val3 >> 28) & 0xf) {
-                case FUTEX_OP_SET:  break;
-                case FUTEX_OP_ADD:  newval = oldval + newval;  break;
-                case FUTEX_OP_OR:   newval = oldval | newval;  break;
-                case FUTEX_OP_ANDN: newval = oldval & ~newval; break;
-                case FUTEX_OP_XOR:  newval = oldval ^ newval;  break;
-            }
-
-            cmpval = val3 & 0xfff;
-            switch ((val3 >> 24) & 0xf) {
-                case FUTEX_OP_CMP_EQ: cmpval = (oldval == cmpval); break;
-                case FUTEX_OP_CMP_NE: cmpval = (oldval != cmpval); break;
-                case FUTEX_OP_CMP_LT: cmpval = (oldval < cmpval);  break;
-                case FUTEX_OP_CMP_LE: cmpval = (oldval <= cmpval); break;
-                case FUTEX_OP_CMP_GT: cmpval = (oldval > cmpval);  break;
-                case FUTEX_OP_CMP_GE: cmpval = (oldval >= cmpval); break;
-            }
-
-            *(int *) uaddr2 = newval;
-            struct futex_waiter * waiter, * wtmp;
-            int nwaken = 0;
-            debug("FUTEX_WAKE_OP: %p (val = %d) count = %d\n", uaddr, *uaddr, val);
-            listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
-                debug("FUTEX_WAKE_OP wake thread %d: %p (val = %d)\n",
-                      waiter->thread->tid, uaddr, *uaddr);
-                listp_del_init(waiter, &futex->waiters, list);
-                thread_wakeup(waiter->thread);
-                nwaken++;
-            }
-
-            if (cmpval) {
-                unlock(hdl->lock);
-                put_handle(hdl);
-                hdl = hdl2;
-                lock(hdl->lock);
-                debug("FUTEX_WAKE: %p (val = %d) count = %d\n", uaddr2,
-                      *uaddr2, val2);
-                listp_for_each_entry_safe(waiter, wtmp, &futex2->waiters, list) {
-                    debug("FUTEX_WAKE_OP(2) wake thread %d: %p (val = %d)\n",
-                          waiter->thread->tid, uaddr2, *uaddr2);
-                    listp_del_init(waiter, &futex2->waiters, list);
-                    thread_wakeup(waiter->thread);
-                    nwaken++;
-                }
-            }
-            ret = nwaken;
+        case FUTEX_WAKE_OP:
+            ret = host ? host_futex_wake_op(uaddr, uaddr2, val, val2, val3) :
+                  futex_wake_op(uaddr, uaddr2, val, val2, val3);
             break;
-        }
 
         case FUTEX_CMP_REQUEUE:
-            if (*uaddr != val3) {
-                ret = -EAGAIN;
-                break;
-            }
-
         case FUTEX_REQUEUE: {
-            assert(futex2);
-            struct futex_waiter * waiter, * wtmp;
-            int nwaken = 0;
-            listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
-                listp_del_init(waiter, &futex->waiters, list);
-                thread_wakeup(waiter->thread);
-                nwaken++;
-                if (nwaken >= val)
-                    break;
-            }
-
-            lock(hdl2->lock);
-            listp_splice_init(&futex->waiters, &futex2->waiters, list, futex_waiter);
-            unlock(hdl2->lock);
-            put_handle(hdl2);
-            ret = nwaken;
+            bool cmp = (futex_op == FUTEX_CMP_REQUEUE);
+            ret = host ? host_futex_requeue(uaddr, uaddr2, val, val2, cmp,
+                                            val3) :
+                  futex_requeue(uaddr, uaddr2, val, val2, cmp, val3);
             break;
         }
 
+        /* FUTEX_FD has been removed from Linux since 2.6.26. */
         case FUTEX_FD:
-            ret = set_new_fd_handle(hdl, 0, NULL);
-            break;
-
         default:
             debug("unsupported futex op: 0x%x\n", op);
             ret = -ENOSYS;
             break;
     }
 
-    unlock(hdl->lock);
-    put_handle(hdl);
     return ret;
 }
 
@@ -352,83 +567,40 @@ int shim_do_get_robust_list (pid_t pid, struct robust_list_head ** head,
     return 0;
 }
 
+/* Clear the futex word and wake up all its waiters, when a thread exits. */
+static void release_futex (unsigned int * uaddr)
+{
+    struct futex_bucket * bucket = get_futex_bucket(uaddr);
+    struct shim_futex * futex;
+
+    lock(bucket->lock);
+    debug("release futex at %p\n", uaddr);
+    *uaddr = 0;
+    futex = __lookup_futex(bucket, uaddr, false);
+    __wake_futex(futex, FUTEX_WAKE_ALL, FUTEX_BITSET_MATCH_ANY);
+    __put_futex(bucket, futex);
+    unlock(bucket->lock);
+
+    /* The waiters may also be blocked on the host futex */
+    if (host_futex_supported())
+        DkFutexWake(uaddr, FUTEX_WAKE_ALL, FUTEX_BITSET_MATCH_ANY);
+}
+
 void release_robust_list (struct robust_list_head * head)
 {
     long futex_offset = head->futex_offset;
     struct robust_list * robust, * prev = &head->list;
 
-    create_lock_runtime(&futex_list_lock);
-
     for (robust = prev->next ; robust && robust != prev ;
          prev = robust, robust = robust->next) {
         void * futex_addr = (void *) robust + futex_offset;
-        struct shim_futex_handle * tmp, * futex = NULL;
-
-        lock(futex_list_lock);
-
-        listp_for_each_entry(tmp, &futex_list, list)
-            if (tmp->uaddr == futex_addr) {
-                futex = tmp;
-                break;
-            }
-
-        unlock(futex_list_lock);
-
-        if (!futex)
-            continue;
-
-        struct futex_waiter * waiter, * wtmp;
-        struct shim_handle * hdl =
-            container_of(futex, struct shim_handle, info.futex);
-        get_handle(hdl);
-        lock(hdl->lock);
-
         debug("release robust list: %p\n", futex_addr);
-        *(int *) futex_addr = 0;
-        listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
-            listp_del_init(waiter, &futex->waiters, list);
-            thread_wakeup(waiter->thread);
-        }
-
-        unlock(hdl->lock);
-        put_handle(hdl);
+        release_futex((unsigned int *) futex_addr);
     }
 }
 
 void release_clear_child_id (int * clear_child_tid)
 {
     debug("clear child tid at %p\n", clear_child_tid);
-    *clear_child_tid = 0;
-
-    create_lock_runtime(&futex_list_lock);
-
-    struct shim_futex_handle * tmp, * futex = NULL;
-    lock(futex_list_lock);
-
-    listp_for_each_entry(tmp, &futex_list, list)
-        if (tmp->uaddr == (void *) clear_child_tid) {
-            futex = tmp;
-            break;
-        }
-
-    unlock(futex_list_lock);
-
-    if (!futex)
-        return;
-
-    struct futex_waiter * waiter, * wtmp;
-    struct shim_handle * hdl =
-            container_of(futex, struct shim_handle, info.futex);
-    get_handle(hdl);
-    lock(hdl->lock);
-
-    debug("release futex at %p\n", clear_child_tid);
-    *clear_child_tid = 0;
-    listp_for_each_entry_safe(waiter, wtmp, &futex->waiters, list) {
-        listp_del_init(waiter, &futex->waiters, list);
-        thread_wakeup(waiter->thread);
-    }
-
-    unlock(hdl->lock);
-    put_handle(hdl);
+    release_futex((unsigned int *) clear_child_tid);
 }
@@ -29,6 +29,7 @@
 #include <shim_vma.h>
 #include <shim_fs.h>
 #include <shim_profile.h>
+#include <shim_checkpoint.h>
 
 #include <pal.h>
 #include <pal_error.h>
@@ -110,6 +111,11 @@ void * shim_do_mmap (void * addr, size_t length, int prot, int flags, int fd,
     void * cur_stack = current_stack();
     assert(cur_stack < addr || cur_stack > addr + length);
 
+    /* the memory replaced is no longer migrated from or to another
+       process */
+    if (flags & MAP_FIXED)
+        release_postcopy_range(addr, length, false);
+
     if (!hdl) {
         addr = (void *) DkVirtualMemoryAlloc(addr, length, pal_alloc_type,
                                              PAL_PROT(prot, 0));
@@ -152,6 +158,8 @@ int shim_do_mprotect (void * addr, size_t length, int prot)
     if (bkeep_mprotect(addr, length, prot, 0) < 0)
         return -EPERM;
 
+    release_postcopy_range(addr, length, true);
+
     if (!DkVirtualMemoryProtect(addr, length, prot))
         return -PAL_ERRNO;
 
@@ -185,6 +193,7 @@ int shim_do_munmap (void * addr, size_t length)
     if (bkeep_mprotect(addr, length, PROT_NONE, 0) < 0)
         return -EPERM;
 
+    release_postcopy_range(addr, length, false);
     DkVirtualMemoryFree(addr, length);
 
     if (bkeep_munmap(addr, length, 0) < 0)
@@ -229,10 +229,18 @@ size_t shim_do_pread64 (int fd, char * buf, size_t count, loff_t pos)
         goto out;
     }
 
-    if (!fs->fs_ops->read)
+    if (hdl->type == TYPE_DIR)
         goto out;
 
-    if (hdl->type == TYPE_DIR)
+    /* access the file at pos without moving the file marker */
+    if (fs->fs_ops->readv) {
+        struct iovec iov = { .iov_base = buf, .iov_len = count };
+        off_t offset = pos;
+        ret = fs->fs_ops->readv(hdl, &iov, 1, &offset);
+        goto out;
+    }
+
+    if (!fs->fs_ops->read)
         goto out;
 
     int offset = fs->fs_ops->seek(hdl, 0, SEEK_CUR);
@@ -280,10 +288,18 @@ size_t shim_do_pwrite64 (int fd, char * buf, size_t count, loff_t pos)
         goto out;
     }
 
-    if (!fs->fs_ops->write)
+    if (hdl->type == TYPE_DIR)
         goto out;
 
-    if (hdl->type == TYPE_DIR)
+    /* access the file at pos without moving the file marker */
+    if (fs->fs_ops->writev) {
+        struct iovec iov = { .iov_base = buf, .iov_len = count };
+        off_t offset = pos;
+        ret = fs->fs_ops->writev(hdl, &iov, 1, &offset);
+        goto out;
+    }
+
+    if (!fs->fs_ops->write)
         goto out;
 
     int offset = fs->fs_ops->seek(hdl, 0, SEEK_CUR);
@@ -361,17 +377,10 @@ size_t shim_do_getdents (int fd, struct linux_dirent * buf, size_t count)
     struct linux_dirent * b = buf;
     int bytes = 0;
 
-    /* If we haven't listed the directory, do this first */
-    if (!(dent->state & DENTRY_LISTED)) {
-        ret = list_directory_dentry(dent);
-        if (ret < 0)
-            goto out;
-    }
-
 #define DIRENT_SIZE(len)  (sizeof(struct linux_dirent) +                \
                            sizeof(struct linux_dirent_tail) + (len) + 1)
 
-#define ASSIGN_DIRENT(dent, name, type)                                 \
+#define ASSIGN_DIRENT(dent, name, dtype)                                \
         do {                                                            \
             int len = strlen(name);                                     \
             if (bytes + DIRENT_SIZE(len) > count)                       \
@@ -387,7 +396,7 @@ size_t shim_do_getdents (int fd, struct linux_dirent * buf, size_t count)
             memcpy(b->d_name, name, len + 1);                           \
                                                                         \
             bt->pad = 0;                                                \
-            bt->d_type = type ? : get_dirent_type(dent->mode);          \
+            bt->d_type = dtype ? : get_dirent_type(dent->type);         \
                                                                         \
             b = (void *) bt + sizeof(struct linux_dirent_tail);         \
             bytes += DIRENT_SIZE(len);                                  \
@@ -406,7 +415,12 @@ size_t shim_do_getdents (int fd, struct linux_dirent * buf, size_t count)
         dirhdl->dotdot = NULL;
     }
 
+    /* the dcache may have the directory listed already */
     if (dirhdl->ptr == (void *) -1) {
+        ret = list_directory_dentry(dent);
+        if (ret < 0)
+            goto out;
+
         ret = list_directory_handle(dent, hdl);
         if (ret < 0)
             goto out;
@@ -451,13 +465,13 @@ size_t shim_do_getdents64 (int fd, struct linux_dirent64 * buf, size_t count)
 
     if (hdl->type != TYPE_DIR) {
         ret = -ENOTDIR;
-        goto out;
+        goto out_no_unlock;
     }
 
     /* DEP 3/3/17: Properly handle an unlinked directory */
     if (hdl->dentry->state & DENTRY_NEGATIVE) {
         ret = -ENOENT;
-        goto out;
+        goto out_no_unlock;
     }
     
     lock(hdl->lock);
@@ -467,15 +481,9 @@ size_t shim_do_getdents64 (int fd, struct linux_dirent64 * buf, size_t count)
     struct linux_dirent64 * b = buf;
     int bytes = 0;
 
-    /* If we haven't listed the directory, do this first */
-    if (!(dent->state & DENTRY_LISTED)) {
-        ret = list_directory_dentry(dent);
-        if (ret) goto out;
-    }
-    
 #define DIRENT_SIZE(len)  (sizeof(struct linux_dirent64) + (len) + 1)
 
-#define ASSIGN_DIRENT(dent, name, type)                                 \
+#define ASSIGN_DIRENT(dent, name, dtype)                                \
         do {                                                            \
             int len = strlen(name);                                     \
             if (bytes + DIRENT_SIZE(len) > count)                       \
@@ -484,7 +492,7 @@ size_t shim_do_getdents64 (int fd, struct linux_dirent64 * buf, size_t count)
             b->d_ino = dent->ino;                                       \
             b->d_off = ++dirhdl->offset;                                \
             b->d_reclen = DIRENT_SIZE(len);                             \
-            b->d_type = type ? : get_dirent_type(dent->mode);           \
+            b->d_type = dtype ? : get_dirent_type(dent->type);          \
                                                                         \
             memcpy(b->d_name, name, len + 1);                           \
                                                                         \
@@ -504,9 +512,15 @@ size_t shim_do_getdents64 (int fd, struct linux_dirent64 * buf, size_t count)
         dirhdl->dotdot = NULL;
     }
 
+    /* the dcache may have the directory listed already */
     if (dirhdl->ptr == (void *) -1) {
+        ret = list_directory_dentry(dent);
+        if (ret < 0)
+            goto out;
+
         ret = list_directory_handle(dent, hdl);
-        if (ret) goto out;
+        if (ret < 0)
+            goto out;
     }
     
     while (dirhdl->ptr && *dirhdl->ptr) {
@@ -528,8 +542,9 @@ done:
     if (bytes == 0 && (dirhdl->dot || dirhdl->dotdot || 
                        (dirhdl->ptr && *dirhdl->ptr)))
         ret = -EINVAL;
-    unlock(hdl->lock);
 out:
+    unlock(hdl->lock);
+out_no_unlock:
     put_handle(hdl);
     return ret;
 }
@@ -107,7 +107,15 @@ int shim_do_pipe2 (int * filedes, int flags)
                             &hdl1->uri, flags)) < 0)
         goto out;
 
-    qstrcopy(&hdl2->uri, &hdl2->uri);
+    qstrcopy(&hdl2->uri, &hdl1->uri);
+
+    hdl1->flags |= flags & O_NONBLOCK;
+    hdl2->flags |= flags & O_NONBLOCK;
+
+    /* both ends are in this process for now; without a ring, the pipe
+       just goes through the host */
+    if (create_pipe_ring(hdl1, hdl2) < 0)
+        debug("pipe ring creation failure\n");
 
     flags = flags & O_CLOEXEC ? FD_CLOEXEC : 0;
     int vfd1 = set_new_fd_handle(hdl1, flags, NULL);
@@ -263,7 +263,7 @@ static int __kill_proc (struct shim_thread * thread, void * arg,
         goto out;
 
     if (!thread->in_vm) {
-        unlock(thread_list_lock);
+        read_unlock(thread_list_lock);
         *unlocked = true;
         return (!ipc_pid_kill_send(warg->sender, warg->id, KILL_PROCESS,
                                    warg->sig)) ? 1 : 0;
@@ -280,7 +280,7 @@ static int __kill_proc (struct shim_thread * thread, void * arg,
         } else {
             /* This double-check case is probably unnecessary, but keep it for now */
             unlock(thread->lock);
-            unlock(thread_list_lock);
+            read_unlock(thread_list_lock);
             *unlocked = true;
             return (!ipc_pid_kill_send(warg->sender, warg->id, KILL_PROCESS,
                                    warg->sig)) ? 1 : 0;
@@ -305,7 +305,7 @@ static int __kill_proc_simple (struct shim_simple_thread * sthread,
 
     if (sthread->is_alive) {
         unlock(sthread->lock);
-        unlock(thread_list_lock);
+        read_unlock(thread_list_lock);
         *unlocked = true;
         return (!ipc_pid_kill_send(warg->sender, warg->id, KILL_PROCESS,
                                    warg->sig)) ? 1 : 0;
@@ -376,7 +376,7 @@ static int __kill_pgroup (struct shim_thread * thread, void * arg,
         srched = 1;
     } else {
         unlock(thread->lock);
-        unlock(thread_list_lock);
+        read_unlock(thread_list_lock);
         *unlocked = true;
         return (!ipc_pid_kill_send(warg->sender, warg->id, KILL_PGROUP,
                                    warg->sig)) ? 1 : 0;
@@ -400,7 +400,7 @@ static int __kill_pgroup_simple (struct shim_simple_thread * sthread,
 
     if (sthread->is_alive) {
         unlock(sthread->lock);
-        unlock(thread_list_lock);
+        read_unlock(thread_list_lock);
         *unlocked = true;
         return (!ipc_pid_kill_send(warg->sender, warg->id, KILL_PGROUP,
                                    warg->sig)) ? 1 : 0;
@@ -1120,24 +1120,17 @@ static ssize_t do_sendmsg (int fd, struct iovec * bufs, int nbufs, int flags,
         debug("next packet send to %s\n", uri);
     }
 
-    int bytes = 0;
     ret = 0;
 
-    for (int i = 0 ; i < nbufs ; i++) {
-        ret = DkStreamWrite(pal_hdl, 0, bufs[i].iov_len, bufs[i].iov_base,
-                            uri);
+    /* send all the buffers in one PAL call, so a datagram is not split */
+    if (iov_length(bufs, nbufs)) {
+        ret = DkStreamWritev(pal_hdl, 0, nbufs, (PAL_IOVEC *) bufs, uri);
 
-        if (!ret) {
+        if (!ret)
             ret = (PAL_NATIVE_ERRNO == PAL_ERROR_STREAMEXIST) ?
                   - ECONNABORTED : -PAL_ERRNO;
-            break;
-        }
-
-        bytes += ret;
     }
 
-    if (bytes)
-        ret = bytes;
     if (ret < 0) {
         lock(hdl->lock);
         goto out_locked;
@@ -1255,25 +1248,23 @@ static ssize_t do_recvmsg (int fd, struct iovec * bufs, int nbufs, int flags,
 
     unlock(hdl->lock);
 
-    bool address_received = false;
     int bytes = 0;
-    ret = 0;
 
-    for (int i = 0 ; i < nbufs ; i++) {
-        ret = DkStreamRead(pal_hdl, 0, bufs[i].iov_len, bufs[i].iov_base,
-                           uri, uri ? SOCK_URI_SIZE : 0);
+    /* receive into all the buffers in one PAL call, so a datagram is
+       not split */
+    if (iov_length(bufs, nbufs)) {
+        bytes = DkStreamReadv(pal_hdl, 0, nbufs, (PAL_IOVEC *) bufs,
+                              uri, uri ? SOCK_URI_SIZE : 0);
 
-        if (!ret) {
+        if (!bytes) {
             ret = (PAL_NATIVE_ERRNO == PAL_ERROR_STREAMNOTEXIST) ?
                   - ECONNABORTED : -PAL_ERRNO;
-            break;
+            lock(hdl->lock);
+            goto out_locked;
         }
+    }
 
-        bytes += ret;
-
-        if (!addr || !bytes || address_received)
-            continue;
-
+    if (addr && bytes) {
         if (sock->domain == AF_UNIX) {
             unix_copy_addr(addr, sock->addr.un.dentry);
             *addrlen = sizeof(struct sockaddr_un);
@@ -1300,16 +1291,9 @@ static ssize_t do_recvmsg (int fd, struct iovec * bufs, int nbufs, int flags,
             *addrlen = (sock->domain == AF_INET) ?
                        sizeof(struct sockaddr_in) : sizeof(struct sockaddr_in6);
         }
-
-        address_received = false;
     }
 
-    if (bytes)
-        ret = bytes;
-    if (ret < 0) {
-        lock(hdl->lock);
-        goto out_locked;
-    }
+    ret = bytes;
     goto out;
 
 out_locked:
@@ -20,7 +20,7 @@
 /*
  * shim_wrapper.c
  *
- * Implementation of system call "readv" and "writev".
+ * Implementation of system call "readv", "writev", "preadv" and "pwritev".
  */
 
 #include <shim_internal.h>
@@ -35,30 +35,49 @@
 
 #include <errno.h>
 
-ssize_t shim_do_readv (int fd, const struct iovec * vec, int vlen)
+static int check_iovec (const struct iovec * vec, int vlen, bool write)
 {
+    if (vlen < 0)
+        return -EINVAL;
+
     if (!vec || test_user_memory((void *) vec, sizeof(*vec) * vlen, false))
         return -EINVAL;
 
     for (int i = 0 ; i < vlen ; i++) {
         if (vec[i].iov_base) {
-            if (vec[i].iov_base + vec[i].iov_len <= vec[i].iov_base)
+            if (vec[i].iov_base + vec[i].iov_len < vec[i].iov_base)
                 return -EINVAL;
-            if (test_user_memory(vec[i].iov_base, vec[i].iov_len, true))
+            if (test_user_memory(vec[i].iov_base, vec[i].iov_len, write))
                 return -EFAULT;
+        } else if (vec[i].iov_len) {
+            return -EFAULT;
         }
     }
 
-    struct shim_handle * hdl = get_fd_handle(fd, NULL, NULL);
-    if (!hdl)
-        return -EBADF;
+    return 0;
+}
 
-    int ret = 0;
+/*
+ * Read into a vector of buffers, at *pos if pos is not NULL. The file
+ * system reads the whole vector in one operation if it supports readv;
+ * otherwise each buffer is read in turn, seeking to pos and back.
+ */
+static ssize_t do_handle_readv (struct shim_handle * hdl,
+                                const struct iovec * vec, int vlen,
+                                off_t * pos)
+{
+    struct shim_fs_ops * fs_ops = hdl->fs->fs_ops;
 
-    if (!(hdl->acc_mode & MAY_READ) ||
-        !hdl->fs || !hdl->fs->fs_ops || !hdl->fs->fs_ops->read) {
-        ret = -EACCES;
-        goto out;
+    if (fs_ops->readv)
+        return fs_ops->readv(hdl, vec, vlen, pos);
+
+    int offset = 0, ret;
+
+    if (pos) {
+        if ((offset = fs_ops->seek(hdl, 0, SEEK_CUR)) < 0)
+            return offset;
+        if ((ret = fs_ops->seek(hdl, *pos, SEEK_SET)) < 0)
+            return ret;
     }
 
     ssize_t bytes = 0;
@@ -69,19 +88,20 @@ ssize_t shim_do_readv (int fd, const struct iovec * vec, int vlen)
         if (!vec[i].iov_base)
             continue;
 
-        b_vec = hdl->fs->fs_ops->read(hdl, vec[i].iov_base, vec[i].iov_len);
+        b_vec = fs_ops->read(hdl, vec[i].iov_base, vec[i].iov_len);
         if (b_vec < 0) {
-            ret = bytes ? : b_vec;
-            goto out;
+            if (!bytes)
+                bytes = b_vec;
+            break;
         }
 
         bytes += b_vec;
     }
 
-    ret = bytes;
-out:
-    put_handle(hdl);
-    return ret;
+    if (pos && (ret = fs_ops->seek(hdl, offset, SEEK_SET)) < 0)
+        return ret;
+
+    return bytes;
 }
 
 /*
@@ -98,53 +118,143 @@ out:
  * Upon successful completion, writev() shall return the number of bytes
  * actually written. Otherwise, it shall return a value of -1, the file-pointer
  * shall remain unchanged, and errno shall be set to indicate an error
+ *
+ * The file systems which support writev (files, pipes and sockets) write
+ * the whole vector in one PAL call, so a writev to a pipe or a datagram
+ * socket is never split. The other file systems still write each buffer
+ * in turn.
  */
-ssize_t shim_do_writev (int fd, const struct iovec * vec, int vlen)
+static ssize_t do_handle_writev (struct shim_handle * hdl,
+                                 const struct iovec * vec, int vlen,
+                                 off_t * pos)
 {
-    if (!vec || test_user_memory((void *) vec, sizeof(*vec) * vlen, false))
-        return -EINVAL;
+    struct shim_fs_ops * fs_ops = hdl->fs->fs_ops;
+
+    if (fs_ops->writev)
+        return fs_ops->writev(hdl, vec, vlen, pos);
+
+    int offset = 0, ret;
+
+    if (pos) {
+        if ((offset = fs_ops->seek(hdl, 0, SEEK_CUR)) < 0)
+            return offset;
+        if ((ret = fs_ops->seek(hdl, *pos, SEEK_SET)) < 0)
+            return ret;
+    }
+
+    ssize_t bytes = 0;
 
     for (int i = 0 ; i < vlen ; i++) {
-        if (vec[i].iov_base) {
-            if (vec[i].iov_base + vec[i].iov_len < vec[i].iov_base)
-                return -EINVAL;
-            if (test_user_memory(vec[i].iov_base, vec[i].iov_len, false))
-                return -EFAULT;
+        int b_vec;
+
+        if (!vec[i].iov_base)
+            continue;
+
+        b_vec = fs_ops->write(hdl, vec[i].iov_base, vec[i].iov_len);
+        if (b_vec < 0) {
+            if (!bytes)
+                bytes = b_vec;
+            break;
         }
+
+        bytes += b_vec;
     }
 
+    if (pos && (ret = fs_ops->seek(hdl, offset, SEEK_SET)) < 0)
+        return ret;
+
+    return bytes;
+}
+
+static ssize_t do_readv (int fd, const struct iovec * vec, int vlen,
+                         off_t * pos)
+{
+    int ret = check_iovec(vec, vlen, true);
+    if (ret < 0)
+        return ret;
+
     struct shim_handle * hdl = get_fd_handle(fd, NULL, NULL);
     if (!hdl)
         return -EBADF;
 
-    int ret = 0;
-
-    if (!(hdl->acc_mode & MAY_WRITE) ||
-        !hdl->fs || !hdl->fs->fs_ops || !hdl->fs->fs_ops->write) {
+    if (!(hdl->acc_mode & MAY_READ) ||
+        !hdl->fs || !hdl->fs->fs_ops || !hdl->fs->fs_ops->read) {
         ret = -EACCES;
         goto out;
     }
 
-    ssize_t bytes = 0;
+    if (pos && !hdl->fs->fs_ops->seek) {
+        ret = -ESPIPE;
+        goto out;
+    }
 
-    for (int i = 0 ; i < vlen ; i++)
-    {
-        int b_vec;
+    if (hdl->type == TYPE_DIR) {
+        ret = -EISDIR;
+        goto out;
+    }
 
-        if (!vec[i].iov_base)
-            continue;
+    ret = do_handle_readv(hdl, vec, vlen, pos);
+out:
+    put_handle(hdl);
+    return ret;
+}
 
-        b_vec = hdl->fs->fs_ops->write(hdl, vec[i].iov_base, vec[i].iov_len);
-        if (b_vec < 0) {
-            ret = bytes ? : b_vec;
-            goto out;
-        }
+static ssize_t do_writev (int fd, const struct iovec * vec, int vlen,
+                          off_t * pos)
+{
+    int ret = check_iovec(vec, vlen, false);
+    if (ret < 0)
+        return ret;
 
-        bytes += b_vec;
+    struct shim_handle * hdl = get_fd_handle(fd, NULL, NULL);
+    if (!hdl)
+        return -EBADF;
+
+    if (!(hdl->acc_mode & MAY_WRITE) ||
+        !hdl->fs || !hdl->fs->fs_ops || !hdl->fs->fs_ops->write) {
+        ret = -EACCES;
+        goto out;
     }
 
-    ret = bytes;
+    if (pos && !hdl->fs->fs_ops->seek) {
+        ret = -ESPIPE;
+        goto out;
+    }
+
+    ret = do_handle_writev(hdl, vec, vlen, pos);
 out:
     put_handle(hdl);
     return ret;
 }
+
+ssize_t shim_do_readv (int fd, const struct iovec * vec, int vlen)
+{
+    return do_readv(fd, vec, vlen, NULL);
+}
+
+ssize_t shim_do_writev (int fd, const struct iovec * vec, int vlen)
+{
+    return do_writev(fd, vec, vlen, NULL);
+}
+
+ssize_t shim_do_preadv (int fd, const struct iovec * vec, int vlen,
+                        unsigned long pos_l, unsigned long pos_h)
+{
+    off_t pos = pos_l;
+
+    if (pos < 0)
+        return -EINVAL;
+
+    return do_readv(fd, vec, vlen, &pos);
+}
+
+ssize_t shim_do_pwritev (int fd, const struct iovec * vec, int vlen,
+                         unsigned long pos_l, unsigned long pos_h)
+{
+    off_t pos = pos_l;
+
+    if (pos < 0)
+        return -EINVAL;
+
+    return do_writev(fd, vec, vlen, &pos);
+}
@@ -0,0 +1,203 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+/* Copyright (C) 2014 Stony Brook University
+   This file is part of Graphene Library OS.
+
+   Graphene Library OS is free software: you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   Graphene Library OS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+ * compress.c
+ *
+ * A fast block compressor in the format of LZ4 blocks: sequences of a
+ * token, literals, a 16-bit offset and a match length. The last sequence
+ * only has literals. Only the memory of the arguments is used, so the
+ * functions can run in threads without the library OS.
+ */
+
+#include <shim_internal.h>
+#include <shim_utils.h>
+
+#include <errno.h>
+
+#define LZ_MINMATCH         4
+#define LZ_LASTLITERALS     5       /* the block ends with literals */
+#define LZ_MFLIMIT          12      /* no match starts in the last bytes */
+#define LZ_HASH_BITS        12
+#define LZ_MAX_OFFSET       65535
+#define LZ_SKIP_TRIGGER     6       /* go faster on incompressible data */
+
+static inline uint32_t lz_read32 (const uint8_t * p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static inline uint32_t lz_hash (uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static inline uint8_t * lz_write_length (uint8_t * op, size_t len)
+{
+    for (; len >= 255 ; len -= 255)
+        *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+/* the bytes needed for a sequence, in the worst case */
+#define LZ_SEQ_SIZE(lit, mlen)                                      \
+    (1 + (lit) + (lit) / 255 + 1 + 2 + (mlen) / 255 + 1)
+
+static inline uint8_t * lz_write_literals (uint8_t * op, const uint8_t * lit,
+                                           size_t len, size_t mlen)
+{
+    *op++ = (len >= 15 ? 15 : len) << 4 | (mlen >= 15 ? 15 : mlen);
+    if (len >= 15)
+        op = lz_write_length(op, len - 15);
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+/*
+ * Compress size bytes of src into dst, using work (LZ_WORK_SIZE bytes) for
+ * the hash table. Returns the compressed size, or 0 if it does not fit in
+ * dst_size bytes.
+ */
+size_t lz_compress (const void * src, size_t size, void * dst, size_t dst_size,
+                    void * work)
+{
+    const uint8_t * base = src, * end = base + size;
+    const uint8_t * ip = base, * anchor = base;
+    uint8_t * op = dst, * oend = op + dst_size;
+    uint32_t * table = work;
+
+    memset(table, 0, LZ_WORK_SIZE);
+
+    if (size > LZ_MFLIMIT) {
+        const uint8_t * mflimit = end - LZ_MFLIMIT;
+        const uint8_t * matchlimit = end - LZ_LASTLITERALS;
+
+        for (ip++ ; ip < mflimit ; ) {
+            uint32_t seq = lz_read32(ip);
+            uint32_t h = lz_hash(seq);
+            const uint8_t * ref = base + table[h];
+            table[h] = ip - base;
+
+            if (ref >= ip || ip - ref > LZ_MAX_OFFSET ||
+                lz_read32(ref) != seq) {
+                ip += 1 + ((ip - anchor) >> LZ_SKIP_TRIGGER);
+                continue;
+            }
+
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+
+            const uint8_t * mp = ip + LZ_MINMATCH, * mr = ref + LZ_MINMATCH;
+            while (mp < matchlimit && *mp == *mr) {
+                mp++;
+                mr++;
+            }
+
+            size_t lit = ip - anchor, mlen = mp - ip - LZ_MINMATCH;
+            if (LZ_SEQ_SIZE(lit, mlen) > oend - op)
+                return 0;
+
+            op = lz_write_literals(op, anchor, lit, mlen);
+            *op++ = (ip - ref) & 0xff;
+            *op++ = (ip - ref) >> 8;
+            if (mlen >= 15)
+                op = lz_write_length(op, mlen - 15);
+
+            ip = anchor = mp;
+        }
+    }
+
+    size_t lit = end - anchor;
+    if (LZ_SEQ_SIZE(lit, 0) > oend - op)
+        return 0;
+
+    op = lz_write_literals(op, anchor, lit, 0);
+    return op - (uint8_t *) dst;
+}
+
+/*
+ * Decompress size bytes of src into dst. Returns the decompressed size, or
+ * -EINVAL if the block is malformed or does not fit in dst_size bytes.
+ */
+int lz_decompress (const void * src, size_t size, void * dst, size_t dst_size)
+{
+    const uint8_t * ip = src, * iend = ip + size;
+    uint8_t * op = dst, * oend = op + dst_size;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        size_t lit = token >> 4, mlen = token & 15;
+        unsigned int byte;
+
+        if (lit == 15)
+            do {
+                if (ip == iend)
+                    return -EINVAL;
+                lit += (byte = *ip++);
+            } while (byte == 255);
+
+        if (lit > iend - ip || lit > oend - op)
+            return -EINVAL;
+
+        memcpy(op, ip, lit);
+        ip += lit;
+        op += lit;
+
+        /* the last sequence */
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -EINVAL;
+
+        size_t off = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (!off || off > op - (uint8_t *) dst)
+            return -EINVAL;
+
+        if (mlen == 15)
+            do {
+                if (ip == iend)
+                    return -EINVAL;
+                mlen += (byte = *ip++);
+            } while (byte == 255);
+
+        mlen += LZ_MINMATCH;
+        if (mlen > oend - op)
+            return -EINVAL;
+
+        const uint8_t * ref = op - off;
+        if (off >= mlen) {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        } else {
+            /* the match overlaps the bytes it produces */
+            while (mlen--)
+                *op++ = *ref++;
+        }
+    }
+
+    return op - (uint8_t *) dst;
+}
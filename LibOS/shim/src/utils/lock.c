@@ -0,0 +1,182 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+/* Copyright (C) 2014 Stony Brook University
+   This file is part of Graphene Library OS.
+
+   Graphene Library OS is free software: you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   Graphene Library OS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+ * lock.c
+ *
+ * This file contains the contended paths of the LibOS locks; the
+ * uncontended paths are inlined in shim_internal.h. A waiter spins for a
+ * while, then marks the lock word as having waiters and parks on it with
+ * DkFutexWait. The thread releasing a lock with waiters wakes them up.
+ */
+
+#include <shim_internal.h>
+
+#include <pal.h>
+#include <pal_error.h>
+
+#include <linux/futex.h>
+
+#define LOCK_SPIN_COUNT     100
+#define RWLOCK_WAKE_ALL     0x7fffffff
+
+static int host_futex_state = 0; /* 0: unknown, 1: supported, -1: not */
+
+bool host_futex_supported (void)
+{
+    if (!host_futex_state) {
+        /* Probe with a mismatching value, which never blocks */
+        unsigned int word = 0;
+        if (!DkFutexWait(&word, 1, NO_TIMEOUT, FUTEX_BITSET_MATCH_ANY) &&
+            PAL_NATIVE_ERRNO == PAL_ERROR_NOTIMPLEMENTED)
+            host_futex_state = -1;
+        else
+            host_futex_state = 1;
+    }
+
+    return host_futex_state > 0;
+}
+
+/* The futex word is the low half of the state (x86 is little-endian);
+   all the state values fit in it. */
+static inline void park (struct atomic_int * state, int64_t val)
+{
+    DkFutexWait(state, (PAL_IDX) val, NO_TIMEOUT, FUTEX_BITSET_MATCH_ANY);
+}
+
+static inline void wake (struct atomic_int * state, int count)
+{
+    DkFutexWake(state, count, FUTEX_BITSET_MATCH_ANY);
+}
+
+void __lock_contended (LOCKTYPE * l)
+{
+    /* the holder is likely to be done soon */
+    for (int i = 0 ; i < LOCK_SPIN_COUNT ; i++) {
+        cpu_relax();
+        if (atomic_read(&l->state) == LOCK_UNLOCKED &&
+            atomic_cmpxchg(&l->state, LOCK_UNLOCKED, LOCK_LOCKED)
+            == LOCK_UNLOCKED)
+            return;
+    }
+
+    /* once parked, the lock is taken as contended, for there may be
+       other waiters to wake up at unlock */
+    while (true) {
+        int64_t state = atomic_read(&l->state);
+
+        if (state == LOCK_UNLOCKED) {
+            if (atomic_cmpxchg(&l->state, LOCK_UNLOCKED, LOCK_CONTENDED)
+                == LOCK_UNLOCKED)
+                return;
+            continue;
+        }
+
+        if (state == LOCK_LOCKED &&
+            atomic_cmpxchg(&l->state, LOCK_LOCKED, LOCK_CONTENDED)
+            != LOCK_LOCKED)
+            continue;
+
+        park(&l->state, LOCK_CONTENDED);
+    }
+}
+
+void __unlock_contended (LOCKTYPE * l)
+{
+    atomic_set(&l->state, LOCK_UNLOCKED);
+    wake(&l->state, 1);
+}
+
+/* wait until the lock can be taken, as told by can_take(), then add
+   taken to the state */
+#define RWLOCK_WAIT(l, can_take, taken)                                     \
+    do {                                                                    \
+        for (int i = 0 ; i < LOCK_SPIN_COUNT ; i++) {                       \
+            int64_t state = atomic_read(&(l)->state);                       \
+            if (can_take(state) &&                                          \
+                atomic_cmpxchg(&(l)->state, state, state + (taken))         \
+                == state)                                                   \
+                return;                                                     \
+            cpu_relax();                                                    \
+        }                                                                   \
+                                                                            \
+        while (true) {                                                      \
+            int64_t state = atomic_read(&(l)->state);                       \
+            if (can_take(state)) {                                          \
+                if (atomic_cmpxchg(&(l)->state, state, state + (taken))     \
+                    == state)                                               \
+                    return;                                                 \
+                continue;                                                   \
+            }                                                               \
+                                                                            \
+            if (!(state & RWLOCK_WAITERS) &&                                \
+                atomic_cmpxchg(&(l)->state, state, state|RWLOCK_WAITERS)    \
+                != state)                                                   \
+                continue;                                                   \
+                                                                            \
+            park(&(l)->state, state|RWLOCK_WAITERS);                        \
+        }                                                                   \
+    } while (0)
+
+#define CAN_READ(state)     (!((state) & RWLOCK_WRITER))
+#define CAN_WRITE(state)    (!((state) & (RWLOCK_WRITER|RWLOCK_READERS)))
+
+void __read_lock_contended (RWLOCKTYPE * l)
+{
+    RWLOCK_WAIT(l, CAN_READ, 1);
+}
+
+void __write_lock_contended (RWLOCKTYPE * l)
+{
+    RWLOCK_WAIT(l, CAN_WRITE, RWLOCK_WRITER);
+}
+
+/* the last one out clears the waiters bit and wakes them all up; those
+   who still cannot take the lock park again */
+void __read_unlock_contended (RWLOCKTYPE * l)
+{
+    while (true) {
+        int64_t state = atomic_read(&l->state);
+        int64_t new = state - 1;
+        bool last = !(new & RWLOCK_READERS) && (new & RWLOCK_WAITERS);
+
+        if (last)
+            new &= ~RWLOCK_WAITERS;
+
+        if (atomic_cmpxchg(&l->state, state, new) == state) {
+            if (last)
+                wake(&l->state, RWLOCK_WAKE_ALL);
+            return;
+        }
+    }
+}
+
+void __write_unlock_contended (RWLOCKTYPE * l)
+{
+    while (true) {
+        int64_t state = atomic_read(&l->state);
+        int64_t new = state & ~(RWLOCK_WRITER|RWLOCK_WAITERS);
+
+        if (atomic_cmpxchg(&l->state, state, new) == state) {
+            if (state & RWLOCK_WAITERS)
+                wake(&l->state, RWLOCK_WAKE_ALL);
+            return;
+        }
+    }
+}
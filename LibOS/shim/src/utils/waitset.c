@@ -0,0 +1,441 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+/* Copyright (C) 2014 Stony Brook University
+   This file is part of Graphene Library OS.
+
+   Graphene Library OS is free software: you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public License
+   as published by the Free Software Foundation, either version 3 of the
+   License, or (at your option) any later version.
+
+   Graphene Library OS is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/*
+ * waitset.c
+ *
+ * This file contains functions to wait on a persistent set of PAL handles.
+ * If the PAL supports wait sets, the handles are registered once in a PAL
+ * wait set, and each wait only returns the ready handles. Otherwise, every
+ * wait passes all the handles to DkObjectsWaitEvents (or DkObjectsWaitAny).
+ * In that case, the edge-triggered events are emulated: an event is
+ * reported once, and not waited for again until the handle is found not
+ * ready for it.
+ *
+ * A handle removed during a wait may still be returned by that wait, so
+ * the data pointer of a handle must stay valid until the concurrent waits
+ * have returned.
+ */
+
+#include <shim_internal.h>
+#include <shim_utils.h>
+
+#include <pal.h>
+#include <pal_error.h>
+
+#include <errno.h>
+
+#define WAITSET_INIT_SIZE   16
+
+int create_waitset (struct shim_waitset * ws)
+{
+    memset(ws, 0, sizeof(struct shim_waitset));
+
+    ws->size = WAITSET_INIT_SIZE;
+    ws->handles = malloc(sizeof(PAL_HANDLE) * ws->size);
+    ws->events = malloc(sizeof(PAL_FLG) * ws->size);
+    ws->data = malloc(sizeof(void *) * ws->size);
+    ws->reported = malloc(sizeof(PAL_FLG) * ws->size);
+
+    if (!ws->handles || !ws->events || !ws->data || !ws->reported) {
+        free(ws->handles);
+        free(ws->events);
+        free(ws->data);
+        free(ws->reported);
+        return -ENOMEM;
+    }
+
+    ws->pal_handle = DkWaitSetCreate();
+
+    /* Without a PAL wait set, the waiters are woken up by an event when
+     * the handles are changed, to wait on the new handles. */
+    if (!ws->pal_handle) {
+        create_event(&ws->update);
+        if (!event_created(&ws->update)) {
+            free(ws->handles);
+            free(ws->events);
+            free(ws->data);
+            free(ws->reported);
+            return -PAL_ERRNO;
+        }
+    }
+
+    create_lock(ws->lock);
+    return 0;
+}
+
+void destroy_waitset (struct shim_waitset * ws)
+{
+    assert(!ws->nwaiters);
+
+    if (ws->pal_handle) {
+        DkObjectClose(ws->pal_handle);
+        ws->pal_handle = NULL;
+    }
+
+    destroy_event(&ws->update);
+    free(ws->handles);
+    free(ws->events);
+    free(ws->data);
+    free(ws->reported);
+    ws->handles = NULL;
+    ws->events = NULL;
+    ws->data = NULL;
+    ws->reported = NULL;
+    ws->nhandles = ws->size = 0;
+    destroy_lock(ws->lock);
+}
+
+static inline void __notify_waiters (struct shim_waitset * ws)
+{
+    if (!ws->pal_handle && ws->nwaiters)
+        set_event(&ws->update, ws->nwaiters);
+}
+
+static int __find_in_waitset (struct shim_waitset * ws, PAL_HANDLE handle)
+{
+    for (int i = 0 ; i < ws->nhandles ; i++)
+        if (ws->handles[i] == handle)
+            return i;
+
+    return -ENOENT;
+}
+
+int add_to_waitset (struct shim_waitset * ws, PAL_HANDLE handle,
+                    PAL_FLG events, void * data)
+{
+    int ret = 0;
+
+    lock(ws->lock);
+
+    if (__find_in_waitset(ws, handle) >= 0) {
+        ret = -EEXIST;
+        goto out;
+    }
+
+    if (ws->nhandles == ws->size) {
+        int size = ws->size * 2;
+        PAL_HANDLE * handles = malloc(sizeof(PAL_HANDLE) * size);
+        PAL_FLG * new_events = malloc(sizeof(PAL_FLG) * size);
+        void ** new_data = malloc(sizeof(void *) * size);
+        PAL_FLG * new_reported = malloc(sizeof(PAL_FLG) * size);
+
+        if (!handles || !new_events || !new_data || !new_reported) {
+            free(handles);
+            free(new_events);
+            free(new_data);
+            free(new_reported);
+            ret = -ENOMEM;
+            goto out;
+        }
+
+        memcpy(handles, ws->handles, sizeof(PAL_HANDLE) * ws->nhandles);
+        memcpy(new_events, ws->events, sizeof(PAL_FLG) * ws->nhandles);
+        memcpy(new_data, ws->data, sizeof(void *) * ws->nhandles);
+        memcpy(new_reported, ws->reported, sizeof(PAL_FLG) * ws->nhandles);
+        free(ws->handles);
+        free(ws->events);
+        free(ws->data);
+        free(ws->reported);
+        ws->handles = handles;
+        ws->events = new_events;
+        ws->data = new_data;
+        ws->reported = new_reported;
+        ws->size = size;
+    }
+
+    if (ws->pal_handle &&
+        !DkWaitSetAdd(ws->pal_handle, handle, events, data)) {
+        ret = -PAL_ERRNO;
+        goto out;
+    }
+
+    ws->handles[ws->nhandles] = handle;
+    ws->events[ws->nhandles] = events;
+    ws->data[ws->nhandles] = data;
+    ws->reported[ws->nhandles] = 0;
+    ws->nhandles++;
+    __notify_waiters(ws);
+out:
+    unlock(ws->lock);
+    return ret;
+}
+
+int modify_waitset (struct shim_waitset * ws, PAL_HANDLE handle,
+                    PAL_FLG events, void * data)
+{
+    int ret;
+
+    lock(ws->lock);
+
+    ret = __find_in_waitset(ws, handle);
+    if (ret < 0)
+        goto out;
+
+    if (ws->pal_handle &&
+        !DkWaitSetModify(ws->pal_handle, handle, events, data)) {
+        ret = -PAL_ERRNO;
+        goto out;
+    }
+
+    ws->events[ret] = events;
+    ws->data[ret] = data;
+    /* a modified handle is armed again, as by epoll_ctl */
+    ws->reported[ret] = 0;
+    __notify_waiters(ws);
+    ret = 0;
+out:
+    unlock(ws->lock);
+    return ret;
+}
+
+int remove_from_waitset (struct shim_waitset * ws, PAL_HANDLE handle)
+{
+    int ret;
+
+    lock(ws->lock);
+
+    ret = __find_in_waitset(ws, handle);
+    if (ret < 0)
+        goto out;
+
+    if (ws->pal_handle)
+        DkWaitSetRemove(ws->pal_handle, handle);
+
+    /* move the last handle into the empty slot */
+    ws->nhandles--;
+    ws->handles[ret] = ws->handles[ws->nhandles];
+    ws->events[ret] = ws->events[ws->nhandles];
+    ws->data[ret] = ws->data[ws->nhandles];
+    ws->reported[ret] = ws->reported[ws->nhandles];
+    __notify_waiters(ws);
+    ret = 0;
+out:
+    unlock(ws->lock);
+    return ret;
+}
+
+/* query the events a handle is ready for from its attributes */
+static int query_events (PAL_HANDLE handle, PAL_FLG events,
+                         PAL_FLG * ret_events)
+{
+    PAL_STREAM_ATTR attr;
+    if (!DkStreamAttributesQuerybyHandle(handle, &attr))
+        return -PAL_ERRNO;
+
+    *ret_events = 0;
+    if (attr.readable)
+        *ret_events |= PAL_WAIT_READ;
+    if (attr.writeable)
+        *ret_events |= PAL_WAIT_WRITE;
+    if (attr.disconnected)
+        *ret_events |= PAL_WAIT_ERROR;
+    *ret_events &= events|PAL_WAIT_ERROR;
+    return 0;
+}
+
+/*
+ * Wait for the events of all the handles, and report the events of every
+ * ready handle in ret_events. If the PAL cannot report multiple handles at
+ * once, fall back to waiting for any one of them and querying its
+ * attributes.
+ */
+static int wait_for_events (int count, PAL_HANDLE * handles,
+                            PAL_FLG * events, PAL_FLG * ret_events,
+                            uint64_t timeout)
+{
+    if (DkObjectsWaitEvents(count, handles, events, ret_events, timeout))
+        return 0;
+
+    if (PAL_NATIVE_ERRNO != PAL_ERROR_NOTIMPLEMENTED)
+        return -PAL_ERRNO;
+
+    PAL_HANDLE polled = DkObjectsWaitAny(count, handles, timeout);
+    if (!polled)
+        return -PAL_ERRNO;
+
+    memset(ret_events, 0, sizeof(PAL_FLG) * count);
+
+    for (int i = 0 ; i < count ; i++)
+        if (handles[i] == polled)
+            return query_events(polled, events[i], &ret_events[i]);
+
+    return 0;
+}
+
+/*
+ * Poll the handles with edge-triggered events already reported, and clear
+ * the events they are no longer ready for, so they are waited for again.
+ * On an error, all the events are cleared, for the wait to report it.
+ * Must be called with the lock held.
+ */
+static void __refresh_reported (struct shim_waitset * ws)
+{
+    int nhandles = ws->nhandles, npoll = 0;
+    PAL_HANDLE * handles = __alloca(sizeof(PAL_HANDLE) * nhandles);
+    PAL_FLG * poll_events = __alloca(sizeof(PAL_FLG) * nhandles);
+    PAL_FLG * ret_events = __alloca(sizeof(PAL_FLG) * nhandles);
+    int * index = __alloca(sizeof(int) * nhandles);
+
+    for (int i = 0 ; i < nhandles ; i++)
+        if (ws->reported[i]) {
+            handles[npoll] = ws->handles[i];
+            poll_events[npoll] = ws->reported[i];
+            index[npoll] = i;
+            npoll++;
+        }
+
+    if (!npoll)
+        return;
+
+    if (!DkObjectsWaitEvents(npoll, handles, poll_events, ret_events, 0)) {
+        if (PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN) {
+            memset(ret_events, 0, sizeof(PAL_FLG) * npoll);
+        } else if (PAL_NATIVE_ERRNO == PAL_ERROR_NOTIMPLEMENTED) {
+            for (int i = 0 ; i < npoll ; i++)
+                if (query_events(handles[i], poll_events[i],
+                                 &ret_events[i]) < 0)
+                    ret_events[i] = poll_events[i];
+        } else {
+            return;
+        }
+    }
+
+    for (int i = 0 ; i < npoll ; i++)
+        ws->reported[index[i]] = (ret_events[i] & PAL_WAIT_ERROR) ? 0 :
+                                 ws->reported[index[i]] & ret_events[i];
+}
+
+/*
+ * Wait on a copy of the handles in the wait set, and the update event.
+ * A handle is not waited on if all its edge-triggered events have been
+ * reported. Must be called with the lock held. Returns the number of ready
+ * handles, with *updated set if the wait set was changed during the wait.
+ */
+static int __wait_on_handles (struct shim_waitset * ws, int max,
+                              void ** data, PAL_FLG * events,
+                              uint64_t timeout, bool * updated)
+{
+    int nhandles = ws->nhandles, nwait = 0;
+    PAL_HANDLE * handles = __alloca(sizeof(PAL_HANDLE) * (nhandles + 1));
+    PAL_FLG * wait_events = __alloca(sizeof(PAL_FLG) * (nhandles + 1));
+    PAL_FLG * ret_events = __alloca(sizeof(PAL_FLG) * (nhandles + 1));
+    void ** wait_data = __alloca(sizeof(void *) * (nhandles + 1));
+    int ret, nready = 0;
+
+    __refresh_reported(ws);
+
+    for (int i = 0 ; i < nhandles ; i++) {
+        PAL_FLG events = ws->events[i] & (PAL_WAIT_READ|PAL_WAIT_WRITE) &
+                         ~ws->reported[i];
+        if (!events && ws->reported[i])
+            continue;
+
+        handles[nwait] = ws->handles[i];
+        wait_events[nwait] = events;
+        wait_data[nwait] = ws->data[i];
+        nwait++;
+    }
+
+    nhandles = nwait;
+
+    if (timeout) {
+        handles[nwait] = event_handle(&ws->update);
+        wait_events[nwait] = PAL_WAIT_READ;
+        nwait++;
+        ws->nwaiters++;
+    }
+
+    if (!nwait)
+        return 0;
+
+    unlock(ws->lock);
+    ret = wait_for_events(nwait, handles, wait_events, ret_events, timeout);
+    lock(ws->lock);
+
+    if (timeout)
+        ws->nwaiters--;
+
+    if (ret < 0)
+        return ret == -EAGAIN ? 0 : ret;
+
+    if (nwait > nhandles && ret_events[nhandles]) {
+        char byte;
+        DkStreamRead(event_handle(&ws->update), 0, 1, &byte, NULL, 0);
+        *updated = true;
+    }
+
+    for (int i = 0 ; i < nhandles && nready < max ; i++) {
+        /* the handle may be moved or removed during the wait */
+        int idx = ret_events[i] ? __find_in_waitset(ws, handles[i]) : -1;
+
+        if (idx >= 0 && (ws->events[idx] & PAL_WAIT_EDGE)) {
+            ret_events[i] &= ~ws->reported[idx];
+            ws->reported[idx] |= ret_events[i] &
+                                 (PAL_WAIT_READ|PAL_WAIT_WRITE);
+
+            /* reported by a concurrent wait; wait again */
+            if (!ret_events[i])
+                *updated = true;
+        }
+
+        if (ret_events[i]) {
+            data[nready] = wait_data[i];
+            events[nready] = ret_events[i];
+            nready++;
+        }
+    }
+
+    return nready;
+}
+
+/*
+ * Wait until any handle in the wait set is ready, and return the data
+ * pointers and the events of up to max ready handles. Returns the number
+ * of ready handles, 0 on timeout, or a negative error code (e.g., -EINTR).
+ */
+int wait_on_waitset (struct shim_waitset * ws, int max, void ** data,
+                     PAL_FLG * events, uint64_t timeout)
+{
+    int ret;
+
+    if (ws->pal_handle) {
+        PAL_NUM nready = DkWaitSetWait(ws->pal_handle, max, data, events,
+                                       timeout);
+        if (nready)
+            return nready;
+
+        return PAL_NATIVE_ERRNO == PAL_ERROR_TRYAGAIN ? 0 : -PAL_ERRNO;
+    }
+
+    lock(ws->lock);
+
+    while (1) {
+        bool updated = false;
+
+        ret = __wait_on_handles(ws, max, data, events, timeout, &updated);
+
+        /* wait on the new handles if only the wait set was changed */
+        if (ret || !updated)
+            break;
+    }
+
+    unlock(ws->lock);
+    return ret;
+}
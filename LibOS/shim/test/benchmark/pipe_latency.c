@@ -0,0 +1,92 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+/* Round-trip latency and streaming throughput of a pipe between two
+   processes. Run it with the default manifest for the socket transport of
+   pipes, and with pipe_latency_shm.manifest for the shared-memory one. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+#define NTRIES      10000
+#define STREAM_SIZE (256 * 1024 * 1024)
+#define CHUNK       (64 * 1024)
+
+static char buf[CHUNK];
+
+static unsigned long long now (void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+int main(int argc, char ** argv)
+{
+    int ntries = NTRIES;
+    int down[2], up[2];
+
+    if (argc >= 2)
+        ntries = atoi(argv[1]);
+
+    pipe(down);
+    pipe(up);
+
+    int pid = fork();
+
+    if (pid < 0) {
+        printf("fork failed\n");
+        return -1;
+    }
+
+    if (pid == 0) {
+        close(down[1]);
+        close(up[0]);
+
+        char byte;
+        for (int i = 0 ; i < ntries ; i++) {
+            read(down[0], &byte, 1);
+            write(up[1], &byte, 1);
+        }
+
+        long long total = 0;
+        int bytes;
+        while ((bytes = read(down[0], buf, CHUNK)) > 0)
+            total += bytes;
+
+        write(up[1], &total, sizeof(total));
+        exit(0);
+    }
+
+    close(down[0]);
+    close(up[1]);
+
+    char byte = 0;
+    unsigned long long start = now();
+    for (int i = 0 ; i < ntries ; i++) {
+        write(down[1], &byte, 1);
+        read(up[0], &byte, 1);
+    }
+    unsigned long long end = now();
+
+    printf("round trip over a pipe: %lf microseconds\n",
+           1.0 * (end - start) / ntries);
+
+    start = now();
+    for (long long sent = 0 ; sent < STREAM_SIZE ; sent += CHUNK)
+        write(down[1], buf, CHUNK);
+    close(down[1]);
+
+    long long total = 0;
+    read(up[0], &total, sizeof(total));
+    end = now();
+
+    printf("throughput over a pipe: %lf bytes/second\n",
+           1.0 * total * 1000000 / (end - start));
+
+    waitpid(pid, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running dir_nlink
+regression = Regression(loader, "dir_nlink")
+
+regression.add_check(name="Link count of an empty directory",
+    check=lambda res: "empty directory nlink test passed" in res[0].out)
+
+regression.add_check(name="Link count after mkdir",
+    check=lambda res: "mkdir nlink test passed" in res[0].out)
+
+regression.add_check(name="Link count after rmdir",
+    check=lambda res: "rmdir nlink test passed" in res[0].out)
+
+regression.run_checks()
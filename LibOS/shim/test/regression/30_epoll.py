@@ -0,0 +1,24 @@
+#!/usr/bin/python
+
+import os, sys
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running epoll_wait
+regression = Regression(loader, "epoll_wait")
+
+regression.add_check(name="Epoll: Report All Ready Descriptors",
+    check=lambda res: "epoll_wait: all 8 pipes reported" in res[0].out)
+
+regression.add_check(name="Epoll: Maxevents and EPOLLONESHOT",
+    check=lambda res: "epoll_wait: maxevents honored" in res[0].out and
+                      "epoll_wait: EPOLLONESHOT honored" in res[0].out)
+
+regression.add_check(name="Epoll: EPOLLET",
+    check=lambda res: "epoll_wait: EPOLLET honored" in res[0].out)
+
+regression.add_check(name="Epoll: Dup'd Descriptors",
+    check=lambda res: "epoll_wait: dup'd fds reported" in res[0].out)
+
+regression.run_checks()
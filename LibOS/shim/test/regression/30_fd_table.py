@@ -0,0 +1,14 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running fd_table.pthread
+regression = Regression(loader, "fd_table.pthread")
+
+regression.add_check(name="Concurrent File Descriptor Table",
+    check=lambda res: "fd table test passed" in res[0].out)
+
+regression.run_checks()
@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running file_cache
+regression = Regression(loader, "file_cache")
+
+regression.add_check(name="Shared file cache",
+    check=lambda res: "shared file cache test passed" in res[0].out)
+
+regression.add_check(name="Truncate file cache",
+    check=lambda res: "truncate file cache test passed" in res[0].out)
+
+regression.add_check(name="Mmap file cache",
+    check=lambda res: "mmap file cache test passed" in res[0].out)
+
+regression.run_checks()
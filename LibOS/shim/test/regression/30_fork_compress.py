@@ -0,0 +1,25 @@
+#!/usr/bin/python
+
+import os, sys, mmap, re
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running fork_compress, with the memory compressed on the streams
+regression = Regression(loader, "fork_compress")
+
+regression.add_check(name="Fork Compressed Text",
+    check=lambda res: "fork compressed text test passed" in res[0].out)
+
+regression.add_check(name="Fork Compressed Random",
+    check=lambda res: "fork compressed random test passed" in res[0].out)
+
+# the text was compressed by the parent, and decompressed by the child
+regression.add_check(name="Fork Compressed Chunks",
+    check=lambda res:
+        re.search("sent [0-9]+ chunks of memory \\([1-9][0-9]* compressed\\)",
+                  "\n".join(res[0].out)) and
+        re.search("received [0-9]+ chunks of memory \\([1-9][0-9]* compressed\\)",
+                  "\n".join(res[0].out)))
+
+regression.run_checks()
@@ -0,0 +1,23 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running fork_postcopy, with the memory of the child fetched on demand
+regression = Regression(loader, "fork_postcopy")
+
+regression.add_check(name="Post-copy Memory",
+    check=lambda res: "post-copy memory test passed" in res[0].out)
+
+regression.add_check(name="Post-copy Write",
+    check=lambda res: "post-copy write test passed" in res[0].out)
+
+regression.add_check(name="Post-copy Parent Memory",
+    check=lambda res: "post-copy parent memory test passed" in res[0].out)
+
+regression.add_check(name="Post-copy Unmap And Protect",
+    check=lambda res: "post-copy unmap and protect test passed" in res[0].out)
+
+regression.run_checks()
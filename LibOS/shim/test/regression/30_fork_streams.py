@@ -0,0 +1,28 @@
+#!/usr/bin/python
+
+import os, sys, mmap, re
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running fork_streams, with the memory sent over parallel streams
+regression = Regression(loader, "fork_streams")
+
+regression.add_check(name="Fork Streams Memory",
+    check=lambda res: "fork streams memory test passed" in res[0].out)
+
+regression.add_check(name="Fork Streams Write",
+    check=lambda res: "fork streams write test passed" in res[0].out)
+
+regression.add_check(name="Fork Streams Parent Memory",
+    check=lambda res: "fork streams parent memory test passed" in res[0].out)
+
+# the memory went on the streams, not through the physical memory channel
+regression.add_check(name="Fork Streams Used",
+    check=lambda res:
+        re.search("sent [1-9][0-9]* chunks of memory .* on 4 streams",
+                  "\n".join(res[0].out)) and
+        re.search("received [1-9][0-9]* chunks of memory .* on 4 streams",
+                  "\n".join(res[0].out)))
+
+regression.run_checks()
@@ -0,0 +1,28 @@
+#!/usr/bin/python
+
+import os, sys, mmap, re
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running fork_zero_pages, with the zero pages left out of the checkpoint
+regression = Regression(loader, "fork_zero_pages")
+
+regression.add_check(name="Fork Zero Pages Memory",
+    check=lambda res: "fork zero pages memory test passed" in res[0].out)
+
+regression.add_check(name="Fork Zero Pages Protected Memory",
+    check=lambda res: "fork zero pages protected memory test passed" in res[0].out)
+
+regression.add_check(name="Fork Zero Pages Write",
+    check=lambda res: "fork zero pages write test passed" in res[0].out)
+
+# the zero pages were left out by the parent, and recreated by the child
+regression.add_check(name="Fork Zero Pages Left Out",
+    check=lambda res:
+        re.search("left [1-9][0-9]* bytes of zero pages out of the checkpoint",
+                  "\n".join(res[0].out)) and
+        re.search("memory entry .*: [1-9][0-9]* bytes of zero pages left out",
+                  "\n".join(res[0].out)))
+
+regression.run_checks()
@@ -0,0 +1,17 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running large_dir
+regression = Regression(loader, "large_dir")
+
+regression.add_check(name="Stat in a large directory",
+    check=lambda res: "large directory stat test passed" in res[0].out)
+
+regression.add_check(name="Unlink in a large directory",
+    check=lambda res: "large directory unlink test passed" in res[0].out)
+
+regression.run_checks()
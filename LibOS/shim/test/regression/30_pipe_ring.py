@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running pipe_ring.pthread
+regression = Regression(loader, "pipe_ring.pthread")
+
+regression.add_check(name="Pipe Between Threads",
+    check=lambda res: "pipe between threads test passed" in res[0].out)
+
+regression.add_check(name="Pipe Poll",
+    check=lambda res: "pipe poll test passed" in res[0].out)
+
+regression.add_check(name="Pipe Across Fork",
+    check=lambda res: "pipe across fork test passed" in res[0].out)
+
+regression.run_checks()
@@ -0,0 +1,23 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running pipe_shm, with the pipes moving their data through shared memory
+regression = Regression(loader, "pipe_shm")
+
+regression.add_check(name="Pipe Stream Across Processes",
+    check=lambda res: "pipe stream across processes test passed" in res[0].out)
+
+regression.add_check(name="Pipe Poll Across Processes",
+    check=lambda res: "pipe poll across processes test passed" in res[0].out)
+
+regression.add_check(name="Pipe End Of Stream",
+    check=lambda res: "pipe end of stream test passed" in res[0].out)
+
+regression.add_check(name="Sendfile Into Pipe",
+    check=lambda res: "sendfile into pipe test passed" in res[0].out)
+
+regression.run_checks()
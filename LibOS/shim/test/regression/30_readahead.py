@@ -0,0 +1,14 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running readahead
+regression = Regression(loader, "readahead")
+
+regression.add_check(name="Sequential read with readahead",
+    check=lambda res: "sequential read test passed" in res[0].out)
+
+regression.run_checks()
@@ -0,0 +1,17 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running readdir
+regression = Regression(loader, "readdir")
+
+regression.add_check(name="Listing a large directory",
+    check=lambda res: "large directory listing test passed" in res[0].out)
+
+regression.add_check(name="Listing a cached directory",
+    check=lambda res: "cached directory listing test passed" in res[0].out)
+
+regression.run_checks()
@@ -0,0 +1,17 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running revalidate
+regression = Regression(loader, "revalidate")
+
+regression.add_check(name="Revalidation of a negative dentry",
+    check=lambda res: "negative dentry revalidation test passed" in res[0].out)
+
+regression.add_check(name="Revalidation of a positive dentry",
+    check=lambda res: "positive dentry revalidation test passed" in res[0].out)
+
+regression.run_checks()
@@ -0,0 +1,17 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running sendfile
+regression = Regression(loader, "sendfile")
+
+regression.add_check(name="Sendfile to file",
+    check=lambda res: "sendfile to file test passed" in res[0].out)
+
+regression.add_check(name="Sendfile to pipe",
+    check=lambda res: "sendfile to pipe test passed" in res[0].out)
+
+regression.run_checks()
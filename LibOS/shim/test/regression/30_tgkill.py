@@ -0,0 +1,14 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running tgkill.pthread
+regression = Regression(loader, "tgkill.pthread")
+
+regression.add_check(name="Signal Delivery to Many Threads",
+    check=lambda res: "tgkill test passed" in res[0].out)
+
+regression.run_checks()
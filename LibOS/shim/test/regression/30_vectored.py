@@ -0,0 +1,17 @@
+#!/usr/bin/python
+
+import os, sys, mmap
+from regression import Regression
+
+loader = sys.argv[1]
+
+# Running vectored I/O
+regression = Regression(loader, "vectored")
+
+regression.add_check(name="Positional vectored I/O on files",
+    check=lambda res: "preadv/pwritev test passed" in res[0].out)
+
+regression.add_check(name="Vectored I/O on pipes",
+    check=lambda res: "readv/writev test passed" in res[0].out)
+
+regression.run_checks()
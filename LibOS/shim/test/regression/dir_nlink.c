@@ -0,0 +1,49 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+static int nlink (const char * path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        perror("stat"); return -1;
+    }
+    return st.st_nlink;
+}
+
+int main (int argc, const char ** argv)
+{
+    if (mkdir("dir_nlink.tmp", 0700) < 0) {
+        perror("mkdir"); return 1;
+    }
+
+    /* an empty directory links to itself and from its parent */
+    if (nlink("dir_nlink.tmp") == 2)
+        printf("empty directory nlink test passed\n");
+
+    /* subdirectories add a link for their "..", files do not */
+    int fd = open("dir_nlink.tmp/file", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0 || mkdir("dir_nlink.tmp/sub", 0700) < 0) {
+        perror("create"); return 1;
+    }
+    close(fd);
+
+    if (nlink("dir_nlink.tmp") == 3)
+        printf("mkdir nlink test passed\n");
+
+    if (rmdir("dir_nlink.tmp/sub") < 0) {
+        perror("rmdir"); return 1;
+    }
+
+    if (nlink("dir_nlink.tmp") == 2)
+        printf("rmdir nlink test passed\n");
+
+    unlink("dir_nlink.tmp/file");
+    rmdir("dir_nlink.tmp");
+    return 0;
+}
@@ -0,0 +1,122 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define NPIPES  8
+
+int main (int argc, const char ** argv)
+{
+    int pipes[NPIPES][2];
+    struct epoll_event ev, events[NPIPES];
+    int efd = epoll_create1(0), i, n;
+
+    if (efd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    for (i = 0 ; i < NPIPES ; i++) {
+        if (pipe(pipes[i]) < 0) {
+            perror("pipe");
+            return 1;
+        }
+
+        ev.events = EPOLLIN | (i == 0 ? EPOLLONESHOT : 0);
+        ev.data.u32 = i;
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, pipes[i][0], &ev) < 0) {
+            perror("epoll_ctl");
+            return 1;
+        }
+
+        if (write(pipes[i][1], "x", 1) != 1) {
+            perror("write");
+            return 1;
+        }
+    }
+
+    /* All the pipes are readable; they should be reported in one call */
+    n = epoll_wait(efd, events, NPIPES, -1);
+    if (n == NPIPES)
+        printf("epoll_wait: all %d pipes reported\n", n);
+    else
+        printf("epoll_wait: %d of %d pipes reported\n", n, NPIPES);
+
+    /* maxevents is honored, and the rest are reported by the next call;
+     * the pipe registered with EPOLLONESHOT is not reported again */
+    n = epoll_wait(efd, events, NPIPES / 2, 0);
+    if (n == NPIPES / 2)
+        printf("epoll_wait: maxevents honored\n");
+
+    int oneshot = 0;
+    n = epoll_wait(efd, events, NPIPES, 0);
+    for (i = 0 ; i < n ; i++)
+        if (events[i].data.u32 == 0)
+            oneshot = 1;
+    if (!oneshot && n == NPIPES - 1)
+        printf("epoll_wait: EPOLLONESHOT honored\n");
+
+    /* An edge-triggered pipe is reported once per write */
+    int etfd = epoll_create1(0), etpipe[2], reported[3];
+
+    if (etfd < 0 || pipe(etpipe) < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u32 = NPIPES;
+    if (epoll_ctl(etfd, EPOLL_CTL_ADD, etpipe[0], &ev) < 0) {
+        perror("epoll_ctl");
+        return 1;
+    }
+
+    if (write(etpipe[1], "x", 1) != 1) {
+        perror("write");
+        return 1;
+    }
+
+    reported[0] = epoll_wait(etfd, events, NPIPES, 0);
+    reported[1] = epoll_wait(etfd, events, NPIPES, 0);
+
+    if (write(etpipe[1], "x", 1) != 1) {
+        perror("write");
+        return 1;
+    }
+
+    reported[2] = epoll_wait(etfd, events, NPIPES, 0);
+
+    if (reported[0] == 1 && reported[1] == 0 && reported[2] == 1)
+        printf("epoll_wait: EPOLLET honored\n");
+
+    /* An fd and its dup are registered and reported separately */
+    int dupefd = epoll_create1(0), duppipe[2], dupfd;
+
+    if (dupefd < 0 || pipe(duppipe) < 0 || (dupfd = dup(duppipe[0])) < 0) {
+        perror("dup");
+        return 1;
+    }
+
+    for (i = 0 ; i < 2 ; i++) {
+        ev.events = EPOLLIN;
+        ev.data.u32 = i;
+        if (epoll_ctl(dupefd, EPOLL_CTL_ADD, i ? dupfd : duppipe[0],
+                      &ev) < 0) {
+            perror("epoll_ctl");
+            return 1;
+        }
+    }
+
+    if (write(duppipe[1], "x", 1) != 1) {
+        perror("write");
+        return 1;
+    }
+
+    n = epoll_wait(dupefd, events, NPIPES, 0);
+    if (n == 2 && events[0].data.u32 != events[1].data.u32)
+        printf("epoll_wait: dup'd fds reported\n");
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define THREADS     4
+#define ITERATIONS  10000
+
+static int fd;
+static volatile int failed;
+
+/* the readers look up the descriptor table while the writers change it */
+static void * reader (void * arg)
+{
+    struct stat st;
+
+    for (int i = 0 ; i < ITERATIONS ; i++)
+        if (fstat(fd, &st) < 0 || st.st_size != 4) {
+            failed = 1;
+            break;
+        }
+
+    return NULL;
+}
+
+static void * writer (void * arg)
+{
+    for (int i = 0 ; i < ITERATIONS ; i++) {
+        int newfd = dup(fd);
+        if (newfd < 0 || close(newfd) < 0) {
+            failed = 1;
+            break;
+        }
+
+        /* also grow the table under the readers */
+        newfd = (long) arg * 256 + i % 256;
+        if (dup2(fd, newfd) != newfd || close(newfd) < 0) {
+            failed = 1;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+int main (int argc, const char ** argv)
+{
+    pthread_t threads[THREADS];
+
+    fd = open("fd_table.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0 || write(fd, "test", 4) != 4) {
+        perror("open"); return 1;
+    }
+
+    for (int i = 0 ; i < THREADS ; i++)
+        pthread_create(&threads[i], NULL, i % 2 ? writer : reader,
+                       (void *) (long) i);
+
+    for (int i = 0 ; i < THREADS ; i++)
+        pthread_join(threads[i], NULL);
+
+    close(fd);
+    unlink("fd_table.tmp");
+
+    if (!failed)
+        printf("fd table test passed\n");
+    return 0;
+}
@@ -0,0 +1,65 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+int main (int argc, const char ** argv)
+{
+    char buf[32];
+
+    /* two handles on the same file see each other's writes */
+    int fd1 = open("file_cache.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    int fd2 = open("file_cache.tmp", O_RDONLY);
+    if (fd1 < 0 || fd2 < 0) {
+        perror("open"); return 1;
+    }
+
+    if (write(fd1, "hello world", 11) != 11) {
+        perror("write"); return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (read(fd2, buf, sizeof(buf)) != 11 || strcmp(buf, "hello world")) {
+        printf("read after write: %s\n", buf); return 1;
+    }
+
+    if (pwrite(fd1, "HELLO", 5, 0) != 5) {
+        perror("pwrite"); return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (pread(fd2, buf, sizeof(buf), 0) == 11 && !strcmp(buf, "HELLO world"))
+        printf("shared file cache test passed\n");
+
+    /* truncate drops the cached content past the new end */
+    if (ftruncate(fd1, 5) < 0) {
+        perror("ftruncate"); return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (pread(fd2, buf, sizeof(buf), 0) == 5 && !strcmp(buf, "HELLO"))
+        printf("truncate file cache test passed\n");
+
+    /* stores to a shared mapping are seen by the reads */
+    char * addr = mmap(NULL, 4096, PROT_READ|PROT_WRITE, MAP_SHARED, fd1, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap"); return 1;
+    }
+
+    memcpy(addr, "howdy", 5);
+
+    memset(buf, 0, sizeof(buf));
+    if (pread(fd2, buf, sizeof(buf), 0) == 5 && !strcmp(buf, "howdy"))
+        printf("mmap file cache test passed\n");
+
+    munmap(addr, 4096);
+    close(fd1);
+    close(fd2);
+    unlink("file_cache.tmp");
+    return 0;
+}
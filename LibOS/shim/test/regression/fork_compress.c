@@ -0,0 +1,77 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIZE        (8 * 1024 * 1024 + 4096)
+
+static unsigned int next (unsigned int * seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 16;
+}
+
+/* text-like data, which compresses well */
+static void fill_text (char * buf, size_t size)
+{
+    static const char words[] = "the quick brown fox jumps over a lazy dog ";
+    unsigned int seed = 1;
+
+    for (size_t i = 0 ; i < size ; i++)
+        buf[i] = words[(i + next(&seed) % 3) % (sizeof(words) - 1)];
+}
+
+/* random data, which does not */
+static void fill_random (char * buf, size_t size)
+{
+    unsigned int seed = 2;
+
+    for (size_t i = 0 ; i < size ; i++)
+        buf[i] = next(&seed);
+}
+
+int main (int argc, const char ** argv)
+{
+    setbuf(stdout, NULL);
+
+    char * text = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                       MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    char * random = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    char * copy = malloc(SIZE);
+    if (text == MAP_FAILED || random == MAP_FAILED || !copy) {
+        perror("mmap"); return 1;
+    }
+
+    fill_text(text, SIZE);
+    fill_random(random, SIZE);
+
+    if (mprotect(text, SIZE, PROT_READ) < 0) {
+        perror("mprotect"); return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        fill_text(copy, SIZE);
+        if (!memcmp(text, copy, SIZE))
+            printf("fork compressed text test passed\n");
+
+        fill_random(copy, SIZE);
+        if (!memcmp(random, copy, SIZE))
+            printf("fork compressed random test passed\n");
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+    return 0;
+}
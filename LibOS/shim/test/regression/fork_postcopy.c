@@ -0,0 +1,81 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIZE        (16 * 1024 * 1024)
+#define PAGE        4096
+
+static int check (const char * buf, size_t start, size_t end, int seed)
+{
+    for (size_t i = start ; i < end ; i++)
+        if (buf[i] != (char) ((i + seed) % 251))
+            return 0;
+    return 1;
+}
+
+int main (int argc, const char ** argv)
+{
+    setbuf(stdout, NULL);
+
+    char * buf = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) {
+        perror("mmap"); return 1;
+    }
+
+    for (size_t i = 0 ; i < SIZE ; i++)
+        buf[i] = (i + 1) % 251;
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        /* the memory is still the one at the time of fork, wherever it is
+           touched first */
+        if (check(buf, SIZE - PAGE, SIZE, 1) && check(buf, 0, SIZE, 1))
+            printf("post-copy memory test passed\n");
+
+        for (size_t i = 0 ; i < SIZE ; i++)
+            buf[i] = (i + 3) % 251;
+        if (check(buf, 0, SIZE, 3))
+            printf("post-copy write test passed\n");
+        return 0;
+    }
+
+    /* change the memory right away, while it is sent to the child */
+    for (size_t i = 0 ; i < SIZE ; i++)
+        buf[i] = (i + 2) % 251;
+
+    waitpid(pid, NULL, 0);
+
+    if (check(buf, 0, SIZE, 2))
+        printf("post-copy parent memory test passed\n");
+
+    /* unmap and reprotect the memory before the child touches it */
+    pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        if (munmap(buf, SIZE / 2) < 0 ||
+            mprotect(buf + SIZE / 2, SIZE / 2, PROT_READ) < 0) {
+            perror("munmap/mprotect"); return 1;
+        }
+
+        if (check(buf, SIZE / 2, SIZE, 2))
+            printf("post-copy unmap and protect test passed\n");
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+    return 0;
+}
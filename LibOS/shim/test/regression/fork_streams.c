@@ -0,0 +1,82 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NAREAS      8
+#define SIZE        (3 * 1024 * 1024 + 4096)
+
+static int check (const char * buf, size_t size, int seed)
+{
+    for (size_t i = 0 ; i < size ; i++)
+        if (buf[i] != (char) ((i + seed) % 251))
+            return 0;
+    return 1;
+}
+
+int main (int argc, const char ** argv)
+{
+    char * areas[NAREAS];
+
+    setbuf(stdout, NULL);
+
+    /* more areas than streams, each in several chunks */
+    for (int i = 0 ; i < NAREAS ; i++) {
+        areas[i] = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                        MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (areas[i] == MAP_FAILED) {
+            perror("mmap"); return 1;
+        }
+
+        for (size_t j = 0 ; j < SIZE ; j++)
+            areas[i][j] = (j + i) % 251;
+    }
+
+    if (mprotect(areas[0], SIZE, PROT_READ) < 0 ||
+        mprotect(areas[1], SIZE, PROT_NONE) < 0) {
+        perror("mprotect"); return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        int good = 1;
+
+        if (mprotect(areas[1], SIZE, PROT_READ) < 0) {
+            perror("mprotect"); return 1;
+        }
+
+        for (int i = 0 ; i < NAREAS ; i++)
+            if (!check(areas[i], SIZE, i))
+                good = 0;
+
+        if (good)
+            printf("fork streams memory test passed\n");
+
+        for (size_t j = 0 ; j < SIZE ; j++)
+            areas[2][j] = (j + 7) % 251;
+        if (check(areas[2], SIZE, 7))
+            printf("fork streams write test passed\n");
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+
+    /* the areas are protected again once sent */
+    if (mprotect(areas[1], SIZE, PROT_READ) < 0) {
+        perror("mprotect"); return 1;
+    }
+
+    if (check(areas[1], SIZE, 1) && check(areas[2], SIZE, 2))
+        printf("fork streams parent memory test passed\n");
+
+    return 0;
+}
@@ -0,0 +1,91 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SIZE        (64 * 1024 * 1024)
+#define PAGE        4096
+#define STRIDE      (37 * PAGE)
+
+/* a page written at every stride, the first and the last one included */
+static int written (size_t page)
+{
+    return page % STRIDE == 0 || page == SIZE - PAGE;
+}
+
+static int check (const char * buf, int seed)
+{
+    for (size_t i = 0 ; i < SIZE ; i++) {
+        size_t page = i & ~(PAGE - 1);
+        char expected = written(page) ? (char) ((i + seed) % 251 + 1) : 0;
+        if (buf[i] != expected)
+            return 0;
+    }
+    return 1;
+}
+
+int main (int argc, const char ** argv)
+{
+    setbuf(stdout, NULL);
+
+    char * buf = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                      MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    char * hidden = mmap(NULL, SIZE, PROT_READ|PROT_WRITE,
+                         MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED || hidden == MAP_FAILED) {
+        perror("mmap"); return 1;
+    }
+
+    /* some pages are written, some only read, the rest never touched */
+    for (size_t page = 0 ; page < SIZE ; page += PAGE) {
+        if (written(page)) {
+            for (size_t i = page ; i < page + PAGE ; i++) {
+                buf[i] = (i + 1) % 251 + 1;
+                hidden[i] = (i + 2) % 251 + 1;
+            }
+        } else if (page % (3 * PAGE) == 0 && buf[page]) {
+            printf("untouched page is not zero\n");
+        }
+    }
+
+    /* a page written with zeros is still zero */
+    memset(buf + PAGE, 0, PAGE);
+
+    if (mprotect(hidden, SIZE, PROT_NONE) < 0) {
+        perror("mprotect"); return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        if (check(buf, 1))
+            printf("fork zero pages memory test passed\n");
+
+        if (mprotect(hidden, SIZE, PROT_READ) < 0) {
+            perror("mprotect"); return 1;
+        }
+
+        if (check(hidden, 2))
+            printf("fork zero pages protected memory test passed\n");
+
+        /* the pages left out are usable */
+        for (size_t i = 0 ; i < SIZE ; i += PAGE / 2)
+            buf[i] = 1;
+        for (size_t i = 0 ; i < SIZE ; i += PAGE / 2)
+            if (buf[i] != 1)
+                return 0;
+        printf("fork zero pages write test passed\n");
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+    return 0;
+}
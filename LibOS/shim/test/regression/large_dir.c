@@ -0,0 +1,63 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define NFILES  2000
+
+int main (int argc, const char ** argv)
+{
+    char name[64];
+    struct stat st;
+    int bad = 0;
+
+    if (mkdir("large_dir.tmp", 0700) < 0 && errno != EEXIST) {
+        perror("mkdir"); return 1;
+    }
+
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "large_dir.tmp/file%d", i);
+        int fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+        if (fd < 0) {
+            perror("open"); return 1;
+        }
+        if (write(fd, name, i % 64) != i % 64) {
+            perror("write"); return 1;
+        }
+        close(fd);
+    }
+
+    /* every file is found again, with its own size */
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "large_dir.tmp/./file%d", i);
+        if (stat(name, &st) < 0 || st.st_size != i % 64)
+            bad++;
+    }
+
+    if (!bad)
+        printf("large directory stat test passed\n");
+
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "large_dir.tmp/file%d", i);
+        unlink(name);
+    }
+
+    /* and none of them is found after being removed */
+    bad = 0;
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "large_dir.tmp/file%d", i);
+        if (stat(name, &st) == 0 || errno != ENOENT)
+            bad++;
+    }
+
+    if (!bad)
+        printf("large directory unlink test passed\n");
+
+    rmdir("large_dir.tmp");
+    return 0;
+}
@@ -0,0 +1,105 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TOTAL       (1024 * 1024)
+#define CHUNK       3000
+
+static int fds[2];
+
+static void * producer (void * arg)
+{
+    char buf[CHUNK];
+    int sent = 0;
+
+    while (sent < TOTAL) {
+        int bytes = TOTAL - sent < CHUNK ? TOTAL - sent : CHUNK;
+        for (int i = 0 ; i < bytes ; i++)
+            buf[i] = (sent + i) % 251;
+
+        int ret = write(fds[1], buf, bytes);
+        if (ret <= 0) {
+            perror("write");
+            break;
+        }
+        sent += ret;
+    }
+
+    close(fds[1]);
+    return NULL;
+}
+
+int main (int argc, const char ** argv)
+{
+    pthread_t thread;
+    char buf[5000];
+    int received = 0, bad = 0, ret;
+
+    setbuf(stdout, NULL);
+
+    /* between threads, up to the end of the pipe */
+    if (pipe(fds) < 0) {
+        perror("pipe"); return 1;
+    }
+
+    pthread_create(&thread, NULL, producer, NULL);
+
+    while ((ret = read(fds[0], buf, sizeof(buf))) > 0) {
+        for (int i = 0 ; i < ret ; i++)
+            if (buf[i] != (char) ((received + i) % 251))
+                bad = 1;
+        received += ret;
+    }
+
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    if (!bad && received == TOTAL)
+        printf("pipe between threads test passed\n");
+
+    /* poll readiness */
+    if (pipe(fds) < 0) {
+        perror("pipe"); return 1;
+    }
+
+    struct pollfd pfd = { .fd = fds[0], .events = POLLIN };
+    if (poll(&pfd, 1, 0) == 0) {
+        write(fds[1], "x", 1);
+        if (poll(&pfd, 1, 1000) == 1 && (pfd.revents & POLLIN) &&
+            read(fds[0], buf, sizeof(buf)) == 1 && poll(&pfd, 1, 0) == 0)
+            printf("pipe poll test passed\n");
+    }
+
+    /* data buffered before a fork is read by the child */
+    write(fds[1], "before", 6);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        close(fds[1]);
+        received = 0;
+        while ((ret = read(fds[0], buf + received,
+                           sizeof(buf) - received)) > 0)
+            received += ret;
+        buf[received] = 0;
+        if (!strcmp(buf, "beforeafter"))
+            printf("pipe across fork test passed\n");
+        return 0;
+    }
+
+    close(fds[0]);
+    write(fds[1], "after", 5);
+    close(fds[1]);
+    waitpid(pid, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TOTAL       (4 * 1024 * 1024)
+#define CHUNK       7000
+#define FILE_SIZE   (256 * 1024)
+
+/* sendfile from a file into a pipe read by another process */
+static int test_sendfile (void)
+{
+    char buf[CHUNK];
+    int fds[2], ret;
+
+    int fd = open("pipe_shm.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("open"); return -1;
+    }
+
+    for (int i = 0 ; i < FILE_SIZE ; i += sizeof(buf)) {
+        int bytes = FILE_SIZE - i < sizeof(buf) ? FILE_SIZE - i : sizeof(buf);
+        for (int j = 0 ; j < bytes ; j++)
+            buf[j] = (i + j) % 251;
+        if (write(fd, buf, bytes) != bytes) {
+            perror("write"); return -1;
+        }
+    }
+
+    if (pipe(fds) < 0) {
+        perror("pipe"); return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return -1;
+    }
+
+    if (pid == 0) {
+        int received = 0, bad = 0;
+        close(fds[1]);
+
+        while ((ret = read(fds[0], buf, sizeof(buf))) > 0) {
+            for (int i = 0 ; i < ret ; i++)
+                if (buf[i] != (char) ((received + i) % 251))
+                    bad = 1;
+            received += ret;
+        }
+
+        if (!ret && !bad && received == FILE_SIZE)
+            printf("sendfile into pipe test passed\n");
+        _exit(0);
+    }
+
+    close(fds[0]);
+
+    off_t off = 0;
+    while (off < FILE_SIZE)
+        if (sendfile(fds[1], fd, &off, FILE_SIZE - off) <= 0) {
+            perror("sendfile"); return -1;
+        }
+
+    close(fds[1]);
+    close(fd);
+    waitpid(pid, NULL, 0);
+    unlink("pipe_shm.tmp");
+    return 0;
+}
+
+int main (int argc, const char ** argv)
+{
+    int down[2], up[2];
+    char buf[CHUNK];
+    int ret;
+
+    setbuf(stdout, NULL);
+
+    if (pipe(down) < 0 || pipe(up) < 0) {
+        perror("pipe"); return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        /* stream everything back, waiting for the data with poll */
+        int received = 0;
+        close(down[1]);
+        close(up[0]);
+
+        while (1) {
+            struct pollfd pfd = { .fd = down[0], .events = POLLIN };
+            if (poll(&pfd, 1, -1) != 1)
+                break;
+            if ((ret = read(down[0], buf, sizeof(buf))) <= 0)
+                break;
+            if (write(up[1], buf, ret) != ret)
+                break;
+            received += ret;
+        }
+
+        if (ret == 0 && received == TOTAL)
+            printf("pipe poll across processes test passed\n");
+        return 0;
+    }
+
+    close(down[0]);
+    close(up[1]);
+
+    int sent = 0, received = 0, bad = 0;
+    while (received < TOTAL) {
+        /* keep at most one chunk in flight, so neither side blocks on a
+           full pipe */
+        if (sent < TOTAL) {
+            int bytes = TOTAL - sent < CHUNK ? TOTAL - sent : CHUNK;
+            for (int i = 0 ; i < bytes ; i++)
+                buf[i] = (sent + i) % 253;
+            if (write(down[1], buf, bytes) != bytes) {
+                perror("write"); return 1;
+            }
+            sent += bytes;
+            if (sent == TOTAL)
+                close(down[1]);
+        }
+
+        int expected = sent - received;
+        while (expected) {
+            if ((ret = read(up[0], buf, expected)) <= 0) {
+                perror("read"); return 1;
+            }
+            for (int i = 0 ; i < ret ; i++)
+                if (buf[i] != (char) ((received + i) % 253))
+                    bad = 1;
+            received += ret;
+            expected -= ret;
+        }
+    }
+
+    if (!bad)
+        printf("pipe stream across processes test passed\n");
+
+    if (read(up[0], buf, sizeof(buf)) == 0)
+        printf("pipe end of stream test passed\n");
+
+    waitpid(pid, NULL, 0);
+
+    if (test_sendfile() < 0)
+        return 1;
+
+    return 0;
+}
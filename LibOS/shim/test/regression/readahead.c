@@ -0,0 +1,61 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FILE_SIZE   (1024 * 1024)
+#define READ_SIZE   4096
+
+static char buf[READ_SIZE];
+
+int main (int argc, const char ** argv)
+{
+    int fd = open("readahead.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("open"); return 1;
+    }
+
+    for (int i = 0 ; i < FILE_SIZE ; i += READ_SIZE) {
+        memset(buf, 'a' + (i / READ_SIZE) % 26, READ_SIZE);
+        if (write(fd, buf, READ_SIZE) != READ_SIZE) {
+            perror("write"); return 1;
+        }
+    }
+
+    /* read the file sequentially, and overwrite a block ahead of the
+       reads through another handle half way through */
+    int rfd = open("readahead.tmp", O_RDONLY);
+    if (rfd < 0) {
+        perror("open"); return 1;
+    }
+
+    int ret = 0, bad = 0;
+    for (int i = 0 ; i < FILE_SIZE ; i += READ_SIZE) {
+        if (i == FILE_SIZE / 2) {
+            memset(buf, '0', READ_SIZE);
+            if (pwrite(fd, buf, READ_SIZE, i + READ_SIZE) != READ_SIZE) {
+                perror("pwrite"); return 1;
+            }
+        }
+
+        if ((ret = read(rfd, buf, READ_SIZE)) != READ_SIZE)
+            break;
+
+        char expected = (i == FILE_SIZE / 2 + READ_SIZE) ? '0' :
+                        'a' + (i / READ_SIZE) % 26;
+        if (buf[0] != expected || buf[READ_SIZE - 1] != expected)
+            bad++;
+    }
+
+    if (ret == READ_SIZE && !bad && read(rfd, buf, READ_SIZE) == 0)
+        printf("sequential read test passed\n");
+
+    close(rfd);
+    close(fd);
+    unlink("readahead.tmp");
+    return 0;
+}
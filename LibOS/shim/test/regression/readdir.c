@@ -0,0 +1,114 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define NFILES  3000
+#define NDIRS   10
+
+/* fills the directory in a child process, so the parent has to list
+   it from the host */
+static int populate (void)
+{
+    char name[64];
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return -1;
+    }
+
+    if (pid > 0) {
+        int status;
+        waitpid(pid, &status, 0);
+        return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+    }
+
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "readdir.tmp/a-rather-long-file-name-%d",
+                 i);
+        int fd = open(name, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+        if (fd < 0) {
+            perror("open"); _exit(1);
+        }
+        close(fd);
+    }
+
+    for (int i = 0 ; i < NDIRS ; i++) {
+        snprintf(name, sizeof(name), "readdir.tmp/dir-%d", i);
+        if (mkdir(name, 0700) < 0) {
+            perror("mkdir"); _exit(1);
+        }
+    }
+
+    _exit(0);
+}
+
+static int list (int * nfiles, int * ndirs)
+{
+    DIR * dir = opendir("readdir.tmp");
+    if (!dir) {
+        perror("opendir"); return -1;
+    }
+
+    struct dirent * d;
+    *nfiles = *ndirs = 0;
+
+    while ((d = readdir(dir))) {
+        if (!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+            continue;
+        /* DT_UNKNOWN is allowed where the host listing has no type */
+        if ((d->d_type == DT_REG || d->d_type == DT_UNKNOWN) &&
+            !strncmp(d->d_name, "a-rather", 8))
+            (*nfiles)++;
+        if (d->d_type == DT_DIR && !strncmp(d->d_name, "dir-", 4))
+            (*ndirs)++;
+    }
+
+    closedir(dir);
+    return 0;
+}
+
+int main (int argc, const char ** argv)
+{
+    char name[64];
+    int nfiles, ndirs;
+
+    setbuf(stdout, NULL);
+
+    if (mkdir("readdir.tmp", 0700) < 0) {
+        perror("mkdir"); return 1;
+    }
+
+    if (populate() < 0)
+        return 1;
+
+    /* every entry is listed with its type, even when the names do not
+       fit in one read from the host */
+    if (list(&nfiles, &ndirs) == 0 && nfiles == NFILES && ndirs == NDIRS)
+        printf("large directory listing test passed\n");
+
+    /* listing again gives the same entries */
+    if (list(&nfiles, &ndirs) == 0 && nfiles == NFILES && ndirs == NDIRS)
+        printf("cached directory listing test passed\n");
+
+    for (int i = 0 ; i < NFILES ; i++) {
+        snprintf(name, sizeof(name), "readdir.tmp/a-rather-long-file-name-%d",
+                 i);
+        unlink(name);
+    }
+
+    for (int i = 0 ; i < NDIRS ; i++) {
+        snprintf(name, sizeof(name), "readdir.tmp/dir-%d", i);
+        rmdir(name);
+    }
+
+    rmdir("readdir.tmp");
+    return 0;
+}
@@ -0,0 +1,60 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define FILENAME    "revalidate.tmp"
+
+int main (int argc, const char ** argv)
+{
+    struct stat st;
+
+    setbuf(stdout, NULL);
+    unlink(FILENAME);
+
+    /* leaves a negative dentry in the cache of this process */
+    if (stat(FILENAME, &st) == 0) {
+        printf("stale file exists\n"); return 1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        int fd = open(FILENAME, O_RDWR|O_CREAT|O_TRUNC, 0600);
+        if (fd < 0 || write(fd, "hello", 5) != 5) {
+            perror("create"); return 1;
+        }
+        close(fd);
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+
+    if (stat(FILENAME, &st) == 0 && st.st_size == 5)
+        printf("negative dentry revalidation test passed\n");
+
+    pid = fork();
+    if (pid < 0) {
+        perror("fork"); return 1;
+    }
+
+    if (pid == 0) {
+        unlink(FILENAME);
+        return 0;
+    }
+
+    waitpid(pid, NULL, 0);
+
+    if (stat(FILENAME, &st) < 0)
+        printf("positive dentry revalidation test passed\n");
+
+    return 0;
+}
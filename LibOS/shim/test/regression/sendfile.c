@@ -0,0 +1,59 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <sys/types.h>
+#include <sys/sendfile.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define MESSAGE     "the quick brown fox jumps over the lazy dog"
+
+int main (int argc, const char ** argv)
+{
+    char buf[64];
+    int fds[2];
+
+    int in = open("sendfile-in.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    int out = open("sendfile-out.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (in < 0 || out < 0) {
+        perror("open"); return 1;
+    }
+
+    if (write(in, MESSAGE, strlen(MESSAGE)) != strlen(MESSAGE)) {
+        perror("write"); return 1;
+    }
+
+    /* file to file, from the current offset of the input */
+    lseek(in, 4, SEEK_SET);
+    if (sendfile(out, in, NULL, 5) != 5) {
+        perror("sendfile"); return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (lseek(in, 0, SEEK_CUR) == 9 && lseek(out, 0, SEEK_CUR) == 5 &&
+        pread(out, buf, sizeof(buf), 0) == 5 && !strcmp(buf, "quick"))
+        printf("sendfile to file test passed\n");
+
+    /* file to pipe, from an explicit offset of the input */
+    if (pipe(fds) < 0) {
+        perror("pipe"); return 1;
+    }
+
+    off_t offset = 10;
+    if (sendfile(fds[1], in, &offset, 5) != 5) {
+        perror("sendfile"); return 1;
+    }
+
+    memset(buf, 0, sizeof(buf));
+    if (offset == 15 && lseek(in, 0, SEEK_CUR) == 9 &&
+        read(fds[0], buf, sizeof(buf)) == 5 && !strcmp(buf, "brown"))
+        printf("sendfile to pipe test passed\n");
+
+    close(in);
+    close(out);
+    unlink("sendfile-in.tmp");
+    unlink("sendfile-out.tmp");
+    return 0;
+}
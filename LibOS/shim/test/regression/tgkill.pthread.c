@@ -0,0 +1,60 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define THREADS     200
+
+static volatile int signaled[THREADS];
+static __thread int self;
+static volatile int done;
+
+static void handler (int sig)
+{
+    signaled[self] = 1;
+}
+
+static void * thread (void * arg)
+{
+    self = (long) arg;
+    while (!done)
+        usleep(1000);
+    return NULL;
+}
+
+int main (int argc, const char ** argv)
+{
+    pthread_t threads[THREADS];
+    int count = 0;
+
+    signal(SIGUSR1, handler);
+
+    for (long i = 0 ; i < THREADS ; i++)
+        if (pthread_create(&threads[i], NULL, thread, (void *) i)) {
+            perror("pthread_create"); return 1;
+        }
+
+    /* each signal goes to the thread looked up by its tid */
+    for (int i = 0 ; i < THREADS ; i++)
+        if (pthread_kill(threads[i], SIGUSR1)) {
+            perror("pthread_kill"); return 1;
+        }
+
+    for (int tries = 0 ; tries < 1000 && count < THREADS ; tries++) {
+        usleep(1000);
+        count = 0;
+        for (int i = 0 ; i < THREADS ; i++)
+            count += signaled[i];
+    }
+
+    done = 1;
+    for (int i = 0 ; i < THREADS ; i++)
+        pthread_join(threads[i], NULL);
+
+    if (count == THREADS)
+        printf("tgkill test passed\n");
+    return 0;
+}
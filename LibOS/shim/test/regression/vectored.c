@@ -0,0 +1,77 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#define _GNU_SOURCE
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+int main (int argc, const char ** argv)
+{
+    char buf1[8], buf2[8];
+    struct iovec iov[2];
+    int fds[2];
+
+    /* pwritev and preadv must not move the file offset */
+    int fd = open("vectored.tmp", O_RDWR|O_CREAT|O_TRUNC, 0600);
+    if (fd < 0) {
+        perror("open"); return 1;
+    }
+
+    iov[0].iov_base = "hello ";
+    iov[0].iov_len = 6;
+    iov[1].iov_base = "world";
+    iov[1].iov_len = 5;
+
+    if (pwritev(fd, iov, 2, 4) != 11) {
+        perror("pwritev"); return 1;
+    }
+
+    memset(buf1, 0, sizeof(buf1));
+    memset(buf2, 0, sizeof(buf2));
+    iov[0].iov_base = buf1;
+    iov[0].iov_len = 6;
+    iov[1].iov_base = buf2;
+    iov[1].iov_len = 5;
+
+    if (preadv(fd, iov, 2, 4) != 11) {
+        perror("preadv"); return 1;
+    }
+
+    if (!strcmp(buf1, "hello ") && !strcmp(buf2, "world") &&
+        lseek(fd, 0, SEEK_CUR) == 0)
+        printf("preadv/pwritev test passed\n");
+
+    close(fd);
+    unlink("vectored.tmp");
+
+    /* a writev to a pipe is read back in one piece */
+    if (pipe(fds) < 0) {
+        perror("pipe"); return 1;
+    }
+
+    iov[0].iov_base = "abc";
+    iov[0].iov_len = 3;
+    iov[1].iov_base = "def";
+    iov[1].iov_len = 3;
+
+    if (writev(fds[1], iov, 2) != 6) {
+        perror("writev"); return 1;
+    }
+
+    memset(buf1, 0, sizeof(buf1));
+    memset(buf2, 0, sizeof(buf2));
+    iov[0].iov_base = buf1;
+    iov[0].iov_len = 2;
+    iov[1].iov_base = buf2;
+    iov[1].iov_len = 4;
+
+    if (readv(fds[0], iov, 2) == 6 &&
+        !strcmp(buf1, "ab") && !strcmp(buf2, "cdef"))
+        printf("readv/writev test passed\n");
+
+    return 0;
+}
@@ -47,6 +47,20 @@
 #define system_unlock() ({})
 #endif
 
+// Optionally, `system_magazine` returns a pointer to the magazine slot of
+// the calling thread (or NULL if the thread cannot use a magazine), to
+// enable the per-thread magazines (see below). `system_magazine_enter` and
+// `system_magazine_exit` bracket every access to a magazine, to prevent the
+// thread from re-entering the allocator (e.g., from a signal handler).
+#ifdef system_magazine
+#ifndef system_magazine_enter
+#define system_magazine_enter() ({})
+#endif
+#ifndef system_magazine_exit
+#define system_magazine_exit() ({})
+#endif
+#endif
+
 /* malloc is supposed to provide some kind of alignment guarantees, but
  * I can't find a specific reference to what that should be for x86_64.
  * The first link here is a reference to a technical report from Mozilla,
@@ -154,6 +168,22 @@ typedef struct slab_mgr {
     SLAB_AREA active_area[SLAB_LEVEL];
 } SLAB_MGR_TYPE, * SLAB_MGR;
 
+#ifdef system_magazine
+/* A magazine caches free objects of each level for a single thread, so
+ * slab_alloc() and slab_free() can skip system_lock in the common case. An
+ * empty magazine is refilled from the slab manager, and a full magazine is
+ * drained to the slab manager, in batches of SLAB_MAGAZINE_BATCH objects. */
+#ifndef SLAB_MAGAZINE_SIZE
+# define SLAB_MAGAZINE_SIZE 16
+#endif
+#define SLAB_MAGAZINE_BATCH (SLAB_MAGAZINE_SIZE / 2)
+
+typedef struct slab_magazine {
+    unsigned int count[SLAB_LEVEL];
+    SLAB_OBJ objs[SLAB_LEVEL][SLAB_MAGAZINE_SIZE];
+} SLAB_MAGAZINE_TYPE, * SLAB_MAGAZINE;
+#endif
+
 typedef struct __attribute__((packed)) large_mem_obj {
     // offset 0
     unsigned long size;  // User buffer size (i.e. excluding control structures)
@@ -350,6 +380,158 @@ static inline int enlarge_slab_mgr (SLAB_MGR mgr, int level)
     return 0;
 }
 
+// system_lock needs to be held by the caller on entry.
+static inline SLAB_OBJ __slab_alloc_obj (SLAB_MGR mgr, int level)
+{
+    SLAB_OBJ mobj;
+
+    assert(mgr->addr[level] <= mgr->addr_top[level]);
+    if (mgr->addr[level] == mgr->addr_top[level] &&
+          listp_empty(&mgr->free_list[level])) {
+        int ret = enlarge_slab_mgr(mgr, level);
+        if (ret < 0)
+            return NULL;
+    }
+
+    if (!listp_empty(&mgr->free_list[level])) {
+        mobj = listp_first_entry(&mgr->free_list[level], SLAB_OBJ_TYPE, __list);
+        listp_del(mobj, &mgr->free_list[level], __list);
+    } else {
+        mobj = (void *) mgr->addr[level];
+        mgr->addr[level] += slab_levels[level] + SLAB_HDR_SIZE;
+    }
+    assert(mgr->addr[level] <= mgr->addr_top[level]);
+    OBJ_LEVEL(mobj) = level;
+    return mobj;
+}
+
+// system_lock needs to be held by the caller on entry.
+static inline void __slab_free_obj (SLAB_MGR mgr, SLAB_OBJ mobj, int level)
+{
+    INIT_LIST_HEAD(mobj, __list);
+    listp_add_tail(mobj, &mgr->free_list[level], __list);
+}
+
+#ifdef system_magazine
+/* Returns the magazine of the calling thread, creating it if necessary.
+ * Must be called between system_magazine_enter() and system_magazine_exit(). */
+static inline SLAB_MAGAZINE __get_slab_magazine (SLAB_MGR mgr,
+                                                 SLAB_MAGAZINE * slot)
+{
+    if (*slot)
+        return *slot;
+
+    int level;
+    for (level = 0 ; level < SLAB_LEVEL ; level++)
+        if (sizeof(SLAB_MAGAZINE_TYPE) <= slab_levels[level])
+            break;
+
+    /* The magazine itself is allocated from the shared lists */
+    assert(level < SLAB_LEVEL);
+    system_lock();
+    SLAB_OBJ mobj = __slab_alloc_obj(mgr, level);
+    system_unlock();
+    if (!mobj)
+        return NULL;
+
+    void * raw = OBJ_RAW(mobj);
+    SLAB_MAGAZINE mag = (SLAB_MAGAZINE) raw;
+    memset(mag->count, 0, sizeof(mag->count));
+    *slot = mag;
+    return mag;
+}
+
+// system_lock needs to be held by the caller on entry.
+static inline void __slab_drain_magazine (SLAB_MGR mgr, SLAB_MAGAZINE mag,
+                                          int level, unsigned int count)
+{
+    /* Objects at the bottom are the least recently freed ones */
+    assert(count <= mag->count[level]);
+    for (unsigned int i = 0 ; i < count ; i++)
+        __slab_free_obj(mgr, mag->objs[level][i], level);
+
+    mag->count[level] -= count;
+    memmove(&mag->objs[level][0], &mag->objs[level][count],
+            mag->count[level] * sizeof(SLAB_OBJ));
+}
+
+static inline SLAB_OBJ __slab_magazine_alloc (SLAB_MGR mgr, int level)
+{
+    SLAB_MAGAZINE * slot = system_magazine();
+    SLAB_OBJ mobj = NULL;
+
+    if (!slot)
+        return NULL;
+
+    system_magazine_enter();
+    SLAB_MAGAZINE mag = __get_slab_magazine(mgr, slot);
+    if (mag) {
+        if (!mag->count[level]) {
+            system_lock();
+            while (mag->count[level] < SLAB_MAGAZINE_BATCH) {
+                SLAB_OBJ obj = __slab_alloc_obj(mgr, level);
+                if (!obj)
+                    break;
+                mag->objs[level][mag->count[level]++] = obj;
+            }
+            system_unlock();
+        }
+
+        if (mag->count[level])
+            mobj = mag->objs[level][--mag->count[level]];
+    }
+    system_magazine_exit();
+    return mobj;
+}
+
+static inline bool __slab_magazine_free (SLAB_MGR mgr, SLAB_OBJ mobj,
+                                         int level)
+{
+    SLAB_MAGAZINE * slot = system_magazine();
+
+    if (!slot)
+        return false;
+
+    system_magazine_enter();
+    SLAB_MAGAZINE mag = __get_slab_magazine(mgr, slot);
+    if (mag) {
+        if (mag->count[level] == SLAB_MAGAZINE_SIZE) {
+            system_lock();
+            __slab_drain_magazine(mgr, mag, level, SLAB_MAGAZINE_BATCH);
+            system_unlock();
+        }
+
+        mag->objs[level][mag->count[level]++] = mobj;
+    }
+    system_magazine_exit();
+    return mag != NULL;
+}
+
+/* Returns all the objects cached in the magazine of the calling thread to
+ * the slab manager, and releases the magazine. The thread may create a new
+ * magazine the next time it allocates or frees an object. */
+static inline void slab_flush_magazine (SLAB_MGR mgr)
+{
+    SLAB_MAGAZINE * slot = system_magazine();
+
+    if (!slot)
+        return;
+
+    system_magazine_enter();
+    SLAB_MAGAZINE mag = *slot;
+    if (mag) {
+        *slot = NULL;
+        system_lock();
+        for (int level = 0 ; level < SLAB_LEVEL ; level++)
+            __slab_drain_magazine(mgr, mag, level, mag->count[level]);
+        __slab_free_obj(mgr, RAW_TO_OBJ((void *) mag, SLAB_OBJ_TYPE),
+                        RAW_TO_LEVEL(mag));
+        system_unlock();
+    }
+    system_magazine_exit();
+}
+#endif /* system_magazine */
+
 static inline void * slab_alloc (SLAB_MGR mgr, int size)
 {
     SLAB_OBJ mobj;
@@ -374,27 +556,17 @@ static inline void * slab_alloc (SLAB_MGR mgr, int size)
         return OBJ_RAW(mem);
     }
 
-    system_lock();
-    assert(mgr->addr[level] <= mgr->addr_top[level]);
-    if (mgr->addr[level] == mgr->addr_top[level] &&
-          listp_empty(&mgr->free_list[level])) {
-        int ret = enlarge_slab_mgr(mgr, level);
-        if (ret < 0) {
-            system_unlock();
+#ifdef system_magazine
+    mobj = __slab_magazine_alloc(mgr, level);
+    if (!mobj)
+#endif
+    {
+        system_lock();
+        mobj = __slab_alloc_obj(mgr, level);
+        system_unlock();
+        if (!mobj)
             return NULL;
-        }
-    }
-
-    if (!listp_empty(&mgr->free_list[level])) {
-        mobj = listp_first_entry(&mgr->free_list[level], SLAB_OBJ_TYPE, __list);
-        listp_del(mobj, &mgr->free_list[level], __list);
-    } else {
-        mobj = (void *) mgr->addr[level];
-        mgr->addr[level] += slab_levels[level] + SLAB_HDR_SIZE;
     }
-    assert(mgr->addr[level] <= mgr->addr_top[level]);
-    OBJ_LEVEL(mobj) = level;
-    system_unlock();
 
 #ifdef SLAB_CANARY
     unsigned long * m =
@@ -491,9 +663,13 @@ static inline void slab_free (SLAB_MGR mgr, void * obj)
 
     SLAB_OBJ mobj = RAW_TO_OBJ(obj, SLAB_OBJ_TYPE);
 
+#ifdef system_magazine
+    if (__slab_magazine_free(mgr, mobj, level))
+        return;
+#endif
+
     system_lock();
-    INIT_LIST_HEAD(mobj, __list);
-    listp_add_tail(mobj, &mgr->free_list[level], __list);
+    __slab_free_obj(mgr, mobj, level);
     system_unlock();
 }
 
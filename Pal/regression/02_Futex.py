@@ -0,0 +1,23 @@
+#!/usr/bin/python
+
+import os, sys
+from regression import Regression
+
+loader = os.environ['PAL_LOADER']
+
+regression = Regression(loader, "Futex")
+
+regression.add_check(name="Futex: Value Mismatch and Timeout",
+    check=lambda res: "Futex Value Mismatch OK" in res[0].log and
+                      "Futex Timed Out OK" in res[0].log)
+
+regression.add_check(name="Futex: Wake Up a Waiting Thread",
+    check=lambda res: "Child Thread Woken Up (1)" in res[0].log and
+                      "Futex Wake OK" in res[0].log)
+
+regression.add_check(name="Futex: Move a Waiter to Another Futex",
+    check=lambda res: "Futex Requeue Value Mismatch OK" in res[0].log and
+                      "Futex Requeue OK" in res[0].log)
+
+rv = regression.run_checks()
+if rv: sys.exit(rv)
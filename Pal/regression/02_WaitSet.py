@@ -0,0 +1,24 @@
+#!/usr/bin/python
+
+import os, sys
+from regression import Regression
+
+loader = os.environ['PAL_LOADER']
+
+regression = Regression(loader, "WaitSet")
+
+regression.add_check(name="Wait Set Creation",
+    check=lambda res: "Wait Set Creation OK" in res[0].log)
+
+regression.add_check(name="Wait Set: Duplicate Add and Timeout",
+    check=lambda res: "Wait Set Duplicate Add OK" in res[0].log and
+                      "Wait Set Timed Out OK" in res[0].log)
+
+regression.add_check(name="Wait Set: Report Ready Handles",
+    check=lambda res: "Wait Set Wait OK" in res[0].log)
+
+regression.add_check(name="Wait Set: Remove and Modify",
+    check=lambda res: "Wait Set Modify OK" in res[0].log)
+
+rv = regression.run_checks()
+if rv: sys.exit(rv)
@@ -0,0 +1,81 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include "pal.h"
+#include "pal_debug.h"
+
+static volatile PAL_IDX futex_word = 0;
+static volatile int child_done = 0;
+static volatile PAL_IDX requeue_word = 0, requeue_target = 0;
+
+int callback (void * args)
+{
+    while (futex_word == 0)
+        DkFutexWait((PAL_PTR) &futex_word, 0, NO_TIMEOUT, (PAL_FLG) -1);
+
+    pal_printf("Child Thread Woken Up (%d)\n", futex_word);
+    child_done = 1;
+    DkThreadExit();
+    return 0;
+}
+
+int requeue_callback (void * args)
+{
+    DkFutexWait((PAL_PTR) &requeue_word, 0, NO_TIMEOUT, (PAL_FLG) -1);
+    child_done = 1;
+    DkThreadExit();
+    return 0;
+}
+
+int main (int argc, char ** argv, char ** envp)
+{
+    PAL_IDX word = 0;
+
+    /* Returns immediately, since the value does not match */
+    if (!DkFutexWait(&word, 1, NO_TIMEOUT, (PAL_FLG) -1))
+        pal_printf("Futex Value Mismatch OK\n");
+
+    if (!DkFutexWait(&word, 0, 1000, (PAL_FLG) -1))
+        pal_printf("Futex Timed Out OK\n");
+
+    PAL_HANDLE thread = DkThreadCreate(callback, NULL, 0);
+    if (!thread)
+        return 1;
+
+    /* Give the child a chance to block on the futex */
+    DkThreadDelayExecution(100000);
+
+    futex_word = 1;
+    DkFutexWake((PAL_PTR) &futex_word, 1, (PAL_FLG) -1);
+
+    while (!child_done)
+        DkThreadYieldExecution();
+
+    pal_printf("Futex Wake OK\n");
+
+    /* A waiter moved to another futex is woken up from there */
+    child_done = 0;
+    thread = DkThreadCreate(requeue_callback, NULL, 0);
+    if (!thread)
+        return 1;
+
+    DkThreadDelayExecution(100000);
+
+    PAL_NUM nwaiters = 0;
+    if (!DkFutexRequeue((PAL_PTR) &requeue_word, 0,
+                        (PAL_PTR) &requeue_target, 1, PAL_TRUE, 1, &nwaiters))
+        pal_printf("Futex Requeue Value Mismatch OK\n");
+
+    if (DkFutexRequeue((PAL_PTR) &requeue_word, 0, (PAL_PTR) &requeue_target,
+                       1, PAL_TRUE, 0, &nwaiters) && nwaiters == 1 &&
+        !child_done) {
+        DkFutexWake((PAL_PTR) &requeue_target, 1, (PAL_FLG) -1);
+
+        while (!child_done)
+            DkThreadYieldExecution();
+
+        pal_printf("Futex Requeue OK\n");
+    }
+
+    return 0;
+}
@@ -26,6 +26,9 @@ int main (int argc, char ** argv, char ** envp)
     print_symbol(DkStreamWaitForClient);
     print_symbol(DkStreamRead);
     print_symbol(DkStreamWrite);
+    print_symbol(DkStreamReadv);
+    print_symbol(DkStreamWritev);
+    print_symbol(DkStreamCopy);
     print_symbol(DkStreamDelete);
     print_symbol(DkStreamMap);
     print_symbol(DkStreamUnmap);
@@ -54,8 +57,17 @@ int main (int argc, char ** argv, char ** envp)
     print_symbol(DkSynchronizationEventCreate);
     print_symbol(DkEventSet);
     print_symbol(DkEventClear);
+    print_symbol(DkFutexWait);
+    print_symbol(DkFutexWake);
+    print_symbol(DkFutexRequeue);
 
     print_symbol(DkObjectsWaitAny);
+    print_symbol(DkObjectsWaitEvents);
+    print_symbol(DkWaitSetCreate);
+    print_symbol(DkWaitSetAdd);
+    print_symbol(DkWaitSetModify);
+    print_symbol(DkWaitSetRemove);
+    print_symbol(DkWaitSetWait);
     print_symbol(DkObjectClose);
 
     print_symbol(DkSystemTimeQuery);
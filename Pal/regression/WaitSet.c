@@ -0,0 +1,68 @@
+/* -*- mode:c; c-file-style:"k&r"; c-basic-offset: 4; tab-width:4; indent-tabs-mode:nil; mode:auto-fill; fill-column:78; -*- */
+/* vim: set ts=4 sw=4 et tw=78 fo=cqt wm=0: */
+
+#include "pal.h"
+#include "pal_debug.h"
+
+#define NPIPES      4
+
+int main (int argc, char ** argv, char ** envp)
+{
+    PAL_HANDLE pipes[NPIPES];
+    PAL_PTR data[NPIPES];
+    PAL_FLG events[NPIPES];
+    char byte = 0;
+    int i;
+
+    PAL_HANDLE waitset = DkWaitSetCreate();
+    if (!waitset) {
+        pal_printf("Wait Set Creation Failed\n");
+        return 1;
+    }
+
+    pal_printf("Wait Set Creation OK\n");
+
+    for (i = 0 ; i < NPIPES ; i++) {
+        pipes[i] = DkStreamOpen("pipe:", PAL_ACCESS_RDWR, 0, 0,
+                                PAL_OPTION_NONBLOCK);
+        if (!pipes[i])
+            return 1;
+
+        if (!DkWaitSetAdd(waitset, pipes[i], PAL_WAIT_READ,
+                          (PAL_PTR) &pipes[i]))
+            return 1;
+    }
+
+    if (!DkWaitSetAdd(waitset, pipes[0], PAL_WAIT_READ, NULL))
+        pal_printf("Wait Set Duplicate Add OK\n");
+
+    if (!DkWaitSetWait(waitset, NPIPES, data, events, 1000))
+        pal_printf("Wait Set Timed Out OK\n");
+
+    DkStreamWrite(pipes[1], 0, 1, &byte, NULL);
+    DkStreamWrite(pipes[3], 0, 1, &byte, NULL);
+
+    PAL_NUM n = DkWaitSetWait(waitset, NPIPES, data, events, NO_TIMEOUT);
+    bool ok = (n == 2);
+    for (i = 0 ; i < n ; i++)
+        if ((data[i] != &pipes[1] && data[i] != &pipes[3]) ||
+            !(events[i] & PAL_WAIT_READ))
+            ok = false;
+
+    if (ok)
+        pal_printf("Wait Set Wait OK\n");
+
+    DkWaitSetRemove(waitset, pipes[1]);
+    DkWaitSetModify(waitset, pipes[3], PAL_WAIT_READ, (PAL_PTR) &pipes[0]);
+
+    n = DkWaitSetWait(waitset, NPIPES, data, events, NO_TIMEOUT);
+    if (n == 1 && data[0] == &pipes[0])
+        pal_printf("Wait Set Modify OK\n");
+
+    DkObjectClose(waitset);
+
+    for (i = 0 ; i < NPIPES ; i++)
+        DkObjectClose(pipes[i]);
+
+    return 0;
+}
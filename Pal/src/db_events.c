@@ -113,3 +113,74 @@ void DkEventClear (PAL_HANDLE handle)
 
     LEAVE_PAL_CALL();
 }
+
+PAL_BOL DkFutexWait (PAL_PTR addr, PAL_IDX val, PAL_NUM timeout,
+                     PAL_FLG bitset)
+{
+    ENTER_PAL_CALL(DkFutexWait);
+
+    if (!addr || ((uintptr_t) addr % sizeof(uint32_t)) || !bitset) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    int ret = _DkFutexWait((uint32_t *) addr, val, timeout, bitset);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
+
+PAL_NUM DkFutexWake (PAL_PTR addr, PAL_NUM count, PAL_FLG bitset)
+{
+    ENTER_PAL_CALL(DkFutexWake);
+
+    if (!addr || ((uintptr_t) addr % sizeof(uint32_t)) || !bitset) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    if (count > INT32_MAX)
+        count = INT32_MAX;
+
+    int ret = _DkFutexWake((uint32_t *) addr, count, bitset);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    LEAVE_PAL_CALL_RETURN(ret);
+}
+
+PAL_BOL DkFutexRequeue (PAL_PTR addr, PAL_NUM count, PAL_PTR addr2,
+                        PAL_NUM count2, PAL_BOL cmp, PAL_IDX val,
+                        PAL_NUM * nwaiters)
+{
+    ENTER_PAL_CALL(DkFutexRequeue);
+
+    if (!addr || ((uintptr_t) addr % sizeof(uint32_t)) ||
+        !addr2 || ((uintptr_t) addr2 % sizeof(uint32_t)) || !nwaiters) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    if (count > INT32_MAX)
+        count = INT32_MAX;
+    if (count2 > INT32_MAX)
+        count2 = INT32_MAX;
+
+    int ret = _DkFutexRequeue((uint32_t *) addr, count, (uint32_t *) addr2,
+                              count2, cmp, val);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    *nwaiters = ret;
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
@@ -105,3 +105,142 @@ DkObjectsWaitAny (PAL_NUM count, PAL_HANDLE * handleArray, PAL_NUM timeout)
 
     LEAVE_PAL_CALL_RETURN(polled);
 }
+
+/* PAL call DkObjectsWaitEvents: wait for any of the handles in the handle
+   array, and report the events of all the ready handles. */
+PAL_BOL
+DkObjectsWaitEvents (PAL_NUM count, PAL_HANDLE * handleArray,
+                     PAL_FLG * events, PAL_FLG * ret_events, PAL_NUM timeout)
+{
+    ENTER_PAL_CALL(DkObjectsWaitEvents);
+
+    if (!count || !handleArray || !events || !ret_events) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    for (int i = 0 ; i < count ; i++)
+        if (UNKNOWN_HANDLE(handleArray[i]))
+            handleArray[i] = NULL;
+
+    int ret = _DkObjectsWaitEvents(count, handleArray, events, ret_events,
+                                   timeout == NO_TIMEOUT ? -1 : timeout);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
+
+/* PAL call DkWaitSetCreate: create an empty wait set. */
+PAL_HANDLE DkWaitSetCreate (void)
+{
+    ENTER_PAL_CALL(DkWaitSetCreate);
+
+    PAL_HANDLE handle = NULL;
+    int ret = _DkWaitSetCreate(&handle);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        handle = NULL;
+    }
+
+    TRACE_HEAP(handle);
+    LEAVE_PAL_CALL_RETURN(handle);
+}
+
+/* PAL call DkWaitSetAdd: register a handle in the wait set, with the events
+   to wait for and the pointer to return when the handle is ready. */
+PAL_BOL
+DkWaitSetAdd (PAL_HANDLE waitSet, PAL_HANDLE handle, PAL_FLG events,
+              PAL_PTR data)
+{
+    ENTER_PAL_CALL(DkWaitSetAdd);
+
+    if (!waitSet || !handle || UNKNOWN_HANDLE(handle) ||
+        !IS_HANDLE_TYPE(waitSet, waitset)) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    int ret = _DkWaitSetAdd(waitSet, handle, events, data);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
+
+/* PAL call DkWaitSetModify: change the events and the pointer of a handle
+   registered in the wait set. */
+PAL_BOL
+DkWaitSetModify (PAL_HANDLE waitSet, PAL_HANDLE handle, PAL_FLG events,
+                 PAL_PTR data)
+{
+    ENTER_PAL_CALL(DkWaitSetModify);
+
+    if (!waitSet || !handle || !IS_HANDLE_TYPE(waitSet, waitset)) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    int ret = _DkWaitSetModify(waitSet, handle, events, data);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
+
+/* PAL call DkWaitSetRemove: unregister a handle from the wait set. The
+   handle must be removed before it is closed. */
+PAL_BOL
+DkWaitSetRemove (PAL_HANDLE waitSet, PAL_HANDLE handle)
+{
+    ENTER_PAL_CALL(DkWaitSetRemove);
+
+    if (!waitSet || !handle || !IS_HANDLE_TYPE(waitSet, waitset)) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    int ret = _DkWaitSetRemove(waitSet, handle);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(PAL_FALSE);
+    }
+
+    LEAVE_PAL_CALL_RETURN(PAL_TRUE);
+}
+
+/* PAL call DkWaitSetWait: wait for the handles in the wait set, and return
+   the pointers and the events of the ready handles. */
+PAL_NUM
+DkWaitSetWait (PAL_HANDLE waitSet, PAL_NUM count, PAL_PTR * data,
+               PAL_FLG * events, PAL_NUM timeout)
+{
+    ENTER_PAL_CALL(DkWaitSetWait);
+
+    if (!waitSet || !count || !data || !events ||
+        !IS_HANDLE_TYPE(waitSet, waitset)) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    int ret = _DkWaitSetWait(waitSet, count, data, events,
+                             timeout == NO_TIMEOUT ? -1 : timeout);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    LEAVE_PAL_CALL_RETURN(ret);
+}
@@ -49,6 +49,7 @@ extern struct handle_ops mutex_ops;
 extern struct handle_ops event_ops;
 extern struct handle_ops gipc_ops;
 extern struct handle_ops mcast_ops;
+extern struct handle_ops waitset_ops;
 
 const struct handle_ops * pal_handle_ops [PAL_HANDLE_TYPE_BOUND] = {
             [pal_type_file]      = &file_ops,
@@ -68,6 +69,7 @@ const struct handle_ops * pal_handle_ops [PAL_HANDLE_TYPE_BOUND] = {
             [pal_type_mutex]     = &mutex_ops,
             [pal_type_event]     = &event_ops,
             [pal_type_gipc]      = &gipc_ops,
+            [pal_type_waitset]   = &waitset_ops,
         };
 
 /* parse_stream_uri scan the uri, seperate prefix and search for
@@ -365,6 +367,241 @@ DkStreamWrite (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM count,
     LEAVE_PAL_CALL_RETURN(ret);
 }
 
+static uint64_t iov_length (int iovcnt, const PAL_IOVEC * iov)
+{
+    uint64_t count = 0;
+    for (int i = 0 ; i < iovcnt ; i++)
+        count += iov[i].size;
+    return count;
+}
+
+/* _DkStreamReadv for internal use. Read from stream into a vector of
+   buffers. If the handler cannot read into a vector, the stream is read
+   into a bounce buffer in one operation, so a datagram is never split
+   across multiple reads. */
+int64_t _DkStreamReadv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                        const PAL_IOVEC * iov, char * addr, int addrlen)
+{
+    if (UNKNOWN_HANDLE(handle))
+        return -PAL_ERROR_BADHANDLE;
+
+    const struct handle_ops * ops = HANDLE_OPS(handle);
+
+    if (!ops)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    uint64_t count = iov_length(iovcnt, iov);
+    if (!count)
+        return -PAL_ERROR_ZEROSIZE;
+
+    int64_t ret;
+
+    if (ops->readv) {
+        ret = ops->readv(handle, offset, iovcnt, iov, addr, addrlen);
+        return ret ? ret : -PAL_ERROR_ENDOFSTREAM;
+    }
+
+    if (iovcnt == 1)
+        return _DkStreamRead(handle, offset, count, iov[0].base, addr,
+                             addrlen);
+
+    void * buf = malloc(count);
+    if (!buf)
+        return -PAL_ERROR_NOMEM;
+
+    ret = _DkStreamRead(handle, offset, count, buf, addr, addrlen);
+
+    if (ret > 0) {
+        uint64_t copied = 0;
+        for (int i = 0 ; i < iovcnt && copied < ret ; i++) {
+            uint64_t size = iov[i].size;
+            if (size > ret - copied)
+                size = ret - copied;
+            memcpy(iov[i].base, buf + copied, size);
+            copied += size;
+        }
+    }
+
+    free(buf);
+    return ret;
+}
+
+/* PAL call DkStreamReadv: Read from stream at absolute offset into a
+   vector of buffers. Return number of bytes if succeeded, or 0 for
+   failure. Error code is notified. */
+PAL_NUM
+DkStreamReadv (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM iovcnt,
+               PAL_IOVEC * iov, PAL_PTR source, PAL_NUM size)
+{
+    ENTER_PAL_CALL(DkStreamReadv);
+
+    if (!handle || !iov || !iovcnt) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    int64_t ret = _DkStreamReadv(handle, offset, iovcnt, iov,
+                                 size ? (char *) source : NULL,
+                                 source ? size : 0);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        ret = 0;
+    }
+
+    LEAVE_PAL_CALL_RETURN(ret);
+}
+
+/* _DkStreamWritev for internal use. Write a vector of buffers to stream.
+   If the handler cannot write a vector, the buffers are gathered into a
+   bounce buffer and written in one operation. */
+int64_t _DkStreamWritev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                         const PAL_IOVEC * iov, const char * addr,
+                         int addrlen)
+{
+    if (UNKNOWN_HANDLE(handle))
+        return -PAL_ERROR_BADHANDLE;
+
+    const struct handle_ops * ops = HANDLE_OPS(handle);
+
+    if (!ops)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    uint64_t count = iov_length(iovcnt, iov);
+    if (!count)
+        return -PAL_ERROR_ZEROSIZE;
+
+    int64_t ret;
+
+    if (ops->writev) {
+        ret = ops->writev(handle, offset, iovcnt, iov, addr, addrlen);
+        return ret ? ret : -PAL_ERROR_ENDOFSTREAM;
+    }
+
+    if (iovcnt == 1)
+        return _DkStreamWrite(handle, offset, count, iov[0].base, addr,
+                              addrlen);
+
+    void * buf = malloc(count);
+    if (!buf)
+        return -PAL_ERROR_NOMEM;
+
+    uint64_t copied = 0;
+    for (int i = 0 ; i < iovcnt ; i++) {
+        memcpy(buf + copied, iov[i].base, iov[i].size);
+        copied += iov[i].size;
+    }
+
+    ret = _DkStreamWrite(handle, offset, count, buf, addr, addrlen);
+    free(buf);
+    return ret;
+}
+
+/* PAL call DkStreamWritev: Write a vector of buffers to stream at absolute
+   offset. Return number of bytes if succeeded, or 0 for failure. Error
+   code is notified. */
+PAL_NUM
+DkStreamWritev (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM iovcnt,
+                PAL_IOVEC * iov, PAL_STR dest)
+{
+    ENTER_PAL_CALL(DkStreamWritev);
+
+    if (!handle || !iov || !iovcnt) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    int64_t ret = _DkStreamWritev(handle, offset, iovcnt, iov, dest,
+                                  dest ? strlen(dest) : 0);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        ret = 0;
+    }
+
+    LEAVE_PAL_CALL_RETURN(ret);
+}
+
+#define STREAM_COPY_BUFSIZE     (64 * 1024)
+
+/* _DkStreamCopy for internal use. Copy from one stream to another inside
+   the PAL. If the handler of the source cannot copy to the destination in
+   the host, the data is read into a PAL buffer and written out, so it
+   never enters the address space of the application. */
+int64_t _DkStreamCopy (PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dest,
+                       uint64_t dest_offset, uint64_t count)
+{
+    if (UNKNOWN_HANDLE(src) || UNKNOWN_HANDLE(dest))
+        return -PAL_ERROR_BADHANDLE;
+
+    const struct handle_ops * ops = HANDLE_OPS(src);
+
+    if (!ops)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    if (!count)
+        return -PAL_ERROR_ZEROSIZE;
+
+    int64_t ret;
+
+    if (ops->copy) {
+        ret = ops->copy(src, src_offset, dest, dest_offset, count);
+        if (ret != -PAL_ERROR_NOTSUPPORT)
+            return ret ? ret : -PAL_ERROR_ENDOFSTREAM;
+    }
+
+    if (count > STREAM_COPY_BUFSIZE)
+        count = STREAM_COPY_BUFSIZE;
+
+    void * buf = malloc(count);
+    if (!buf)
+        return -PAL_ERROR_NOMEM;
+
+    ret = _DkStreamRead(src, src_offset, count, buf, NULL, 0);
+
+    if (ret > 0) {
+        int64_t bytes = ret, written = 0;
+
+        while (written < bytes) {
+            ret = _DkStreamWrite(dest, dest_offset + written, bytes - written,
+                                 buf + written, NULL, 0);
+            if (ret < 0)
+                break;
+            written += ret;
+        }
+
+        if (written)
+            ret = written;
+    }
+
+    free(buf);
+    return ret;
+}
+
+/* PAL call DkStreamCopy: Copy from a stream at absolute offset to another
+   stream at absolute offset. Return number of bytes if succeeded, or 0 for
+   failure. Error code is notified. */
+PAL_NUM
+DkStreamCopy (PAL_HANDLE src, PAL_NUM src_offset, PAL_HANDLE dest,
+              PAL_NUM dest_offset, PAL_NUM count)
+{
+    ENTER_PAL_CALL(DkStreamCopy);
+
+    if (!src || !dest) {
+        _DkRaiseFailure(PAL_ERROR_INVAL);
+        LEAVE_PAL_CALL_RETURN(0);
+    }
+
+    int64_t ret = _DkStreamCopy(src, src_offset, dest, dest_offset, count);
+
+    if (ret < 0) {
+        _DkRaiseFailure(-ret);
+        ret = 0;
+    }
+
+    LEAVE_PAL_CALL_RETURN(ret);
+}
+
 /* _DkStreamAttributesQuery of internal use. The function query attribute
    of streams by their URI */
 int _DkStreamAttributesQuery (const char * uri, PAL_STREAM_ATTR * attr)
@@ -399,6 +636,7 @@ DkStreamAttributesQuery (PAL_STR uri, PAL_STREAM_ATTR * attr)
     log_stream(uri);
 
     PAL_STREAM_ATTR attr_buf;
+    memset(&attr_buf, 0, sizeof(PAL_STREAM_ATTR));
 
     int ret = _DkStreamAttributesQuery(uri, &attr_buf);
 
@@ -442,6 +680,7 @@ DkStreamAttributesQuerybyHandle (PAL_HANDLE handle, PAL_STREAM_ATTR * attr)
         LEAVE_PAL_CALL_RETURN(PAL_FALSE);
     }
 
+    memset(attr, 0, sizeof(PAL_STREAM_ATTR));
     int ret = _DkStreamAttributesQuerybyHandle(handle, attr);
 
     if (ret < 0) {
@@ -144,6 +144,25 @@ int _DkEventClear (PAL_HANDLE event)
 }
 
 
+/* FreeBSD has no futexes; the library OS falls back to its own futex
+ * emulation, and to PAL mutexes for its locks. */
+int _DkFutexWait (uint32_t * addr, uint32_t val, uint64_t timeout,
+                  uint32_t bitset)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkFutexWake (uint32_t * addr, int count, uint32_t bitset)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkFutexRequeue (uint32_t * addr, int count, uint32_t * addr2,
+                     int count2, bool cmp, uint32_t val)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
 static int event_close (PAL_HANDLE handle)
 {
     _DkEventSet(handle, -1);
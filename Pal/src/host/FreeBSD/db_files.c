@@ -221,6 +221,7 @@ file_attrcopy (PAL_STREAM_ATTR * attr, struct stat * stat)
     attr->runnable     = stataccess(stat, ACCESS_X);
     attr->share_flags  = stat->st_mode;
     attr->pending_size = stat->st_size;
+    attr->nlink        = stat->st_nlink;
 }
 
 /* 'attrquery' operation for file streams */
@@ -372,18 +373,27 @@ struct dirent {
 #define DT_SOCK         12
 #define DT_WHT          14
 
-#define DIRBUF_SIZE     1024
+#define DIRBUF_SIZE     (32 * 1024)
 
 /* 'read' operation for directory stream. Directory stream will not
    need a 'write' operat4on. */
 int dir_read (PAL_HANDLE handle, int offset, int count, void * buf)
 {
-    void * dent_buf = handle->dir.buf ? : __alloca(DIRBUF_SIZE);
+    /* the entries fetched from the host but not returned yet are kept in
+       the buffer of the handle for the next read */
+    if (!handle->dir.buf) {
+        handle->dir.buf = malloc(DIRBUF_SIZE);
+        if (!handle->dir.buf)
+            return -PAL_ERROR_NOMEM;
+        handle->dir.ptr = handle->dir.end = handle->dir.buf;
+    }
+
+    void * dent_buf = handle->dir.buf;
     void * ptr = handle->dir.ptr;
     void * end = handle->dir.end;
     int bytes = 0;
 
-    if (ptr && ptr < end)
+    if (ptr < end)
         goto output;
 
     do {
@@ -430,19 +440,11 @@ next:
         }
     } while (ptr == end);
 
-    if (ptr < end) {
-        if (!handle->dir.buf)
-            handle->dir.buf = malloc(DIRBUF_SIZE);
+    handle->dir.ptr = ptr;
+    handle->dir.end = end;
 
-        if (handle->dir.buf != ptr) {
-            memmove(handle->dir.buf, ptr, end - ptr);
-            end = handle->dir.buf + (end - ptr);
-            ptr = handle->dir.buf;
-        }
-
-        if (!bytes)
-            return -PAL_ERROR_OVERFLOW;
-    }
+    if (ptr < end && !bytes)
+        return -PAL_ERROR_OVERFLOW;
 
     return bytes ? : -PAL_ERROR_ENDOFSTREAM;
 }
@@ -295,6 +295,7 @@ file_attrcopy (PAL_STREAM_ATTR * attr, struct stat * stat)
     attr->runnable     = stataccess(stat, ACCESS_X);
     attr->share_flags  = stat->st_mode;
     attr->pending_size = stat->st_size;
+    attr->nlink        = stat->st_nlink;
 
 }
 
@@ -429,19 +430,28 @@ static int dir_open (PAL_HANDLE * handle, const char * type, const char * uri,
     return 0;
 }
 
-#define DIRBUF_SIZE     1024
+#define DIRBUF_SIZE     (32 * 1024)
 
 /* 'read' operation for directory stream. Directory stream will not
    need a 'write' operat4on. */
 static int64_t dir_read (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                          void * buf)
 {
-    void * dent_buf = (void *) handle->dir.buf ? : __alloca(DIRBUF_SIZE);
+    /* the entries fetched from the host but not returned yet are kept in
+       the buffer of the handle for the next read */
+    if (!handle->dir.buf) {
+        handle->dir.buf = (PAL_PTR) malloc(DIRBUF_SIZE);
+        if (!handle->dir.buf)
+            return -PAL_ERROR_NOMEM;
+        handle->dir.ptr = handle->dir.end = handle->dir.buf;
+    }
+
+    void * dent_buf = (void *) handle->dir.buf;
     void * ptr = (void *) handle->dir.ptr;
     void * end = (void *) handle->dir.end;
     int bytes = 0;
 
-    if (ptr && ptr < end)
+    if (ptr < end)
         goto output;
 
     do {
@@ -487,19 +497,11 @@ next:
         }
     } while (ptr == end);
 
-    if (ptr < end) {
-        if (!handle->dir.buf)
-            handle->dir.buf = (PAL_PTR) malloc(DIRBUF_SIZE);
+    handle->dir.ptr = (PAL_PTR) ptr;
+    handle->dir.end = (PAL_PTR) end;
 
-        if ((void *) handle->dir.buf != ptr) {
-            memmove((void *) handle->dir.buf, ptr, end - ptr);
-            end = (void *) handle->dir.buf + (end - ptr);
-            ptr = (void *) handle->dir.buf;
-        }
-
-        if (!bytes)
-            return -PAL_ERROR_OVERFLOW;
-    }
+    if (ptr < end && !bytes)
+        return -PAL_ERROR_OVERFLOW;
 
     return bytes ? : -PAL_ERROR_ENDOFSTREAM;
 }
@@ -143,6 +143,73 @@ int _DkEventClear (PAL_HANDLE event)
     return 0;
 }
 
+int _DkFutexWait (uint32_t * addr, uint32_t val, uint64_t timeout,
+                  uint32_t bitset)
+{
+    struct timespec waittime, * waittimep = NULL;
+    int op = (bitset == FUTEX_BITSET_MATCH_ANY ? FUTEX_WAIT :
+              FUTEX_WAIT_BITSET)|FUTEX_PRIVATE_FLAG;
+    int ret;
+
+    if (timeout != NO_TIMEOUT) {
+        if (bitset == FUTEX_BITSET_MATCH_ANY) {
+            /* FUTEX_WAIT takes a relative timeout */
+            waittime.tv_sec  = timeout / 1000000UL;
+            waittime.tv_nsec = (timeout % 1000000UL) * 1000;
+        } else {
+            /* FUTEX_WAIT_BITSET takes an absolute timeout, on the same clock
+             * as _DkSystemTimeQuery() */
+            uint64_t deadline = _DkSystemTimeQuery() + timeout;
+            waittime.tv_sec  = deadline / 1000000UL;
+            waittime.tv_nsec = (deadline % 1000000UL) * 1000;
+#if USE_CLOCK_GETTIME != 1
+            op |= FUTEX_CLOCK_REALTIME;
+#endif
+        }
+        waittimep = &waittime;
+    }
+
+    ret = INLINE_SYSCALL(futex, 6, addr, op, val, waittimep, NULL, bitset);
+
+    if (IS_ERR(ret)) {
+        switch (ERRNO(ret)) {
+            case EWOULDBLOCK:
+                return -PAL_ERROR_INCONSIST;
+            case ETIMEDOUT:
+                return -PAL_ERROR_TRYAGAIN;
+            default:
+                return unix_to_pal_error(ERRNO(ret));
+        }
+    }
+
+    return 0;
+}
+
+int _DkFutexWake (uint32_t * addr, int count, uint32_t bitset)
+{
+    int ret = INLINE_SYSCALL(futex, 6, addr,
+                             FUTEX_WAKE_BITSET|FUTEX_PRIVATE_FLAG, count,
+                             NULL, NULL, bitset);
+
+    return IS_ERR(ret) ? unix_to_pal_error(ERRNO(ret)) : ret;
+}
+
+int _DkFutexRequeue (uint32_t * addr, int count, uint32_t * addr2,
+                     int count2, bool cmp, uint32_t val)
+{
+    /* the number of waiters to move is passed in place of the timeout */
+    int ret = INLINE_SYSCALL(futex, 6, addr,
+                             (cmp ? FUTEX_CMP_REQUEUE : FUTEX_REQUEUE)|
+                             FUTEX_PRIVATE_FLAG, count,
+                             (void *) (long) count2, addr2, val);
+
+    if (IS_ERR(ret))
+        return ERRNO(ret) == EAGAIN ? -PAL_ERROR_INCONSIST :
+               unix_to_pal_error(ERRNO(ret));
+
+    return ret;
+}
+
 static int event_close (PAL_HANDLE handle)
 {
     _DkEventSet(handle, -1);
@@ -69,31 +69,20 @@ static int file_open (PAL_HANDLE * handle, const char * type, const char * uri,
     return 0;
 }
 
-#ifndef SEEK_SET
-# define SEEK_SET 0
-#endif
-
-/* 'read' operation for file streams. */
+/* 'read' operation for file streams. The file is read at the offset with
+   pread, unless the file is not seekable (e.g., a FIFO). */
 static int64_t file_read (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                           void * buffer)
 {
     int fd = handle->file.fd;
-    int64_t ret;
-
-    if (handle->file.offset != offset) {
-        ret = INLINE_SYSCALL(lseek, 3, fd, offset, SEEK_SET);
-        if (IS_ERR(ret))
-            return -PAL_ERROR_DENIED;
+    int64_t ret = INLINE_SYSCALL(pread64, 4, fd, buffer, count, offset);
 
-        handle->file.offset = offset;
-    }
-
-    ret = INLINE_SYSCALL(read, 3, fd, buffer, count);
+    if (IS_ERR(ret) && ERRNO(ret) == ESPIPE)
+        ret = INLINE_SYSCALL(read, 3, fd, buffer, count);
 
     if (IS_ERR(ret))
         return unix_to_pal_error(ERRNO(ret));
 
-    handle->file.offset = offset + ret;
     return ret;
 }
 
@@ -102,22 +91,118 @@ static int64_t file_write (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                            const void * buffer)
 {
     int fd = handle->file.fd;
+    int64_t ret = INLINE_SYSCALL(pwrite64, 4, fd, buffer, count, offset);
+
+    if (IS_ERR(ret) && ERRNO(ret) == ESPIPE)
+        ret = INLINE_SYSCALL(write, 3, fd, buffer, count);
+
+    if (IS_ERR(ret))
+        return unix_to_pal_error(ERRNO(ret));
+
+    return ret;
+}
+
+/* 'readv' operation for file streams. PAL_IOVEC has the same layout as
+   struct iovec, so the vector is passed to preadv as is. */
+static int64_t file_readv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                           const PAL_IOVEC * iov, char * addr, int addrlen)
+{
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    int fd = handle->file.fd;
+    int64_t ret = INLINE_SYSCALL(preadv, 5, fd, iov, iovcnt, offset, 0);
+
+    if (IS_ERR(ret) && ERRNO(ret) == ESPIPE)
+        ret = INLINE_SYSCALL(readv, 3, fd, iov, iovcnt);
+
+    if (IS_ERR(ret))
+        return unix_to_pal_error(ERRNO(ret));
+
+    return ret;
+}
+
+/* 'writev' operation for file streams. */
+static int64_t file_writev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                            const PAL_IOVEC * iov, const char * addr,
+                            int addrlen)
+{
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    int fd = handle->file.fd;
+    int64_t ret = INLINE_SYSCALL(pwritev, 5, fd, iov, iovcnt, offset, 0);
+
+    if (IS_ERR(ret) && ERRNO(ret) == ESPIPE)
+        ret = INLINE_SYSCALL(writev, 3, fd, iov, iovcnt);
+
+    if (IS_ERR(ret))
+        return unix_to_pal_error(ERRNO(ret));
+
+    return ret;
+}
+
+/* 'copy' operation for file streams. The file is copied inside the host:
+   to another file with copy_file_range, and to a pipe, a socket or a
+   device with sendfile. */
+static int64_t file_copy (PAL_HANDLE handle, uint64_t offset, PAL_HANDLE dest,
+                          uint64_t dest_offset, uint64_t count)
+{
+    if (!IS_HANDLE_TYPE(dest, file) &&
+        !IS_HANDLE_TYPE(dest, pipe) && !IS_HANDLE_TYPE(dest, pipecli) &&
+        !IS_HANDLE_TYPE(dest, pipeprv) && !IS_HANDLE_TYPE(dest, tcp) &&
+        !IS_HANDLE_TYPE(dest, udp) && !IS_HANDLE_TYPE(dest, dev))
+        return -PAL_ERROR_NOTSUPPORT;
+
+    int destfd = -1, i;
+    for (i = 0 ; i < MAX_FDS ; i++)
+        if (HANDLE_HDR(dest)->flags & WFD(i)) {
+            destfd = dest->generic.fds[i];
+            break;
+        }
+
+    if (destfd < 0 || destfd == PAL_IDX_POISON)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    /* the data of a pipe with a ring goes through the ring; the socket is
+       only its doorbell */
+    if ((IS_HANDLE_TYPE(dest, pipe) || IS_HANDLE_TYPE(dest, pipecli)) &&
+        dest->pipe.ring)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    int fd = handle->file.fd;
+    int64_t off = offset;
     int64_t ret;
 
-    if (handle->file.offset != offset) {
-        ret = INLINE_SYSCALL(lseek, 3, fd, offset, SEEK_SET);
-        if (IS_ERR(ret))
-            return -PAL_ERROR_DENIED;
+    if (IS_HANDLE_TYPE(dest, file)) {
+        int64_t dest_off = dest_offset;
+        ret = INLINE_SYSCALL(copy_file_range, 6, fd, &off, destfd, &dest_off,
+                             count, 0);
+
+        if (!IS_ERR(ret))
+            return ret;
 
-        handle->file.offset = offset;
+        if (ERRNO(ret) != EXDEV && ERRNO(ret) != EINVAL &&
+            ERRNO(ret) != ENOSYS && ERRNO(ret) != EOPNOTSUPP)
+            return unix_to_pal_error(ERRNO(ret));
+
+        /* sendfile writes at the file offset, not at dest_offset */
+        return -PAL_ERROR_NOTSUPPORT;
     }
 
-    ret = INLINE_SYSCALL(write, 3, fd, buffer, count);
+    ret = INLINE_SYSCALL(sendfile, 4, destfd, fd, &off, count);
+
+    if (IS_ERR(ret)) {
+        /* the file cannot be mapped by the host (e.g., a FIFO) */
+        if (ERRNO(ret) == EINVAL || ERRNO(ret) == ENOSYS)
+            return -PAL_ERROR_NOTSUPPORT;
 
-    if (IS_ERR(ret))
         return unix_to_pal_error(ERRNO(ret));
+    }
+
+    if (ret < count)
+        HANDLE_HDR(dest)->flags &= ~WRITEABLE(i);
 
-    handle->file.offset = offset + ret;
     return ret;
 }
 
@@ -219,6 +304,7 @@ file_attrcopy (PAL_STREAM_ATTR * attr, struct stat * stat)
     attr->runnable     = stataccess(stat, ACCESS_X);
     attr->share_flags  = stat->st_mode;
     attr->pending_size = stat->st_size;
+    attr->nlink        = stat->st_nlink;
 }
 
 /* 'attrquery' operation for file streams */
@@ -303,6 +389,9 @@ struct handle_ops file_ops = {
         .open               = &file_open,
         .read               = &file_read,
         .write              = &file_write,
+        .readv              = &file_readv,
+        .writev             = &file_writev,
+        .copy               = &file_copy,
         .close              = &file_close,
         .delete             = &file_delete,
         .map                = &file_map,
@@ -369,18 +458,27 @@ struct linux_dirent64 {
 #define DT_SOCK         12
 #define DT_WHT          14
 
-#define DIRBUF_SIZE     1024
+#define DIRBUF_SIZE     (32 * 1024)
 
 /* 'read' operation for directory stream. Directory stream will not
    need a 'write' operat4on. */
 int64_t dir_read (PAL_HANDLE handle, uint64_t offset, uint64_t count, void * buf)
 {
-    void * dent_buf = (void *) handle->dir.buf ? : __alloca(DIRBUF_SIZE);
+    /* the entries fetched from the host but not returned yet are kept in
+       the buffer of the handle for the next read */
+    if (!handle->dir.buf) {
+        handle->dir.buf = (PAL_PTR) malloc(DIRBUF_SIZE);
+        if (!handle->dir.buf)
+            return -PAL_ERROR_NOMEM;
+        handle->dir.ptr = handle->dir.end = handle->dir.buf;
+    }
+
+    void * dent_buf = (void *) handle->dir.buf;
     void * ptr = (void *) handle->dir.ptr;
     void * end = (void *) handle->dir.end;
     int bytes = 0;
 
-    if (ptr && ptr < end)
+    if (ptr < end)
         goto output;
 
     do {
@@ -427,19 +525,11 @@ next:
         }
     } while (ptr == end);
 
-    if (ptr < end) {
-        if (!handle->dir.buf)
-            handle->dir.buf = (PAL_PTR) malloc(DIRBUF_SIZE);
+    handle->dir.ptr = (PAL_PTR) ptr;
+    handle->dir.end = (PAL_PTR) end;
 
-        if ((void *) handle->dir.buf != ptr) {
-            memmove((void *) handle->dir.buf, ptr, end - ptr);
-            end = (void *) handle->dir.buf + (end - ptr);
-            ptr = (void *) handle->dir.buf;
-        }
-
-        if (!bytes)
-            return -PAL_ERROR_OVERFLOW;
-    }
+    if (ptr < end && !bytes)
+        return -PAL_ERROR_OVERFLOW;
 
     return bytes ? : -PAL_ERROR_ENDOFSTREAM;
 }
@@ -34,19 +34,75 @@
 #include "graphene-ipc.h"
 #include "api.h"
 
+#include <asm/fcntl.h>
+#include <asm/mman.h>
+#include <asm/errno.h>
+
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 0x0001U
+#endif
+
+/*
+ * Without the gipc module, the channel is a memfd: the committed memory is
+ * copied into it, and mapped copy-on-write by the receiver, which opens it
+ * through /proc of the sender. The key of the channel carries the pid of
+ * the sender and the fd of the memfd.
+ */
+#define GIPC_MEMFD_KEY          (1UL << 62)
+#define GIPC_MEMFD_FD_BITS      20
+#define GIPC_MEMFD_BOUNCE_SIZE  (64 * 1024)
+
+static PAL_HANDLE gipc_handle (int fd, unsigned long token, bool memfd)
+{
+    PAL_HANDLE hdl = malloc(HANDLE_SIZE(gipc));
+    if (!hdl)
+        return NULL;
+
+    SET_HANDLE_TYPE(hdl, gipc);
+    hdl->gipc.fd = fd;
+    hdl->gipc.token = token;
+    hdl->gipc.memfd = memfd;
+    hdl->gipc.offset = 0;
+    return hdl;
+}
+
+static int memfd_channel_open (PAL_HANDLE * handle, unsigned long token)
+{
+    char path[48];
+    snprintf(path, sizeof(path), "/proc/%lu/fd/%lu",
+             (token & ~GIPC_MEMFD_KEY) >> GIPC_MEMFD_FD_BITS,
+             token & ((1UL << GIPC_MEMFD_FD_BITS) - 1));
+
+    int fd = INLINE_SYSCALL(open, 3, path, O_RDONLY|O_CLOEXEC, 0);
+    if (IS_ERR(fd))
+        return -PAL_ERROR_DENIED;
+
+    PAL_HANDLE hdl = gipc_handle(fd, token, true);
+    if (!hdl) {
+        INLINE_SYSCALL(close, 1, fd);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    *handle = hdl;
+    return 0;
+}
+
 int gipc_open (PAL_HANDLE * handle, const char * type, const char * uri,
                int access, int share, int create, int options)
 {
     int64_t token;
     int rv;
 
+    token = strtol(uri, NULL, 10);
+
+    if (token & GIPC_MEMFD_KEY)
+        return memfd_channel_open(handle, token);
+
     int fd = INLINE_SYSCALL(open, 3, GIPC_FILE, O_RDONLY|O_CLOEXEC, 0);
 
     if (IS_ERR(fd))
         return -PAL_ERROR_DENIED;
 
-    token = atoi(uri);
-
     rv = INLINE_SYSCALL(ioctl, 3, fd, GIPC_JOIN, token);
 
     if (rv < 0) {
@@ -58,6 +114,7 @@ int gipc_open (PAL_HANDLE * handle, const char * type, const char * uri,
     SET_HANDLE_TYPE(hdl, gipc);
     hdl->gipc.fd = fd;
     hdl->gipc.token = token;
+    hdl->gipc.memfd = PAL_FALSE;
     *handle = hdl;
     return 0;
 }
@@ -80,18 +137,45 @@ struct handle_ops gipc_ops = {
         .close              = &gipc_close,
     };
 
+static int memfd_channel_create (PAL_HANDLE * handle, unsigned long * key)
+{
+    int fd = INLINE_SYSCALL(memfd_create, 2, "graphene-gipc", MFD_CLOEXEC);
+
+    if (IS_ERR(fd))
+        return -PAL_ERROR_DENIED;
+
+    if (fd >= (1 << GIPC_MEMFD_FD_BITS)) {
+        INLINE_SYSCALL(close, 1, fd);
+        return -PAL_ERROR_DENIED;
+    }
+
+    unsigned long token = GIPC_MEMFD_KEY |
+        ((unsigned long) linux_state.pid << GIPC_MEMFD_FD_BITS) | fd;
+
+    PAL_HANDLE hdl = gipc_handle(fd, token, true);
+    if (!hdl) {
+        INLINE_SYSCALL(close, 1, fd);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    *handle = hdl;
+    *key = token;
+    return 0;
+}
+
 int _DkCreatePhysicalMemoryChannel (PAL_HANDLE * handle, unsigned long * key)
 {
     unsigned long token = 0;
     int fd = INLINE_SYSCALL(open, 3, GIPC_FILE, O_RDONLY|O_CLOEXEC, 0);
 
     if (IS_ERR(fd))
-        goto err;
+        return memfd_channel_create(handle, key);
 
 
     PAL_HANDLE hdl = malloc(HANDLE_SIZE(gipc));
     SET_HANDLE_TYPE(hdl, gipc);
     hdl->gipc.fd = fd;
+    hdl->gipc.memfd = PAL_FALSE;
 
     // ioctl to create a new queue
     token = INLINE_SYSCALL(ioctl, 3, fd, GIPC_CREATE, 0);
@@ -104,14 +188,127 @@ int _DkCreatePhysicalMemoryChannel (PAL_HANDLE * handle, unsigned long * key)
 
  err_fd:
     INLINE_SYSCALL(close, 1, fd);
-
- err:
     return -PAL_ERROR_DENIED;
 }
 
+/* copy memory which can't be read as is, e.g. PROT_NONE, through
+   /proc/self/mem, which ignores the protection */
+static int64_t memfd_commit_forced (PAL_HANDLE channel, const void * addr,
+                                    uint64_t size)
+{
+    int memfd = INLINE_SYSCALL(open, 3, "/proc/self/mem", O_RDONLY|O_CLOEXEC,
+                               0);
+    if (IS_ERR(memfd))
+        return -PAL_ERROR_DENIED;
+
+    void * buf = (void *) ARCH_MMAP(NULL, GIPC_MEMFD_BOUNCE_SIZE,
+                                    PROT_READ|PROT_WRITE,
+                                    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (IS_ERR_P(buf)) {
+        INLINE_SYSCALL(close, 1, memfd);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    uint64_t copied = 0;
+    int64_t ret = 0;
+
+    while (copied < size) {
+        uint64_t len = size - copied < GIPC_MEMFD_BOUNCE_SIZE ?
+                       size - copied : GIPC_MEMFD_BOUNCE_SIZE;
+
+        ret = INLINE_SYSCALL(pread64, 4, memfd, buf, len,
+                             (unsigned long) addr + copied);
+        if (!IS_ERR(ret) && ret > 0)
+            ret = INLINE_SYSCALL(pwrite64, 4, channel->gipc.fd, buf, ret,
+                                 channel->gipc.offset + copied);
+        if (IS_ERR(ret) || !ret)
+            break;
+
+        copied += ret;
+    }
+
+    INLINE_SYSCALL(munmap, 2, buf, GIPC_MEMFD_BOUNCE_SIZE);
+    INLINE_SYSCALL(close, 1, memfd);
+
+    if (IS_ERR(ret))
+        return -PAL_ERROR_DENIED;
+
+    return copied;
+}
+
+static int memfd_channel_commit (PAL_HANDLE channel, int entries,
+                                 PAL_PTR * addrs, PAL_NUM * sizes)
+{
+    int npages = 0;
+
+    for (int i = 0 ; i < entries ; i++) {
+        if (!addrs[i] || !sizes[i] || !ALLOC_ALIGNED(addrs[i]) ||
+            !ALLOC_ALIGNED(sizes[i]))
+            return -PAL_ERROR_INVAL;
+
+        const void * addr = addrs[i];
+        uint64_t size = sizes[i];
+
+        while (size) {
+            int64_t ret = INLINE_SYSCALL(pwrite64, 4, channel->gipc.fd, addr,
+                                         size, channel->gipc.offset);
+
+            if (IS_ERR(ret) && ERRNO(ret) == EINTR)
+                continue;
+
+            if (IS_ERR(ret) && ERRNO(ret) == EFAULT) {
+                ret = memfd_commit_forced(channel, addr, size);
+                if (ret < 0)
+                    return ret;
+            }
+
+            if (IS_ERR(ret) || !ret)
+                return -PAL_ERROR_DENIED;
+
+            addr += ret;
+            size -= ret;
+            channel->gipc.offset += ret;
+        }
+
+        npages += sizes[i] / pal_state.alloc_align;
+    }
+
+    return npages;
+}
+
+static int memfd_channel_map (PAL_HANDLE channel, int entries,
+                              PAL_PTR * addrs, PAL_NUM * sizes,
+                              PAL_FLG * prots)
+{
+    int npages = 0;
+
+    for (int i = 0 ; i < entries ; i++) {
+        if (!sizes[i] || !ALLOC_ALIGNED(addrs[i]) || !ALLOC_ALIGNED(sizes[i]))
+            return -PAL_ERROR_INVAL;
+
+        int flags = MAP_PRIVATE|(addrs[i] ? MAP_FIXED : 0);
+        void * addr = (void *) ARCH_MMAP(addrs[i], sizes[i],
+                                         HOST_PROT(prots[i]), flags,
+                                         channel->gipc.fd,
+                                         channel->gipc.offset);
+
+        if (IS_ERR_P(addr))
+            return -PAL_ERROR_DENIED;
+
+        addrs[i] = (PAL_PTR) addr;
+        channel->gipc.offset += sizes[i];
+        npages += sizes[i] / pal_state.alloc_align;
+    }
+
+    return npages;
+}
+
 int _DkPhysicalMemoryCommit (PAL_HANDLE channel, int entries,
                              PAL_PTR * addrs, PAL_NUM * sizes, int flags)
 {
+    if (channel->gipc.memfd)
+        return memfd_channel_commit(channel, entries, addrs, sizes);
+
     int fd = channel->gipc.fd;
     struct gipc_send gs;
 
@@ -139,6 +336,9 @@ int _DkPhysicalMemoryCommit (PAL_HANDLE channel, int entries,
 int _DkPhysicalMemoryMap (PAL_HANDLE channel, int entries,
                           PAL_PTR * addrs, PAL_NUM * sizes, PAL_FLG * prots)
 {
+    if (channel->gipc.memfd)
+        return memfd_channel_map(channel, entries, addrs, sizes, prots);
+
     int fd = channel->gipc.fd;
     struct gipc_recv gr;
 
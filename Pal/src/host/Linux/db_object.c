@@ -35,11 +35,16 @@
 #include <linux/time.h>
 #include <linux/poll.h>
 #include <linux/wait.h>
+#include <linux/eventpoll.h>
 #include <atomic.h>
 #include <asm/errno.h>
 
 #define DEFAULT_QUANTUM 500
 
+#ifndef EPOLLET
+# define EPOLLET (1U << 31)
+#endif
+
 /* internally to wait for one object. Also used as a shortcut to wait
  *  on events and semaphores.
  *
@@ -123,6 +128,135 @@ static int _DkObjectWaitOne (PAL_HANDLE handle, uint64_t timeout)
     return ops->wait(handle, timeout);
 }
 
+/* _DkObjectsWaitEvents for internal use. The function polls all the handles
+   in the handle array with a single ppoll, and reports the events of every
+   ready handle in ret_events. */
+int _DkObjectsWaitEvents (int count, PAL_HANDLE * handleArray,
+                          PAL_FLG * events, PAL_FLG * ret_events,
+                          uint64_t timeout)
+{
+    int i, j, ret, maxfds = 0, nfds = 0, nready = 0;
+
+    for (i = 0 ; i < count ; i++) {
+        PAL_HANDLE hdl = handleArray[i];
+        ret_events[i] = 0;
+
+        if (!hdl)
+            continue;
+
+        if (!(HANDLE_HDR(hdl)->flags & HAS_FDS))
+            return -PAL_ERROR_NOTSUPPORT;
+
+        for (j = 0 ; j < MAX_FDS ; j++)
+            if (HANDLE_HDR(hdl)->flags & (RFD(j)|WFD(j)))
+                maxfds++;
+    }
+
+    struct pollfd * fds = __alloca(sizeof(struct pollfd) * maxfds);
+    int * idx = __alloca(sizeof(int) * maxfds);
+    int * off = __alloca(sizeof(int) * maxfds);
+
+    for (i = 0 ; i < count ; i++) {
+        PAL_HANDLE hdl = handleArray[i];
+
+        if (!hdl)
+            continue;
+
+        for (j = 0 ; j < MAX_FDS ; j++) {
+            int flags = HANDLE_HDR(hdl)->flags;
+            int pollev = 0;
+
+            if (!(flags & (RFD(j)|WFD(j))) ||
+                hdl->generic.fds[j] == PAL_IDX_POISON)
+                continue;
+
+            /* errors and cached writability are reported without polling */
+            if (flags & ERROR(j)) {
+                ret_events[i] |= PAL_WAIT_ERROR;
+                continue;
+            }
+
+            if ((flags & RFD(j)) && (events[i] & PAL_WAIT_READ))
+                pollev |= POLLIN;
+
+            if ((flags & WFD(j)) && (events[i] & PAL_WAIT_WRITE)) {
+                if (flags & WRITEABLE(j))
+                    ret_events[i] |= PAL_WAIT_WRITE;
+                else
+                    pollev |= POLLOUT;
+            }
+
+            fds[nfds].fd = hdl->generic.fds[j];
+            fds[nfds].events = pollev|POLLHUP|POLLERR;
+            fds[nfds].revents = 0;
+            idx[nfds] = i;
+            off[nfds] = j;
+            nfds++;
+        }
+
+        if (ret_events[i])
+            nready++;
+    }
+
+    if (!nfds && !nready)
+        return -PAL_ERROR_TRYAGAIN;
+
+    if (nfds) {
+        struct timespec timeout_ts;
+
+        /* don't block if some handles are already known to be ready */
+        if (nready)
+            timeout = 0;
+
+        if (timeout >= 0) {
+            long sec = (unsigned long) timeout / 1000000;
+            long microsec = (unsigned long) timeout - (sec * 1000000);
+            timeout_ts.tv_sec = sec;
+            timeout_ts.tv_nsec = microsec * 1000;
+        }
+
+        ret = INLINE_SYSCALL(ppoll, 5, fds, nfds,
+                             timeout >= 0 ? &timeout_ts : NULL,
+                             NULL, 0);
+
+        if (IS_ERR(ret))
+            switch (ERRNO(ret)) {
+                case EINTR:
+                case ERESTART:
+                    if (nready)
+                        break;
+                    return -PAL_ERROR_INTERRUPTED;
+                default:
+                    return unix_to_pal_error(ERRNO(ret));
+            }
+
+        for (i = 0 ; !IS_ERR(ret) && i < nfds ; i++) {
+            if (!fds[i].revents)
+                continue;
+
+            PAL_HANDLE hdl = handleArray[idx[i]];
+            PAL_FLG polled = 0;
+
+            if (fds[i].revents & POLLIN)
+                polled |= PAL_WAIT_READ;
+            if (fds[i].revents & POLLOUT) {
+                HANDLE_HDR(hdl)->flags |= WRITEABLE(off[i]);
+                polled |= PAL_WAIT_WRITE;
+            }
+            if (fds[i].revents & (POLLHUP|POLLERR)) {
+                HANDLE_HDR(hdl)->flags |= ERROR(off[i]);
+                polled |= PAL_WAIT_ERROR;
+            }
+
+            if (polled && !ret_events[idx[i]])
+                nready++;
+            ret_events[idx[i]] |= polled;
+        }
+    }
+
+    return nready ? 0 : -PAL_ERROR_TRYAGAIN;
+}
+
 /* _DkObjectsWaitAny for internal use. The function wait for any of the handle
    in the handle array. timeout can be set for the wait. */
 int _DkObjectsWaitAny (int count, PAL_HANDLE * handleArray, uint64_t timeout,
@@ -261,6 +395,323 @@ int _DkObjectsWaitAny (int count, PAL_HANDLE * handleArray, uint64_t timeout,
     return polled_hdl ? 0 : -PAL_ERROR_TRYAGAIN;
 }
 
+/*
+ * Wait sets are backed by a host epoll instance. Each fd of a registered
+ * handle is added to the epoll instance, tagged with the pointer of the
+ * wait entry and the index of the fd (in the low bits), so the ready
+ * handles are found without scanning the registered ones.
+ *
+ * A removed entry may still be returned by a concurrent epoll_wait, so it
+ * is only freed when no thread is waiting on the wait set.
+ */
+struct pal_wait_entry {
+    PAL_HANDLE handle;              /* NULL once removed */
+    void * data;
+    int events;
+    int nfds;
+    struct pal_wait_entry * next;
+};
+
+#define WAIT_ENTRY_FD_MASK      (3)
+
+static unsigned int wait_entry_epoll_events (PAL_HANDLE handle, int events,
+                                             int fd)
+{
+    unsigned int epoll_events = POLLERR|POLLHUP;
+
+    if ((HANDLE_HDR(handle)->flags & RFD(fd)) && (events & PAL_WAIT_READ))
+        epoll_events |= POLLIN;
+    if ((HANDLE_HDR(handle)->flags & WFD(fd)) && (events & PAL_WAIT_WRITE))
+        epoll_events |= POLLOUT;
+    if (events & PAL_WAIT_EDGE)
+        epoll_events |= EPOLLET;
+
+    return epoll_events;
+}
+
+static int wait_entry_ctl (PAL_HANDLE waitset, struct pal_wait_entry * entry,
+                           int op)
+{
+    PAL_HANDLE handle = entry->handle;
+    int i, ret = 0;
+
+    for (i = 0 ; i < MAX_FDS ; i++) {
+        if (!(HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i))) ||
+            handle->generic.fds[i] == PAL_IDX_POISON)
+            continue;
+
+        struct epoll_event event;
+        event.events = wait_entry_epoll_events(handle, entry->events, i);
+        event.data = (__u64) entry | i;
+
+        ret = INLINE_SYSCALL(epoll_ctl, 4, waitset->waitset.epfd, op,
+                             handle->generic.fds[i], &event);
+        if (IS_ERR(ret))
+            break;
+    }
+
+    if (!IS_ERR(ret))
+        return 0;
+
+    /* if adding failed, roll back the fds that have been added */
+    if (op == EPOLL_CTL_ADD)
+        while (i--)
+            if ((HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i))) &&
+                handle->generic.fds[i] != PAL_IDX_POISON)
+                INLINE_SYSCALL(epoll_ctl, 4, waitset->waitset.epfd,
+                               EPOLL_CTL_DEL, handle->generic.fds[i], NULL);
+
+    return ERRNO(ret) == EPERM ? -PAL_ERROR_NOTSUPPORT :
+           unix_to_pal_error(ERRNO(ret));
+}
+
+static struct pal_wait_entry *
+__lookup_wait_entry (PAL_HANDLE waitset, PAL_HANDLE handle)
+{
+    struct pal_wait_entry * entry = waitset->waitset.entries;
+
+    for (; entry ; entry = entry->next)
+        if (entry->handle == handle)
+            return entry;
+
+    return NULL;
+}
+
+static void __free_wait_entries (struct pal_wait_entry * entry)
+{
+    while (entry) {
+        struct pal_wait_entry * next = entry->next;
+        free(entry);
+        entry = next;
+    }
+}
+
+int _DkWaitSetCreate (PAL_HANDLE * waitset)
+{
+    int fd = INLINE_SYSCALL(epoll_create1, 1, EPOLL_CLOEXEC);
+
+    if (IS_ERR(fd))
+        return unix_to_pal_error(ERRNO(fd));
+
+    PAL_HANDLE ws = malloc(HANDLE_SIZE(waitset));
+    if (!ws) {
+        INLINE_SYSCALL(close, 1, fd);
+        return -PAL_ERROR_NOMEM;
+    }
+
+    SET_HANDLE_TYPE(ws, waitset);
+    ws->waitset.epfd = fd;
+    ws->waitset.lock.locked = 0;
+    atomic_set(&ws->waitset.lock.nwaiters, 0);
+    ws->waitset.entries = NULL;
+    ws->waitset.dead = NULL;
+    ws->waitset.nwaiters = 0;
+    *waitset = ws;
+    return 0;
+}
+
+int _DkWaitSetAdd (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                   void * data)
+{
+    if (!(HANDLE_HDR(handle)->flags & HAS_FDS))
+        return -PAL_ERROR_NOTSUPPORT;
+
+    struct pal_wait_entry * entry = malloc(sizeof(struct pal_wait_entry));
+    if (!entry)
+        return -PAL_ERROR_NOMEM;
+
+    entry->handle = handle;
+    entry->data = data;
+    entry->events = events;
+    entry->nfds = 0;
+
+    for (int i = 0 ; i < MAX_FDS ; i++)
+        if ((HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i))) &&
+            handle->generic.fds[i] != PAL_IDX_POISON)
+            entry->nfds++;
+
+    _DkInternalLock(&waitset->waitset.lock);
+
+    int ret = -PAL_ERROR_STREAMEXIST;
+    if (__lookup_wait_entry(waitset, handle))
+        goto out;
+
+    ret = wait_entry_ctl(waitset, entry, EPOLL_CTL_ADD);
+    if (ret < 0)
+        goto out;
+
+    entry->next = waitset->waitset.entries;
+    waitset->waitset.entries = entry;
+    entry = NULL;
+out:
+    _DkInternalUnlock(&waitset->waitset.lock);
+    if (entry)
+        free(entry);
+    return ret;
+}
+
+int _DkWaitSetModify (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                      void * data)
+{
+    _DkInternalLock(&waitset->waitset.lock);
+
+    struct pal_wait_entry * entry = __lookup_wait_entry(waitset, handle);
+    int ret = -PAL_ERROR_STREAMNOTEXIST;
+
+    if (entry) {
+        entry->events = events;
+        entry->data = data;
+        ret = wait_entry_ctl(waitset, entry, EPOLL_CTL_MOD);
+    }
+
+    _DkInternalUnlock(&waitset->waitset.lock);
+    return ret;
+}
+
+int _DkWaitSetRemove (PAL_HANDLE waitset, PAL_HANDLE handle)
+{
+    _DkInternalLock(&waitset->waitset.lock);
+
+    struct pal_wait_entry ** prev = &waitset->waitset.entries;
+    struct pal_wait_entry * entry = *prev;
+
+    for (; entry ; prev = &entry->next, entry = *prev)
+        if (entry->handle == handle)
+            break;
+
+    if (!entry) {
+        _DkInternalUnlock(&waitset->waitset.lock);
+        return -PAL_ERROR_STREAMNOTEXIST;
+    }
+
+    *prev = entry->next;
+
+    for (int i = 0 ; i < MAX_FDS ; i++)
+        if ((HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i))) &&
+            handle->generic.fds[i] != PAL_IDX_POISON)
+            INLINE_SYSCALL(epoll_ctl, 4, waitset->waitset.epfd,
+                           EPOLL_CTL_DEL, handle->generic.fds[i], NULL);
+
+    entry->handle = NULL;
+
+    if (waitset->waitset.nwaiters) {
+        entry->next = waitset->waitset.dead;
+        waitset->waitset.dead = entry;
+        entry = NULL;
+    }
+
+    _DkInternalUnlock(&waitset->waitset.lock);
+
+    if (entry)
+        free(entry);
+    return 0;
+}
+
+int _DkWaitSetWait (PAL_HANDLE waitset, int count, void ** data,
+                    PAL_FLG * events, uint64_t timeout)
+{
+    struct epoll_event * epoll_events =
+                __alloca(sizeof(struct epoll_event) * count);
+    struct pal_wait_entry ** entries =
+                __alloca(sizeof(struct pal_wait_entry *) * count);
+    int timeout_ms = -1;
+    int ret, nready = 0;
+
+    /* round up, so the wait never times out too early */
+    if (timeout != (uint64_t) -1)
+        timeout_ms = timeout > (uint64_t) 0x7fffffff * 1000 ?
+                     0x7fffffff : (timeout + 999) / 1000;
+
+retry:
+    _DkInternalLock(&waitset->waitset.lock);
+    waitset->waitset.nwaiters++;
+    _DkInternalUnlock(&waitset->waitset.lock);
+
+    ret = INLINE_SYSCALL(epoll_wait, 4, waitset->waitset.epfd, epoll_events,
+                         count, timeout_ms);
+
+    _DkInternalLock(&waitset->waitset.lock);
+
+    for (int i = 0 ; !IS_ERR(ret) && i < ret ; i++) {
+        struct pal_wait_entry * entry = (struct pal_wait_entry *)
+                (epoll_events[i].data & ~WAIT_ENTRY_FD_MASK);
+        int fd = epoll_events[i].data & WAIT_ENTRY_FD_MASK;
+        PAL_HANDLE handle = entry->handle;
+        PAL_FLG polled = 0;
+        int j = nready;
+
+        /* skip the handles removed during the wait */
+        if (!handle)
+            continue;
+
+        if (epoll_events[i].events & POLLIN)
+            polled |= PAL_WAIT_READ;
+        if (epoll_events[i].events & POLLOUT) {
+            HANDLE_HDR(handle)->flags |= WRITEABLE(fd);
+            polled |= PAL_WAIT_WRITE;
+        }
+        if (epoll_events[i].events & (POLLERR|POLLHUP)) {
+            HANDLE_HDR(handle)->flags |= ERROR(fd);
+            polled |= PAL_WAIT_ERROR;
+        }
+
+        /* a handle with multiple fds is reported only once */
+        if (entry->nfds > 1)
+            for (j = 0 ; j < nready ; j++)
+                if (entries[j] == entry)
+                    break;
+
+        if (j == nready) {
+            entries[nready] = entry;
+            data[nready] = entry->data;
+            events[nready] = 0;
+            nready++;
+        }
+
+        events[j] |= polled;
+    }
+
+    if (!--waitset->waitset.nwaiters && waitset->waitset.dead) {
+        __free_wait_entries(waitset->waitset.dead);
+        waitset->waitset.dead = NULL;
+    }
+
+    _DkInternalUnlock(&waitset->waitset.lock);
+
+    if (IS_ERR(ret))
+        switch (ERRNO(ret)) {
+            case EINTR:
+            case ERESTART:
+                return -PAL_ERROR_INTERRUPTED;
+            default:
+                return unix_to_pal_error(ERRNO(ret));
+        }
+
+    if (!nready) {
+        /* all the ready handles were removed; keep waiting if the wait
+           cannot time out */
+        if (ret && timeout_ms == -1)
+            goto retry;
+        return -PAL_ERROR_TRYAGAIN;
+    }
+
+    return nready;
+}
+
+static int waitset_close (PAL_HANDLE handle)
+{
+    INLINE_SYSCALL(close, 1, handle->waitset.epfd);
+    __free_wait_entries(handle->waitset.entries);
+    __free_wait_entries(handle->waitset.dead);
+    handle->waitset.entries = NULL;
+    handle->waitset.dead = NULL;
+    return 0;
+}
+
+struct handle_ops waitset_ops = {
+        .close              = &waitset_close,
+    };
+
 #if TRACE_HEAP_LEAK == 1
 
 PAL_HANDLE heap_alloc_head;
@@ -42,11 +42,18 @@ typedef __kernel_pid_t pid_t;
 #include <sys/socket.h>
 #include <linux/un.h>
 #include <asm/errno.h>
+#include <linux/futex.h>
+#include <limits.h>
+#include <atomic.h>
 
 #if USE_PIPE_SYSCALL == 1
 # include <linux/msg.h>
 #endif
 
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 0x0001U
+#endif
+
 static int pipe_path (int pipeid, char * path, int len)
 {
     /* use abstract UNIX sockets for pipes */
@@ -65,6 +72,512 @@ static int pipe_addr (int pipeid, struct sockaddr_un * addr)
     return pipe_path(pipeid, (char *) addr->sun_path, sizeof(addr->sun_path));
 }
 
+/*
+ * Shared-memory ring transport. If the manifest sets
+ * "loader.pipe_transport = shm", the client of a pipe connection creates a
+ * memfd holding one single-producer, single-consumer ring per direction,
+ * and passes it to the server right after connecting. The data then moves
+ * through the rings, and the socket only carries doorbells: a byte is
+ * queued on the socket when a ring turns from empty to non-empty, and the
+ * reader takes it back once it has drained the ring. The socket is thus
+ * readable exactly when the ring is (or when the peer is gone), so the
+ * handle can still be polled, and no syscall is made while the reader is
+ * busy. A writer finding the ring full sleeps on a futex in the ring, which
+ * the reader only wakes if the writer is waiting.
+ */
+#define PIPE_RING_SIZE          (64 * 1024)
+#define PIPE_RING_HDR_SIZE      (4096)
+#define PIPE_RING_MAP_SIZE      (PIPE_RING_HDR_SIZE + PIPE_RING_SIZE * 2)
+#define PIPE_RING_WAIT_TIMEOUT  (1)     /* seconds */
+
+struct pipe_ring {
+    PAL_LOCK lock;              /* protects the indices and flags below */
+    PAL_LOCK rd_lock;           /* serializes the readers */
+    PAL_LOCK wr_lock;           /* serializes the writers */
+    volatile unsigned int head, tail;
+    volatile PAL_BOL bell;      /* a doorbell is queued on the socket */
+    volatile PAL_BOL writer_waiting;
+    struct atomic_int space;    /* bumped when a waiting writer gets space */
+} __attribute__((aligned(64)));
+
+enum { PIPE_TRANSPORT_UNKNOWN = 0, PIPE_TRANSPORT_SOCKET,
+       PIPE_TRANSPORT_SHM };
+
+static int pipe_transport = PIPE_TRANSPORT_UNKNOWN;
+
+static bool pipe_ring_enabled (void)
+{
+    if (pipe_transport == PIPE_TRANSPORT_UNKNOWN) {
+        char cfgbuf[CONFIG_MAX];
+        int transport = PIPE_TRANSPORT_SOCKET;
+
+        if (pal_state.root_config &&
+            get_config(pal_state.root_config, "loader.pipe_transport",
+                       cfgbuf, CONFIG_MAX) > 0 &&
+            strcmp_static(cfgbuf, "shm"))
+            transport = PIPE_TRANSPORT_SHM;
+
+        pipe_transport = transport;
+    }
+
+    return pipe_transport == PIPE_TRANSPORT_SHM;
+}
+
+static inline bool pipe_has_ring (PAL_HANDLE handle)
+{
+    return !IS_HANDLE_TYPE(handle, pipeprv) && handle->pipe.ring;
+}
+
+/* the ring written by this end is indexed by ringside, the ring read by
+   this end by the other side */
+static inline struct pipe_ring * pipe_ring (PAL_HANDLE handle, bool tx)
+{
+    int idx = tx ? handle->pipe.ringside : 1 - handle->pipe.ringside;
+    return (struct pipe_ring *) handle->pipe.ring + idx;
+}
+
+static inline char * pipe_ring_buf (PAL_HANDLE handle, bool tx)
+{
+    int idx = tx ? handle->pipe.ringside : 1 - handle->pipe.ringside;
+    return (char *) handle->pipe.ring + PIPE_RING_HDR_SIZE +
+           idx * PIPE_RING_SIZE;
+}
+
+static int pipe_ring_map (int ringfd, void ** ring)
+{
+    void * addr = (void *) ARCH_MMAP(NULL, PIPE_RING_MAP_SIZE,
+                                     PROT_READ|PROT_WRITE, MAP_SHARED,
+                                     ringfd, 0);
+
+    if (IS_ERR_P(addr))
+        return unix_to_pal_error(ERRNO_P(addr));
+
+    *ring = addr;
+    return 0;
+}
+
+/* Called by the client right after connecting: create the rings and pass
+   them to the server. If the rings cannot be created, the server is told
+   to keep using the socket. */
+static int pipe_ring_create (PAL_HANDLE handle)
+{
+    void * ring = NULL;
+    int ret;
+
+    int ringfd = INLINE_SYSCALL(memfd_create, 2, "graphene-pipe",
+                                MFD_CLOEXEC);
+
+    if (!IS_ERR(ringfd)) {
+        ret = INLINE_SYSCALL(ftruncate, 2, ringfd, PIPE_RING_MAP_SIZE);
+        if (IS_ERR(ret) || pipe_ring_map(ringfd, &ring) < 0) {
+            INLINE_SYSCALL(close, 1, ringfd);
+            ring = NULL;
+        }
+    }
+
+    struct msghdr hdr;
+    struct iovec iov;
+    char cbuf[sizeof(struct cmsghdr) + sizeof(int)];
+    char b = 0;
+
+    memset(&hdr, 0, sizeof(struct msghdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+
+    if (ring) {
+        hdr.msg_control = cbuf;
+        hdr.msg_controllen = sizeof(cbuf);
+
+        struct cmsghdr * chdr = CMSG_FIRSTHDR(&hdr);
+        chdr->cmsg_level = SOL_SOCKET;
+        chdr->cmsg_type = SCM_RIGHTS;
+        chdr->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(chdr), &ringfd, sizeof(int));
+    }
+
+    ret = INLINE_SYSCALL(sendmsg, 3, handle->pipe.fd, &hdr, MSG_NOSIGNAL);
+
+    if (IS_ERR(ret)) {
+        if (ring) {
+            INLINE_SYSCALL(munmap, 2, ring, PIPE_RING_MAP_SIZE);
+            INLINE_SYSCALL(close, 1, ringfd);
+        }
+        return -PAL_ERROR_DENIED;
+    }
+
+    if (ring) {
+        HANDLE_HDR(handle)->flags |= PASSFD(1);
+        handle->pipe.ringfd = ringfd;
+        handle->pipe.ring = ring;
+        handle->pipe.ringside = 0;
+    }
+
+    return 0;
+}
+
+/* Called by the server right after accepting: receive the rings created
+   by the client, if any. */
+static int pipe_ring_accept (PAL_HANDLE handle)
+{
+    struct msghdr hdr;
+    struct iovec iov;
+    char cbuf[sizeof(struct cmsghdr) + sizeof(int)];
+    char b;
+    int ret;
+
+    memset(&hdr, 0, sizeof(struct msghdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    hdr.msg_control = cbuf;
+    hdr.msg_controllen = sizeof(cbuf);
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+
+    do {
+        ret = INLINE_SYSCALL(recvmsg, 3, handle->pipe.fd, &hdr,
+                             MSG_CMSG_CLOEXEC);
+    } while (IS_ERR(ret) && ERRNO(ret) == EINTR);
+
+    if (IS_ERR(ret) || !ret)
+        return -PAL_ERROR_CONNFAILED;
+
+    struct cmsghdr * chdr = CMSG_FIRSTHDR(&hdr);
+    if (!chdr || chdr->cmsg_type != SCM_RIGHTS)
+        return 0;
+
+    int ringfd;
+    void * ring = NULL;
+    memcpy(&ringfd, CMSG_DATA(chdr), sizeof(int));
+
+    if ((ret = pipe_ring_map(ringfd, &ring)) < 0) {
+        INLINE_SYSCALL(close, 1, ringfd);
+        return ret;
+    }
+
+    HANDLE_HDR(handle)->flags |= PASSFD(1);
+    handle->pipe.ringfd = ringfd;
+    handle->pipe.ring = ring;
+    handle->pipe.ringside = 1;
+    return 0;
+}
+
+int pipe_ring_attach (PAL_HANDLE handle)
+{
+    void * ring = NULL;
+    int ret;
+
+    /* the pointer is the one of the sender */
+    handle->pipe.ring = NULL;
+
+    if (!(HANDLE_HDR(handle)->flags & PASSFD(1)))
+        return -PAL_ERROR_BADHANDLE;
+
+    if ((ret = pipe_ring_map(handle->pipe.ringfd, &ring)) < 0)
+        return ret;
+
+    handle->pipe.ring = ring;
+    return 0;
+}
+
+/* copy len bytes between the ring buffer, from the index pos, and the I/O
+   vector, from the byte offset skip */
+static void pipe_ring_copy (char * buf, unsigned int pos,
+                            const PAL_IOVEC * iov, int iovcnt, uint64_t skip,
+                            uint64_t len, bool to_ring)
+{
+    for (int i = 0 ; i < iovcnt && len ; i++) {
+        if (skip >= iov[i].size) {
+            skip -= iov[i].size;
+            continue;
+        }
+
+        char * base = (char *) iov[i].base + skip;
+        uint64_t count = iov[i].size - skip;
+        if (count > len)
+            count = len;
+        skip = 0;
+        len -= count;
+
+        while (count) {
+            unsigned int off = pos % PIPE_RING_SIZE;
+            unsigned int chunk = PIPE_RING_SIZE - off;
+            if (chunk > count)
+                chunk = count;
+
+            if (to_ring)
+                memcpy(buf + off, base, chunk);
+            else
+                memcpy(base, buf + off, chunk);
+
+            base += chunk;
+            pos += chunk;
+            count -= chunk;
+        }
+    }
+}
+
+static int pipe_ring_bell (int fd)
+{
+    struct msghdr hdr;
+    struct iovec iov;
+    char b = 0;
+    int ret;
+
+    memset(&hdr, 0, sizeof(struct msghdr));
+    hdr.msg_iov = &iov;
+    hdr.msg_iovlen = 1;
+    iov.iov_base = &b;
+    iov.iov_len = 1;
+
+    do {
+        ret = INLINE_SYSCALL(sendmsg, 3, fd, &hdr, MSG_NOSIGNAL);
+    } while (IS_ERR(ret) && ERRNO(ret) == EINTR);
+
+    return IS_ERR(ret) ? unix_to_pal_error(ERRNO(ret)) : 0;
+}
+
+/* Take back the doorbell once the ring is drained. The writer queues it
+   right after publishing the data, so it may still be on its way. */
+static void pipe_ring_drain (int fd)
+{
+    char b;
+
+    while (true) {
+        int ret = INLINE_SYSCALL(read, 3, fd, &b, 1);
+
+        if (!IS_ERR(ret))
+            return;
+
+        if (ERRNO(ret) == EAGAIN) {
+            struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+            INLINE_SYSCALL(ppoll, 5, &pfd, 1, NULL, NULL, 0);
+            continue;
+        }
+
+        if (ERRNO(ret) != EINTR && ERRNO(ret) != ERESTART)
+            return;
+    }
+}
+
+/* Wait until the reader frees some space. A reader exiting may not wake
+   us up, so the wait times out to check if the peer is still there. */
+static int pipe_ring_wait_space (PAL_HANDLE handle, struct pipe_ring * ring)
+{
+    struct pollfd pfd = { .fd = handle->pipe.fd, .events = 0, .revents = 0 };
+    struct timespec tp = { 0, 0 };
+    int ret = INLINE_SYSCALL(ppoll, 5, &pfd, 1, &tp, NULL, 0);
+
+    if (ret == 1 && (pfd.revents & (POLLHUP|POLLERR)))
+        return unix_to_pal_error(EPIPE);
+
+    _DkMutexLock(&ring->lock);
+
+    if (ring->tail - ring->head < PIPE_RING_SIZE) {
+        _DkMutexUnlock(&ring->lock);
+        return 0;
+    }
+
+    ring->writer_waiting = true;
+    int64_t space = atomic_read(&ring->space);
+    _DkMutexUnlock(&ring->lock);
+
+    struct timespec waittime = { PIPE_RING_WAIT_TIMEOUT, 0 };
+    ret = INLINE_SYSCALL(futex, 6, &ring->space, FUTEX_WAIT, space,
+                         &waittime, NULL, 0);
+
+    if (IS_ERR(ret))
+        switch (ERRNO(ret)) {
+            case EWOULDBLOCK:
+            case ETIMEDOUT:
+                break;
+            case EINTR:
+            case ERESTART:
+                return -PAL_ERROR_INTERRUPTED;
+            default:
+                return unix_to_pal_error(ERRNO(ret));
+        }
+
+    return 0;
+}
+
+/* with ring->lock held: check if a writer is waiting for space, and if
+   so, let it pass its futex wait; the caller then wakes it up */
+static inline bool __pipe_ring_writer_waiting (struct pipe_ring * ring)
+{
+    if (!ring->writer_waiting)
+        return false;
+
+    ring->writer_waiting = false;
+    atomic_inc(&ring->space);
+    return true;
+}
+
+static inline void pipe_ring_wake_writer (struct pipe_ring * ring)
+{
+    INLINE_SYSCALL(futex, 6, &ring->space, FUTEX_WAKE, INT_MAX,
+                   NULL, NULL, 0);
+}
+
+/* A blocking write waits until the whole vector is in the ring; a
+   nonblocking one only writes what fits. */
+static int64_t pipe_ring_write (PAL_HANDLE handle, int iovcnt,
+                                const PAL_IOVEC * iov)
+{
+    struct pipe_ring * ring = pipe_ring(handle, true);
+    char * buf = pipe_ring_buf(handle, true);
+    uint64_t total = 0, written = 0;
+    int64_t ret = 0;
+
+    for (int i = 0 ; i < iovcnt ; i++)
+        total += iov[i].size;
+
+    _DkMutexLock(&ring->wr_lock);
+
+    while (written < total) {
+        unsigned int tail = ring->tail;
+        unsigned int space = PIPE_RING_SIZE - (tail - ring->head);
+
+        if (!space) {
+            if (written)
+                break;
+
+            if (handle->pipe.nonblocking) {
+                ret = -PAL_ERROR_TRYAGAIN;
+                break;
+            }
+
+            if ((ret = pipe_ring_wait_space(handle, ring)) < 0)
+                break;
+
+            continue;
+        }
+
+        if (space > total - written)
+            space = total - written;
+
+        pipe_ring_copy(buf, tail, iov, iovcnt, written, space, true);
+        wmb();
+
+        _DkMutexLock(&ring->lock);
+        ring->tail = tail + space;
+        bool bell = !ring->bell;
+        ring->bell = true;
+        _DkMutexUnlock(&ring->lock);
+
+        written += space;
+
+        if (bell && (ret = pipe_ring_bell(handle->pipe.fd)) < 0)
+            break;
+    }
+
+    _DkMutexUnlock(&ring->wr_lock);
+    return written ? (int64_t) written : ret;
+}
+
+/* The ring is empty, so no doorbell is queued: the socket only turns
+   readable once the writer rings, or once the writer is gone. */
+static int pipe_ring_wait_data (PAL_HANDLE handle, bool * polled)
+{
+    int fd = handle->pipe.fd;
+    int ret;
+
+    if (handle->pipe.nonblocking || *polled) {
+        struct msghdr hdr;
+        struct iovec iov;
+        char b;
+
+        memset(&hdr, 0, sizeof(struct msghdr));
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        iov.iov_base = &b;
+        iov.iov_len = 1;
+
+        ret = INLINE_SYSCALL(recvmsg, 3, fd, &hdr, MSG_PEEK|MSG_DONTWAIT);
+
+        if (!IS_ERR(ret))
+            return ret ? 0 : -PAL_ERROR_ENDOFSTREAM;
+
+        if (ERRNO(ret) != EAGAIN)
+            return unix_to_pal_error(ERRNO(ret));
+
+        if (handle->pipe.nonblocking)
+            return -PAL_ERROR_TRYAGAIN;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN, .revents = 0 };
+    ret = INLINE_SYSCALL(ppoll, 5, &pfd, 1, NULL, NULL, 0);
+
+    if (IS_ERR(ret))
+        switch (ERRNO(ret)) {
+            case EINTR:
+            case ERESTART:
+                return -PAL_ERROR_INTERRUPTED;
+            default:
+                return unix_to_pal_error(ERRNO(ret));
+        }
+
+    *polled = true;
+    return 0;
+}
+
+static int64_t pipe_ring_read (PAL_HANDLE handle, int iovcnt,
+                               const PAL_IOVEC * iov)
+{
+    struct pipe_ring * ring = pipe_ring(handle, false);
+    char * buf = pipe_ring_buf(handle, false);
+    uint64_t total = 0;
+    bool polled = false;
+    int64_t ret;
+
+    for (int i = 0 ; i < iovcnt ; i++)
+        total += iov[i].size;
+
+    if (!total)
+        return 0;
+
+    _DkMutexLock(&ring->rd_lock);
+
+    while (true) {
+        unsigned int head = ring->head;
+        unsigned int avail = ring->tail - head;
+
+        if (!avail) {
+            if ((ret = pipe_ring_wait_data(handle, &polled)) < 0)
+                break;
+            continue;
+        }
+
+        if (avail > total)
+            avail = total;
+
+        rmb();
+        pipe_ring_copy(buf, head, iov, iovcnt, 0, avail, false);
+        mb();
+
+        _DkMutexLock(&ring->lock);
+        ring->head = head + avail;
+        bool drain = ring->bell && ring->head == ring->tail;
+        if (drain)
+            ring->bell = false;
+        bool wake = __pipe_ring_writer_waiting(ring);
+        _DkMutexUnlock(&ring->lock);
+
+        if (wake)
+            pipe_ring_wake_writer(ring);
+
+        if (drain)
+            pipe_ring_drain(handle->pipe.fd);
+
+        ret = avail;
+        break;
+    }
+
+    _DkMutexUnlock(&ring->rd_lock);
+    return ret;
+}
+
 static int pipe_listen (PAL_HANDLE * handle, PAL_NUM pipeid, int options)
 {
     int ret, fd;
@@ -102,9 +615,12 @@ static int pipe_listen (PAL_HANDLE * handle, PAL_NUM pipeid, int options)
     SET_HANDLE_TYPE(hdl, pipesrv);
     HANDLE_HDR(hdl)->flags |= RFD(0);
     hdl->pipe.fd = fd;
+    hdl->pipe.ringfd = PAL_IDX_POISON;
     hdl->pipe.pipeid = pipeid;
     hdl->pipe.nonblocking = options & PAL_OPTION_NONBLOCK ?
                             PAL_TRUE : PAL_FALSE;
+    hdl->pipe.ring = NULL;
+    hdl->pipe.ringside = 0;
     *handle = hdl;
     return 0;
 }
@@ -168,8 +684,21 @@ static int pipe_waitforclient (PAL_HANDLE handle, PAL_HANDLE * client)
     SET_HANDLE_TYPE(clnt, pipecli);
     HANDLE_HDR(clnt)->flags |= RFD(0)|WFD(0)|WRITEABLE(0);
     clnt->pipe.fd = newfd;
+    clnt->pipe.ringfd = PAL_IDX_POISON;
     clnt->pipe.pipeid = handle->pipe.pipeid;
     clnt->pipe.nonblocking = PAL_FALSE;
+    clnt->pipe.ring = NULL;
+    clnt->pipe.ringside = 0;
+
+    if (pipe_ring_enabled()) {
+        int ret = pipe_ring_accept(clnt);
+        if (ret < 0) {
+            INLINE_SYSCALL(close, 1, newfd);
+            free(clnt);
+            return ret;
+        }
+    }
+
     *client = clnt;
 #endif
 
@@ -261,9 +790,18 @@ static int pipe_connect (PAL_HANDLE * handle, PAL_NUM pipeid, int options)
     SET_HANDLE_TYPE(hdl, pipe);
     HANDLE_HDR(hdl)->flags |= RFD(0)|WFD(0)|WRITEABLE(0);
     hdl->pipe.fd = fd;
+    hdl->pipe.ringfd = PAL_IDX_POISON;
     hdl->pipe.pipeid = pipeid;
     hdl->pipe.nonblocking = (options & PAL_OPTION_NONBLOCK) ?
                             PAL_TRUE : PAL_FALSE;
+    hdl->pipe.ring = NULL;
+    hdl->pipe.ringside = 0;
+
+    if (pipe_ring_enabled() && (ret = pipe_ring_create(hdl)) < 0) {
+        INLINE_SYSCALL(close, 1, fd);
+        free(hdl);
+        return ret;
+    }
 #endif
     *handle = hdl;
 
@@ -330,6 +868,11 @@ static int64_t pipe_read (PAL_HANDLE handle, uint64_t offset, uint64_t len,
         !IS_HANDLE_TYPE(handle, pipe))
         return -PAL_ERROR_NOTCONNECTION;
 
+    if (pipe_has_ring(handle)) {
+        PAL_IOVEC iov = { .base = buffer, .size = len };
+        return pipe_ring_read(handle, 1, &iov);
+    }
+
     int fd = IS_HANDLE_TYPE(handle, pipeprv) ? handle->pipeprv.fds[0] :
              handle->pipe.fd;
     int64_t bytes = 0;
@@ -383,6 +926,12 @@ static int64_t pipe_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
              handle->pipe.fd;
     int64_t bytes = 0;
 
+    if (pipe_has_ring(handle)) {
+        PAL_IOVEC iov = { .base = (void *) buffer, .size = len };
+        bytes = pipe_ring_write(handle, 1, &iov);
+        goto out;
+    }
+
 #if USE_PIPE_SYSCALL == 1
     if (IS_HANDLE_TYPE(handle, pipeprv)) {
         bytes = INLINE_SYSCALL(write, 3, fd, buffer, len);
@@ -410,12 +959,121 @@ static int64_t pipe_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     }
 #endif
 
+    if (IS_ERR(bytes))
+        bytes = unix_to_pal_error(ERRNO(bytes));
+
+out:;
     PAL_FLG writeable = IS_HANDLE_TYPE(handle, pipeprv) ? WRITEABLE(1) :
                         WRITEABLE(0);
 
+    if (bytes == len)
+        HANDLE_HDR(handle)->flags |= writeable;
+    else
+        HANDLE_HDR(handle)->flags &= ~writeable;
+
+    return bytes;
+}
+
+/* 'readv' operation of pipe stream. The pipe is a UNIX socket, so the
+   vector is received with a single recvmsg. */
+static int64_t pipe_readv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                           const PAL_IOVEC * iov, char * addr, int addrlen)
+{
+    if (!IS_HANDLE_TYPE(handle, pipecli) &&
+        !IS_HANDLE_TYPE(handle, pipeprv) &&
+        !IS_HANDLE_TYPE(handle, pipe))
+        return -PAL_ERROR_NOTCONNECTION;
+
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    if (pipe_has_ring(handle))
+        return pipe_ring_read(handle, iovcnt, iov);
+
+    int fd = IS_HANDLE_TYPE(handle, pipeprv) ? handle->pipeprv.fds[0] :
+             handle->pipe.fd;
+    int64_t bytes = 0;
+
+#if USE_PIPE_SYSCALL == 1
+    if (IS_HANDLE_TYPE(handle, pipeprv)) {
+        bytes = INLINE_SYSCALL(readv, 3, fd, iov, iovcnt);
+    } else {
+#endif
+        struct msghdr hdr;
+        hdr.msg_name = NULL;
+        hdr.msg_namelen = 0;
+        hdr.msg_iov = (struct iovec *) iov;
+        hdr.msg_iovlen = iovcnt;
+        hdr.msg_control = NULL;
+        hdr.msg_controllen = 0;
+        hdr.msg_flags = 0;
+
+        bytes = INLINE_SYSCALL(recvmsg, 3, fd, &hdr, 0);
+#if USE_PIPE_SYSCALL == 1
+    }
+#endif
+
     if (IS_ERR(bytes))
         bytes = unix_to_pal_error(ERRNO(bytes));
 
+    if (!bytes)
+        return -PAL_ERROR_ENDOFSTREAM;
+
+    return bytes;
+}
+
+/* 'writev' operation of pipe stream. */
+static int64_t pipe_writev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                            const PAL_IOVEC * iov, const char * addr,
+                            int addrlen)
+{
+    if (!IS_HANDLE_TYPE(handle, pipecli) &&
+        !IS_HANDLE_TYPE(handle, pipeprv) &&
+        !IS_HANDLE_TYPE(handle, pipe))
+        return -PAL_ERROR_NOTCONNECTION;
+
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
+    int fd = IS_HANDLE_TYPE(handle, pipeprv) ? handle->pipeprv.fds[1] :
+             handle->pipe.fd;
+    int64_t bytes = 0;
+
+    if (pipe_has_ring(handle)) {
+        bytes = pipe_ring_write(handle, iovcnt, iov);
+        goto out;
+    }
+
+#if USE_PIPE_SYSCALL == 1
+    if (IS_HANDLE_TYPE(handle, pipeprv)) {
+        bytes = INLINE_SYSCALL(writev, 3, fd, iov, iovcnt);
+    } else {
+#endif
+        struct msghdr hdr;
+        hdr.msg_name = NULL;
+        hdr.msg_namelen = 0;
+        hdr.msg_iov = (struct iovec *) iov;
+        hdr.msg_iovlen = iovcnt;
+        hdr.msg_control = NULL;
+        hdr.msg_controllen = 0;
+        hdr.msg_flags = 0;
+
+        bytes = INLINE_SYSCALL(sendmsg, 3, fd, &hdr, MSG_NOSIGNAL);
+#if USE_PIPE_SYSCALL == 1
+    }
+#endif
+
+    if (IS_ERR(bytes))
+        bytes = unix_to_pal_error(ERRNO(bytes));
+
+out:;
+    PAL_FLG writeable = IS_HANDLE_TYPE(handle, pipeprv) ? WRITEABLE(1) :
+                        WRITEABLE(0);
+
+    uint64_t len = 0;
+    for (int i = 0 ; i < iovcnt ; i++)
+        len += iov[i].size;
+
     if (bytes == len)
         HANDLE_HDR(handle)->flags |= writeable;
     else
@@ -444,6 +1102,26 @@ static int pipe_close (PAL_HANDLE handle)
         handle->pipe.fd = PAL_IDX_POISON;
     }
 
+    if (handle->pipe.ring) {
+        /* a writer waiting for this end to read rechecks if we are gone */
+        struct pipe_ring * ring = pipe_ring(handle, false);
+        _DkMutexLock(&ring->lock);
+        bool wake = __pipe_ring_writer_waiting(ring);
+        _DkMutexUnlock(&ring->lock);
+
+        if (wake)
+            pipe_ring_wake_writer(ring);
+
+        INLINE_SYSCALL(munmap, 2, handle->pipe.ring, PIPE_RING_MAP_SIZE);
+        handle->pipe.ring = NULL;
+    }
+
+    if ((HANDLE_HDR(handle)->flags & PASSFD(1)) &&
+        handle->pipe.ringfd != PAL_IDX_POISON) {
+        INLINE_SYSCALL(close, 1, handle->pipe.ringfd);
+        handle->pipe.ringfd = PAL_IDX_POISON;
+    }
+
     return 0;
 }
 
@@ -514,6 +1192,29 @@ static int pipe_attrquerybyhdl (PAL_HANDLE handle, PAL_STREAM_ATTR * attr)
         return -PAL_ERROR_BADHANDLE;
 
     attr->handle_type  = PAL_GET_TYPE(handle);
+    attr->disconnected = HANDLE_HDR(handle)->flags & ERROR(0);
+    attr->nonblocking  = IS_HANDLE_TYPE(handle, pipeprv) ?
+                         handle->pipeprv.nonblocking : handle->pipe.nonblocking;
+
+    if (pipe_has_ring(handle)) {
+        struct pipe_ring * rx = pipe_ring(handle, false);
+        struct pipe_ring * tx = pipe_ring(handle, true);
+
+        attr->pending_size = rx->tail - rx->head;
+        attr->writeable    = tx->tail - tx->head < PIPE_RING_SIZE;
+
+        /* with the ring empty, the socket is only readable at the end
+           of the stream */
+        if (attr->pending_size) {
+            attr->readable = PAL_TRUE;
+        } else {
+            struct pollfd pfd = { .fd = handle->pipe.fd, .events = POLLIN, .revents = 0 };
+            struct timespec tp = { 0, 0 };
+            ret = INLINE_SYSCALL(ppoll, 5, &pfd, 1, &tp, NULL, 0);
+            attr->readable = (ret == 1 && (pfd.revents & POLLIN));
+        }
+        return 0;
+    }
 
     if (attr->handle_type != pal_type_pipesrv) {
         ret = INLINE_SYSCALL(ioctl, 3, handle->generic.fds[0], FIONREAD, &val);
@@ -536,10 +1237,6 @@ static int pipe_attrquerybyhdl (PAL_HANDLE handle, PAL_STREAM_ATTR * attr)
     struct timespec tp = { 0, 0 };
     ret = INLINE_SYSCALL(ppoll, 5, &pfd, 1, &tp, NULL, 0);
     attr->readable = (ret == 1 && pfd.revents == POLLIN);
-
-    attr->disconnected = HANDLE_HDR(handle)->flags & ERROR(0);
-    attr->nonblocking  = IS_HANDLE_TYPE(handle, pipeprv) ?
-                         handle->pipeprv.nonblocking : handle->pipe.nonblocking;
     return 0;
 }
 
@@ -616,6 +1313,8 @@ struct handle_ops pipe_ops = {
         .waitforclient      = &pipe_waitforclient,
         .read               = &pipe_read,
         .write              = &pipe_write,
+        .readv              = &pipe_readv,
+        .writev             = &pipe_writev,
         .close              = &pipe_close,
         .delete             = &pipe_delete,
         .attrquerybyhdl     = &pipe_attrquerybyhdl,
@@ -626,6 +1325,8 @@ struct handle_ops pipeprv_ops = {
         .open               = &pipe_open,
         .read               = &pipe_read,
         .write              = &pipe_write,
+        .readv              = &pipe_readv,
+        .writev             = &pipe_writev,
         .close              = &pipe_close,
         .attrquerybyhdl     = &pipe_attrquerybyhdl,
         .attrsetbyhdl       = &pipe_attrsetbyhdl,
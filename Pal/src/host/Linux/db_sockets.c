@@ -574,24 +574,24 @@ static int tcp_open (PAL_HANDLE *handle, const char * type, const char * uri,
     return -PAL_ERROR_NOTSUPPORT;
 }
 
-/* 'read' operation of tcp stream */
-static int64_t tcp_read (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                         void * buf)
+/* 'readv' operation of tcp stream */
+static int64_t tcp_readv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                          const PAL_IOVEC * iov, char * addr, int addrlen)
 {
     if (!IS_HANDLE_TYPE(handle, tcp) || !handle->sock.conn)
         return -PAL_ERROR_NOTCONNECTION;
 
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
     if (handle->sock.fd == PAL_IDX_POISON)
         return -PAL_ERROR_ENDOFSTREAM;
 
     struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = buf;
-    iov.iov_len = len;
     hdr.msg_name = NULL;
     hdr.msg_namelen = 0;
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
+    hdr.msg_iov = (struct iovec *) iov;
+    hdr.msg_iovlen = iovcnt;
     hdr.msg_control = NULL;
     hdr.msg_controllen = 0;
     hdr.msg_flags = 0;
@@ -607,24 +607,33 @@ static int64_t tcp_read (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     return bytes;
 }
 
-/* write' operation of tcp stream */
-static int64_t tcp_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                          const void * buf)
+/* 'read' operation of tcp stream */
+static int64_t tcp_read (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                         void * buf)
+{
+    PAL_IOVEC iov = { .base = buf, .size = len };
+    return tcp_readv(handle, offset, 1, &iov, NULL, 0);
+}
+
+/* 'writev' operation of tcp stream */
+static int64_t tcp_writev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                           const PAL_IOVEC * iov, const char * addr,
+                           int addrlen)
 {
     if (!IS_HANDLE_TYPE(handle, tcp) || !handle->sock.conn)
         return -PAL_ERROR_NOTCONNECTION;
 
+    if (addr)
+        return -PAL_ERROR_NOTSUPPORT;
+
     if (handle->sock.fd == PAL_IDX_POISON)
         return -PAL_ERROR_CONNFAILED;
 
     struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = (void *) buf;
-    iov.iov_len = len;
     hdr.msg_name = NULL;
     hdr.msg_namelen = 0;
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
+    hdr.msg_iov = (struct iovec *) iov;
+    hdr.msg_iovlen = iovcnt;
     hdr.msg_control = NULL;
     hdr.msg_controllen = 0;
     hdr.msg_flags = 0;
@@ -634,6 +643,10 @@ static int64_t tcp_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     if (IS_ERR(bytes))
         bytes = unix_to_pal_error(ERRNO(bytes));
 
+    uint64_t len = 0;
+    for (int i = 0 ; i < iovcnt ; i++)
+        len += iov[i].size;
+
     if (bytes == len)
         HANDLE_HDR(handle)->flags |= WRITEABLE(0);
     else
@@ -642,6 +655,14 @@ static int64_t tcp_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     return bytes;
 }
 
+/* write' operation of tcp stream */
+static int64_t tcp_write (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                          const void * buf)
+{
+    PAL_IOVEC iov = { .base = (void *) buf, .size = len };
+    return tcp_writev(handle, offset, 1, &iov, NULL, 0);
+}
+
 /* used by 'open' operation of tcp stream for bound socket */
 static int udp_bind (PAL_HANDLE * handle, char * uri, int options)
 {
@@ -793,40 +814,17 @@ static int udp_open (PAL_HANDLE *hdl, const char * type, const char * uri,
     return -PAL_ERROR_NOTSUPPORT;
 }
 
-static int64_t udp_receive (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                            void * buf)
+/* 'readv' operation of udp stream. A connected socket (udp) receives
+   from its peer, and a bound socket (udpsrv) returns the address of the
+   sender. */
+static int64_t udp_receivev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                             const PAL_IOVEC * iov, char * addr, int addrlen)
 {
-    if (!IS_HANDLE_TYPE(handle, udp))
+    if (!IS_HANDLE_TYPE(handle, udp) && !IS_HANDLE_TYPE(handle, udpsrv))
         return -PAL_ERROR_NOTCONNECTION;
 
-    if (handle->sock.fd == PAL_IDX_POISON)
-        return -PAL_ERROR_BADHANDLE;
-
-    struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = buf;
-    iov.iov_len = len;
-    hdr.msg_name = NULL;
-    hdr.msg_namelen = 0;
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
-    hdr.msg_control = NULL;
-    hdr.msg_controllen = 0;
-    hdr.msg_flags = 0;
-
-    int64_t bytes = INLINE_SYSCALL(recvmsg, 3, handle->sock.fd, &hdr, 0);
-
-    if (IS_ERR(bytes))
-        return unix_to_pal_error(ERRNO(bytes));
-
-    return bytes;
-}
-
-static int64_t udp_receivebyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                                  void * buf, char * addr, int addrlen)
-{
-    if (!IS_HANDLE_TYPE(handle, udpsrv))
-        return -PAL_ERROR_NOTCONNECTION;
+    if (!addr != IS_HANDLE_TYPE(handle, udp))
+        return -PAL_ERROR_NOTSUPPORT;
 
     if (handle->sock.fd == PAL_IDX_POISON)
         return -PAL_ERROR_BADHANDLE;
@@ -835,13 +833,10 @@ static int64_t udp_receivebyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t l
     socklen_t conn_addrlen = sizeof(struct sockaddr);
 
     struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = buf;
-    iov.iov_len = len;
-    hdr.msg_name = &conn_addr;
-    hdr.msg_namelen = conn_addrlen;
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
+    hdr.msg_name = addr ? &conn_addr : NULL;
+    hdr.msg_namelen = addr ? conn_addrlen : 0;
+    hdr.msg_iov = (struct iovec *) iov;
+    hdr.msg_iovlen = iovcnt;
     hdr.msg_control = NULL;
     hdr.msg_controllen = 0;
     hdr.msg_flags = 0;
@@ -851,6 +846,9 @@ static int64_t udp_receivebyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t l
     if (IS_ERR(bytes))
         return unix_to_pal_error(ERRNO(bytes));
 
+    if (!addr)
+        return bytes;
+
     char * addr_uri = strcpy_static(addr, "udp:", addrlen);
     if (!addr_uri)
         return -PAL_ERROR_OVERFLOW;
@@ -863,73 +861,60 @@ static int64_t udp_receivebyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t l
     return bytes;
 }
 
-static int64_t udp_send (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                         const void * buf)
+static int64_t udp_receive (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                            void * buf)
 {
-    if (!IS_HANDLE_TYPE(handle, udp))
-        return -PAL_ERROR_NOTCONNECTION;
-
-    if (handle->sock.fd == PAL_IDX_POISON)
-        return -PAL_ERROR_BADHANDLE;
-
-    struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = (void *) buf;
-    iov.iov_len = len;
-    hdr.msg_name = (void *) handle->sock.conn;
-    hdr.msg_namelen = addr_size((struct sockaddr *) handle->sock.conn);
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
-    hdr.msg_control = NULL;
-    hdr.msg_controllen = 0;
-    hdr.msg_flags = 0;
-
-    int64_t bytes = INLINE_SYSCALL(sendmsg, 3, handle->sock.fd, &hdr, MSG_NOSIGNAL);
-
-    if (IS_ERR(bytes))
-        bytes = unix_to_pal_error(ERRNO(bytes));
-
-    if (bytes == len)
-        HANDLE_HDR(handle)->flags |= WRITEABLE(0);
-    else
-        HANDLE_HDR(handle)->flags &= ~WRITEABLE(0);
+    PAL_IOVEC iov = { .base = buf, .size = len };
+    return udp_receivev(handle, offset, 1, &iov, NULL, 0);
+}
 
-    return bytes;
+static int64_t udp_receivebyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                                  void * buf, char * addr, int addrlen)
+{
+    PAL_IOVEC iov = { .base = buf, .size = len };
+    return udp_receivev(handle, offset, 1, &iov, addr, addrlen);
 }
 
-static int64_t udp_sendbyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
-                               const void * buf, const char * addr, int addrlen)
+/* 'writev' operation of udp stream. The whole vector is sent as one
+   datagram, either to the peer of a connected socket (udp), or to the
+   given address from a bound socket (udpsrv). */
+static int64_t udp_sendv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                          const PAL_IOVEC * iov, const char * addr,
+                          int addrlen)
 {
-    if (!IS_HANDLE_TYPE(handle, udpsrv))
+    if (!IS_HANDLE_TYPE(handle, udp) && !IS_HANDLE_TYPE(handle, udpsrv))
         return -PAL_ERROR_NOTCONNECTION;
 
+    if (!addr != IS_HANDLE_TYPE(handle, udp))
+        return -PAL_ERROR_NOTSUPPORT;
+
     if (handle->sock.fd == PAL_IDX_POISON)
         return -PAL_ERROR_BADHANDLE;
 
-    if (!strpartcmp_static(addr, "udp:"))
-        return -PAL_ERROR_INVAL;
+    struct sockaddr conn_addr;
+    int conn_addrlen;
 
-    addr    += static_strlen("udp:");
-    addrlen -= static_strlen("udp:");
+    if (addr) {
+        if (!strpartcmp_static(addr, "udp:"))
+            return -PAL_ERROR_INVAL;
 
-    char * addrbuf = __alloca(addrlen);
-    memcpy(addrbuf, addr, addrlen);
+        addr    += static_strlen("udp:");
+        addrlen -= static_strlen("udp:");
 
-    struct sockaddr conn_addr;
-    int conn_addrlen;
+        char * addrbuf = __alloca(addrlen);
+        memcpy(addrbuf, addr, addrlen);
 
-    int ret = inet_parse_uri(&addrbuf, &conn_addr, &conn_addrlen);
-    if (ret < 0)
-        return ret;
+        int ret = inet_parse_uri(&addrbuf, &conn_addr, &conn_addrlen);
+        if (ret < 0)
+            return ret;
+    }
 
     struct msghdr hdr;
-    struct iovec iov;
-    iov.iov_base = (void *) buf;
-    iov.iov_len = len;
-    hdr.msg_name = &conn_addr;
-    hdr.msg_namelen = conn_addrlen;
-    hdr.msg_iov = &iov;
-    hdr.msg_iovlen = 1;
+    hdr.msg_name = addr ? &conn_addr : (void *) handle->sock.conn;
+    hdr.msg_namelen = addr ? conn_addrlen :
+                      addr_size((struct sockaddr *) handle->sock.conn);
+    hdr.msg_iov = (struct iovec *) iov;
+    hdr.msg_iovlen = iovcnt;
     hdr.msg_control = NULL;
     hdr.msg_controllen = 0;
     hdr.msg_flags = 0;
@@ -939,6 +924,10 @@ static int64_t udp_sendbyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     if (IS_ERR(bytes))
         bytes = unix_to_pal_error(ERRNO(bytes));
 
+    uint64_t len = 0;
+    for (int i = 0 ; i < iovcnt ; i++)
+        len += iov[i].size;
+
     if (bytes == len)
         HANDLE_HDR(handle)->flags |= WRITEABLE(0);
     else
@@ -947,6 +936,20 @@ static int64_t udp_sendbyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
     return bytes;
 }
 
+static int64_t udp_send (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                         const void * buf)
+{
+    PAL_IOVEC iov = { .base = (void *) buf, .size = len };
+    return udp_sendv(handle, offset, 1, &iov, NULL, 0);
+}
+
+static int64_t udp_sendbyaddr (PAL_HANDLE handle, uint64_t offset, uint64_t len,
+                               const void * buf, const char * addr, int addrlen)
+{
+    PAL_IOVEC iov = { .base = (void *) buf, .size = len };
+    return udp_sendv(handle, offset, 1, &iov, addr, addrlen);
+}
+
 static int socket_delete (PAL_HANDLE handle, int access)
 {
     if (handle->sock.fd == PAL_IDX_POISON)
@@ -1231,6 +1234,8 @@ struct handle_ops tcp_ops = {
         .waitforclient  = &tcp_accept,
         .read           = &tcp_read,
         .write          = &tcp_write,
+        .readv          = &tcp_readv,
+        .writev         = &tcp_writev,
         .delete         = &socket_delete,
         .close          = &socket_close,
         .attrquerybyhdl = &socket_attrquerybyhdl,
@@ -1242,6 +1247,8 @@ struct handle_ops udp_ops = {
         .open           = &udp_open,
         .read           = &udp_receive,
         .write          = &udp_send,
+        .readv          = &udp_receivev,
+        .writev         = &udp_sendv,
         .delete         = &socket_delete,
         .close          = &socket_close,
         .attrquerybyhdl = &socket_attrquerybyhdl,
@@ -1253,6 +1260,8 @@ struct handle_ops udpsrv_ops = {
         .open           = &udp_open,
         .readbyaddr     = &udp_receivebyaddr,
         .writebyaddr    = &udp_sendbyaddr,
+        .readv          = &udp_receivev,
+        .writev         = &udp_sendv,
         .delete         = &socket_delete,
         .close          = &socket_close,
         .attrquerybyhdl = &socket_attrquerybyhdl,
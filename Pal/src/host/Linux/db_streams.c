@@ -77,7 +77,7 @@ out:
 int handle_set_cloexec (PAL_HANDLE handle, bool enable)
 {
     for (int i = 0 ; i < MAX_FDS ; i++)
-        if (HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i))) {
+        if (HANDLE_HDR(handle)->flags & (RFD(i)|WFD(i)|PASSFD(i))) {
             long flags = enable ? FD_CLOEXEC : 0;
             int ret = INLINE_SYSCALL(fcntl, 3,
                                      handle->generic.fds[i], F_SETFD,
@@ -292,7 +292,7 @@ int _DkSendHandle (PAL_HANDLE hdl, PAL_HANDLE cargo)
     int fds[MAX_FDS];
     int nfds = 0;
     for (int i = 0 ; i < MAX_FDS ; i++)
-        if (HANDLE_HDR(cargo)->flags & (RFD(i)|WFD(1))) {
+        if (HANDLE_HDR(cargo)->flags & (RFD(i)|WFD(i)|PASSFD(i))) {
             hdl_hdr.fds |= 1U << i;
             fds[nfds++] = cargo->generic.fds[i];
         }
@@ -448,10 +448,19 @@ int _DkReceiveHandle(PAL_HANDLE hdl, PAL_HANDLE * cargo)
             if (n < total_fds) {
                 handle->generic.fds[i] = ((int *) CMSG_DATA(chdr))[n++];
             } else {
-                HANDLE_HDR(handle)->flags &= ~(RFD(i)|WFD(i));
+                HANDLE_HDR(handle)->flags &= ~(RFD(i)|WFD(i)|PASSFD(i));
             }
         }
 
+    if ((IS_HANDLE_TYPE(handle, pipe) || IS_HANDLE_TYPE(handle, pipecli)) &&
+        handle->pipe.ring) {
+        ret = pipe_ring_attach(handle);
+        if (ret < 0) {
+            _DkObjectClose(handle);
+            return ret;
+        }
+    }
+
     if (IS_HANDLE_TYPE(handle, file)) {
         ret = INLINE_SYSCALL(lseek, 3, handle->file.fd, 0, SEEK_SET);
         if (!IS_ERR(ret))
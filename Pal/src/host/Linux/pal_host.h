@@ -97,8 +97,11 @@ typedef struct pal_handle
         
         struct {
             PAL_IDX fd;
+            PAL_IDX ringfd;
             PAL_NUM pipeid;
             PAL_BOL nonblocking;
+            PAL_PTR ring;
+            PAL_NUM ringside;
         } pipe;
 
         struct {
@@ -125,6 +128,8 @@ typedef struct pal_handle
         struct {
             PAL_IDX fd;
             PAL_NUM token;
+            PAL_BOL memfd;      /* no gipc module, see db_ipc.c */
+            PAL_NUM offset;
         } gipc;
 
         struct {
@@ -171,6 +176,14 @@ typedef struct pal_handle
             struct atomic_int nwaiters;
             PAL_BOL isnotification;
         } event;
+
+        struct {
+            PAL_IDX epfd;
+            PAL_LOCK lock;
+            struct pal_wait_entry * entries;
+            struct pal_wait_entry * dead;
+            PAL_NUM nwaiters;
+        } waitset;
     };
 } * PAL_HANDLE;
 
@@ -178,6 +191,8 @@ typedef struct pal_handle
 #define WFD(n)          (00010 << (n))
 #define WRITEABLE(n)    (00100 << (n))
 #define ERROR(n)        (01000 << (n))
+/* the fd is passed along with the handle, but is never polled */
+#define PASSFD(n)       (010000 << (n))
 #define MAX_FDS         (3)
 #define HAS_FDS         (00077)
 
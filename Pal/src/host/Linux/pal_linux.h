@@ -147,6 +147,9 @@ int handle_set_cloexec (PAL_HANDLE handle, bool enable);
 int handle_serialize (PAL_HANDLE handle, void ** data);
 int handle_deserialize (PAL_HANDLE * handle, const void * data, int size);
 
+/* map the shared-memory ring of a pipe handle received from another process */
+int pipe_ring_attach (PAL_HANDLE handle);
+
 #define ACCESS_R    4
 #define ACCESS_W    2
 #define ACCESS_X    1
@@ -47,6 +47,16 @@
 # define __NR_semtimedop 220
 #endif
 
+/* The same for __NR_copy_file_range, which was added in Linux 4.5.  */
+#ifndef __NR_copy_file_range
+# define __NR_copy_file_range 326
+#endif
+
+/* The same for __NR_memfd_create, which was added in Linux 3.17.  */
+#ifndef __NR_memfd_create
+# define __NR_memfd_create 319
+#endif
+
 #ifdef __ASSEMBLER__
 
 /* ELF uses byte-counts for .align, most others use log2 of count of bytes.  */
@@ -58,3 +58,20 @@ int _DkEventClear (PAL_HANDLE event)
 {
     return -PAL_ERROR_NOTIMPLEMENTED;
 }
+
+int _DkFutexWait (uint32_t * addr, uint32_t val, uint64_t timeout,
+                  uint32_t bitset)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkFutexWake (uint32_t * addr, int count, uint32_t bitset)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkFutexRequeue (uint32_t * addr, int count, uint32_t * addr2,
+                     int count2, bool cmp, uint32_t val)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
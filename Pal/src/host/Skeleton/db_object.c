@@ -30,6 +30,47 @@
 #include "pal_debug.h"
 #include "api.h"
 
+/* _DkObjectsWaitEvents for internal use. Not supported by this host; the
+   library OS falls back to _DkObjectsWaitAny. */
+int _DkObjectsWaitEvents (int count, PAL_HANDLE * handleArray,
+                          PAL_FLG * events, PAL_FLG * ret_events,
+                          uint64_t timeout)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+/* Wait sets are not supported by this host; the library OS keeps the set of
+   handles itself and falls back to _DkObjectsWaitEvents. */
+int _DkWaitSetCreate (PAL_HANDLE * waitset)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetAdd (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                   void * data)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetModify (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                      void * data)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetRemove (PAL_HANDLE waitset, PAL_HANDLE handle)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+int _DkWaitSetWait (PAL_HANDLE waitset, int count, void ** data,
+                    PAL_FLG * events, uint64_t timeout)
+{
+    return -PAL_ERROR_NOTIMPLEMENTED;
+}
+
+struct handle_ops waitset_ops;
+
 /* _DkObjectsWaitAny for internal use. The function wait for any of the handle
    in the handle array. timeout can be set for the wait. */
 int _DkObjectsWaitAny (int count, PAL_HANDLE * handleArray, int timeout,
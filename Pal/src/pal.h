@@ -120,6 +120,7 @@ enum {
     pal_type_mutex,
     pal_type_event,
     pal_type_gipc,
+    pal_type_waitset,
     PAL_HANDLE_TYPE_BOUND,
 };
 
@@ -312,6 +313,25 @@ PAL_NUM
 DkStreamWrite (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM count,
                PAL_PTR buffer, PAL_STR dest);
 
+/* I/O vector of DkStreamReadv and DkStreamWritev, which has the same
+   layout as struct iovec */
+typedef struct {
+    PAL_PTR base;
+    PAL_NUM size;
+} PAL_IOVEC;
+
+PAL_NUM
+DkStreamReadv (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM iovcnt,
+               PAL_IOVEC * iov, PAL_PTR source, PAL_NUM size);
+
+PAL_NUM
+DkStreamWritev (PAL_HANDLE handle, PAL_NUM offset, PAL_NUM iovcnt,
+                PAL_IOVEC * iov, PAL_STR dest);
+
+PAL_NUM
+DkStreamCopy (PAL_HANDLE src, PAL_NUM src_offset, PAL_HANDLE dest,
+              PAL_NUM dest_offset, PAL_NUM count);
+
 #define PAL_DELETE_RD       01
 #define PAL_DELETE_WR       02
 
@@ -345,6 +365,7 @@ typedef struct {
     PAL_BOL readable, writeable, runnable;
     PAL_FLG share_flags;
     PAL_NUM pending_size;
+    PAL_NUM nlink;          /* host link count, 0 if unknown */
     union {
         struct {
             PAL_NUM linger;
@@ -458,6 +479,30 @@ DkEventSet (PAL_HANDLE eventHandle);
 void
 DkEventClear (PAL_HANDLE eventHandle);
 
+/* Wait on the 32-bit futex word at addr, if it still contains val, until
+ * woken up by DkFutexWake with a matching bitset, or until the timeout (in
+ * microseconds) expires. The futex is private to the current process.
+ * Returns PAL_FALSE on failure: PAL_ERROR_INCONSIST if the word does not
+ * contain val, PAL_ERROR_TRYAGAIN on timeout, PAL_ERROR_NOTIMPLEMENTED if
+ * the host cannot provide futexes. */
+PAL_BOL
+DkFutexWait (PAL_PTR addr, PAL_IDX val, PAL_NUM timeout, PAL_FLG bitset);
+
+/* Wake up at most count waiters of the futex word at addr whose bitsets
+ * match. Returns the number of woken waiters. */
+PAL_NUM
+DkFutexWake (PAL_PTR addr, PAL_NUM count, PAL_FLG bitset);
+
+/* Wake up at most count waiters of the futex word at addr, and move at most
+ * count2 of the others to wait on the futex word at addr2 instead. If cmp
+ * is set, only do so if the word at addr still contains val. The number of
+ * waiters woken up (and moved, if cmp is set) is returned in *nwaiters.
+ * Returns PAL_FALSE on failure: PAL_ERROR_INCONSIST if the word does not
+ * contain val, PAL_ERROR_NOTIMPLEMENTED if the host cannot move waiters. */
+PAL_BOL
+DkFutexRequeue (PAL_PTR addr, PAL_NUM count, PAL_PTR addr2, PAL_NUM count2,
+                PAL_BOL cmp, PAL_IDX val, PAL_NUM * nwaiters);
+
 #define NO_TIMEOUT      ((PAL_NUM) -1)
 
 /* assuming timeout to be in microseconds 
@@ -467,6 +512,47 @@ DkEventClear (PAL_HANDLE eventHandle);
 PAL_HANDLE
 DkObjectsWaitAny (PAL_NUM count, PAL_HANDLE * handleArray, PAL_NUM timeout);
 
+enum {
+    PAL_WAIT_READ   = 1,
+    PAL_WAIT_WRITE  = 2,
+    PAL_WAIT_ERROR  = 4,    /* always reported, never needs to be requested */
+    PAL_WAIT_EDGE   = 8,    /* wait sets only: report each change once */
+};
+
+/* Wait until any of the handles is ready for the events given in
+ * events[], and report the events of every ready handle in ret_events[],
+ * so that many handles can be harvested from a single wait.
+ * Returns PAL_FALSE on failure, with PAL_ERROR_TRYAGAIN on timeout. */
+PAL_BOL
+DkObjectsWaitEvents (PAL_NUM count, PAL_HANDLE * handleArray,
+                     PAL_FLG * events, PAL_FLG * ret_events, PAL_NUM timeout);
+
+/* A wait set is a persistent set of handles to wait on. Each handle is
+ * registered once, with the events to wait for and an opaque pointer that
+ * is returned whenever the handle is ready, so the cost of each wait does
+ * not depend on the number of registered handles. */
+PAL_HANDLE
+DkWaitSetCreate (void);
+
+PAL_BOL
+DkWaitSetAdd (PAL_HANDLE waitSet, PAL_HANDLE handle, PAL_FLG events,
+              PAL_PTR data);
+
+PAL_BOL
+DkWaitSetModify (PAL_HANDLE waitSet, PAL_HANDLE handle, PAL_FLG events,
+                 PAL_PTR data);
+
+PAL_BOL
+DkWaitSetRemove (PAL_HANDLE waitSet, PAL_HANDLE handle);
+
+/* Wait until any handle in the wait set is ready, and return the pointers
+ * and the events of up to count ready handles in data[] and events[].
+ * Returns the number of ready handles, or 0 on failure, with
+ * PAL_ERROR_TRYAGAIN on timeout. */
+PAL_NUM
+DkWaitSetWait (PAL_HANDLE waitSet, PAL_NUM count, PAL_PTR * data,
+               PAL_FLG * events, PAL_NUM timeout);
+
 /* Deprecate DkObjectReference */
 
 void DkObjectClose (PAL_HANDLE objectHandle);
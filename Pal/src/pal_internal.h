@@ -68,6 +68,20 @@ struct handle_ops {
     int64_t (*writebyaddr) (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                             const void * buffer, const char * addr, int addrlen);
 
+    /* 'readv' and 'writev' are used by DkStreamReadv and DkStreamWritev.
+       They read or write a vector of buffers in one operation, and take
+       an optional address like readbyaddr and writebyaddr */
+    int64_t (*readv) (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                      const PAL_IOVEC * iov, char * addr, int addrlen);
+    int64_t (*writev) (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                       const PAL_IOVEC * iov, const char * addr, int addrlen);
+
+    /* 'copy' is used by DkStreamCopy. It copies from the stream to another
+       stream inside the host, or returns -PAL_ERROR_NOTSUPPORT if it
+       cannot copy to that stream */
+    int64_t (*copy) (PAL_HANDLE handle, uint64_t offset, PAL_HANDLE dest,
+                     uint64_t dest_offset, uint64_t count);
+
     /* 'close' and 'delete' is used by DkObjectClose and DkStreamDelete,
        'close' will close the stream, while 'delete' actually destroy
        the stream, such as deleting a file or shutting down a socket */
@@ -279,6 +293,13 @@ int64_t _DkStreamRead (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                        void * buf, char * addr, int addrlen);
 int64_t _DkStreamWrite (PAL_HANDLE handle, uint64_t offset, uint64_t count,
                         const void * buf, const char * addr, int addrlen);
+int64_t _DkStreamReadv (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                        const PAL_IOVEC * iov, char * addr, int addrlen);
+int64_t _DkStreamWritev (PAL_HANDLE handle, uint64_t offset, int iovcnt,
+                         const PAL_IOVEC * iov, const char * addr,
+                         int addrlen);
+int64_t _DkStreamCopy (PAL_HANDLE src, uint64_t src_offset, PAL_HANDLE dest,
+                      uint64_t dest_offset, uint64_t count);
 int _DkStreamAttributesQuery (const char * uri, PAL_STREAM_ATTR * attr);
 int _DkStreamAttributesQuerybyHandle (PAL_HANDLE hdl, PAL_STREAM_ATTR * attr);
 int _DkStreamMap (PAL_HANDLE handle, void ** addr, int prot, uint64_t offset,
@@ -319,6 +340,13 @@ int _DkEventWaitTimeout (PAL_HANDLE event, uint64_t timeout);
 int _DkEventWait (PAL_HANDLE event);
 int _DkEventClear (PAL_HANDLE event);
 
+/* DkFutex calls */
+int _DkFutexWait (uint32_t * addr, uint32_t val, uint64_t timeout,
+                  uint32_t bitset);
+int _DkFutexWake (uint32_t * addr, int count, uint32_t bitset);
+int _DkFutexRequeue (uint32_t * addr, int count, uint32_t * addr2,
+                     int count2, bool cmp, uint32_t val);
+
 /* DkVirtualMemory calls */
 int _DkVirtualMemoryAlloc (void ** paddr, uint64_t size, int alloc_type, int prot);
 int _DkVirtualMemoryFree (void * addr, uint64_t size);
@@ -327,9 +355,22 @@ int _DkVirtualMemoryProtect (void * addr, uint64_t size, int prot);
 /* DkObject calls */
 int _DkObjectReference (PAL_HANDLE objectHandle);
 int _DkObjectClose (PAL_HANDLE objectHandle);
+int _DkObjectsWaitEvents (int count, PAL_HANDLE * handleArray,
+                          PAL_FLG * events, PAL_FLG * ret_events,
+                          uint64_t timeout);
 int _DkObjectsWaitAny (int count, PAL_HANDLE * handleArray, uint64_t timeout,
                        PAL_HANDLE * polled);
 
+/* DkWaitSet calls */
+int _DkWaitSetCreate (PAL_HANDLE * waitset);
+int _DkWaitSetAdd (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                   void * data);
+int _DkWaitSetModify (PAL_HANDLE waitset, PAL_HANDLE handle, int events,
+                      void * data);
+int _DkWaitSetRemove (PAL_HANDLE waitset, PAL_HANDLE handle);
+int _DkWaitSetWait (PAL_HANDLE waitset, int count, void ** data,
+                    PAL_FLG * events, uint64_t timeout);
+
 /* DkException calls & structures */
 PAL_EVENT_HANDLER _DkGetExceptionHandler (PAL_NUM event_num);
 void _DkRaiseFailure (int error);
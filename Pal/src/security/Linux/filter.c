@@ -40,6 +40,9 @@ typedef __builtin_va_list __gnuc_va_list;
     SYSCALL(__NR_close,         ALLOW),                  \
     SYSCALL(__NR_dup2,          ALLOW),                  \
     SYSCALL(__NR_connect,       ALLOW),                  \
+    SYSCALL(__NR_epoll_create1, ALLOW),                  \
+    SYSCALL(__NR_epoll_ctl,     ALLOW),                  \
+    SYSCALL(__NR_epoll_wait,    ALLOW),                  \
     SYSCALL(__NR_execve,        ALLOW),                  \
     SYSCALL(__NR_exit,          ALLOW),                  \
     SYSCALL(__NR_exit_group,    ALLOW),                  \
@@ -61,12 +64,18 @@ typedef __builtin_va_list __gnuc_va_list;
     SYSCALL(__NR_nanosleep,     ALLOW),                  \
     SYSCALL(__NR_pipe2,         ALLOW),                  \
     SYSCALL(__NR_ppoll,         ALLOW),                  \
+    SYSCALL(__NR_pread64,       ALLOW),                  \
+    SYSCALL(__NR_preadv,        ALLOW),                  \
+    SYSCALL(__NR_pwrite64,      ALLOW),                  \
+    SYSCALL(__NR_pwritev,       ALLOW),                  \
     SYSCALL(__NR_read,          ALLOW),                  \
     SYSCALL(__NR_readlink,      ALLOW),                  \
+    SYSCALL(__NR_readv,         ALLOW),                  \
     SYSCALL(__NR_recvmsg,       ALLOW),                  \
     SYSCALL(__NR_rename,        ALLOW),                  \
     SYSCALL(__NR_rmdir,         ALLOW),                  \
     SYSCALL(__NR_sched_yield,   ALLOW),                  \
+    SYSCALL(__NR_sendfile,      ALLOW),                  \
     SYSCALL(__NR_sendmsg,       ALLOW),                  \
     SYSCALL(__NR_setsockopt,    ALLOW),                  \
     SYSCALL(__NR_shutdown,      ALLOW),                  \
@@ -78,12 +87,21 @@ typedef __builtin_va_list __gnuc_va_list;
     SYSCALL(__NR_vfork,         ALLOW),                  \
     SYSCALL(__NR_wait4,         ALLOW),                  \
     SYSCALL(__NR_write,         ALLOW),                  \
+    SYSCALL(__NR_writev,        ALLOW),                  \
                                                          \
     SYSCALL_ARCH_FILTERS
 
 #ifdef __x86_64__
+# ifndef __NR_copy_file_range
+#  define __NR_copy_file_range 326
+# endif
+# ifndef __NR_memfd_create
+#  define __NR_memfd_create 319
+# endif
 # define SYSCALL_ARCH_FILTERS                            \
     SYSCALL(__NR_arch_prctl,        ALLOW),              \
+    SYSCALL(__NR_copy_file_range,   ALLOW),              \
+    SYSCALL(__NR_memfd_create,      ALLOW),              \
     SYSCALL(__NR_rt_sigaction,      ALLOW),              \
     SYSCALL(__NR_rt_sigprocmask,    ALLOW),              \
     SYSCALL(__NR_rt_sigreturn,      ALLOW)